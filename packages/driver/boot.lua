@@ -5,19 +5,6 @@ package.path = package.path .. ";/app/root/lua/?.lua;/app/root/lua/?/init.lua"
 unpack = table.unpack
 loadstring = load
 
-bit = {
-    lshift = bit32.lshift,
-    rshift = bit32.rshift,
-    band = bit32.band,
-    bor = bit32.bor,
-    bxor = bit32.bxor,
-    bnot = bit32.bnot,
-    tobit = function(value)
-        local normalized = value % 0x100000000
-        return normalized >= 0x80000000 and normalized - 0x100000000 or normalized
-    end,
-}
-
 if not setfenv then -- Lua 5.2
     -- based on http://lua-users.org/lists/lua-l/2010-06/msg00314.html
     -- this assumes f is a function
@@ -84,13 +71,17 @@ end
 function GetWorkDir()
     return ""
 end
+local function endTrace(span, ...)
+    TraceEnd(span)
+    return ...
+end
 function LoadModule(fileName, ...)
     if not fileName:match("%.lua") then
         fileName = fileName .. ".lua"
     end
     local func, err = loadfile(fileName)
     if func then
-        return func(...)
+        return endTrace(TraceBegin("execute", fileName), func(...))
     else
         error("LoadModule() error loading '" .. fileName .. "': " .. err)
     end
@@ -101,7 +92,7 @@ function PLoadModule(fileName, ...)
     end
     local func, err = loadfile(fileName)
     if func then
-        return PCall(func, ...)
+        return endTrace(TraceBegin("execute", fileName), PCall(func, ...))
     else
         error("PLoadModule() error loading '" .. fileName .. "': " .. err)
     end
@@ -139,7 +130,26 @@ end
 function SetForeground()
 end
 
-dofile("Launch.lua")
+-- PoB decodes API, trade and pastebin responses with dkjson, which is pure Lua. The module is still
+-- loaded from the game files, but decode and plain encode calls go to the native versions.
+package.preload["dkjson"] = function(name)
+    local path = assert(package.searchpath(name, package.path))
+    local json = assert(loadfile(path))(name, path)
+    local encode = json.encode
+    json.decode = JsonDecode
+    json.encode = function(value, state)
+        if state == nil then
+            local text = JsonEncode(value)
+            if text then
+                return text
+            end
+        end
+        return encode(value, state)
+    end
+    return json
+end
+
+LoadModule("Launch.lua")
 
 --
 -- pob-web related custom code
@@ -170,9 +180,42 @@ local function installOAuthLogoutHook(buildMode)
     end
 end
 
+-- PoB decodes imported codes and encodes share codes with common.base64, which is pure Lua.
+-- Calls with the default alphabet go to the native codec instead.
+local function installNativeBase64()
+    local base64 = common and common.base64
+    if not base64 then
+        return
+    end
+    local encode, decode = base64.encode, base64.decode
+    base64.encode = function(text, encoder, ...)
+        if encoder == nil then
+            return Base64Encode(text)
+        end
+        return encode(text, encoder, ...)
+    end
+    base64.decode = function(text, decoder, ...)
+        if decoder == nil then
+            return Base64Decode(text)
+        end
+        return decode(text, decoder, ...)
+    end
+end
+
+local function installNativeXml()
+    local xml = common and common.xml
+    if not xml then
+        return
+    end
+    xml.ParseXML = ParseXML
+    xml.ComposeXML = ComposeXML
+end
+
 local onInit = mainObject["OnInit"]
 mainObject["OnInit"] = function(self)
     onInit(self)
+    installNativeBase64()
+    installNativeXml()
     self.main.controls.checkUpdate.shown = function()
         return false
     end
@@ -184,45 +227,65 @@ mainObject["OnInit"] = function(self)
     end
 end
 
-local function runCallback(name, ...)
-    local callback = GetCallback(name)
-    if callback then
-        return callback(...)
+-- Calls `fn` with `owner[name]` wrapped so the time spent in it is added to `timings[key]`.
+local function timeMethod(owner, name, timings, key, fn)
+    local original = owner and owner[name]
+    if type(original) ~= "function" then
+        return fn()
+    end
+    owner[name] = function(...)
+        local start = GetTimePrecise()
+        local results = { original(...) }
+        timings[key] = timings[key] + (GetTimePrecise() - start)
+        return unpack(results)
     end
-    if mainObject and type(mainObject[name]) == "function" then
-        return mainObject[name](mainObject, ...)
+    local ok, err = pcall(fn)
+    owner[name] = original
+    if not ok then
+        error(err, 0)
     end
-    error("runCallback: no handler for '" .. tostring(name) .. "'")
 end
 
+-- Imports a build code straight into BUILD mode, without going through the import tab controls or
+-- running frames. Returns the time spent decoding, parsing the XML, calculating, and in total, in
+-- fractional milliseconds.
 function loadBuildFromCode(code)
-    if not mainObject.main then
+    local main = mainObject.main
+    if not main then
         error("loadBuildFromCode: mainObject.main is nil")
     end
-
-    -- Flush any pending state before import
-    runCallback("OnFrame")
-
-    if mainObject.main.mode ~= "BUILD" then
-        mainObject.main:SetMode("BUILD", false, "")
-        runCallback("OnFrame")
+    local build = main.modes["BUILD"]
+    if not build then
+        error("loadBuildFromCode: BUILD mode not available")
     end
 
-    local importTab = mainObject.main.modes["BUILD"]
-        and mainObject.main.modes["BUILD"].importTab
-    if not importTab or not importTab.controls then
-        error("loadBuildFromCode: import tab controls not available")
+    local timings = { decode = 0, parse = 0, calc = 0 }
+    local start = GetTimePrecise()
+    local xmlText, err = DecodeBuildCode(code)
+    if not xmlText then
+        error("loadBuildFromCode: " .. tostring(err))
     end
+    timings.decode = GetTimePrecise() - start
 
-    importTab.controls.importCodeIn:SetText(code, true)
-    importTab.controls.importCodeMode.selIndex = 2
-    importTab.controls.importCodeGo.onClick()
+    local calcsTab = common.classes and common.classes["CalcsTab"]
+    timeMethod(common.xml, "ParseXML", timings, "parse", function()
+        timeMethod(calcsTab, "BuildOutput", timings, "calc", function()
+            -- What Main:OnFrame does when a SetMode("BUILD", ...) is pending.
+            if main.mode then
+                main:CallMode("Shutdown")
+            end
+            main.mode = "BUILD"
+            main.modeArgs = { false, "Imported build", xmlText }
+            main.newMode = nil
+            build:Init(false, "Imported build", xmlText)
+            build.viewMode = "TREE"
+        end)
+    end)
 
-    -- Flush to process the import
-    runCallback("OnFrame")
+    return timings.decode, timings.parse, timings.calc, GetTimePrecise() - start
 end
 
-function getBuildCode()
+function getBuildCode(level, dictionary)
     if not mainObject.main then
         error("getBuildCode: mainObject.main is nil")
     end
@@ -237,5 +300,5 @@ function getBuildCode()
         error("getBuildCode: SaveDB returned nil")
     end
 
-    return common.base64.encode(Deflate(xmlText)):gsub("+","-"):gsub("/","_")
+    return EncodeBuildCode(xmlText, level, dictionary)
 end
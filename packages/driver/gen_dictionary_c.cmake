@@ -0,0 +1,6 @@
+file(READ ${CMAKE_CURRENT_LIST_DIR}/dictionaries/build-code-v1.txt file_content HEX)
+string(LENGTH "${file_content}" hex_length)
+math(EXPR size "${hex_length} / 2")
+string(REGEX REPLACE "(..)" "\\\\x\\1" c_string "${file_content}")
+file(WRITE ${CMAKE_BINARY_DIR}/build_code_dictionary_data.c
+        "const unsigned char build_code_dictionary_v1[] = \"${c_string}\";\nconst unsigned int build_code_dictionary_v1_size = ${size};\n")
@@ -0,0 +1,21 @@
+#ifndef DRIVER_BASE64_H
+#define DRIVER_BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Padded output size for len input bytes.
+size_t base64_encoded_size(size_t len);
+
+// Writes base64 with '=' padding; url selects '-' and '_' for the last two symbols as build codes do.
+// Returns the number of characters written.
+size_t base64_encode(const uint8_t *in, size_t len, char *out, int url);
+
+// Upper bound of the decoded size for len input characters.
+size_t base64_decoded_size(size_t len);
+
+// Accepts both alphabets, skips characters outside them and stops at the first '='.
+// Returns the number of bytes written.
+size_t base64_decode(const char *in, size_t len, uint8_t *out);
+
+#endif //DRIVER_BASE64_H
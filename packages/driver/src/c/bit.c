@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "bit.h"
+#include "lauxlib.h"
+
+// LuaJIT's bit library. Arguments are normalized to int32 the way LuaJIT does it: adding 2^52 + 2^51
+// moves the integer part into the low mantissa bits, so values wrap modulo 2^32 and fractions round
+// to nearest even. Results are signed 32-bit numbers.
+
+static int32_t bit_tobit(double n) {
+    union {
+        double n;
+        uint64_t u;
+    } o;
+    o.n = n + 6755399441055744.0;
+    return (int32_t)(uint32_t)o.u;
+}
+
+static uint32_t checkbit(lua_State *L, int arg) {
+    return (uint32_t)bit_tobit(luaL_checknumber(L, arg));
+}
+
+static int push_bit(lua_State *L, uint32_t value) {
+    lua_pushnumber(L, (lua_Number)(int32_t)value);
+    return 1;
+}
+
+static int bit_tobit_lua(lua_State *L) {
+    return push_bit(L, checkbit(L, 1));
+}
+
+static int bit_bnot(lua_State *L) {
+    return push_bit(L, ~checkbit(L, 1));
+}
+
+static int bit_band(lua_State *L) {
+    int n = lua_gettop(L);
+    uint32_t value = checkbit(L, 1);
+    for (int i = 2; i <= n; i++) {
+        value &= checkbit(L, i);
+    }
+    return push_bit(L, value);
+}
+
+static int bit_bor(lua_State *L) {
+    int n = lua_gettop(L);
+    uint32_t value = checkbit(L, 1);
+    for (int i = 2; i <= n; i++) {
+        value |= checkbit(L, i);
+    }
+    return push_bit(L, value);
+}
+
+static int bit_bxor(lua_State *L) {
+    int n = lua_gettop(L);
+    uint32_t value = checkbit(L, 1);
+    for (int i = 2; i <= n; i++) {
+        value ^= checkbit(L, i);
+    }
+    return push_bit(L, value);
+}
+
+// Shift counts use their low five bits, like the x86 shift instructions LuaJIT compiles to.
+static int bit_lshift(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    return push_bit(L, value << (checkbit(L, 2) & 31));
+}
+
+static int bit_rshift(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    return push_bit(L, value >> (checkbit(L, 2) & 31));
+}
+
+static int bit_arshift(lua_State *L) {
+    int32_t value = (int32_t)checkbit(L, 1);
+    uint32_t shift = checkbit(L, 2) & 31;
+    return push_bit(L, (uint32_t)(value < 0 ? ~(~value >> shift) : value >> shift));
+}
+
+static int bit_rol(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    uint32_t shift = checkbit(L, 2) & 31;
+    return push_bit(L, shift == 0 ? value : (value << shift) | (value >> (32 - shift)));
+}
+
+static int bit_ror(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    uint32_t shift = checkbit(L, 2) & 31;
+    return push_bit(L, shift == 0 ? value : (value >> shift) | (value << (32 - shift)));
+}
+
+static int bit_bswap(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    return push_bit(L, (value >> 24) | ((value >> 8) & 0xff00) | ((value & 0xff00) << 8) | (value << 24));
+}
+
+// tohex(x[, n]) formats the low |n| (at most 8, default 8) hex digits; a negative n uses upper case.
+static int bit_tohex(lua_State *L) {
+    uint32_t value = checkbit(L, 1);
+    int32_t n = lua_isnoneornil(L, 2) ? 8 : (int32_t)checkbit(L, 2);
+    const char *digits = "0123456789abcdef";
+    char text[8];
+    if (n < 0) {
+        n = n == INT32_MIN ? 8 : -n;
+        digits = "0123456789ABCDEF";
+    }
+    if (n > 8) {
+        n = 8;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        text[i] = digits[value & 15];
+        value >>= 4;
+    }
+    lua_pushlstring(L, text, (size_t)n);
+    return 1;
+}
+
+static const luaL_Reg bit_functions[] = {
+    {"tobit", bit_tobit_lua},
+    {"bnot", bit_bnot},
+    {"band", bit_band},
+    {"bor", bit_bor},
+    {"bxor", bit_bxor},
+    {"lshift", bit_lshift},
+    {"rshift", bit_rshift},
+    {"arshift", bit_arshift},
+    {"rol", bit_rol},
+    {"ror", bit_ror},
+    {"bswap", bit_bswap},
+    {"tohex", bit_tohex},
+    {NULL, NULL},
+};
+
+static int luaopen_bit(lua_State *L) {
+    luaL_newlib(L, bit_functions);
+    return 1;
+}
+
+void bit_init(lua_State *L) {
+    luaL_requiref(L, "bit", luaopen_bit, 1);
+    lua_pop(L, 1);
+}
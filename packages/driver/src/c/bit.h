@@ -0,0 +1,9 @@
+#ifndef DRIVER_BIT_H
+#define DRIVER_BIT_H
+
+#include "lua.h"
+
+// Registers the `bit` module with LuaJIT's semantics, as a global and in package.loaded.
+extern void bit_init(lua_State *L);
+
+#endif //DRIVER_BIT_H
@@ -0,0 +1,119 @@
+#include "base64.h"
+#include "build_code.h"
+#include "build_code_dictionary.h"
+#include "zstream.h"
+
+// Build codes are the deflated build XML in base64url. Both directions run in a single native call
+// so that neither the base64 text nor its character substitutions exist as intermediate Lua strings.
+// The deflated bytes live in a userdata, so the GC reclaims them when building the result raises.
+
+static ZStream st_deflate;
+static ZStream st_inflate;
+
+// EncodeBuildCode(xml[, level[, dictionary]])
+//
+// A lower level trades size for speed when the code is needed right away. With `dictionary` set,
+// the stream is primed with the latest preset dictionary; such codes are smaller but only decode
+// with that dictionary, so they are meant for exchange between pob-web instances.
+static int EncodeBuildCode(lua_State *L) {
+    size_t len;
+    const char *xml = luaL_checklstring(L, 1, &len);
+    int level = luaL_optint(L, 2, Z_BEST_COMPRESSION);
+    int use_dictionary = lua_toboolean(L, 3);
+    luaL_argcheck(L, level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION, 2, "level out of range");
+
+    if (zstream_reuse(&st_deflate, 0, level) != Z_OK) {
+        lua_pushnil(L);
+        lua_pushstring(L, "deflateInit failed");
+        return 2;
+    }
+    z_stream *strm = &st_deflate.strm;
+    if (use_dictionary) {
+        const BuildCodeDictionary *dictionary = build_code_dictionary_latest();
+        if (deflateSetDictionary(strm, dictionary->data, dictionary->size) != Z_OK) {
+            lua_pushnil(L);
+            lua_pushstring(L, "deflateSetDictionary failed");
+            return 2;
+        }
+    }
+    uLong bound = deflateBound(strm, len);
+    uint8_t *deflated = lua_newuserdata(L, bound);
+    strm->next_in = (Bytef *)xml;
+    strm->avail_in = len;
+    strm->next_out = deflated;
+    strm->avail_out = bound;
+    int ret = deflate(strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        lua_pushnil(L);
+        lua_pushstring(L, zError(ret));
+        return 2;
+    }
+
+    luaL_Buffer b;
+    char *out = luaL_buffinitsize(L, &b, base64_encoded_size(strm->total_out));
+    size_t written = base64_encode(deflated, strm->total_out, out, 1);
+    luaL_pushresultsize(&b, written);
+    return 1;
+}
+
+// DecodeBuildCode(code) returns the XML, or nil and an error message.
+static int DecodeBuildCode(lua_State *L) {
+    size_t len;
+    const char *code = luaL_checklstring(L, 1, &len);
+
+    uint8_t *deflated = lua_newuserdata(L, base64_decoded_size(len));
+    size_t deflated_len = base64_decode(code, len, deflated);
+    if (zstream_reuse(&st_inflate, 1, 0) != Z_OK) {
+        lua_pushnil(L);
+        lua_pushstring(L, "inflateInit failed");
+        return 2;
+    }
+    st_inflate.size_hint = deflated_len * 4;
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    int ret = zstream_run(&st_inflate, (const char *)deflated, deflated_len, Z_FINISH, &b);
+    if (ret != Z_OK) {
+        lua_pushnil(L);
+        if (ret == Z_NEED_DICT) {
+            lua_pushstring(L, "Build code needs a preset dictionary this driver does not have");
+        } else {
+            lua_pushstring(L, ret == Z_DATA_ERROR && st_inflate.strm.msg ? st_inflate.strm.msg : zError(ret));
+        }
+        return 2;
+    }
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int Base64Encode(lua_State *L) {
+    size_t len;
+    const char *data = luaL_checklstring(L, 1, &len);
+    luaL_Buffer b;
+    char *out = luaL_buffinitsize(L, &b, base64_encoded_size(len));
+    luaL_pushresultsize(&b, base64_encode((const uint8_t *)data, len, out, lua_toboolean(L, 2)));
+    return 1;
+}
+
+static int Base64Decode(lua_State *L) {
+    size_t len;
+    const char *text = luaL_checklstring(L, 1, &len);
+    luaL_Buffer b;
+    char *out = luaL_buffinitsize(L, &b, base64_decoded_size(len));
+    luaL_pushresultsize(&b, base64_decode(text, len, (uint8_t *)out));
+    return 1;
+}
+
+void build_code_init(lua_State *L) {
+    lua_pushcfunction(L, EncodeBuildCode);
+    lua_setglobal(L, "EncodeBuildCode");
+
+    lua_pushcfunction(L, DecodeBuildCode);
+    lua_setglobal(L, "DecodeBuildCode");
+
+    lua_pushcfunction(L, Base64Encode);
+    lua_setglobal(L, "Base64Encode");
+
+    lua_pushcfunction(L, Base64Decode);
+    lua_setglobal(L, "Base64Decode");
+}
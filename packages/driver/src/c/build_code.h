@@ -0,0 +1,9 @@
+#ifndef DRIVER_BUILD_CODE_H
+#define DRIVER_BUILD_CODE_H
+
+#include "lua.h"
+
+// Registers EncodeBuildCode/DecodeBuildCode and the Base64Encode/Base64Decode helpers.
+extern void build_code_init(lua_State *L);
+
+#endif //DRIVER_BUILD_CODE_H
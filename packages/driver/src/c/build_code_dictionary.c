@@ -0,0 +1,42 @@
+#include <stddef.h>
+
+#include "build_code_dictionary.h"
+
+// Generated from dictionaries/*.txt by gen_dictionary_c.cmake.
+extern const unsigned char build_code_dictionary_v1[];
+extern const unsigned int build_code_dictionary_v1_size;
+
+// Oldest first. Entries are never removed, otherwise codes encoded with them stop decoding.
+static BuildCodeDictionary st_dictionaries[] = {
+    {build_code_dictionary_v1, 0, 0},
+};
+
+#define DICTIONARY_COUNT (sizeof(st_dictionaries) / sizeof(st_dictionaries[0]))
+
+static void ensure_ids(void) {
+    static int initialized = 0;
+    if (initialized) {
+        return;
+    }
+    st_dictionaries[0].size = build_code_dictionary_v1_size;
+    for (size_t i = 0; i < DICTIONARY_COUNT; i++) {
+        BuildCodeDictionary *dictionary = &st_dictionaries[i];
+        dictionary->id = adler32(adler32(0L, Z_NULL, 0), dictionary->data, dictionary->size);
+    }
+    initialized = 1;
+}
+
+const BuildCodeDictionary *build_code_dictionary_latest(void) {
+    ensure_ids();
+    return &st_dictionaries[DICTIONARY_COUNT - 1];
+}
+
+const BuildCodeDictionary *build_code_dictionary_find(uLong id) {
+    ensure_ids();
+    for (size_t i = 0; i < DICTIONARY_COUNT; i++) {
+        if (st_dictionaries[i].id == id) {
+            return &st_dictionaries[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef DRIVER_BUILD_CODE_DICTIONARY_H
+#define DRIVER_BUILD_CODE_DICTIONARY_H
+
+#include <zlib.h>
+
+// A zlib preset dictionary for build XML. zlib stores the dictionary's Adler-32 in the stream
+// header (FDICT), which is what identifies the dictionary version when a code is decoded.
+typedef struct {
+    const unsigned char *data;
+    unsigned int size;
+    uLong id;
+} BuildCodeDictionary;
+
+// The dictionary new codes are encoded with.
+const BuildCodeDictionary *build_code_dictionary_latest(void);
+
+// Looks up a dictionary by the id a stream asked for, or returns NULL for an unknown one.
+const BuildCodeDictionary *build_code_dictionary_find(uLong id);
+
+#endif //DRIVER_BUILD_CODE_DICTIONARY_H
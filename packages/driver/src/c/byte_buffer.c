@@ -4,8 +4,13 @@
 #include <string.h>
 
 void byte_buffer_append(ByteBuffer *buffer, const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
     if (buffer->size + size > buffer->capacity) {
-        buffer->capacity = buffer->size + (size > 65536 ? size : 65536);
+        // Grow geometrically so that building a large buffer from small appends stays linear
+        size_t capacity = buffer->capacity < 32768 ? 65536 : buffer->capacity * 2;
+        buffer->capacity = capacity > buffer->size + size ? capacity : buffer->size + size;
         buffer->data = realloc(buffer->data, buffer->capacity);
     }
     memcpy(buffer->data + buffer->size, data, size);
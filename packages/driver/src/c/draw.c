@@ -80,6 +80,7 @@ typedef struct {
 #pragma pack(pop)
 
 static ByteBuffer st_buffer = {0};
+static int st_suppressed = 0;
 
 static double get_system_scale(void) {
     return EM_ASM_DOUBLE({ return Module.getScreenScale(); });
@@ -90,6 +91,9 @@ static double get_screen_scale(void) {
 }
 
 static void draw_push(const void *data, size_t size) {
+    if (st_suppressed) {
+        return;
+    }
     byte_buffer_append(&st_buffer, data, size);
 }
 
@@ -110,6 +114,10 @@ void draw_end() {
     byte_buffer_free(&st_buffer);
 }
 
+void draw_set_suppressed(int suppressed) {
+    st_suppressed = suppressed;
+}
+
 static int GetScreenSize(lua_State *L) {
     int width = EM_ASM_INT({
         return Module.getScreenWidth();
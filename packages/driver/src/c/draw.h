@@ -7,5 +7,7 @@ extern void draw_init(lua_State *L);
 extern void draw_begin();
 extern void draw_get_buffer(void **data, size_t *size);
 extern void draw_end();
+// While suppressed, draw calls still run but emit no commands; used for work done outside a frame.
+extern void draw_set_suppressed(int suppressed);
 
 #endif //DRIVER_DRAW_H
@@ -1,20 +1,29 @@
 #include <stdio.h>
 #include <emscripten.h>
-#include <emscripten/wasmfs.h>
+#include <emscripten/heap.h>
 #include <assert.h>
 #include <string.h>
-#include <zlib.h>
+#include <unistd.h>
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
 #include "draw.h"
 #include "dpi.h"
 #include "image.h"
+#include "input.h"
 #include "fs.h"
 #include "sub.h"
+#include "sub_lua.h"
 #include "lcurl.h"
-
-extern backend_t wasmfs_create_nodefs_backend(const char* root);
+#include "lua_bundle.h"
+#include "zstream.h"
+#include "build_code.h"
+#include "xml.h"
+#include "json.h"
+#include "bit.h"
+#include "trace.h"
+
+extern size_t wasmfs_nodefs_open_descriptors();
 extern int luaopen_utf8(lua_State *L);
 
 extern const char *boot_lua;
@@ -48,7 +57,7 @@ static int OnOAuthLogout(lua_State *L) {
     return 0;
 }
 
-static int push_callback(lua_State *L, const char *name) {
+int push_callback(lua_State *L, const char *name) {
     lua_getfield(L, LUA_REGISTRYINDEX, "uicallbacks");
     lua_getfield(L, -1, name);
     if (lua_isfunction(L, -1)) {
@@ -85,6 +94,7 @@ static int SetCallback(lua_State *L) {
         lua_pushnil(L);
     }
     lua_settable(L, lua_upvalueindex(1));
+    input_invalidate_callbacks();
     return 0;
 }
 
@@ -107,6 +117,7 @@ static int SetMainObject(lua_State *L) {
         lua_pushnil(L);
     }
     lua_settable(L, lua_upvalueindex(1));
+    input_invalidate_callbacks();
     return 0;
 }
 
@@ -122,14 +133,21 @@ static int GetTime(lua_State *L) {
     return 1;
 }
 
+// Like GetTime, but keeps the fraction of a millisecond. Not part of the PoB host API; boot.lua
+// uses it to time phases that often finish within a millisecond.
+static int GetTimePrecise(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now() - st_start_time);
+    return 1;
+}
+
 static int RequestFrames(lua_State *L) {
     EM_ASM({ Module.requestFrames($0); }, luaL_checkinteger(L, 1));
     return 0;
 }
 
 static int GetCursorPos(lua_State *L) {
-    double x = EM_ASM_DOUBLE({ return Module.getCursorPosX(); });
-    double y = EM_ASM_DOUBLE({ return Module.getCursorPosY(); });
+    double x, y;
+    input_cursor(&x, &y);
     double system_scale = EM_ASM_DOUBLE({ return Module.getScreenScale(); });
     lua_pushinteger(L, dpi_cursor_coordinate(x, system_scale));
     lua_pushinteger(L, dpi_cursor_coordinate(y, system_scale));
@@ -180,104 +198,6 @@ static int Paste(lua_State *L) {
     return 1;
 }
 
-static int Deflate(lua_State *L) {
-    int n = lua_gettop(L);
-    assert(n >= 1);
-    assert(lua_isstring(L, 1));
-
-    z_stream strm;
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
-    if (ret != Z_OK) {
-        lua_pushnil(L);
-        lua_pushstring(L, "deflateInit failed");
-        return 2;
-    }
-
-    size_t in_len;
-    const char *in = lua_tolstring(L, 1, &in_len);
-
-    // Prevent deflation of input data larger than 128 MiB.
-    if (in_len > (128ull << 20)) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Input larger than 128 MiB");
-        return 2;
-    }
-
-    uLong out_sz = deflateBound(&strm, in_len);
-    // Clamp deflate bound to a fairly reasonable 128 MiB.
-    void *out = malloc(out_sz > (128ull << 20) ? (128ull << 20) : out_sz);
-    strm.next_in = (Bytef *)in;
-    strm.avail_in = in_len;
-    strm.next_out = (Bytef *)out;
-    strm.avail_out = out_sz;
-
-    ret = deflate(&strm, Z_FINISH);
-    deflateEnd(&strm);
-    if (ret != Z_STREAM_END) {
-        lua_pushnil(L);
-        lua_pushstring(L, zError(ret));
-        return 2;
-    }
-
-    lua_pushlstring(L, out, strm.total_out);
-    free(out);
-    return 1;
-}
-
-static int Inflate(lua_State *L) {
-    int n = lua_gettop(L);
-    assert(n >= 1);
-    assert(lua_isstring(L, 1));
-
-    z_stream strm;
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    int ret = inflateInit(&strm);
-    if (ret != Z_OK) {
-        lua_pushnil(L);
-        lua_pushstring(L, "inflateInit failed");
-        return 2;
-    }
-
-    size_t in_len;
-    const char *in = lua_tolstring(L, 1, &in_len);
-
-    // Prevent inflation of input data larger than 128 MiB.
-    if (in_len > (128ull << 20)) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Input larger than 128 MiB");
-        return 2;
-    }
-
-    uLong out_sz = in_len * 4;
-    void *out = malloc(out_sz);
-    strm.next_in = (Bytef *)in;
-    strm.avail_in = in_len;
-    strm.next_out = (Bytef *)out;
-    strm.avail_out = out_sz;
-
-    while ((ret = inflate(&strm, Z_NO_FLUSH)) == Z_OK) {
-        if (strm.avail_out == 0) {
-            out_sz *= 2;
-            out = realloc(out, out_sz);
-            strm.next_out = (Bytef *)((char *)out + strm.total_out);
-            strm.avail_out = out_sz - strm.total_out;
-        }
-    }
-    inflateEnd(&strm);
-    if (ret != Z_STREAM_END) {
-        lua_pushnil(L);
-        lua_pushstring(L, zError(ret));
-        return 2;
-    }
-
-    lua_pushlstring(L, out, strm.total_out);
-    free(out);
-    return 1;
-}
-
 static int SetWindowTitle(lua_State *L) {
     int n = lua_gettop(L);
     assert(n >= 1);
@@ -326,21 +246,29 @@ static int DownloadPage(lua_State *L) {
 
 EMSCRIPTEN_KEEPALIVE
 int init() {
-    backend_t app = wasmfs_create_nodefs_backend("");
-    wasmfs_create_directory("/app", 0777, app);
+    int span = trace_begin(TRACE_FS_BACKEND, "mount", 0);
+    trace_set_bytes(span, fs_mount());
 
     chdir("/app/root");
+    trace_end(span);
 
     GL = lua_newstate(my_alloc, NULL);
     lua_State *L = GL;
 
     // Open standard libraries
+    span = trace_begin(TRACE_OPENLIBS, "luaL_openlibs", 0);
     luaL_openlibs(GL);
+    trace_end(span);
     luaL_getsubtable(L, LUA_REGISTRYINDEX, "_PRELOAD");
     lua_pushcfunction(L, luaopen_utf8);
     lua_setfield(L, -2, "lua-utf8");
     lua_pop(L, 1);
 
+    trace_init(L);
+
+    // Serve PoB modules from the packer's precompiled bundle when one is shipped
+    lua_bundle_init(L, ".lua.bundle");
+
     // Handle lua errors
     lua_atpanic(L, at_panic);
 
@@ -378,6 +306,11 @@ int init() {
     image_init(L);
     draw_init(L);
     fs_init(L);
+    zstream_init(L);
+    build_code_init(L);
+    xml_init(L);
+    json_init(L);
+    bit_init(L);
     sub_init(L);
     lcurl_register(L);
 
@@ -385,6 +318,9 @@ int init() {
     lua_pushcclosure(L, GetTime, 0);
     lua_setglobal(L, "GetTime");
 
+    lua_pushcclosure(L, GetTimePrecise, 0);
+    lua_setglobal(L, "GetTimePrecise");
+
     lua_pushcclosure(L, RequestFrames, 0);
     lua_setglobal(L, "RequestFrames");
 
@@ -400,12 +336,6 @@ int init() {
     lua_pushcclosure(L, Paste, 0);
     lua_setglobal(L, "Paste");
 
-    lua_pushcclosure(L, Deflate, 0);
-    lua_setglobal(L, "Deflate");
-
-    lua_pushcclosure(L, Inflate, 0);
-    lua_setglobal(L, "Inflate");
-
     lua_pushcclosure(L, SetWindowTitle, 0);
     lua_setglobal(L, "SetWindowTitle");
 
@@ -425,19 +355,31 @@ int start() {
 
     st_start_time = emscripten_get_now();
 
-    if (luaL_dostring(L, boot_lua) != LUA_OK) {
+    int span = trace_begin(TRACE_BOOT, "boot.lua", 0);
+    int ret = luaL_dostring(L, boot_lua);
+    trace_end(span);
+    if (ret != LUA_OK) {
         fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
+        trace_stop();
         return 1;
     }
 
+    span = trace_begin(TRACE_ON_INIT, "OnInit", 0);
     push_callback(L, "OnInit");
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+    ret = lua_pcall(L, 1, 0, 0);
+    trace_end(span);
+    if (ret != LUA_OK) {
         fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
+        trace_stop();
         return 1;
     }
 
+    span = trace_begin(TRACE_FIRST_FRAME, "OnFrame", 0);
     push_callback(L, "OnFrame");
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+    ret = lua_pcall(L, 1, 0, 0);
+    trace_end(span);
+    trace_stop();
+    if (ret != LUA_OK) {
         fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
         return 1;
     }
@@ -445,10 +387,40 @@ int start() {
     return 0;
 }
 
+// Heap snapshot support. After start() the whole driver state lives in linear memory below the
+// current break, so the host can save that range and copy it into a fresh instance instead of
+// calling init() and start() again. Only host-side resources have to be bound again.
+
+EMSCRIPTEN_KEEPALIVE
+size_t heap_snapshot_size() {
+    // Broker file descriptors cannot be carried over to another session.
+    if (wasmfs_nodefs_open_descriptors() > 0) {
+        return 0;
+    }
+    return (size_t)sbrk(0);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int heap_snapshot_reserve(size_t size) {
+    if (size <= emscripten_get_heap_size()) {
+        return 0;
+    }
+    return emscripten_resize_heap(size) ? 0 : 1;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int heap_snapshot_restored() {
+    st_start_time = emscripten_get_now();
+    image_rebind();
+    return 0;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int on_frame() {
     lua_State *L = GL;
 
+    input_drain(L);
+
     draw_begin();
 
     if (push_callback(L, "OnFrame") < 0) {
@@ -467,8 +439,15 @@ int on_frame() {
            }, buffer, size);
 
     draw_end();
+    input_frame_end();
 
+    return 0;
+}
 
+// Dispatches queued input without running a frame, used when the queue is full and by flushInput().
+EMSCRIPTEN_KEEPALIVE
+int flush_input() {
+    input_drain(GL);
     return 0;
 }
 
@@ -545,15 +524,22 @@ int on_download_page_result(const char *json) {
     return 0;
 }
 
+int on_subscript_error(int id, int shard, const char *message);
+
+// `shard` is the 1-based shard of a LaunchSubScriptBatch job, or 0 for LaunchSubScript.
 EMSCRIPTEN_KEEPALIVE
-int on_subscript_finished(int id, const uint8_t *data) {
+int on_subscript_finished(int id, int shard, const uint8_t *data, size_t size) {
     lua_State *L = GL;
 
     int extra = push_callback(L, "OnSubFinished");
     if (extra >= 0) {
-        lua_pushlightuserdata(L, (void *)id);
-        int count = sub_lua_deserialize(L, data);
-        if (lua_pcall(L, extra + 1 + count, 0, 0) != LUA_OK) {
+        int count = sub_lua_push_result(L, id, shard, data, size);
+        if (count < 0) {
+            lua_pop(L, extra + 1);
+            fprintf(stderr, "on_subscript_finished error: malformed result\n");
+            return on_subscript_error(id, shard, "malformed subscript result");
+        }
+        if (lua_pcall(L, extra + count, 0, 0) != LUA_OK) {
             const char *msg = lua_tostring(L, -1);
             fprintf(stderr, "on_subscript_finished error: %s\n", msg);
             return 1;
@@ -564,14 +550,13 @@ int on_subscript_finished(int id, const uint8_t *data) {
 }
 
 EMSCRIPTEN_KEEPALIVE
-int on_subscript_error(int id, const char *message) {
+int on_subscript_error(int id, int shard, const char *message) {
     lua_State *L = GL;
 
     int extra = push_callback(L, "OnSubError");
     if (extra >= 0) {
-        lua_pushlightuserdata(L, (void *)id);
-        lua_pushstring(L, message);
-        if (lua_pcall(L, extra + 2, 0, 0) != LUA_OK) {
+        int count = sub_lua_push_error(L, id, shard, message);
+        if (lua_pcall(L, extra + count, 0, 0) != LUA_OK) {
             const char *msg = lua_tostring(L, -1);
             fprintf(stderr, "on_subscript_error error: %s\n", msg);
             return 1;
@@ -581,29 +566,92 @@ int on_subscript_error(int id, const char *message) {
     return 1;
 }
 
+// OnSubProgress(id, [shard,] ...) receives the arguments of a ReportProgress call in the subscript.
+EMSCRIPTEN_KEEPALIVE
+int on_subscript_progress(int id, int shard, const uint8_t *data, size_t size) {
+    lua_State *L = GL;
+
+    int extra = push_callback(L, "OnSubProgress");
+    if (extra >= 0) {
+        int count = sub_lua_push_result(L, id, shard, data, size);
+        if (count < 0) {
+            lua_pop(L, extra + 1);
+            fprintf(stderr, "on_subscript_progress error: malformed progress\n");
+            return 1;
+        }
+        if (lua_pcall(L, extra + count, 0, 0) != LUA_OK) {
+            const char *msg = lua_tostring(L, -1);
+            fprintf(stderr, "on_subscript_progress error: %s\n", msg);
+            return 1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+// Phase timings of the last load_build_from_code call, in milliseconds. Read by worker.ts.
+typedef struct {
+    double decode;
+    double parse;
+    double calc;
+    double total;
+} BuildImportStats;
+
+static BuildImportStats st_build_import_stats;
+
+EMSCRIPTEN_KEEPALIVE
+const BuildImportStats *build_import_stats() {
+    return &st_build_import_stats;
+}
+
+// Decodes the code and loads it into BUILD mode directly. Nothing is drawn while it runs; the
+// imported build shows up on the next regular frame.
 EMSCRIPTEN_KEEPALIVE
 int load_build_from_code(const char *code) {
     lua_State *L = GL;
+    memset(&st_build_import_stats, 0, sizeof(st_build_import_stats));
+
+    draw_set_suppressed(1);
     lua_getglobal(L, "loadBuildFromCode");
     lua_pushstring(L, code);
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+    int status = lua_pcall(L, 1, 4, 0);
+    draw_set_suppressed(0);
+    if (status != LUA_OK) {
         fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
         return 1;
     }
+
+    st_build_import_stats.decode = lua_tonumber(L, -4);
+    st_build_import_stats.parse = lua_tonumber(L, -3);
+    st_build_import_stats.calc = lua_tonumber(L, -2);
+    st_build_import_stats.total = lua_tonumber(L, -1);
+    lua_pop(L, 4);
     return 0;
 }
 
-static char *s_build_code = NULL;
+// The last code stays referenced from the registry, so the host can read it in place until the
+// next call instead of getting a copy.
+static int s_build_code_ref = LUA_NOREF;
+static size_t s_build_code_length = 0;
 
+// A negative level keeps the default; `dictionary` selects the preset-dictionary encoding.
 EMSCRIPTEN_KEEPALIVE
-const char* get_build_code() {
+const char* get_build_code(int level, int dictionary) {
     lua_State *L = GL;
 
-    free(s_build_code);
-    s_build_code = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, s_build_code_ref);
+    s_build_code_ref = LUA_NOREF;
+    s_build_code_length = 0;
 
     lua_getglobal(L, "getBuildCode");
-    if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+    if (level >= 0) {
+        lua_pushinteger(L, level);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_pushboolean(L, dictionary);
+    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
         fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
         lua_pop(L, 1);
         return NULL;
@@ -611,8 +659,16 @@ const char* get_build_code() {
 
     size_t len;
     const char *code = lua_tolstring(L, -1, &len);
-    s_build_code = malloc(len + 1);
-    memcpy(s_build_code, code, len + 1);
-    lua_pop(L, 1);
-    return s_build_code;
+    if (code == NULL) {
+        lua_pop(L, 1);
+        return NULL;
+    }
+    s_build_code_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    s_build_code_length = len;
+    return code;
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t get_build_code_length() {
+    return s_build_code_length;
 }
@@ -1,11 +1,17 @@
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <dirent.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <libgen.h>
+#include <limits.h>
 #include <fnmatch.h>
 #include <unistd.h>
+#include <emscripten.h>
+#include <emscripten/wasmfs.h>
 
 #include "fs.h"
 
@@ -32,122 +38,135 @@ static FsReaddirHandle *get_readdir_handle(lua_State *L, int valid) {
     FsReaddirHandle *handle = lua_touserdata(L, 1);
     lua_remove(L, 1);
     if (valid) {
-        assert(handle->dir != NULL);
+        assert(handle->index < handle->count);
     }
     return handle;
 }
 
-static int NewFileSearch(lua_State *L) {
-    int n = lua_gettop(L);
-    assert(n >= 1);
-    assert(lua_isstring(L, 1));
-
-    const char *path = lua_tostring(L, 1);
+EMSCRIPTEN_KEEPALIVE
+void fs_record_entry(FsReaddirHandle *handle, const char *name, double size, double mtime) {
+    if (handle->count == handle->capacity) {
+        handle->capacity = handle->capacity ? handle->capacity * 2 : 16;
+        handle->entries = realloc(handle->entries, handle->capacity * sizeof(FsEntry));
+    }
+    handle->entries[handle->count++] = (FsEntry){strdup(name), size, mtime};
+}
 
-    char _dirname[PATH_MAX];
-    strncpy(_dirname, path, sizeof(_dirname) - 1);
-    dirname(_dirname);
+// One broker round trip lists the matching entries of a Node-backed directory with their size and
+// modification time, with the pattern applied on the broker side.
+EM_JS(int, rpc_readdir_plus, (const char *path, const char *pattern, int dir_only, FsReaddirHandle *handle), {
+    try {
+        const args = [UTF8ToString(path), UTF8ToString(pattern), dir_only !== 0];
+        const entries = Module.rpcCall("readdir_plus", args, undefined, 4 * 1024 * 1024).value;
+        for (const [name, size, mtime] of entries) {
+            const sp = stackSave();
+            _fs_record_entry(handle, stringToUTF8OnStack(name), size, mtime);
+            stackRestore(sp);
+        }
+        return 0;
+    } catch (e) { return Module.ERRNO_CODES[e.code] || 5; }
+});
 
-    char *pattern = basename((char *)path);
+extern int wasmfs_nodefs_directory_path(const char *path, char *out, size_t size);
 
-    DIR *dir = opendir(_dirname);
+// Directories of other backends are listed through WasmFS.
+static int readdir_local(const char *path, const char *pattern, int dir_only, FsReaddirHandle *handle) {
+    DIR *dir = opendir(path);
     if (dir == NULL) {
-        fprintf(stderr, "Failed to open directory: %s\n", _dirname);
-        return 0;
+        return errno;
     }
-
-    int dir_only = lua_toboolean(L, 2) != 0;
     struct dirent *entry;
-    while (1) {
-        entry = readdir(dir);
-        if (entry == NULL) {
-            closedir(dir);
-            return 0;
-        }
-
+    while ((entry = readdir(dir)) != NULL) {
         if ((entry->d_type == DT_DIR) != dir_only || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue;
         }
-
         if (fnmatch(pattern, entry->d_name, FNM_FILE_NAME) != 0) {
             continue;
         }
-
-        break;
+        char child[PATH_MAX];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        struct stat st;
+        if (stat(child, &st) != 0) {
+            continue;
+        }
+        fs_record_entry(handle, entry->d_name, (double)st.st_size, (double)st.st_mtime);
     }
+    closedir(dir);
+    return 0;
+}
 
-    FsReaddirHandle *handle = lua_newuserdata(L, sizeof(FsReaddirHandle));
-    strncpy(handle->path, _dirname, sizeof(handle->path) - 1);
-    strncpy(handle->pattern, pattern, sizeof(handle->pattern) - 1);
-    handle->dir = dir;
-    handle->entry = entry;
-    handle->dir_only = dir_only;
+static int NewFileSearch(lua_State *L) {
+    int n = lua_gettop(L);
+    assert(n >= 1);
+    assert(lua_isstring(L, 1));
 
+    const char *path = lua_tostring(L, 1);
+    int dir_only = lua_toboolean(L, 2) != 0;
+
+    char _dirname[PATH_MAX] = {0};
+    strncpy(_dirname, path, sizeof(_dirname) - 1);
+    dirname(_dirname);
+
+    char _basename[PATH_MAX] = {0};
+    strncpy(_basename, path, sizeof(_basename) - 1);
+    const char *pattern = basename(_basename);
+
+    FsReaddirHandle *handle = lua_newuserdata(L, sizeof(FsReaddirHandle));
+    *handle = (FsReaddirHandle){0};
     lua_pushvalue(L, lua_upvalueindex(1));
     lua_setmetatable(L, -2);
 
+    char node_path[PATH_MAX];
+    int err = wasmfs_nodefs_directory_path(_dirname, node_path, sizeof(node_path));
+    if (err == 0) {
+        err = rpc_readdir_plus(node_path, pattern, dir_only, handle);
+    } else if (err == EXDEV) {
+        err = readdir_local(_dirname, pattern, dir_only, handle);
+    }
+    if (err != 0) {
+        fprintf(stderr, "Failed to open directory: %s\n", _dirname);
+        return 0;
+    }
+    if (handle->count == 0) {
+        return 0;
+    }
     return 1;
 }
 
 static int FsReaddirHandle_gc(lua_State *L) {
     FsReaddirHandle *handle = get_readdir_handle(L, 0);
-    closedir(handle->dir);
+    for (size_t i = 0; i < handle->count; i++) {
+        free(handle->entries[i].name);
+    }
+    free(handle->entries);
+    *handle = (FsReaddirHandle){0};
     return 0;
 }
 
 static int FsReaddirHandle_NextFile(lua_State *L) {
     FsReaddirHandle *handle = get_readdir_handle(L, 1);
-
-    struct dirent *entry;
-    while (1) {
-        entry = readdir(handle->dir);
-        if (entry == NULL) {
-            closedir(handle->dir);
-            handle->dir = NULL;
-            return 0;
-        }
-
-        if ((entry->d_type == DT_DIR) != handle->dir_only || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        if (fnmatch(handle->pattern, entry->d_name, FNM_FILE_NAME) != 0) {
-            continue;
-        }
-
-        break;
+    if (++handle->index >= handle->count) {
+        return 0;
     }
-
-    handle->entry = entry;
-
     lua_pushboolean(L, 1);
     return 1;
 }
 
 static int FsReaddirHandle_GetFileName(lua_State *L) {
     FsReaddirHandle *handle = get_readdir_handle(L, 1);
-    lua_pushstring(L, handle->entry->d_name);
+    lua_pushstring(L, handle->entries[handle->index].name);
     return 1;
 }
 
 static int FsReaddirHandle_GetFileSize(lua_State *L) {
     FsReaddirHandle *handle = get_readdir_handle(L, 1);
-    lua_pushinteger(L, handle->entry->d_reclen);
+    lua_pushnumber(L, handle->entries[handle->index].size);
     return 1;
 }
 
 static int FsReaddirHandle_GetFileModifiedTime(lua_State *L) {
     FsReaddirHandle *handle = get_readdir_handle(L, 1);
-
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path) - 1, "%s/%s", handle->path, handle->entry->d_name);
-
-    struct stat st;
-    if (stat(path, &st) == 0) {
-        lua_pushnumber(L, (double)st.st_mtime);
-    } else {
-        lua_pushnumber(L, 0);
-    }
+    lua_pushnumber(L, handle->entries[handle->index].mtime);
     return 1;
 }
 
@@ -188,6 +207,41 @@ static int RemoveDir(lua_State *L) {
     return 1;
 }
 
+extern backend_t wasmfs_create_nodefs_backend(const char *root);
+extern backend_t wasmfs_create_zipfs_backend(const uint8_t *data, size_t size);
+
+// root.zip as the host passed it in Module.rootArchive; the bytes are moved into `data`.
+EM_JS(size_t, host_root_archive_size, (), { return Module.rootArchive ? Module.rootArchive.byteLength : 0; });
+EM_JS(void, host_root_archive_take, (uint8_t *data), {
+    HEAPU8.set(new Uint8Array(Module.rootArchive), data);
+    delete Module.rootArchive;
+});
+
+size_t fs_mount(void) {
+    wasmfs_create_directory("/app", 0777, NULL);
+    wasmfs_create_directory("/app/user", 0777, wasmfs_create_nodefs_backend("/user"));
+
+    backend_t root = NULL;
+    size_t size = host_root_archive_size();
+    size_t mounted = 0;
+    uint8_t *archive = size > 0 ? malloc(size) : NULL;
+    if (archive != NULL) {
+        host_root_archive_take(archive);
+        root = wasmfs_create_zipfs_backend(archive, size);
+        if (root != NULL) {
+            mounted = size;
+        } else {
+            fprintf(stderr, "Ignoring unreadable root archive (%zu bytes)\n", size);
+            free(archive);
+        }
+    }
+    if (root == NULL) {
+        root = wasmfs_create_nodefs_backend("/root");
+    }
+    wasmfs_create_directory("/app/root", 0555, root);
+    return mounted;
+}
+
 void fs_init(lua_State *L) {
     lua_newtable(L);
     lua_pushvalue(L, -1);
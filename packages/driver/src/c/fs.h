@@ -1,17 +1,28 @@
 #ifndef DRIVER_FS_H
 #define DRIVER_FS_H
 
-#include <dirent.h>
+#include <stddef.h>
 #include "lua.h"
 
 typedef struct {
-    char path[PATH_MAX];
-    char pattern[PATH_MAX];
-    DIR *dir;
-    struct dirent *entry;
-    int dir_only;
+    char *name;
+    double size;
+    double mtime;
+} FsEntry;
+
+// Matches of a NewFileSearch, listed up front and iterated in memory
+typedef struct {
+    FsEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t index;
 } FsReaddirHandle;
 
+// Mounts the broker's /user at /app/user and the game root at /app/root, served from Module.rootArchive when
+// the host provides root.zip there and through the broker's /root otherwise. Returns the size of the archive
+// mounted in memory, or 0.
+extern size_t fs_mount(void);
+
 extern void fs_init(lua_State *L);
 
 #endif //DRIVER_FS_H
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <emscripten.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "image.h"
@@ -62,6 +63,30 @@ static const char *IMAGE_HANDLE_TYPE = "ImageHandle";
 
 static int st_next_handle = 0;
 
+// Last load request per handle, replayed to the host after a heap snapshot restore.
+typedef struct {
+    char *filename;
+    int flags;
+} ImageLoad;
+
+static ImageLoad *st_loads = NULL;
+static int st_loads_capacity = 0;
+
+static void record_load(int handle, const char *filename, int flags) {
+    if (handle >= st_loads_capacity) {
+        int capacity = st_loads_capacity ? st_loads_capacity : 256;
+        while (capacity <= handle) {
+            capacity *= 2;
+        }
+        st_loads = realloc(st_loads, capacity * sizeof(ImageLoad));
+        memset(st_loads + st_loads_capacity, 0, (capacity - st_loads_capacity) * sizeof(ImageLoad));
+        st_loads_capacity = capacity;
+    }
+    free(st_loads[handle].filename);
+    st_loads[handle].filename = strdup(filename);
+    st_loads[handle].flags = flags;
+}
+
 static int is_user_data(lua_State *L, int index, const char *type) {
     if (lua_type(L, index) != LUA_TUSERDATA) {
         return 0;
@@ -132,6 +157,7 @@ static int ImageHandle_Load(lua_State *L) {
         }
     }
 
+    record_load(image_handle->handle, filename, flags);
     EM_ASM({
                Module.imageLoad($0, UTF8ToString($1), $2);
            }, image_handle->handle, filename, flags);
@@ -169,3 +195,14 @@ void image_init(lua_State *L) {
 
     lua_setfield(L, LUA_REGISTRYINDEX, IMAGE_HANDLE_TYPE);
 }
+
+void image_rebind() {
+    for (int handle = 0; handle < st_loads_capacity; handle++) {
+        if (st_loads[handle].filename == NULL) {
+            continue;
+        }
+        EM_ASM({
+                   Module.imageLoad($0, UTF8ToString($1), $2);
+               }, handle, st_loads[handle].filename, st_loads[handle].flags);
+    }
+}
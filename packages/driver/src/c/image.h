@@ -10,5 +10,6 @@ typedef struct {
 } ImageHandle;
 
 extern void image_init(lua_State *L);
+extern void image_rebind();
 
 #endif //DRIVER_IMAGE_H
@@ -0,0 +1,143 @@
+#include <emscripten.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "input.h"
+
+// Defined in driver.c.
+extern int push_callback(lua_State *L, const char *name);
+
+typedef struct {
+    const char *name;
+    int generation;
+    int function;
+    int self;
+} CachedCallback;
+
+static InputQueue st_queue = {
+    .capacity = INPUT_QUEUE_CAPACITY,
+    .event_size = sizeof(InputEvent),
+};
+static InputFrameStats st_frame_stats;
+static InputFrameStats st_pending_stats;
+static double st_pending_oldest = 0;
+static double st_cursor_x = 0;
+static double st_cursor_y = 0;
+
+static int st_generation = 1;
+static CachedCallback st_callbacks[] = {
+    [INPUT_KEY_DOWN] = {"OnKeyDown", 0, LUA_NOREF, LUA_NOREF},
+    [INPUT_KEY_UP] = {"OnKeyUp", 0, LUA_NOREF, LUA_NOREF},
+    [INPUT_CHAR] = {"OnChar", 0, LUA_NOREF, LUA_NOREF},
+};
+
+void input_invalidate_callbacks() {
+    st_generation++;
+}
+
+// Same result as push_callback(), but the lookup is resolved once and kept as registry refs.
+static int push_cached_callback(lua_State *L, CachedCallback *callback) {
+    if (callback->generation != st_generation) {
+        luaL_unref(L, LUA_REGISTRYINDEX, callback->function);
+        luaL_unref(L, LUA_REGISTRYINDEX, callback->self);
+        callback->function = LUA_NOREF;
+        callback->self = LUA_NOREF;
+        callback->generation = st_generation;
+
+        int extra = push_callback(L, callback->name);
+        if (extra > 0) {
+            callback->self = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        if (extra >= 0) {
+            callback->function = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+    }
+    if (callback->function == LUA_NOREF) {
+        return -1;
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, callback->function);
+    if (callback->self == LUA_NOREF) {
+        return 0;
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, callback->self);
+    return 1;
+}
+
+static void dispatch(lua_State *L, const InputEvent *event) {
+    if (event->type == INPUT_MOUSE_MOVE) {
+        st_cursor_x = event->x;
+        st_cursor_y = event->y;
+        return;
+    }
+    if (event->type > INPUT_CHAR) {
+        return;
+    }
+
+    int extra = push_cached_callback(L, &st_callbacks[event->type]);
+    if (extra < 0) {
+        return;
+    }
+    lua_pushstring(L, event->name);
+    int nargs = extra + 1;
+    // OnKeyUp is called without the double-click flag when it is negative.
+    if (event->type != INPUT_KEY_UP || event->double_click >= 0) {
+        lua_pushboolean(L, event->double_click);
+        nargs++;
+    }
+    if (lua_pcall(L, nargs, 0, 0) != LUA_OK) {
+        fprintf(stderr, "Error: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+void input_drain(lua_State *L) {
+    uint32_t tail = st_queue.tail;
+    uint32_t head = __atomic_load_n(&st_queue.head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        const InputEvent *event = &st_queue.events[tail % INPUT_QUEUE_CAPACITY];
+        if (st_pending_stats.events == 0) {
+            st_pending_oldest = event->time;
+        }
+        st_pending_stats.events++;
+
+        // Only the last of consecutive mouse moves matters; nothing observes the cursor in between.
+        uint32_t next = tail + 1;
+        if (event->type == INPUT_MOUSE_MOVE && next != head &&
+            st_queue.events[next % INPUT_QUEUE_CAPACITY].type == INPUT_MOUSE_MOVE) {
+            tail = next;
+            continue;
+        }
+
+        // Release the slot before the callback runs anything that might queue more input.
+        InputEvent copy = *event;
+        copy.name[INPUT_NAME_SIZE - 1] = '\0';
+        tail = next;
+        __atomic_store_n(&st_queue.tail, tail, __ATOMIC_RELEASE);
+        st_pending_stats.dispatched++;
+        dispatch(L, &copy);
+        head = __atomic_load_n(&st_queue.head, __ATOMIC_ACQUIRE);
+    }
+    __atomic_store_n(&st_queue.tail, tail, __ATOMIC_RELEASE);
+}
+
+void input_frame_end() {
+    st_frame_stats = st_pending_stats;
+    st_frame_stats.latency = st_pending_stats.events > 0 ? emscripten_get_now() - st_pending_oldest : 0;
+    memset(&st_pending_stats, 0, sizeof(st_pending_stats));
+}
+
+void input_cursor(double *x, double *y) {
+    *x = st_cursor_x;
+    *y = st_cursor_y;
+}
+
+EMSCRIPTEN_KEEPALIVE
+InputQueue *input_queue() {
+    return &st_queue;
+}
+
+EMSCRIPTEN_KEEPALIVE
+const InputFrameStats *input_frame_stats() {
+    return &st_frame_stats;
+}
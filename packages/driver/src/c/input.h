@@ -0,0 +1,53 @@
+#ifndef DRIVER_INPUT_H
+#define DRIVER_INPUT_H
+
+#include <stdint.h>
+#include "lua.h"
+
+// Input event queue. The worker appends events into a ring in linear memory and on_frame() drains
+// them before OnFrame, so a burst of input costs one call into Wasm instead of one per event.
+
+typedef enum {
+    INPUT_MOUSE_MOVE,
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_CHAR,
+} InputEventType;
+
+#define INPUT_NAME_SIZE 32
+#define INPUT_QUEUE_CAPACITY 256
+
+// Layout shared with input-queue.ts; keep it at 64 bytes.
+typedef struct {
+    double time;
+    double x;
+    double y;
+    uint32_t type;
+    int32_t double_click;
+    char name[INPUT_NAME_SIZE];
+} InputEvent;
+
+// Single producer (the host) advances head, single consumer (the driver) advances tail.
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t capacity;
+    uint32_t event_size;
+    InputEvent events[INPUT_QUEUE_CAPACITY];
+} InputQueue;
+
+typedef struct {
+    uint32_t events;     // events taken from the queue
+    uint32_t dispatched; // events left after merging consecutive mouse moves
+    double latency;      // from the oldest event to the end of the frame, in ms
+} InputFrameStats;
+
+// Dispatches all queued events; the counts roll into the stats published by input_frame_end().
+void input_drain(lua_State *L);
+void input_frame_end();
+void input_cursor(double *x, double *y);
+
+// Cached callback lookups are dropped whenever SetCallback or SetMainObject run.
+void input_invalidate_callbacks();
+
+#endif //DRIVER_INPUT_H
@@ -0,0 +1,1005 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byte_buffer.h"
+#include "json.h"
+#include "lauxlib.h"
+
+// Native JSON for PoB's dkjson module. Decoding follows dkjson's scanner, including its leniency
+// (comments, missing commas, "key: value" pairs inside arrays) and its error messages, and builds
+// the Lua tables directly. Encoding streams into one reusable buffer; anything that needs dkjson's
+// hooks (__tojson, __jsonorder, __pairs, cycles, encoder state) is left to the Lua encoder.
+
+#define JSON_MAX_DEPTH 1000
+#define LAZY_ARRAY_TYPE "LazyJsonArray"
+
+typedef struct {
+    lua_State *L;
+    const char *s;
+    size_t len;
+    int nullval;
+    int objectmeta;
+    int arraymeta;
+    int lazy_min;
+    int lazy_config;
+    int depth;
+    size_t err_pos;
+    char err[128];
+} Parser;
+
+typedef struct {
+    size_t first;
+    size_t count;
+    size_t offsets[1];
+} LazyArray;
+
+static ByteBuffer st_scratch;
+static ByteBuffer st_output;
+
+static int decode_value(Parser *P, size_t pos, size_t *next);
+
+// dkjson reports positions as "line L, column C", with the column counted from the last newline.
+static void location(const Parser *P, size_t where, char *out, size_t size) {
+    int line = 1;
+    size_t line_start = 0;
+    for (size_t i = 0; i + 1 < where && i < P->len; i++) {
+        if (P->s[i] == '\n') {
+            line++;
+            line_start = i + 1;
+        }
+    }
+    snprintf(out, size, "line %d, column %zu", line, where - line_start);
+}
+
+static int fail_at(Parser *P, size_t err_pos, const char *prefix, size_t where, const char *suffix) {
+    char loc[64];
+    location(P, where + 1, loc, sizeof(loc));
+    snprintf(P->err, sizeof(P->err), "%s%s%s", prefix, loc, suffix);
+    P->err_pos = err_pos;
+    return -1;
+}
+
+static int unterminated(Parser *P, const char *what, size_t start) {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "unterminated %s at ", what);
+    return fail_at(P, P->len, prefix, start, "");
+}
+
+// Skips whitespace, a UTF-8 BOM and // or /* */ comments. Returns 0 when the input ends first.
+static int skip_white(const Parser *P, size_t *pos) {
+    size_t p = *pos;
+    const char *s = P->s;
+    for (;;) {
+        while (p < P->len && isspace((unsigned char)s[p])) {
+            p++;
+        }
+        if (p >= P->len) {
+            return 0;
+        }
+        if (p + 2 < P->len && memcmp(s + p, "\xef\xbb\xbf", 3) == 0) {
+            p += 3;
+        } else if (p + 1 < P->len && s[p] == '/' && s[p + 1] == '/') {
+            p += 2;
+            while (p < P->len && s[p] != '\n' && s[p] != '\r') {
+                p++;
+            }
+            if (p >= P->len) {
+                return 0;
+            }
+        } else if (p + 1 < P->len && s[p] == '/' && s[p + 1] == '*') {
+            const char *end = NULL;
+            for (size_t q = p + 2; q + 1 < P->len; q++) {
+                if (s[q] == '*' && s[q + 1] == '/') {
+                    end = s + q;
+                    break;
+                }
+            }
+            if (end == NULL) {
+                return 0;
+            }
+            p = end - s + 2;
+        } else {
+            *pos = p;
+            return 1;
+        }
+    }
+}
+
+// tonumber(text, 16) for the (up to four) characters after \u.
+static int hex_tonumber(const char *s, size_t len, long *value) {
+    const char *end = s + len;
+    while (s < end && isspace((unsigned char)*s)) {
+        s++;
+    }
+    int negative = s < end && *s == '-';
+    if (negative) {
+        s++;
+    }
+    if (s >= end || !isalnum((unsigned char)*s)) {
+        return 0;
+    }
+    long n = 0;
+    while (s < end && isalnum((unsigned char)*s)) {
+        int c = (unsigned char)*s;
+        int digit = isdigit(c) ? c - '0' : toupper(c) - 'A' + 10;
+        if (digit >= 16) {
+            return 0;
+        }
+        n = n * 16 + digit;
+        s++;
+    }
+    while (s < end && isspace((unsigned char)*s)) {
+        s++;
+    }
+    if (s != end) {
+        return 0;
+    }
+    *value = negative ? -n : n;
+    return 1;
+}
+
+// dkjson's unichar(): the UTF-8 length of a code point, or 0 if it cannot be encoded.
+static size_t unichar_length(long code) {
+    return code < 0 ? 0 : code <= 0x7f ? 1 : code <= 0x7ff ? 2 : code <= 0xffff ? 3 : code <= 0x10ffff ? 4 : 0;
+}
+
+static void append_unichar(ByteBuffer *out, long code, size_t n) {
+    char bytes[4];
+    switch (n) {
+        case 1:
+            bytes[0] = (char)code;
+            break;
+        case 2:
+            bytes[0] = (char)(0xc0 | (code >> 6));
+            bytes[1] = (char)(0x80 | (code & 0x3f));
+            break;
+        case 3:
+            bytes[0] = (char)(0xe0 | (code >> 12));
+            bytes[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+            bytes[2] = (char)(0x80 | (code & 0x3f));
+            break;
+        default:
+            bytes[0] = (char)(0xf0 | (code >> 18));
+            bytes[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+            bytes[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+            bytes[3] = (char)(0x80 | (code & 0x3f));
+            break;
+    }
+    byte_buffer_append(out, bytes, n);
+}
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+// Scans the string starting at the opening quote. Pushes it unless `push` is 0.
+static int scan_string(Parser *P, size_t start, size_t *next, int push) {
+    const char *s = P->s;
+    size_t last = start + 1;
+    int escaped = 0;
+    for (;;) {
+        size_t q = last;
+        while (q < P->len && s[q] != '"' && s[q] != '\\') {
+            q++;
+        }
+        if (q >= P->len) {
+            return unterminated(P, "string", start);
+        }
+        if (push && escaped) {
+            byte_buffer_append(&st_scratch, s + last, q - last);
+        }
+        if (s[q] == '"') {
+            if (push && !escaped) {
+                lua_pushlstring(P->L, s + start + 1, q - start - 1);
+            }
+            last = q + 1;
+            break;
+        }
+        if (push && !escaped) {
+            st_scratch.size = 0;
+            byte_buffer_append(&st_scratch, s + start + 1, q - start - 1);
+        }
+        escaped = 1;
+
+        char esc = q + 1 < P->len ? s[q + 1] : '\0';
+        int decoded = 0;
+        if (esc == 'u') {
+            long value, low;
+            size_t avail = q + 2 <= P->len ? P->len - (q + 2) : 0;
+            if (hex_tonumber(s + q + 2, min_size(4, avail), &value)) {
+                int pair = 0;
+                if (value >= 0xd800 && value <= 0xdbff && q + 7 < P->len && s[q + 6] == '\\' && s[q + 7] == 'u') {
+                    size_t low_avail = q + 8 <= P->len ? P->len - (q + 8) : 0;
+                    if (hex_tonumber(s + q + 8, min_size(4, low_avail), &low) && low >= 0xdc00 && low <= 0xdfff) {
+                        value = (value - 0xd800) * 0x400 + (low - 0xdc00) + 0x10000;
+                        pair = 1;
+                    }
+                }
+                size_t n = unichar_length(value);
+                if (n > 0) {
+                    if (push) {
+                        append_unichar(&st_scratch, value, n);
+                    }
+                    decoded = 1;
+                    last = q + (pair ? 12 : 6);
+                }
+            }
+        }
+        if (!decoded) {
+            if (push && q + 1 < P->len) {
+                char c;
+                switch (esc) {
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    default: c = esc; break;
+                }
+                byte_buffer_append(&st_scratch, &c, 1);
+            }
+            last = q + 2;
+        }
+    }
+    if (push && escaped) {
+        lua_pushlstring(P->L, (const char *)st_scratch.data, st_scratch.size);
+    }
+    *next = last;
+    return 0;
+}
+
+static int is_number_char(char c) {
+    return isdigit((unsigned char)c) || c == '.';
+}
+
+// Numbers match dkjson's pattern ^-?[%d.]+[eE]?[+-]?%d* and must then convert like tonumber().
+static int scan_number(Parser *P, size_t pos, size_t *next, double *value) {
+    const char *s = P->s;
+    size_t p = pos;
+    if (p < P->len && s[p] == '-') {
+        p++;
+    }
+    size_t digits = p;
+    while (p < P->len && is_number_char(s[p])) {
+        p++;
+    }
+    if (p == digits) {
+        return 0;
+    }
+    if (p < P->len && (s[p] == 'e' || s[p] == 'E')) {
+        p++;
+    }
+    if (p < P->len && (s[p] == '+' || s[p] == '-')) {
+        p++;
+    }
+    while (p < P->len && isdigit((unsigned char)s[p])) {
+        p++;
+    }
+
+    char stack_text[64];
+    size_t len = p - pos;
+    char *text = len < sizeof(stack_text) ? stack_text : malloc(len + 1);
+    if (text == NULL) {
+        return 0;
+    }
+    memcpy(text, s + pos, len);
+    text[len] = '\0';
+    char *end;
+    *value = strtod(text, &end);
+    int ok = end == text + len;
+    if (text != stack_text) {
+        free(text);
+    }
+    *next = p;
+    return ok;
+}
+
+static int scan_table(Parser *P, size_t start, size_t *next, int is_array);
+
+static int no_value(Parser *P, size_t pos) {
+    return fail_at(P, pos, "no valid JSON value at ", pos, "");
+}
+
+// Decodes one value and pushes it; on failure nothing is pushed and P->err describes the error.
+static int decode_value(Parser *P, size_t pos, size_t *next) {
+    if (!skip_white(P, &pos)) {
+        snprintf(P->err, sizeof(P->err), "no valid JSON value (reached the end)");
+        P->err_pos = P->len;
+        return -1;
+    }
+    char c = P->s[pos];
+    if (c == '{' || c == '[') {
+        return scan_table(P, pos, next, c == '[');
+    }
+    if (c == '"') {
+        luaL_checkstack(P->L, 1, "JSON string");
+        return scan_string(P, pos, next, 1);
+    }
+    double number;
+    size_t end;
+    if (scan_number(P, pos, &end, &number)) {
+        lua_pushnumber(P->L, number);
+        *next = end;
+        return 0;
+    }
+    if (isalpha((unsigned char)c)) {
+        size_t q = pos + 1;
+        while (q < P->len && isalnum((unsigned char)P->s[q])) {
+            q++;
+        }
+        size_t len = q - pos;
+        if (len == 4 && memcmp(P->s + pos, "true", 4) == 0) {
+            lua_pushboolean(P->L, 1);
+        } else if (len == 5 && memcmp(P->s + pos, "false", 5) == 0) {
+            lua_pushboolean(P->L, 0);
+        } else if (len == 4 && memcmp(P->s + pos, "null", 4) == 0) {
+            lua_pushvalue(P->L, P->nullval);
+        } else {
+            return no_value(P, pos);
+        }
+        *next = q;
+        return 0;
+    }
+    return no_value(P, pos);
+}
+
+// Whether the value at `pos` decodes to nil, which dkjson refuses as a key.
+static int is_nil_literal(Parser *P, size_t pos) {
+    skip_white(P, &pos);
+    return lua_isnil(P->L, P->nullval) && pos + 4 <= P->len && memcmp(P->s + pos, "null", 4) == 0 &&
+           (pos + 4 == P->len || !isalnum((unsigned char)P->s[pos + 4]));
+}
+
+// Validates one value without building it, for the lazy array index.
+static int skip_value(Parser *P, size_t pos, size_t *next) {
+    if (!skip_white(P, &pos)) {
+        snprintf(P->err, sizeof(P->err), "no valid JSON value (reached the end)");
+        P->err_pos = P->len;
+        return -1;
+    }
+    char c = P->s[pos];
+    if (c == '"') {
+        return scan_string(P, pos, next, 0);
+    }
+    if (c != '{' && c != '[') {
+        // Scalars are cheap to decode, so they are checked the same way and dropped.
+        int ret = decode_value(P, pos, next);
+        if (ret == 0) {
+            lua_pop(P->L, 1);
+        }
+        return ret;
+    }
+    char close = c == '[' ? ']' : '}';
+    const char *what = c == '[' ? "array" : "object";
+    size_t p = pos + 1;
+    if (++P->depth > JSON_MAX_DEPTH) {
+        return fail_at(P, pos, "too many nested levels at ", pos, "");
+    }
+    for (;;) {
+        if (!skip_white(P, &p)) {
+            return unterminated(P, what, pos);
+        }
+        if (P->s[p] == close) {
+            P->depth--;
+            *next = p + 1;
+            return 0;
+        }
+        size_t key = p;
+        if (skip_value(P, p, &p) != 0) {
+            return -1;
+        }
+        if (!skip_white(P, &p)) {
+            return unterminated(P, what, pos);
+        }
+        if (P->s[p] == ':') {
+            if (is_nil_literal(P, key)) {
+                return fail_at(P, p, "cannot use nil as table index (at ", p, ")");
+            }
+            p++;
+            if (!skip_white(P, &p)) {
+                return unterminated(P, what, pos);
+            }
+            if (skip_value(P, p, &p) != 0) {
+                return -1;
+            }
+            if (!skip_white(P, &p)) {
+                return unterminated(P, what, pos);
+            }
+        }
+        if (P->s[p] == ',') {
+            p++;
+        }
+    }
+}
+
+static void make_lazy(Parser *P, size_t first, const size_t *offsets, size_t rest);
+
+// Collects the offsets of the remaining elements of the array that starts at `start`, beginning
+// with the one at `pos`. Returns 1 on success, 0 if a "key: value" pair follows (the array has to
+// be decoded eagerly) or -1 on a syntax error.
+static int index_rest(Parser *P, size_t start, size_t pos, size_t *next, ByteBuffer *offsets) {
+    size_t p = pos;
+    for (;;) {
+        byte_buffer_append(offsets, &p, sizeof(p));
+        if (skip_value(P, p, &p) != 0) {
+            return -1;
+        }
+        if (!skip_white(P, &p)) {
+            return unterminated(P, "array", start);
+        }
+        if (P->s[p] == ':') {
+            return 0;
+        }
+        if (P->s[p] == ',') {
+            p++;
+        }
+        if (!skip_white(P, &p)) {
+            return unterminated(P, "array", start);
+        }
+        if (P->s[p] == ']') {
+            *next = p + 1;
+            return 1;
+        }
+    }
+}
+
+static void set_meta(Parser *P, int is_array) {
+    int meta = is_array ? P->arraymeta : P->objectmeta;
+    if (meta != 0 && lua_istable(P->L, meta)) {
+        lua_pushvalue(P->L, meta);
+        lua_setmetatable(P->L, -2);
+    }
+}
+
+static int scan_table(Parser *P, size_t start, size_t *next, int is_array) {
+    lua_State *L = P->L;
+    const char *what = is_array ? "array" : "object";
+    char close = is_array ? ']' : '}';
+    if (++P->depth > JSON_MAX_DEPTH) {
+        return fail_at(P, start, "too many nested levels at ", start, "");
+    }
+    luaL_checkstack(L, 4, "JSON nesting");
+
+    lua_newtable(L);
+    set_meta(P, is_array);
+    int lazy = is_array && P->lazy_min > 0;
+    int n = 0;
+    size_t p = start + 1;
+    for (;;) {
+        if (!skip_white(P, &p)) {
+            lua_pop(L, 1);
+            return unterminated(P, what, start);
+        }
+        if (P->s[p] == close) {
+            P->depth--;
+            *next = p + 1;
+            return 0;
+        }
+        if (lazy && n == P->lazy_min) {
+            // Long array: the elements decoded so far stay, the rest are only indexed.
+            ByteBuffer offsets = {0};
+            int ret = index_rest(P, start, p, next, &offsets);
+            if (ret == 1) {
+                make_lazy(P, (size_t)n, (const size_t *)offsets.data, offsets.size / sizeof(size_t));
+                byte_buffer_free(&offsets);
+                P->depth--;
+                return 0;
+            }
+            byte_buffer_free(&offsets);
+            if (ret < 0) {
+                lua_pop(L, 1);
+                return -1;
+            }
+            lua_pop(L, 1);
+            lua_newtable(L);
+            set_meta(P, is_array);
+            lazy = 0;
+            n = 0;
+            p = start + 1;
+            continue;
+        }
+        if (decode_value(P, p, &p) != 0) {
+            lua_pop(L, 1);
+            return -1;
+        }
+        if (!skip_white(P, &p)) {
+            lua_pop(L, 2);
+            return unterminated(P, what, start);
+        }
+        if (P->s[p] == ':') {
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 2);
+                return fail_at(P, p, "cannot use nil as table index (at ", p, ")");
+            }
+            p++;
+            if (!skip_white(P, &p)) {
+                lua_pop(L, 2);
+                return unterminated(P, what, start);
+            }
+            if (decode_value(P, p, &p) != 0) {
+                lua_pop(L, 2);
+                return -1;
+            }
+            lua_rawset(L, -3);
+            if (!skip_white(P, &p)) {
+                lua_pop(L, 1);
+                return unterminated(P, what, start);
+            }
+        } else {
+            n++;
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+            } else {
+                lua_rawseti(L, -2, n);
+            }
+        }
+        if (P->s[p] == ',') {
+            p++;
+        }
+    }
+}
+
+// Lazy arrays are tables whose elements past the first lazy_min are decoded from the source on
+// first access. The LazyArray userdata holds the offsets of those elements; its user value is the configuration table
+// { source, nullval, objectmeta, arraymeta, lazy_min }.
+
+static void parser_from_config(lua_State *L, Parser *P, int config) {
+    memset(P, 0, sizeof(*P));
+    P->L = L;
+    lua_rawgeti(L, config, 1);
+    P->s = lua_tolstring(L, -1, &P->len);
+    lua_rawgeti(L, config, 2);
+    P->nullval = lua_gettop(L);
+    lua_rawgeti(L, config, 3);
+    P->objectmeta = lua_gettop(L);
+    lua_rawgeti(L, config, 4);
+    P->arraymeta = lua_gettop(L);
+    lua_rawgeti(L, config, 5);
+    P->lazy_min = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    P->lazy_config = config;
+}
+
+// Decodes element `index` (1-based) of the lazy array at `array` and stores it. Pushes the value.
+static void lazy_load(lua_State *L, int array, LazyArray *lazy, int config, size_t index) {
+    int top = lua_gettop(L);
+    Parser P;
+    parser_from_config(L, &P, config);
+    size_t next;
+    if (decode_value(&P, lazy->offsets[index - lazy->first - 1], &next) != 0) {
+        luaL_error(L, "%s", P.err);
+    }
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, array, (int)index);
+    lua_replace(L, top + 1);
+    lua_settop(L, top + 1);
+}
+
+static LazyArray *lazy_state(lua_State *L, int *config) {
+    LazyArray *lazy = lua_touserdata(L, lua_upvalueindex(1));
+    lua_getuservalue(L, lua_upvalueindex(1));
+    *config = lua_gettop(L);
+    return lazy;
+}
+
+static int LazyArray_index(lua_State *L) {
+    int config;
+    LazyArray *lazy = lazy_state(L, &config);
+    int isnum;
+    lua_Number key = lua_tonumberx(L, 2, &isnum);
+    if (!isnum || key <= (lua_Number)lazy->first || key > (lua_Number)lazy->count || floor(key) != key) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lazy_load(L, 1, lazy, config, (size_t)key);
+    return 1;
+}
+
+static int LazyArray_len(lua_State *L) {
+    int config;
+    LazyArray *lazy = lazy_state(L, &config);
+    lua_pushinteger(L, (lua_Integer)lazy->count);
+    return 1;
+}
+
+static int LazyArray_inext(lua_State *L) {
+    lua_Integer i = luaL_checkinteger(L, 2) + 1;
+    lua_pushinteger(L, i);
+    lua_pushinteger(L, i);
+    lua_gettable(L, 1);
+    return lua_isnil(L, -1) ? 1 : 2;
+}
+
+static int LazyArray_ipairs(lua_State *L) {
+    lua_pushcfunction(L, LazyArray_inext);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    return 3;
+}
+
+// pairs() has to see every element, so the whole array is decoded first.
+static int LazyArray_pairs(lua_State *L) {
+    int config;
+    LazyArray *lazy = lazy_state(L, &config);
+    for (size_t i = lazy->first + 1; i <= lazy->count; i++) {
+        lua_rawgeti(L, 1, (int)i);
+        int missing = lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if (missing) {
+            lazy_load(L, 1, lazy, config, i);
+            lua_pop(L, 1);
+        }
+    }
+    lua_getglobal(L, "next");
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+// Turns the array on top of the stack, which holds its first `first` elements, into a lazy array
+// with `rest` more elements at `offsets`.
+static void make_lazy(Parser *P, size_t first, const size_t *offsets, size_t rest) {
+    lua_State *L = P->L;
+    LazyArray *lazy = lua_newuserdata(L, sizeof(LazyArray) + (rest - 1) * sizeof(size_t));
+    lazy->first = first;
+    lazy->count = first + rest;
+    memcpy(lazy->offsets, offsets, rest * sizeof(size_t));
+    luaL_setmetatable(L, LAZY_ARRAY_TYPE);
+    lua_pushvalue(L, P->lazy_config);
+    lua_setuservalue(L, -2);
+
+    // Each lazy array gets its own metatable: the array metatable's fields plus the accessors.
+    lua_newtable(L);
+    if (P->arraymeta != 0 && lua_istable(L, P->arraymeta)) {
+        lua_pushnil(L);
+        while (lua_next(L, P->arraymeta) != 0) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -4);
+        }
+    }
+    static const luaL_Reg methods[] = {
+        {"__index", LazyArray_index},
+        {"__len", LazyArray_len},
+        {"__ipairs", LazyArray_ipairs},
+        {"__pairs", LazyArray_pairs},
+        {NULL, NULL},
+    };
+    lua_pushvalue(L, -2);
+    luaL_setfuncs(L, methods, 1);
+    lua_remove(L, -2);
+    lua_setmetatable(L, -2);
+}
+
+static int decode(lua_State *L, int lazy_min) {
+    size_t len;
+    const char *s = luaL_checklstring(L, 1, &len);
+    lua_Integer pos = luaL_optinteger(L, 2, 1);
+    int nargs = lua_gettop(L);
+    lua_settop(L, 5);
+
+    Parser P;
+    memset(&P, 0, sizeof(P));
+    P.L = L;
+    P.s = s;
+    P.len = len;
+    P.nullval = 3;
+    P.lazy_min = lazy_min;
+    if (nargs >= 4) {
+        P.objectmeta = 4;
+        P.arraymeta = 5;
+    } else {
+        // Like dkjson, each decode shares one fresh metatable per kind.
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "object");
+        lua_setfield(L, -2, "__jsontype");
+        lua_replace(L, 4);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "array");
+        lua_setfield(L, -2, "__jsontype");
+        lua_replace(L, 5);
+        P.objectmeta = 4;
+        P.arraymeta = 5;
+    }
+    if (lazy_min > 0) {
+        lua_createtable(L, 5, 0);
+        lua_pushvalue(L, 1);
+        lua_rawseti(L, -2, 1);
+        for (int i = 3; i <= 5; i++) {
+            lua_pushvalue(L, i);
+            lua_rawseti(L, -2, i - 1);
+        }
+        lua_pushinteger(L, lazy_min);
+        lua_rawseti(L, -2, 5);
+        P.lazy_config = lua_gettop(L);
+    }
+
+    size_t start = pos > 0 ? (size_t)(pos - 1) : 0;
+    size_t next;
+    if (start > len || decode_value(&P, start, &next) != 0) {
+        if (start > len) {
+            snprintf(P.err, sizeof(P.err), "no valid JSON value (reached the end)");
+            P.err_pos = len;
+        }
+        lua_pushnil(L);
+        lua_pushinteger(L, (lua_Integer)P.err_pos + 1);
+        lua_pushstring(L, P.err);
+        return 3;
+    }
+    lua_pushinteger(L, (lua_Integer)next + 1);
+    return 2;
+}
+
+// JsonDecode(str[, pos[, nullval[, objectmeta, arraymeta]]]) has dkjson.decode's contract: the
+// value and the position after it, or nil, the error position and a message.
+static int JsonDecode(lua_State *L) {
+    return decode(L, 0);
+}
+
+// JsonDecodeLazy(str[, minLength]) decodes the elements of arrays past the first minLength
+// (default 64) only when they are accessed. Lazy arrays support indexing, #, ipairs and pairs; raw
+// access (rawget, table.sort, table.concat) does not see elements that were not read yet.
+static int JsonDecodeLazy(lua_State *L) {
+    int lazy_min = luaL_optint(L, 2, 64);
+    luaL_argcheck(L, lazy_min > 0, 2, "minLength must be positive");
+    lua_settop(L, 1);
+    return decode(L, lazy_min);
+}
+
+static void append(const char *s, size_t len) {
+    byte_buffer_append(&st_output, s, len);
+}
+
+static void append_number(double value) {
+    if (value != value || value >= HUGE_VAL || -value >= HUGE_VAL) {
+        append("null", 4);
+        return;
+    }
+    char text[64];
+    int len = snprintf(text, sizeof(text), "%.14g", value);
+    append(text, (size_t)len);
+}
+
+// dkjson's quotestring: control characters, '"', '\\', DEL and a few invisible or line-breaking
+// code points are escaped, everything else is copied as is.
+static size_t escape_length(const unsigned char *s, size_t avail) {
+    unsigned char c = s[0];
+    if (c < 0x20 || c == '"' || c == '\\' || c == 0x7f) {
+        return 1;
+    }
+    if (avail < 2) {
+        return 0;
+    }
+    unsigned char c1 = s[1];
+    switch (c) {
+        case 0xc2: return (c1 >= 0x80 && c1 <= 0x9f) || c1 == 0xad ? 2 : 0;
+        case 0xd8: return c1 >= 0x80 && c1 <= 0x84 ? 2 : 0;
+        case 0xdc: return c1 == 0x8f ? 2 : 0;
+        default: break;
+    }
+    if (avail < 3) {
+        return 0;
+    }
+    unsigned char c2 = s[2];
+    switch (c) {
+        case 0xe1: return c1 == 0x9e && (c2 == 0xb4 || c2 == 0xb5) ? 3 : 0;
+        case 0xe2:
+            if (c1 == 0x80 && ((c2 >= 0x8c && c2 <= 0x8f) || (c2 >= 0xa8 && c2 <= 0xaf))) {
+                return 3;
+            }
+            return c1 == 0x81 && c2 >= 0xa0 && c2 <= 0xaf ? 3 : 0;
+        case 0xef:
+            if (c1 == 0xbb && c2 == 0xbf) {
+                return 3;
+            }
+            return c1 == 0xbf && c2 >= 0xb0 ? 3 : 0;
+        default: return 0;
+    }
+}
+
+static void append_escape(const unsigned char *s, size_t len) {
+    char text[8];
+    switch (len == 1 ? s[0] : 0) {
+        case '"': append("\\\"", 2); return;
+        case '\\': append("\\\\", 2); return;
+        case '\b': append("\\b", 2); return;
+        case '\f': append("\\f", 2); return;
+        case '\n': append("\\n", 2); return;
+        case '\r': append("\\r", 2); return;
+        case '\t': append("\\t", 2); return;
+        default: break;
+    }
+    unsigned int code = len == 1 ? s[0]
+                      : len == 2 ? ((s[0] & 0x1fu) << 6) | (s[1] & 0x3fu)
+                      : ((s[0] & 0x0fu) << 12) | ((s[1] & 0x3fu) << 6) | (s[2] & 0x3fu);
+    snprintf(text, sizeof(text), "\\u%.4x", code);
+    append(text, 6);
+}
+
+static void append_string(const char *s, size_t len) {
+    const unsigned char *u = (const unsigned char *)s;
+    append("\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < len;) {
+        size_t escape = (u[i] < 0x20 || u[i] == '"' || u[i] == '\\' || u[i] >= 0x7f) ? escape_length(u + i, len - i) : 0;
+        if (escape == 0) {
+            i++;
+            continue;
+        }
+        append(s + run, i - run);
+        append_escape(u + i, escape);
+        i += escape;
+        run = i;
+    }
+    append(s + run, len - run);
+    append("\"", 1);
+}
+
+// Returns 1 if dkjson would leave this table to a hook the native encoder does not implement.
+static int needs_lua(lua_State *L, int index) {
+    if (!lua_getmetatable(L, index)) {
+        return 0;
+    }
+    static const char *const hooks[] = {"__tojson", "__jsonorder", "__pairs", "__index"};
+    for (size_t i = 0; i < sizeof(hooks) / sizeof(hooks[0]); i++) {
+        lua_getfield(L, -1, hooks[i]);
+        int present = !lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if (present) {
+            lua_pop(L, 1);
+            return 1;
+        }
+    }
+    lua_getfield(L, -1, "__jsontype");
+    return -1;
+}
+
+// Returns 0 on success, -1 when the value has to be encoded by dkjson instead.
+static int encode_value(lua_State *L, int index, int depth) {
+    switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            append("null", 4);
+            return 0;
+        case LUA_TBOOLEAN:
+            lua_toboolean(L, index) ? append("true", 4) : append("false", 5);
+            return 0;
+        case LUA_TNUMBER:
+            append_number(lua_tonumber(L, index));
+            return 0;
+        case LUA_TSTRING: {
+            size_t len;
+            const char *s = lua_tolstring(L, index, &len);
+            append_string(s, len);
+            return 0;
+        }
+        case LUA_TTABLE:
+            break;
+        default:
+            return -1;
+    }
+    if (depth > JSON_MAX_DEPTH) {
+        return -1;
+    }
+    luaL_checkstack(L, 6, "JSON nesting");
+    int top = lua_gettop(L);
+    int meta = needs_lua(L, index);
+    if (meta > 0) {
+        return -1;
+    }
+    int object_type = meta < 0 && lua_type(L, -1) == LUA_TSTRING && strcmp(lua_tostring(L, -1), "object") == 0;
+    lua_settop(L, top);
+
+    // dkjson's isarray(): positive integer keys only (plus a numeric "n"), and not too sparse.
+    double max = 0, arraylen = 0;
+    size_t n = 0;
+    int is_array = 1;
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        if (lua_type(L, -2) == LUA_TSTRING && lua_type(L, -1) == LUA_TNUMBER) {
+            size_t klen;
+            const char *k = lua_tolstring(L, -2, &klen);
+            if (klen == 1 && k[0] == 'n') {
+                arraylen = lua_tonumber(L, -1);
+                if (arraylen > max) {
+                    max = arraylen;
+                }
+                lua_pop(L, 1);
+                continue;
+            }
+        }
+        double k = lua_type(L, -2) == LUA_TNUMBER ? lua_tonumber(L, -2) : 0;
+        lua_pop(L, 1);
+        if (k < 1 || floor(k) != k) {
+            is_array = 0;
+            lua_pop(L, 1);
+            break;
+        }
+        if (k > max) {
+            max = k;
+        }
+        n++;
+    }
+    if (is_array && max > 10 && max > arraylen && max > (double)n * 2) {
+        is_array = 0;
+    }
+    if (is_array && max == 0 && object_type) {
+        is_array = 0;
+    }
+
+    if (is_array) {
+        append("[", 1);
+        for (double i = 1; i <= max; i++) {
+            lua_rawgeti(L, index, (int)i);
+            if (encode_value(L, lua_gettop(L), depth + 1) != 0) {
+                return -1;
+            }
+            lua_pop(L, 1);
+            if (i < max) {
+                append(",", 1);
+            }
+        }
+        append("]", 1);
+        return 0;
+    }
+
+    append("{", 1);
+    int first = 1;
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        int key_type = lua_type(L, -2);
+        if (key_type != LUA_TSTRING && key_type != LUA_TNUMBER) {
+            return -1;
+        }
+        if (!first) {
+            append(",", 1);
+        }
+        first = 0;
+        if (key_type == LUA_TNUMBER) {
+            char text[64];
+            int len = snprintf(text, sizeof(text), "%.14g", lua_tonumber(L, -2));
+            append_string(text, (size_t)len);
+        } else {
+            size_t klen;
+            const char *k = lua_tolstring(L, -2, &klen);
+            append_string(k, klen);
+        }
+        append(":", 1);
+        if (encode_value(L, lua_gettop(L), depth + 1) != 0) {
+            return -1;
+        }
+        lua_pop(L, 1);
+    }
+    append("}", 1);
+    return 0;
+}
+
+// JsonEncode(value) returns the JSON text, or false when dkjson.encode has to handle the value
+// (hooks, reference cycles or unsupported types, which dkjson reports as errors).
+static int JsonEncode(lua_State *L) {
+    luaL_checkany(L, 1);
+    lua_settop(L, 1);
+    st_output.size = 0;
+    if (encode_value(L, 1, 0) != 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_pushlstring(L, (const char *)st_output.data, st_output.size);
+    return 1;
+}
+
+void json_init(lua_State *L) {
+    luaL_newmetatable(L, LAZY_ARRAY_TYPE);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, JsonDecode);
+    lua_setglobal(L, "JsonDecode");
+
+    lua_pushcfunction(L, JsonDecodeLazy);
+    lua_setglobal(L, "JsonDecodeLazy");
+
+    lua_pushcfunction(L, JsonEncode);
+    lua_setglobal(L, "JsonEncode");
+}
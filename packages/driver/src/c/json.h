@@ -0,0 +1,9 @@
+#ifndef DRIVER_JSON_H
+#define DRIVER_JSON_H
+
+#include "lua.h"
+
+// Registers JsonDecode/JsonDecodeLazy/JsonEncode, native versions of dkjson's decode and encode.
+extern void json_init(lua_State *L);
+
+#endif //DRIVER_JSON_H
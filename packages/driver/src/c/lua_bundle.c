@@ -0,0 +1,205 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lundump.h"
+#include "lua_bundle.h"
+#include "lua_bundle_format.h"
+#include "trace.h"
+#include "util.h"
+
+static LuaBundle st_bundle;
+
+// Bundle entries are keyed by their path inside root.zip.
+static const LuaBundleEntry *find_entry(const char *filename) {
+    static const char root[] = "/app/root/";
+    if (filename == NULL) {
+        return NULL;
+    }
+    if (strncmp(filename, root, sizeof(root) - 1) == 0) {
+        filename += sizeof(root) - 1;
+    }
+    while (filename[0] == '.' && filename[1] == '/') {
+        filename += 2;
+    }
+    return lua_bundle_find(&st_bundle, filename, strlen(filename));
+}
+
+static int load_entry(lua_State *L, const LuaBundleEntry *entry, const char *filename) {
+    ByteBuffer buffer = {0};
+    int span = trace_begin(TRACE_MODULE_READ, filename, entry->size);
+    LuaBundleStatus status = lua_bundle_read(&st_bundle, entry, &buffer);
+    trace_end(span);
+    if (status != LUA_BUNDLE_OK) {
+        byte_buffer_free(&buffer);
+        lua_pushfstring(L, "cannot load %s from bundle: %s", filename, lua_bundle_status_string(status));
+        return LUA_ERRFILE;
+    }
+    span = trace_begin(TRACE_MODULE_COMPILE, filename, buffer.size);
+    lua_pushfstring(L, "@%s", filename);
+    int ret = luaL_loadbufferx(L, (const char *)buffer.data, buffer.size, lua_tostring(L, -1), "b");
+    lua_remove(L, -2);
+    trace_end(span);
+    byte_buffer_free(&buffer);
+    return ret;
+}
+
+static int call_original(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+static int BundleLoadfile(lua_State *L) {
+    const char *filename = luaL_optstring(L, 1, NULL);
+    const char *mode = luaL_optstring(L, 2, NULL);
+    const LuaBundleEntry *entry = mode == NULL || strchr(mode, 'b') != NULL ? find_entry(filename) : NULL;
+    if (entry == NULL) {
+        return call_original(L);
+    }
+
+    int env = !lua_isnone(L, 3) ? 3 : 0;
+    if (load_entry(L, entry, filename) != LUA_OK) {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    if (env != 0) {
+        lua_pushvalue(L, env);
+        if (!lua_setupvalue(L, -2, 1)) {
+            lua_pop(L, 1);
+        }
+    }
+    return 1;
+}
+
+static int BundleDofile(lua_State *L) {
+    const char *filename = luaL_optstring(L, 1, NULL);
+    lua_settop(L, 1);
+    const LuaBundleEntry *entry = find_entry(filename);
+    if (entry == NULL) {
+        return call_original(L);
+    }
+
+    if (load_entry(L, entry, filename) != LUA_OK) {
+        return lua_error(L);
+    }
+    lua_call(L, 0, LUA_MULTRET);
+    return lua_gettop(L) - 1;
+}
+
+static const char *push_next_template(lua_State *L, const char *path) {
+    while (*path == *LUA_PATH_SEP) {
+        path++;
+    }
+    if (*path == '\0') {
+        return NULL;
+    }
+    const char *end = strchr(path, *LUA_PATH_SEP);
+    if (end == NULL) {
+        end = path + strlen(path);
+    }
+    lua_pushlstring(L, path, end - path);
+    return end;
+}
+
+// package.searchers entry placed right after the preload searcher.
+static int BundleSearcher(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    const char *path = lua_tostring(L, -1);
+    if (path == NULL) {
+        return 0;
+    }
+    name = luaL_gsub(L, name, ".", LUA_DIRSEP);
+
+    int top = lua_gettop(L);
+    while ((path = push_next_template(L, path)) != NULL) {
+        const char *filename = luaL_gsub(L, lua_tostring(L, -1), LUA_PATH_MARK, name);
+        const LuaBundleEntry *entry = find_entry(filename);
+        if (entry != NULL) {
+            if (load_entry(L, entry, filename) != LUA_OK) {
+                return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                                  lua_tostring(L, 1), filename, lua_tostring(L, -1));
+            }
+            lua_pushstring(L, filename);
+            return 2;
+        }
+        lua_settop(L, top);
+    }
+    lua_pushfstring(L, "\n\tno bundle entry for '%s'", lua_tostring(L, 1));
+    return 1;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *data = malloc(st.st_size ? st.st_size : 1);
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + total, st.st_size - total);
+        if (n <= 0) {
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        total += n;
+    }
+    close(fd);
+    *size = total;
+    return data;
+}
+
+int lua_bundle_init(lua_State *L, const char *path) {
+    size_t size = 0;
+    int span = trace_begin(TRACE_MODULE_READ, path, 0);
+    uint8_t *data = read_file(path, &size);
+    trace_set_bytes(span, size);
+    trace_end(span);
+    if (data == NULL) {
+        return 1;
+    }
+
+    lu_byte stamp[LUAC_HEADERSIZE];
+    luaU_header(stamp);
+    LuaBundleStatus status = lua_bundle_parse(&st_bundle, data, size, stamp, sizeof(stamp));
+    if (status != LUA_BUNDLE_OK) {
+        log_error("Ignoring Lua bundle %s: %s", path, lua_bundle_status_string(status));
+        lua_bundle_free(&st_bundle);
+        return 1;
+    }
+
+    lua_getglobal(L, "loadfile");
+    lua_pushcclosure(L, BundleLoadfile, 1);
+    lua_setglobal(L, "loadfile");
+
+    lua_getglobal(L, "dofile");
+    lua_pushcclosure(L, BundleDofile, 1);
+    lua_setglobal(L, "dofile");
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    for (int i = (int)luaL_len(L, -1); i >= 2; i--) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushcfunction(L, BundleSearcher);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 2);
+
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef DRIVER_LUA_BUNDLE_H
+#define DRIVER_LUA_BUNDLE_H
+
+#include "lua.h"
+
+// Mounts the precompiled bundle at path and routes loadfile, dofile and require through it.
+// Returns 0 when the bundle is active; without one the stock loaders are left untouched.
+int lua_bundle_init(lua_State *L, const char *path);
+
+#endif //DRIVER_LUA_BUNDLE_H
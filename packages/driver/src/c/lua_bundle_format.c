@@ -0,0 +1,244 @@
+#include "lua_bundle_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void append_u32(ByteBuffer *buffer, uint32_t value) {
+    uint8_t bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff};
+    byte_buffer_append(buffer, bytes, sizeof(bytes));
+}
+
+static void append_u16(ByteBuffer *buffer, uint16_t value) {
+    uint8_t bytes[2] = {value & 0xff, (value >> 8) & 0xff};
+    byte_buffer_append(buffer, bytes, sizeof(bytes));
+}
+
+static int compare_names(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int result = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (result != 0) {
+        return result;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+LuaBundleStatus lua_bundle_parse(LuaBundle *bundle, uint8_t *data, size_t size, const void *stamp, size_t stamp_size) {
+    *bundle = (LuaBundle){.data = data, .size = size};
+
+    if (size < LUA_BUNDLE_HEADER_SIZE || memcmp(data, LUA_BUNDLE_MAGIC, 4) != 0) {
+        return LUA_BUNDLE_ERROR_FORMAT;
+    }
+    if (read_u32(data + 4) != LUA_BUNDLE_VERSION) {
+        return LUA_BUNDLE_ERROR_VERSION;
+    }
+    uint32_t flags = read_u32(data + 8);
+    uint32_t bundle_stamp_size = read_u32(data + 12);
+    uint32_t count = read_u32(data + 16);
+    uint32_t index_size = read_u32(data + 20);
+
+    size_t remaining = size - LUA_BUNDLE_HEADER_SIZE;
+    if (bundle_stamp_size > remaining || index_size > remaining - bundle_stamp_size) {
+        return LUA_BUNDLE_ERROR_FORMAT;
+    }
+    const uint8_t *p = data + LUA_BUNDLE_HEADER_SIZE;
+    if (bundle_stamp_size != stamp_size || memcmp(p, stamp, stamp_size) != 0) {
+        return LUA_BUNDLE_ERROR_STAMP;
+    }
+    p += bundle_stamp_size;
+
+    const uint8_t *index_end = p + index_size;
+    const uint8_t *blob = index_end;
+    size_t blob_size = size - (size_t)(blob - data);
+
+    // Every entry takes at least 14 bytes, which bounds the allocation below.
+    if (count > index_size / 14) {
+        return LUA_BUNDLE_ERROR_FORMAT;
+    }
+    LuaBundleEntry *entries = calloc(count ? count : 1, sizeof(LuaBundleEntry));
+    for (uint32_t i = 0; i < count; i++) {
+        if (index_end - p < 14) {
+            free(entries);
+            return LUA_BUNDLE_ERROR_FORMAT;
+        }
+        LuaBundleEntry *entry = &entries[i];
+        entry->offset = read_u32(p);
+        entry->size = read_u32(p + 4);
+        entry->raw_size = read_u32(p + 8);
+        entry->name_len = read_u16(p + 12);
+        p += 14;
+        if ((size_t)(index_end - p) < entry->name_len ||
+            entry->offset > blob_size || entry->size > blob_size - entry->offset) {
+            free(entries);
+            return LUA_BUNDLE_ERROR_FORMAT;
+        }
+        entry->name = (const char *)p;
+        p += entry->name_len;
+
+        // Lookups use binary search, so the index must be strictly ordered.
+        if (i > 0 && compare_names(entries[i - 1].name, entries[i - 1].name_len, entry->name, entry->name_len) >= 0) {
+            free(entries);
+            return LUA_BUNDLE_ERROR_FORMAT;
+        }
+    }
+
+    bundle->flags = flags;
+    bundle->entries = entries;
+    bundle->count = count;
+    bundle->blob = blob;
+    bundle->blob_size = blob_size;
+    return LUA_BUNDLE_OK;
+}
+
+const LuaBundleEntry *lua_bundle_find(const LuaBundle *bundle, const char *name, size_t name_len) {
+    uint32_t lo = 0;
+    uint32_t hi = bundle->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const LuaBundleEntry *entry = &bundle->entries[mid];
+        int result = compare_names(name, name_len, entry->name, entry->name_len);
+        if (result == 0) {
+            return entry;
+        }
+        if (result < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+LuaBundleStatus lua_bundle_read(const LuaBundle *bundle, const LuaBundleEntry *entry, ByteBuffer *out) {
+    const uint8_t *chunk = bundle->blob + entry->offset;
+    if (!(bundle->flags & LUA_BUNDLE_FLAG_DEFLATE)) {
+        byte_buffer_append(out, chunk, entry->size);
+        return LUA_BUNDLE_OK;
+    }
+
+    size_t start = out->size;
+    if (out->capacity - out->size < entry->raw_size) {
+        out->capacity = out->size + entry->raw_size;
+        out->data = realloc(out->data, out->capacity ? out->capacity : 1);
+    }
+    uLongf dest_len = entry->raw_size;
+    int ret = uncompress(out->data + start, &dest_len, chunk, entry->size);
+    if (ret != Z_OK || dest_len != entry->raw_size) {
+        return LUA_BUNDLE_ERROR_DATA;
+    }
+    out->size = start + dest_len;
+    return LUA_BUNDLE_OK;
+}
+
+void lua_bundle_free(LuaBundle *bundle) {
+    free(bundle->entries);
+    free(bundle->data);
+    *bundle = (LuaBundle){0};
+}
+
+void lua_bundle_writer_init(LuaBundleWriter *writer, uint32_t flags) {
+    *writer = (LuaBundleWriter){.flags = flags};
+}
+
+LuaBundleStatus lua_bundle_writer_add(LuaBundleWriter *writer, const char *name, const void *data, size_t size) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > UINT16_MAX || size > UINT32_MAX) {
+        return LUA_BUNDLE_ERROR_FORMAT;
+    }
+
+    uint32_t offset = (uint32_t)writer->blob.size;
+    if (writer->flags & LUA_BUNDLE_FLAG_DEFLATE) {
+        uLongf bound = compressBound(size);
+        uint8_t *compressed = malloc(bound);
+        if (compress2(compressed, &bound, data, size, Z_BEST_COMPRESSION) != Z_OK) {
+            free(compressed);
+            return LUA_BUNDLE_ERROR_DATA;
+        }
+        byte_buffer_append(&writer->blob, compressed, bound);
+        free(compressed);
+    } else {
+        byte_buffer_append(&writer->blob, data, size);
+    }
+
+    if (writer->count == writer->capacity) {
+        writer->capacity = writer->capacity ? writer->capacity * 2 : 64;
+        writer->entries = realloc(writer->entries, writer->capacity * sizeof(LuaBundleWriterEntry));
+    }
+    LuaBundleWriterEntry *entry = &writer->entries[writer->count++];
+    entry->name = strdup(name);
+    entry->offset = offset;
+    entry->size = (uint32_t)writer->blob.size - offset;
+    entry->raw_size = (uint32_t)size;
+    return LUA_BUNDLE_OK;
+}
+
+static int compare_writer_entries(const void *a, const void *b) {
+    const LuaBundleWriterEntry *ea = a;
+    const LuaBundleWriterEntry *eb = b;
+    return compare_names(ea->name, strlen(ea->name), eb->name, strlen(eb->name));
+}
+
+LuaBundleStatus lua_bundle_writer_finish(LuaBundleWriter *writer, const void *stamp, size_t stamp_size, ByteBuffer *out) {
+    qsort(writer->entries, writer->count, sizeof(LuaBundleWriterEntry), compare_writer_entries);
+
+    ByteBuffer index = {0};
+    for (uint32_t i = 0; i < writer->count; i++) {
+        const LuaBundleWriterEntry *entry = &writer->entries[i];
+        if (i > 0 && strcmp(writer->entries[i - 1].name, entry->name) == 0) {
+            byte_buffer_free(&index);
+            return LUA_BUNDLE_ERROR_DUPLICATE;
+        }
+        size_t name_len = strlen(entry->name);
+        append_u32(&index, entry->offset);
+        append_u32(&index, entry->size);
+        append_u32(&index, entry->raw_size);
+        append_u16(&index, (uint16_t)name_len);
+        byte_buffer_append(&index, entry->name, name_len);
+    }
+
+    byte_buffer_append(out, LUA_BUNDLE_MAGIC, 4);
+    append_u32(out, LUA_BUNDLE_VERSION);
+    append_u32(out, writer->flags);
+    append_u32(out, (uint32_t)stamp_size);
+    append_u32(out, writer->count);
+    append_u32(out, (uint32_t)index.size);
+    byte_buffer_append(out, stamp, stamp_size);
+    byte_buffer_append(out, index.data, index.size);
+    byte_buffer_append(out, writer->blob.data, writer->blob.size);
+    byte_buffer_free(&index);
+    return LUA_BUNDLE_OK;
+}
+
+void lua_bundle_writer_free(LuaBundleWriter *writer) {
+    for (uint32_t i = 0; i < writer->count; i++) {
+        free(writer->entries[i].name);
+    }
+    free(writer->entries);
+    byte_buffer_free(&writer->blob);
+    *writer = (LuaBundleWriter){0};
+}
+
+const char *lua_bundle_status_string(LuaBundleStatus status) {
+    switch (status) {
+        case LUA_BUNDLE_OK:
+            return "ok";
+        case LUA_BUNDLE_ERROR_FORMAT:
+            return "malformed bundle";
+        case LUA_BUNDLE_ERROR_VERSION:
+            return "unsupported bundle version";
+        case LUA_BUNDLE_ERROR_STAMP:
+            return "bytecode stamp does not match this driver";
+        case LUA_BUNDLE_ERROR_DUPLICATE:
+            return "duplicate bundle entry";
+        case LUA_BUNDLE_ERROR_DATA:
+            return "corrupt bundle entry";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,78 @@
+#ifndef DRIVER_LUA_BUNDLE_FORMAT_H
+#define DRIVER_LUA_BUNDLE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "byte_buffer.h"
+
+// Precompiled Lua bundle produced by the packer (see luac.c).
+//
+// Layout, all integers little-endian:
+//   "PLBC" u32 version u32 flags u32 stamp_size u32 entry_count u32 index_size
+//   stamp[stamp_size]                  Lua bytecode header of the compiler
+//   index[index_size]                  entries sorted by name:
+//                                      u32 offset u32 size u32 raw_size u16 name_len name
+//   blob                               concatenated chunks
+#define LUA_BUNDLE_MAGIC "PLBC"
+#define LUA_BUNDLE_VERSION 1
+#define LUA_BUNDLE_HEADER_SIZE 24
+
+// Each chunk is a separate zlib stream.
+#define LUA_BUNDLE_FLAG_DEFLATE 1u
+
+typedef enum {
+    LUA_BUNDLE_OK,
+    LUA_BUNDLE_ERROR_FORMAT,
+    LUA_BUNDLE_ERROR_VERSION,
+    LUA_BUNDLE_ERROR_STAMP,
+    LUA_BUNDLE_ERROR_DUPLICATE,
+    LUA_BUNDLE_ERROR_DATA,
+} LuaBundleStatus;
+
+typedef struct {
+    const char *name;
+    uint16_t name_len;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t raw_size;
+} LuaBundleEntry;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t flags;
+    LuaBundleEntry *entries;
+    uint32_t count;
+    const uint8_t *blob;
+    size_t blob_size;
+} LuaBundle;
+
+typedef struct {
+    char *name;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t raw_size;
+} LuaBundleWriterEntry;
+
+typedef struct {
+    uint32_t flags;
+    LuaBundleWriterEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    ByteBuffer blob;
+} LuaBundleWriter;
+
+// Takes ownership of data; it is released by lua_bundle_free even when parsing fails.
+LuaBundleStatus lua_bundle_parse(LuaBundle *bundle, uint8_t *data, size_t size, const void *stamp, size_t stamp_size);
+const LuaBundleEntry *lua_bundle_find(const LuaBundle *bundle, const char *name, size_t name_len);
+LuaBundleStatus lua_bundle_read(const LuaBundle *bundle, const LuaBundleEntry *entry, ByteBuffer *out);
+void lua_bundle_free(LuaBundle *bundle);
+
+void lua_bundle_writer_init(LuaBundleWriter *writer, uint32_t flags);
+LuaBundleStatus lua_bundle_writer_add(LuaBundleWriter *writer, const char *name, const void *data, size_t size);
+LuaBundleStatus lua_bundle_writer_finish(LuaBundleWriter *writer, const void *stamp, size_t stamp_size, ByteBuffer *out);
+void lua_bundle_writer_free(LuaBundleWriter *writer);
+
+const char *lua_bundle_status_string(LuaBundleStatus status);
+
+#endif //DRIVER_LUA_BUNDLE_FORMAT_H
@@ -0,0 +1,103 @@
+// Bytecode compiler used by the packer to build .lua.bundle.
+// It is built from the same Lua sources and flags as the driver, so the
+// bytecode stamp it writes is exactly the one the driver expects.
+#define LUA_CORE
+
+#include <stdlib.h>
+#include <string.h>
+#include <emscripten.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lundump.h"
+#include "byte_buffer.h"
+#include "lua_bundle_format.h"
+
+static lua_State *st_state;
+static LuaBundleWriter st_writer;
+static ByteBuffer st_output;
+static char *st_error;
+static int st_strip;
+
+static void set_error(const char *message) {
+    free(st_error);
+    st_error = strdup(message);
+}
+
+static int write_chunk(lua_State *L, const void *p, size_t size, void *ud) {
+    (void)L;
+    byte_buffer_append(ud, p, size);
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void luac_begin(int deflate, int strip) {
+    if (st_state != NULL) {
+        lua_close(st_state);
+    }
+    lua_bundle_writer_free(&st_writer);
+    byte_buffer_free(&st_output);
+
+    st_state = luaL_newstate();
+    st_strip = strip;
+    lua_bundle_writer_init(&st_writer, deflate ? LUA_BUNDLE_FLAG_DEFLATE : 0);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int luac_add(const char *name, const char *source, size_t size) {
+    lua_State *L = st_state;
+
+    lua_pushfstring(L, "@%s", name);
+    int ret = luaL_loadbufferx(L, source, size, lua_tostring(L, -1), "t");
+    lua_remove(L, -2);
+    if (ret != LUA_OK) {
+        set_error(lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return 1;
+    }
+
+    ByteBuffer chunk = {0};
+    luaU_dump(L, getproto(L->top - 1), write_chunk, &chunk, st_strip);
+    lua_pop(L, 1);
+
+    LuaBundleStatus status = lua_bundle_writer_add(&st_writer, name, chunk.data, chunk.size);
+    byte_buffer_free(&chunk);
+    if (status != LUA_BUNDLE_OK) {
+        set_error(lua_bundle_status_string(status));
+        return 1;
+    }
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int luac_finish() {
+    lu_byte stamp[LUAC_HEADERSIZE];
+    luaU_header(stamp);
+
+    LuaBundleStatus status = lua_bundle_writer_finish(&st_writer, stamp, sizeof(stamp), &st_output);
+    lua_bundle_writer_free(&st_writer);
+    lua_close(st_state);
+    st_state = NULL;
+    if (status != LUA_BUNDLE_OK) {
+        set_error(lua_bundle_status_string(status));
+        return 1;
+    }
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char *luac_error() {
+    return st_error;
+}
+
+EMSCRIPTEN_KEEPALIVE
+const uint8_t *luac_data() {
+    return st_output.data;
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t luac_size() {
+    return st_output.size;
+}
@@ -1,14 +1,10 @@
 #include "sub.h"
-#include "sub_serialization.h"
+#include "sub_lua.h"
 #include "lauxlib.h"
-#include "lualib.h"
-#include "lcurl.h"
 #include <emscripten.h>
 #include <assert.h>
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include <stdint.h>
 
 EM_JS(int, launch_sub_script, (const char *script, const char *funcs, const char *subs, size_t size, void *data), {
     try {
@@ -19,62 +15,8 @@ EM_JS(int, launch_sub_script, (const char *script, const char *funcs, const char
     }
 })
 
-static size_t lua_serialize(lua_State *L, int offset, uint8_t **serializedData) {
-    int n = lua_gettop(L);
-    size_t dataCount = n - offset + 1;
-    DataItem *data = (DataItem *)malloc(dataCount * sizeof(DataItem));
-    for (int i = 0; i < dataCount; ++i) {
-        switch (lua_type(L, i + offset)) {
-            case LUA_TNUMBER:
-                data[i].type = TYPE_DOUBLE;
-                data[i].value.doubleValue = lua_tonumber(L, i + offset);
-                break;
-            case LUA_TBOOLEAN:
-                data[i].type = TYPE_BOOLEAN;
-                data[i].value.intValue = lua_toboolean(L, i + offset);
-                break;
-            case LUA_TSTRING:
-                data[i].type = TYPE_STRING;
-                data[i].value.stringValue = lua_tostring(L, i + offset);
-                break;
-            case LUA_TNIL:
-                data[i].type = TYPE_STRING;
-                data[i].value.stringValue = NULL;
-                break;
-            default:
-                assert(0);
-        }
-    }
-    size_t dataSize = serialize(data, dataCount, serializedData);
-    free(data);
-    lua_settop(L, offset - 1);
-    return dataSize;
-}
-
-int sub_lua_deserialize(lua_State *L, const uint8_t *serializedData) {
-    int dataCount;
-    DataItem *data = deserialize(serializedData, &dataCount);
-    for (int i = 0; i < dataCount; ++i) {
-        lua_checkstack(L, 1);
-        switch (data[i].type) {
-            case TYPE_DOUBLE:
-                lua_pushnumber(L, data[i].value.doubleValue);
-                break;
-            case TYPE_BOOLEAN:
-                lua_pushboolean(L, data[i].value.intValue);
-                break;
-            case TYPE_STRING:
-                if (data[i].value.stringValue) {
-                    lua_pushstring(L, data[i].value.stringValue);
-                } else {
-                    lua_pushnil(L);
-                }
-                break;
-        }
-    }
-    free_deserialized_data(data, dataCount);
-    return dataCount;
-}
+// Arguments of the subscript being launched
+static ByteBuffer st_arguments;
 
 // Call from main worker
 static int LaunchSubScript(lua_State *L) {
@@ -88,17 +30,59 @@ static int LaunchSubScript(lua_State *L) {
     const char *funcs = lua_tostring(L, 2);
     const char *subs = lua_tostring(L, 3);
 
-    uint8_t *serializedData;
-    size_t dataSize = lua_serialize(L, 4, &serializedData);
+    st_arguments.size = 0;
+    if (sub_lua_serialize(L, &st_arguments, 4, 0) != 0) {
+        return lua_error(L);
+    }
 
-    int r = launch_sub_script(script, funcs, subs, dataSize, serializedData);
+    int r = launch_sub_script(script, funcs, subs, st_arguments.size, st_arguments.data);
     if (r > 0) {
         lua_pushlightuserdata(L, (void *)r);
     } else {
         lua_pushnil(L);
     }
 
-    free(serializedData);
+    return 1;
+}
+
+EM_JS(int, launch_sub_script_batch, (const char *script, int count, const uint32_t *sizes, size_t size, void *data), {
+    try {
+        const shards = Array.from(HEAPU32.subarray(sizes >> 2, (sizes >> 2) + count));
+        const args = [UTF8ToString(script), shards];
+        return Module.rpcCall("subscript_start_batch", args, HEAPU8.slice(data, data + size)).value;
+    } catch (e) {
+        console.error("launch_sub_script_batch error", e);
+        return 0;
+    }
+})
+
+// Call from main worker. LaunchSubScriptBatch(script, funcs, subs, shard...) runs the script once per
+// shard, spread over the sub workers. Each shard is a table whose sequence is passed as the script's
+// arguments. The batch has a single id: OnSubFinished(id, shard, ...) and OnSubError(id, message, shard)
+// are called once per shard, and AbortSubScript cancels the shards that have not finished yet.
+static int LaunchSubScriptBatch(lua_State *L) {
+    int n = lua_gettop(L);
+    const char *script = luaL_checkstring(L, 1);
+    luaL_checkstring(L, 2);
+    luaL_checkstring(L, 3);
+    int count = n - 3;
+    luaL_argcheck(L, count > 0, 4, "at least one shard expected");
+    for (int i = 4; i <= n; i++) {
+        luaL_checktype(L, i, LUA_TTABLE);
+    }
+
+    uint32_t *sizes = lua_newuserdata(L, sizeof(uint32_t) * count);
+    st_arguments.size = 0;
+    if (sub_lua_serialize_shards(L, &st_arguments, 4, count, sizes) != 0) {
+        return lua_error(L);
+    }
+
+    int r = launch_sub_script_batch(script, count, sizes, st_arguments.size, st_arguments.data);
+    if (r > 0) {
+        lua_pushlightuserdata(L, (void *)r);
+    } else {
+        lua_pushnil(L);
+    }
 
     return 1;
 }
@@ -134,130 +118,99 @@ static int IsSubScriptRunning(lua_State *L) {
     return 1;
 }
 
-// Call from main worker
-void sub_init(lua_State *L) {
-    // SubScript
-    lua_pushcclosure(L, LaunchSubScript, 0);
-    lua_setglobal(L, "LaunchSubScript");
-
-    lua_pushcclosure(L, AbortSubScript, 0);
-    lua_setglobal(L, "AbortSubScript");
+EM_JS(void, set_sub_script_shared_data, (const char *name, size_t size, void *data), {
+    Module.rpcCall("subscript_shared_data", [UTF8ToString(name)], data ? HEAPU8.slice(data, data + size) : undefined);
+})
 
-    lua_pushcclosure(L, IsSubScriptRunning, 0);
-    lua_setglobal(L, "IsSubScriptRunning");
-}
+// Call from main worker. SetSubScriptSharedData(name, table) publishes a read-only image of a table, such as
+// PoB's loaded game data, to the subscripts, which read it with GetSubScriptSharedData(name) instead of
+// building it again. Functions and other values that cannot be passed to a subscript are left out.
+// Passing nil withdraws the image. Each run still decodes the whole image into its own state, so a
+// larger image makes every subscript that reads it start later.
+static int SetSubScriptSharedData(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        set_sub_script_shared_data(name, 0, NULL);
+        return 0;
+    }
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
 
-static int panic_func(lua_State *L) {
-    const char *msg = lua_tostring(L, -1);
-    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg);
+    ByteBuffer image = {0};
+    if (sub_lua_serialize(L, &image, 2, SUB_LUA_SKIP_UNSUPPORTED) != 0) {
+        byte_buffer_free(&image);
+        return lua_error(L);
+    }
+    set_sub_script_shared_data(name, image.size, image.data);
+    byte_buffer_free(&image);
     return 0;
 }
 
-static int traceback (lua_State *L) {
-    if (!lua_isstring(L, 1))  /* 'message' not a string? */
-        return 1;  /* keep it intact */
-    lua_getglobal(L, "debug");
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        return 1;
-    }
-    lua_getfield(L, -1, "traceback");
-    if (!lua_isfunction(L, -1)) {
-        lua_pop(L, 2);
-        return 1;
-    }
-    lua_pushvalue(L, 1);  /* pass error message */
-    lua_pushinteger(L, 2);  /* skip this function and traceback */
-    lua_call(L, 2, 1);  /* call debug.traceback */
-    return 1;
+// Call from main worker. ConfigureSubScriptCache(script, ttl, persist) declares that `script` only
+// depends on its arguments, so later launches with the same arguments can be answered from the cache.
+// Results expire after `ttl` seconds (0 for never); with `persist` they are also kept on disk.
+static int ConfigureSubScriptCache(lua_State *L) {
+    const char *script = luaL_checkstring(L, 1);
+    lua_Number ttl = luaL_optnumber(L, 2, 0);
+    int persist = lua_toboolean(L, 3);
+    EM_ASM({
+        Module.rpcCall("subscript_cache_configure", [UTF8ToString($0), $1, !!$2]);
+    }, script, ttl, persist);
+    return 0;
 }
 
-// TODO: use main worker's ConPrintf
-static int ConPrintf(lua_State *L) {
-    int n = lua_gettop(L);
-    if (n < 1) {
-        return luaL_error(L, "ConPrintf needs at least one argument");
-    }
-
-    const char *fmt = luaL_checkstring(L, 1);
-
-    luaL_Buffer b;
-    luaL_buffinit(L, &b);
-
-    for (int i = 2; i <= n; i++) {
-        lua_pushvalue(L, i);
-        luaL_addvalue(&b);
-    }
-
-    luaL_pushresult(&b);
-    const char *args = lua_tostring(L, -1);
-
-    lua_getglobal(L, "string");
-    lua_getfield(L, -1, "format");
-    lua_remove(L, -2);  // remove the 'string' table from the stack
-
-    lua_pushstring(L, fmt);
-    lua_pushstring(L, args);
-
-    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
-        return luaL_error(L, "error calling 'string.format': %s", lua_tostring(L, -1));
-    }
-
-    const char *formatted = lua_tostring(L, -1);
-
-    lua_getglobal(L, "print");
-    lua_pushstring(L, formatted);
-
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
-        return luaL_error(L, "error calling 'print': %s", lua_tostring(L, -1));
-    }
-
+// Call from main worker. InvalidateSubScriptCache([script]) drops the cached results of one script, or
+// of all of them, for scripts whose results went stale before their TTL.
+static int InvalidateSubScriptCache(lua_State *L) {
+    const char *script = luaL_optstring(L, 1, NULL);
+    EM_ASM({
+        Module.rpcCall("subscript_cache_invalidate", [$0 ? UTF8ToString($0) : null]);
+    }, script);
     return 0;
 }
 
-// Call from sub worker
-EMSCRIPTEN_KEEPALIVE
-int sub_start(const char *script, const char *funcs, const char *subs, size_t size, void *data) {
-    lua_State *L = luaL_newstate();
-    if (L == NULL) {
-        return 1;
-    }
-
-    lua_atpanic(L, panic_func);
-    lua_pushcfunction(L, traceback);
-
-    luaL_openlibs(L);
-    // TODO: os.exit()
-    lua_register(L, "ConPrintf", ConPrintf);
-
-    lcurl_register(L);
+EM_JS(void, sub_cache_stats, (double *stats), {
+    const { hits, misses, entries, bytes } = Module.rpcCall("subscript_cache_stats").value;
+    HEAPF64.set([hits, misses, entries, bytes], stats >> 3);
+})
 
-    int err = luaL_loadstring(L, script);
-    if (err != LUA_OK) {
-        return 2;
+// Call from main worker
+static int GetSubScriptCacheStats(lua_State *L) {
+    static const char *const names[] = {"hits", "misses", "entries", "bytes"};
+    double stats[4];
+    sub_cache_stats(stats);
+    lua_createtable(L, 0, 4);
+    for (int i = 0; i < 4; i++) {
+        lua_pushnumber(L, stats[i]);
+        lua_setfield(L, -2, names[i]);
     }
+    return 1;
+}
 
-    int count = sub_lua_deserialize(L, data);
+// Call from main worker
+void sub_init(lua_State *L) {
+    // SubScript
+    lua_pushcclosure(L, LaunchSubScript, 0);
+    lua_setglobal(L, "LaunchSubScript");
 
-    if (lua_pcall(L, count, LUA_MULTRET, 1) != LUA_OK) {
-        const char *msg = lua_tostring(L, -1);
-        fprintf(stderr, "sub_start error: %s\n", msg);
+    lua_pushcclosure(L, LaunchSubScriptBatch, 0);
+    lua_setglobal(L, "LaunchSubScriptBatch");
 
-        EM_ASM({
-            Module.bridge.onSubScriptError(UTF8ToString($0));
-        }, msg);
+    lua_pushcclosure(L, AbortSubScript, 0);
+    lua_setglobal(L, "AbortSubScript");
 
-        return 3;
-    }
+    lua_pushcclosure(L, IsSubScriptRunning, 0);
+    lua_setglobal(L, "IsSubScriptRunning");
 
-    uint8_t *result;
-    size_t result_size = lua_serialize(L, 2, &result);
+    lua_pushcclosure(L, SetSubScriptSharedData, 0);
+    lua_setglobal(L, "SetSubScriptSharedData");
 
-    EM_ASM({
-        Module.bridge.onSubScriptFinished($0, $1);
-    }, result, result_size);
+    lua_pushcclosure(L, ConfigureSubScriptCache, 0);
+    lua_setglobal(L, "ConfigureSubScriptCache");
 
-    free(result);
+    lua_pushcclosure(L, InvalidateSubScriptCache, 0);
+    lua_setglobal(L, "InvalidateSubScriptCache");
 
-    return 0;
+    lua_pushcclosure(L, GetSubScriptCacheStats, 0);
+    lua_setglobal(L, "GetSubScriptCacheStats");
 }
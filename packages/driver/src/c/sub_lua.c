@@ -0,0 +1,233 @@
+#include "sub_lua.h"
+#include "sub_serialization.h"
+#include "lauxlib.h"
+
+#define SUB_MAX_DEPTH 100
+
+// Output and flags of the sub_lua_serialize call in progress
+static ByteBuffer *st_output;
+static int st_skip_unsupported;
+
+static void serialize_value(lua_State *L, int index, int seen, int depth);
+
+static int is_array_key(lua_State *L, int index, uint32_t array) {
+    if (lua_type(L, index) != LUA_TNUMBER) {
+        return 0;
+    }
+    lua_Number key = lua_tonumber(L, index);
+    return key >= 1 && key <= array && key == (lua_Number)(uint32_t)key;
+}
+
+static int is_supported(lua_State *L, int index) {
+    int type = lua_type(L, index);
+    return !st_skip_unsupported || type == LUA_TBOOLEAN || type == LUA_TNUMBER || type == LUA_TSTRING ||
+           type == LUA_TTABLE;
+}
+
+// Tables are written raw (metatables are ignored) as their 1..n sequence plus the remaining pairs.
+// A table may appear more than once, but not inside itself.
+static void serialize_table(lua_State *L, int index, int seen, int depth) {
+    if (depth > SUB_MAX_DEPTH) {
+        luaL_error(L, "subscript value is nested too deeply");
+    }
+    luaL_checkstack(L, 4, "subscript value");
+    lua_pushvalue(L, index);
+    lua_rawget(L, seen);
+    if (lua_toboolean(L, -1)) {
+        luaL_error(L, "cannot pass a table that contains itself to or from a subscript");
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, index);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, seen);
+
+    uint32_t array = 0;
+    for (;;) {
+        lua_rawgeti(L, index, (int)array + 1);
+        int end = lua_isnil(L, -1) || !is_supported(L, -1);
+        lua_pop(L, 1);
+        if (end) {
+            break;
+        }
+        array++;
+    }
+    uint32_t hash = 0;
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        hash += !is_array_key(L, -2, array) && is_supported(L, -2) && is_supported(L, -1);
+        lua_pop(L, 1);
+    }
+
+    sub_write_table(st_output, array, hash);
+    for (uint32_t i = 1; i <= array; i++) {
+        lua_rawgeti(L, index, (int)i);
+        serialize_value(L, lua_gettop(L), seen, depth + 1);
+        lua_pop(L, 1);
+    }
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        if (!is_array_key(L, -2, array) && is_supported(L, -2) && is_supported(L, -1)) {
+            int top = lua_gettop(L);
+            serialize_value(L, top - 1, seen, depth + 1);
+            serialize_value(L, top, seen, depth + 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_pushvalue(L, index);
+    lua_pushnil(L);
+    lua_rawset(L, seen);
+}
+
+static void serialize_value(lua_State *L, int index, int seen, int depth) {
+    switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            sub_write_nil(st_output);
+            break;
+        case LUA_TBOOLEAN:
+            sub_write_boolean(st_output, lua_toboolean(L, index));
+            break;
+        case LUA_TNUMBER:
+            sub_write_number(st_output, lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING: {
+            size_t length;
+            const char *data = lua_tolstring(L, index, &length);
+            sub_write_string(st_output, data, length);
+            break;
+        }
+        case LUA_TTABLE:
+            serialize_table(L, index, seen, depth);
+            break;
+        default:
+            luaL_error(L, "cannot pass a %s value to or from a subscript", luaL_typename(L, index));
+    }
+}
+
+static int serialize_values(lua_State *L) {
+    int count = lua_gettop(L);
+    lua_newtable(L);
+    int seen = lua_gettop(L);
+    sub_write_header(st_output, (uint32_t)count);
+    for (int i = 1; i <= count; i++) {
+        serialize_value(L, i, seen, 0);
+    }
+    return 0;
+}
+
+int sub_lua_serialize(lua_State *L, ByteBuffer *output, int first, int flags) {
+    st_output = output;
+    st_skip_unsupported = (flags & SUB_LUA_SKIP_UNSUPPORTED) != 0;
+    lua_pushcfunction(L, serialize_values);
+    lua_insert(L, first);
+    int status = lua_pcall(L, lua_gettop(L) - first, 0, 0);
+    st_output = NULL;
+    st_skip_unsupported = 0;
+    return status == LUA_OK ? 0 : -1;
+}
+
+static int push_value(lua_State *L, SubReader *reader, int depth) {
+    SubValue value;
+    if (depth > SUB_MAX_DEPTH + 1 || !lua_checkstack(L, 3) || sub_read_value(reader, &value) != 0) {
+        return -1;
+    }
+    switch (value.type) {
+        case SUB_NIL:
+            lua_pushnil(L);
+            return 0;
+        case SUB_FALSE:
+        case SUB_TRUE:
+            lua_pushboolean(L, value.type == SUB_TRUE);
+            return 0;
+        case SUB_INTEGER:
+            lua_pushinteger(L, value.value.integer);
+            return 0;
+        case SUB_FLOAT:
+            lua_pushnumber(L, value.value.number);
+            return 0;
+        case SUB_STRING:
+            lua_pushlstring(L, value.value.string.data, value.value.string.length);
+            return 0;
+        case SUB_TABLE:
+            break;
+    }
+    uint32_t array = value.value.table.array;
+    uint32_t hash = value.value.table.hash;
+    lua_createtable(L, array > INT32_MAX ? 0 : (int)array, hash > INT32_MAX ? 0 : (int)hash);
+    for (uint32_t i = 1; i <= array; i++) {
+        if (push_value(L, reader, depth + 1) != 0) {
+            return -1;
+        }
+        lua_rawseti(L, -2, (int)i);
+    }
+    for (uint32_t i = 0; i < hash; i++) {
+        if (push_value(L, reader, depth + 1) != 0 || push_value(L, reader, depth + 1) != 0) {
+            return -1;
+        }
+        if (lua_isnil(L, -2) || (lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) != lua_tonumber(L, -2))) {
+            return -1;
+        }
+        lua_rawset(L, -3);
+    }
+    return 0;
+}
+
+int sub_lua_deserialize(lua_State *L, const uint8_t *data, size_t size) {
+    int top = lua_gettop(L);
+    SubReader reader = {data, size, 0};
+    uint32_t count;
+    if (sub_read_header(&reader, &count) != 0 || count > size) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (push_value(L, &reader, 0) != 0) {
+            lua_settop(L, top);
+            return -1;
+        }
+    }
+    if (reader.offset != size) {
+        lua_settop(L, top);
+        return -1;
+    }
+    return (int)count;
+}
+
+int sub_lua_serialize_shards(lua_State *L, ByteBuffer *output, int first, int count, uint32_t *sizes) {
+    for (int i = 0; i < count; i++) {
+        int shard = first + i;
+        int length = (int)lua_rawlen(L, shard);
+        luaL_checkstack(L, length + 1, "too many subscript arguments");
+        size_t start = output->size;
+        int values = lua_gettop(L) + 1;
+        for (int j = 1; j <= length; j++) {
+            lua_rawgeti(L, shard, j);
+        }
+        if (sub_lua_serialize(L, output, values, 0) != 0) {
+            return -1;
+        }
+        sizes[i] = (uint32_t)(output->size - start);
+    }
+    return 0;
+}
+
+int sub_lua_push_result(lua_State *L, int id, int shard, const uint8_t *data, size_t size) {
+    lua_pushlightuserdata(L, (void *)(intptr_t)id);
+    if (shard > 0) {
+        lua_pushinteger(L, shard);
+    }
+    int count = sub_lua_deserialize(L, data, size);
+    if (count < 0) {
+        lua_pop(L, 1 + (shard > 0));
+        return -1;
+    }
+    return 1 + (shard > 0) + count;
+}
+
+int sub_lua_push_error(lua_State *L, int id, int shard, const char *message) {
+    lua_pushlightuserdata(L, (void *)(intptr_t)id);
+    lua_pushstring(L, message);
+    if (shard > 0) {
+        lua_pushinteger(L, shard);
+    }
+    return 2 + (shard > 0);
+}
@@ -0,0 +1,33 @@
+#ifndef DRIVER_SUB_LUA_H
+#define DRIVER_SUB_LUA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "byte_buffer.h"
+#include "lua.h"
+
+// Leave out values that cannot be passed to a subscript, such as functions, instead of failing
+#define SUB_LUA_SKIP_UNSUPPORTED 1
+
+// Appends the values from `first` to the top of the stack to `output` in the format of
+// sub_serialization.h and removes them. Returns -1 with the error message on the stack if one of them
+// cannot be passed to a subscript.
+int sub_lua_serialize(lua_State *L, ByteBuffer *output, int first, int flags);
+// Pushes the subscript values in `data` and returns how many, or -1 (pushing nothing) if the data is
+// malformed.
+int sub_lua_deserialize(lua_State *L, const uint8_t *data, size_t size);
+
+// Serializes the sequence of each of the `count` tables from `first` as its own value list, back to back
+// in `output`, and stores the size of each in `sizes`. This is the layout of a LaunchSubScriptBatch call,
+// which the broker splits by `sizes`. The tables stay on the stack. Returns -1 with the error message on
+// the stack if a value cannot be passed to a subscript.
+int sub_lua_serialize_shards(lua_State *L, ByteBuffer *output, int first, int count, uint32_t *sizes);
+// Pushes the arguments of OnSubFinished and OnSubProgress, `id, [shard,] values...`, and returns how many,
+// or -1 (pushing nothing) if `data` is malformed. `shard` is 1-based for LaunchSubScriptBatch jobs and 0
+// for LaunchSubScript, whose callbacks get no shard argument.
+int sub_lua_push_result(lua_State *L, int id, int shard, const uint8_t *data, size_t size);
+// Pushes the arguments of OnSubError, `id, message[, shard]`, and returns how many. The shard comes last
+// so that handlers written for LaunchSubScript keep working.
+int sub_lua_push_error(lua_State *L, int id, int shard, const char *message);
+
+#endif //DRIVER_SUB_LUA_H
@@ -1,102 +1,125 @@
 #include "sub_serialization.h"
 
-#include <stdlib.h>
+#include <math.h>
 #include <string.h>
 
-size_t serialize(DataItem *data, size_t count, unsigned char **buffer) {
-    size_t totalSize = sizeof(size_t);
-    for (size_t i = 0; i < count; ++i) {
-        totalSize += sizeof(DataType);
-        switch (data[i].type) {
-            case TYPE_DOUBLE:
-                totalSize += sizeof(double);
-                break;
-            case TYPE_BOOLEAN:
-                totalSize += sizeof(int);
-                break;
-            case TYPE_STRING:
-                totalSize += sizeof(size_t) + (data[i].value.stringValue ? strlen(data[i].value.stringValue) + 1 : 0);
-                break;
-        }
-    }
+static const uint8_t magic[3] = {'L', 'S', 'V'};
 
-    *buffer = malloc(totalSize);
-    unsigned char *ptr = *buffer;
+static void write_u8(ByteBuffer *out, uint8_t value) {
+    byte_buffer_append(out, &value, 1);
+}
 
-    memcpy(ptr, &count, sizeof(size_t));
-    ptr += sizeof(size_t);
+static void write_u32(ByteBuffer *out, uint32_t value) {
+    uint8_t bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24};
+    byte_buffer_append(out, bytes, 4);
+}
 
-    for (size_t i = 0; i < count; ++i) {
-        memcpy(ptr, &data[i].type, sizeof(DataType));
-        ptr += sizeof(DataType);
-        switch (data[i].type) {
-            case TYPE_DOUBLE:
-                memcpy(ptr, &data[i].value.doubleValue, sizeof(double));
-                ptr += sizeof(double);
-                break;
-            case TYPE_BOOLEAN:
-                memcpy(ptr, &data[i].value.intValue, sizeof(int));
-                ptr += sizeof(int);
-                break;
-            case TYPE_STRING: {
-                size_t stringLen = data[i].value.stringValue ? strlen(data[i].value.stringValue) + 1 : 0;
-                memcpy(ptr, &stringLen, sizeof(size_t));
-                ptr += sizeof(size_t);
-                if (stringLen > 0) {
-                    memcpy(ptr, data[i].value.stringValue, stringLen);
-                    ptr += stringLen;
-                }
-                break;
-            }
-        }
+void sub_write_header(ByteBuffer *out, uint32_t count) {
+    byte_buffer_append(out, magic, sizeof(magic));
+    write_u8(out, SUB_SERIALIZATION_VERSION);
+    write_u32(out, count);
+}
+
+void sub_write_nil(ByteBuffer *out) {
+    write_u8(out, SUB_NIL);
+}
+
+void sub_write_boolean(ByteBuffer *out, int value) {
+    write_u8(out, value ? SUB_TRUE : SUB_FALSE);
+}
+
+void sub_write_number(ByteBuffer *out, double value) {
+    if (value >= INT32_MIN && value <= INT32_MAX && floor(value) == value && !(value == 0 && signbit(value))) {
+        write_u8(out, SUB_INTEGER);
+        write_u32(out, (uint32_t)(int32_t)value);
+        return;
     }
+    // wasm is little-endian, so the double's memory layout is already the wire layout.
+    write_u8(out, SUB_FLOAT);
+    byte_buffer_append(out, &value, sizeof(value));
+}
 
-    return totalSize;
+void sub_write_string(ByteBuffer *out, const char *data, size_t length) {
+    write_u8(out, SUB_STRING);
+    write_u32(out, (uint32_t)length);
+    byte_buffer_append(out, data, length);
 }
 
-DataItem *deserialize(const unsigned char *buffer, int *count) {
-    const unsigned char *ptr = buffer;
+void sub_write_table(ByteBuffer *out, uint32_t array, uint32_t hash) {
+    write_u8(out, SUB_TABLE);
+    write_u32(out, array);
+    write_u32(out, hash);
+}
 
-    memcpy(count, ptr, sizeof(int));
-    ptr += sizeof(int);
+static int read_bytes(SubReader *reader, void *out, size_t size) {
+    if (reader->size - reader->offset < size) {
+        return -1;
+    }
+    memcpy(out, reader->data + reader->offset, size);
+    reader->offset += size;
+    return 0;
+}
 
-    DataItem *data = malloc(*count * sizeof(DataItem));
-    for (int i = 0; i < *count; ++i) {
-        memcpy(&data[i].type, ptr, sizeof(DataType));
-        ptr += sizeof(DataType);
-        switch (data[i].type) {
-            case TYPE_DOUBLE:
-                memcpy(&data[i].value.doubleValue, ptr, sizeof(double));
-                ptr += sizeof(double);
-                break;
-            case TYPE_BOOLEAN:
-                memcpy(&data[i].value.intValue, ptr, sizeof(int));
-                ptr += sizeof(int);
-                break;
-            case TYPE_STRING: {
-                size_t stringLen;
-                memcpy(&stringLen, ptr, sizeof(size_t));
-                ptr += sizeof(size_t);
-                if (stringLen > 0) {
-                    data[i].value.stringValue = malloc(stringLen);
-                    memcpy((void *)data[i].value.stringValue, ptr, stringLen);
-                    ptr += stringLen;
-                } else {
-                    data[i].value.stringValue = NULL;
-                }
-                break;
-            }
-        }
+static int read_u32(SubReader *reader, uint32_t *value) {
+    uint8_t bytes[4];
+    if (read_bytes(reader, bytes, 4) != 0) {
+        return -1;
     }
+    *value = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return 0;
+}
 
-    return data;
+int sub_read_header(SubReader *reader, uint32_t *count) {
+    uint8_t header[4];
+    if (read_bytes(reader, header, sizeof(header)) != 0 || memcmp(header, magic, sizeof(magic)) != 0 ||
+        header[3] != SUB_SERIALIZATION_VERSION) {
+        return -1;
+    }
+    return read_u32(reader, count);
 }
 
-void free_deserialized_data(DataItem *data, int count) {
-    for (int i = 0; i < count; ++i) {
-        if (data[i].type == TYPE_STRING) {
-            free((void *)data[i].value.stringValue);
+int sub_read_value(SubReader *reader, SubValue *value) {
+    uint8_t tag;
+    if (read_bytes(reader, &tag, 1) != 0) {
+        return -1;
+    }
+    value->type = (SubValueType)tag;
+    switch (tag) {
+        case SUB_NIL:
+        case SUB_FALSE:
+        case SUB_TRUE:
+            return 0;
+        case SUB_INTEGER: {
+            uint32_t bits;
+            if (read_u32(reader, &bits) != 0) {
+                return -1;
+            }
+            value->value.integer = (int32_t)bits;
+            return 0;
+        }
+        case SUB_FLOAT:
+            return read_bytes(reader, &value->value.number, sizeof(double));
+        case SUB_STRING: {
+            uint32_t length;
+            if (read_u32(reader, &length) != 0 || reader->size - reader->offset < length) {
+                return -1;
+            }
+            value->value.string.data = (const char *)reader->data + reader->offset;
+            value->value.string.length = length;
+            reader->offset += length;
+            return 0;
         }
+        case SUB_TABLE:
+            if (read_u32(reader, &value->value.table.array) != 0 || read_u32(reader, &value->value.table.hash) != 0) {
+                return -1;
+            }
+            // Every value takes at least one byte, which bounds the sizes callers preallocate.
+            if ((uint64_t)value->value.table.array + 2 * (uint64_t)value->value.table.hash >
+                reader->size - reader->offset) {
+                return -1;
+            }
+            return 0;
+        default:
+            return -1;
     }
-    free(data);
 }
@@ -2,26 +2,65 @@
 #define DRIVER_SUB_SERIALIZATION_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "byte_buffer.h"
+
+// Wire format for values passed to and returned from subscripts, shared with sub-serialization.ts.
+// All integers are little-endian.
+//
+//   header: "LSV" version:u8 count:u32, then `count` values
+//   value:  tag:u8 followed by
+//     NIL, FALSE, TRUE   nothing
+//     INTEGER            i32
+//     FLOAT              f64
+//     STRING             length:u32 bytes
+//     TABLE              array:u32 hash:u32, then `array` values for keys 1..array and `hash` key/value pairs
+#define SUB_SERIALIZATION_VERSION 2
 
 typedef enum {
-    TYPE_DOUBLE,
-    TYPE_BOOLEAN,
-    TYPE_STRING
-} DataType;
+    SUB_NIL = 0,
+    SUB_FALSE = 1,
+    SUB_TRUE = 2,
+    SUB_INTEGER = 3,
+    SUB_FLOAT = 4,
+    SUB_STRING = 5,
+    SUB_TABLE = 6,
+} SubValueType;
+
+typedef struct {
+    SubValueType type;
+    union {
+        int32_t integer;
+        double number;
+        struct {
+            const char *data;
+            uint32_t length;
+        } string;
+        struct {
+            uint32_t array;
+            uint32_t hash;
+        } table;
+    } value;
+} SubValue;
 
-typedef union {
-    double doubleValue;
-    int intValue;
-    const char *stringValue;
-} DataValue;
+void sub_write_header(ByteBuffer *out, uint32_t count);
+void sub_write_nil(ByteBuffer *out);
+void sub_write_boolean(ByteBuffer *out, int value);
+// Integral numbers in the int32 range are written as INTEGER, everything else as FLOAT.
+void sub_write_number(ByteBuffer *out, double value);
+void sub_write_string(ByteBuffer *out, const char *data, size_t length);
+void sub_write_table(ByteBuffer *out, uint32_t array, uint32_t hash);
 
 typedef struct {
-    DataType type;
-    DataValue value;
-} DataItem;
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} SubReader;
 
-size_t serialize(DataItem *data, size_t count, unsigned char **buffer);
-DataItem *deserialize(const unsigned char *buffer, int *count);
-void free_deserialized_data(DataItem *data, int count);
+// Both return 0, or -1 when the input is truncated, of another version or has an unknown tag.
+// Strings point into the reader's buffer.
+int sub_read_header(SubReader *reader, uint32_t *count);
+int sub_read_value(SubReader *reader, SubValue *value);
 
 #endif
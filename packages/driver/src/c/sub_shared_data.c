@@ -0,0 +1,72 @@
+#include "sub_shared_data.h"
+#include "sub_lua.h"
+#include "lauxlib.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SharedData {
+    struct SharedData *next;
+    char *name;
+    uint8_t *data;
+    size_t size;
+} SharedData;
+
+// Shared data images received by this sub worker. They outlive the Lua states of single runs.
+static SharedData *st_shared_data;
+
+void sub_shared_data_set(const char *name, uint8_t *data, size_t size) {
+    for (SharedData **entry = &st_shared_data; *entry != NULL; entry = &(*entry)->next) {
+        if (strcmp((*entry)->name, name) == 0) {
+            SharedData *old = *entry;
+            *entry = old->next;
+            free(old->name);
+            free(old->data);
+            free(old);
+            break;
+        }
+    }
+    if (data == NULL) {
+        return;
+    }
+    SharedData *entry = malloc(sizeof(SharedData));
+    *entry = (SharedData){st_shared_data, strdup(name), data, size};
+    st_shared_data = entry;
+}
+
+// GetSubScriptSharedData(name) decodes a shared image into the running state on first use. The upvalue
+// keeps the decoded tables, so later calls in the same run return the same table.
+//
+// Every run has its own Lua state, so every run that asks for an image decodes all of it again. That
+// still skips running the Data modules, but the first call of a run takes time in proportion to the
+// image size (driver_shared_data_bench compares the two).
+static int GetSubScriptSharedData(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    lua_settop(L, 1);
+    lua_pushvalue(L, 1);
+    lua_rawget(L, lua_upvalueindex(1));
+    if (!lua_isnil(L, -1)) {
+        return 1;
+    }
+    const SharedData *shared = st_shared_data;
+    while (shared != NULL && strcmp(shared->name, name) != 0) {
+        shared = shared->next;
+    }
+    if (shared == NULL) {
+        return 1;
+    }
+    lua_pop(L, 1);
+    if (sub_lua_deserialize(L, shared->data, shared->size) != 1) {
+        return luaL_error(L, "malformed shared data '%s'", name);
+    }
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(1));
+    return 1;
+}
+
+void sub_shared_data_open(lua_State *L) {
+    lua_newtable(L);
+    lua_pushcclosure(L, GetSubScriptSharedData, 1);
+    lua_setglobal(L, "GetSubScriptSharedData");
+}
@@ -0,0 +1,15 @@
+#ifndef DRIVER_SUB_SHARED_DATA_H
+#define DRIVER_SUB_SHARED_DATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lua.h"
+
+// Keeps the image published as `name` by SetSubScriptSharedData for the following runs, replacing the
+// previous version. Takes ownership of `data`, which is malloc'd by the caller; NULL removes the image.
+void sub_shared_data_set(const char *name, uint8_t *data, size_t size);
+
+// Registers GetSubScriptSharedData(name) in the Lua state of a run.
+void sub_shared_data_open(lua_State *L);
+
+#endif //DRIVER_SUB_SHARED_DATA_H
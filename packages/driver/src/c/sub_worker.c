@@ -0,0 +1,209 @@
+#include "sub_lua.h"
+#include "sub_shared_data.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lcurl.h"
+#include "bit.h"
+#include <emscripten.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs subscripts inside a sub worker. The driver_sub build links this with sub_lua.c, lcurl and bit only.
+
+// Serialized result of the last run
+static ByteBuffer st_result;
+
+static int panic_func(lua_State *L) {
+    const char *msg = lua_tostring(L, -1);
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg);
+    return 0;
+}
+
+static int traceback (lua_State *L) {
+    if (!lua_isstring(L, 1))  /* 'message' not a string? */
+        return 1;  /* keep it intact */
+    lua_getglobal(L, "debug");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return 1;
+    }
+    lua_getfield(L, -1, "traceback");
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 2);
+        return 1;
+    }
+    lua_pushvalue(L, 1);  /* pass error message */
+    lua_pushinteger(L, 2);  /* skip this function and traceback */
+    lua_call(L, 2, 1);  /* call debug.traceback */
+    return 1;
+}
+
+// TODO: use main worker's ConPrintf
+static int ConPrintf(lua_State *L) {
+    int n = lua_gettop(L);
+    if (n < 1) {
+        return luaL_error(L, "ConPrintf needs at least one argument");
+    }
+
+    const char *fmt = luaL_checkstring(L, 1);
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+
+    for (int i = 2; i <= n; i++) {
+        lua_pushvalue(L, i);
+        luaL_addvalue(&b);
+    }
+
+    luaL_pushresult(&b);
+    const char *args = lua_tostring(L, -1);
+
+    lua_getglobal(L, "string");
+    lua_getfield(L, -1, "format");
+    lua_remove(L, -2);  // remove the 'string' table from the stack
+
+    lua_pushstring(L, fmt);
+    lua_pushstring(L, args);
+
+    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+        return luaL_error(L, "error calling 'string.format': %s", lua_tostring(L, -1));
+    }
+
+    const char *formatted = lua_tostring(L, -1);
+
+    lua_getglobal(L, "print");
+    lua_pushstring(L, formatted);
+
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        return luaL_error(L, "error calling 'print': %s", lua_tostring(L, -1));
+    }
+
+    return 0;
+}
+
+static void report_sub_error(const char *msg) {
+    fprintf(stderr, "sub_start error: %s\n", msg);
+
+    EM_ASM({
+        Module.bridge.onSubScriptError(UTF8ToString($0));
+    }, msg);
+}
+
+// Instructions between two polls of the cancellation flag
+#define CANCEL_CHECK_INTERVAL 10000
+
+// The broker sets the job's shared flag when the subscript is aborted.
+EM_JS(int, sub_cancelled, (), {
+    return Module.cancelFlag ? Atomics.load(Module.cancelFlag, 0) : 0;
+})
+
+static void cancel_hook(lua_State *L, lua_Debug *ar) {
+    (void)ar;
+    if (sub_cancelled()) {
+        luaL_error(L, "subscript aborted");
+    }
+}
+
+// IsSubScriptAborted() lets a script notice an abort between its own steps and stop cleanly. Scripts
+// that don't check are stopped by the count hook at the next poll.
+static int IsSubScriptAborted(lua_State *L) {
+    lua_pushboolean(L, sub_cancelled());
+    return 1;
+}
+
+// Serialized arguments of the last progress report
+static ByteBuffer st_progress;
+
+// ReportProgress(...) passes its arguments to OnSubProgress in the main state. Reports arriving sooner
+// than the worker's throttle interval after the previous one are dropped; returns whether it was sent.
+static int ReportProgress(lua_State *L) {
+    int due = EM_ASM_INT({
+        return Module.bridge.progressDue();
+    });
+    if (!due) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    st_progress.size = 0;
+    if (sub_lua_serialize(L, &st_progress, 1, 0) != 0) {
+        return lua_error(L);
+    }
+    EM_ASM({
+        Module.bridge.onSubScriptProgress($0, $1);
+    }, st_progress.data, st_progress.size);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Call from sub worker. Takes ownership of `data`, which is malloc'd by the caller; NULL removes the image.
+EMSCRIPTEN_KEEPALIVE
+void sub_set_shared_data(const char *name, uint8_t *data, size_t size) {
+    sub_shared_data_set(name, data, size);
+}
+
+static int run_sub(lua_State *L, const char *script, size_t size, const uint8_t *data) {
+    lua_atpanic(L, panic_func);
+    lua_pushcfunction(L, traceback);
+
+    luaL_openlibs(L);
+    // TODO: os.exit()
+    lua_register(L, "ConPrintf", ConPrintf);
+    lua_register(L, "IsSubScriptAborted", IsSubScriptAborted);
+    lua_register(L, "ReportProgress", ReportProgress);
+    lua_sethook(L, cancel_hook, LUA_MASKCOUNT, CANCEL_CHECK_INTERVAL);
+
+    sub_shared_data_open(L);
+
+    bit_init(L);
+    lcurl_register(L);
+
+    // A script that doesn't compile is the script's error, not the worker's, so it is reported the same
+    // way as one raised while running and the worker stays in the pool.
+    if (luaL_loadstring(L, script) != LUA_OK) {
+        report_sub_error(lua_tostring(L, -1));
+        return 2;
+    }
+
+    int count = sub_lua_deserialize(L, data, size);
+    if (count < 0) {
+        report_sub_error("malformed subscript arguments");
+        return 4;
+    }
+
+    if (lua_pcall(L, count, LUA_MULTRET, 1) != LUA_OK) {
+        report_sub_error(lua_tostring(L, -1));
+        return 3;
+    }
+
+    st_result.size = 0;
+    if (sub_lua_serialize(L, &st_result, 2, 0) != 0) {
+        report_sub_error(lua_tostring(L, -1));
+        return 3;
+    }
+
+    return 0;
+}
+
+// Call from sub worker. The worker is reused for later subscripts, so every run gets its own Lua state
+// and closes it before returning.
+EMSCRIPTEN_KEEPALIVE
+int sub_start(const char *script, const char *funcs, const char *subs, size_t size, void *data) {
+    lua_State *L = luaL_newstate();
+    if (L == NULL) {
+        return 1;
+    }
+
+    int ret = run_sub(L, script, size, data);
+    // The result lives in st_result, so the Lua values behind it can go before JS copies it out.
+    lua_close(L);
+    if (ret == 0) {
+        EM_ASM({
+            Module.bridge.onSubScriptFinished($0, $1);
+        }, st_result.data, st_result.size);
+    }
+    byte_buffer_free(&st_result);
+    byte_buffer_free(&st_progress);
+    return ret;
+}
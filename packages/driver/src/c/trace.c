@@ -0,0 +1,187 @@
+#include <emscripten.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "lauxlib.h"
+#include "trace.h"
+
+static TraceEvent st_events[TRACE_CAPACITY];
+static uint32_t st_count = 0;
+static int st_stopped = 0;
+
+static TraceEvent *get_event(int span) {
+    if (span < 0 || st_count - (uint32_t)span > TRACE_CAPACITY) {
+        return NULL;
+    }
+    return &st_events[(uint32_t)span % TRACE_CAPACITY];
+}
+
+int trace_begin(TracePhase phase, const char *name, uint32_t bytes) {
+    if (st_stopped) {
+        return -1;
+    }
+    uint32_t id = st_count++;
+    TraceEvent *event = &st_events[id % TRACE_CAPACITY];
+    event->start = emscripten_get_now();
+    event->end = event->start;
+    event->phase = phase;
+    event->bytes = bytes;
+
+    // Keep the tail of long paths; the file name is the useful part.
+    size_t len = strlen(name);
+    if (len >= TRACE_NAME_SIZE) {
+        name += len - (TRACE_NAME_SIZE - 1);
+    }
+    strncpy(event->name, name, TRACE_NAME_SIZE - 1);
+    event->name[TRACE_NAME_SIZE - 1] = '\0';
+    return (int)id;
+}
+
+void trace_end(int span) {
+    TraceEvent *event = get_event(span);
+    if (event != NULL) {
+        event->end = emscripten_get_now();
+    }
+}
+
+void trace_set_bytes(int span, uint32_t bytes) {
+    TraceEvent *event = get_event(span);
+    if (event != NULL) {
+        event->bytes = bytes;
+    }
+}
+
+int trace_active() {
+    return !st_stopped;
+}
+
+void trace_stop() {
+    st_stopped = 1;
+}
+
+EMSCRIPTEN_KEEPALIVE
+const TraceEvent *trace_events() {
+    return st_events;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t trace_count() {
+    return st_count;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t trace_capacity() {
+    return TRACE_CAPACITY;
+}
+
+static int TraceBegin(lua_State *L) {
+    static const char *const phases[] = {"read", "compile", "execute", NULL};
+    int phase = luaL_checkoption(L, 1, NULL, phases);
+    int span = trace_begin(TRACE_MODULE_READ + phase, luaL_checkstring(L, 2), luaL_optinteger(L, 3, 0));
+    if (span < 0) {
+        return 0;
+    }
+    lua_pushinteger(L, span);
+    return 1;
+}
+
+static int TraceEnd(lua_State *L) {
+    trace_end(luaL_optinteger(L, 1, -1));
+    return 0;
+}
+
+// Same behaviour as the stock loadfile, but the file is read in one go so that reading and
+// compiling show up as separate spans.
+static int TracedLoadfile(lua_State *L) {
+    const char *filename = luaL_optstring(L, 1, NULL);
+    if (!trace_active() || filename == NULL) {
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_insert(L, 1);
+        lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+        return lua_gettop(L);
+    }
+    const char *mode = luaL_optstring(L, 2, NULL);
+    int env = !lua_isnone(L, 3) ? 3 : 0;
+
+    // The file is sized before it is opened and read into a userdata, so that a memory error raised while
+    // allocating or compiling leaks neither the descriptor nor the buffer.
+    int span = trace_begin(TRACE_MODULE_READ, filename, 0);
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        trace_end(span);
+        lua_pushnil(L);
+        lua_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+        return 2;
+    }
+    if (st.st_size < 0 || (uintmax_t)st.st_size >= SIZE_MAX) {
+        trace_end(span);
+        lua_pushnil(L);
+        lua_pushfstring(L, "cannot read %s", filename);
+        return 2;
+    }
+    size_t size = (size_t)st.st_size;
+    char *data = lua_newuserdata(L, size > 0 ? size : 1);
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        trace_end(span);
+        lua_pushnil(L);
+        lua_pushfstring(L, "cannot open %s: %s", filename, strerror(errno));
+        return 2;
+    }
+    size_t read = fread(data, 1, size, f);
+    int failed = ferror(f);
+    fclose(f);
+    trace_set_bytes(span, read);
+    trace_end(span);
+    if (failed) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "cannot read %s", filename);
+        return 2;
+    }
+
+    // Match luaL_loadfilex: skip a UTF-8 BOM and a leading '#' line, keeping its newline.
+    const char *chunk = data;
+    if (read >= 3 && memcmp(chunk, "\xEF\xBB\xBF", 3) == 0) {
+        chunk += 3;
+    }
+    if (chunk < data + read && *chunk == '#') {
+        while (chunk < data + read && *chunk != '\n') {
+            chunk++;
+        }
+    }
+
+    span = trace_begin(TRACE_MODULE_COMPILE, filename, read);
+    lua_pushfstring(L, "@%s", filename);
+    int ret = luaL_loadbufferx(L, chunk, data + read - chunk, lua_tostring(L, -1), mode);
+    // Drop the chunk name and the buffer
+    lua_remove(L, -2);
+    lua_remove(L, -2);
+    trace_end(span);
+    if (ret != LUA_OK) {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    if (env != 0) {
+        lua_pushvalue(L, env);
+        if (!lua_setupvalue(L, -2, 1)) {
+            lua_pop(L, 1);
+        }
+    }
+    return 1;
+}
+
+void trace_init(lua_State *L) {
+    lua_pushcfunction(L, TraceBegin);
+    lua_setglobal(L, "TraceBegin");
+
+    lua_pushcfunction(L, TraceEnd);
+    lua_setglobal(L, "TraceEnd");
+
+    lua_getglobal(L, "loadfile");
+    lua_pushcclosure(L, TracedLoadfile, 1);
+    lua_setglobal(L, "loadfile");
+}
@@ -0,0 +1,44 @@
+#ifndef DRIVER_TRACE_H
+#define DRIVER_TRACE_H
+
+#include <stdint.h>
+#include "lua.h"
+
+// Startup timeline. Spans are written into a ring buffer in linear memory that the host reads
+// through trace_events(); recording stops for good once trace_stop() is called after the first frame.
+
+typedef enum {
+    TRACE_FS_BACKEND,
+    TRACE_OPENLIBS,
+    TRACE_BOOT,
+    TRACE_MODULE_READ,
+    TRACE_MODULE_COMPILE,
+    TRACE_MODULE_EXECUTE,
+    TRACE_ON_INIT,
+    TRACE_FIRST_FRAME,
+    TRACE_PHASE_COUNT,
+} TracePhase;
+
+#define TRACE_NAME_SIZE 40
+#define TRACE_CAPACITY 2048
+
+// Layout shared with worker.ts; keep it at 64 bytes.
+typedef struct {
+    double start;
+    double end;
+    uint32_t phase;
+    uint32_t bytes;
+    char name[TRACE_NAME_SIZE];
+} TraceEvent;
+
+// Returns a span id for trace_end, or -1 when recording has stopped.
+int trace_begin(TracePhase phase, const char *name, uint32_t bytes);
+void trace_end(int span);
+void trace_set_bytes(int span, uint32_t bytes);
+int trace_active();
+void trace_stop();
+
+// Registers TraceBegin/TraceEnd and wraps the stock loadfile so source reads and compiles are timed.
+void trace_init(lua_State *L);
+
+#endif //DRIVER_TRACE_H
@@ -3,7 +3,13 @@
 // University of Illinois/NCSA Open Source License.  Both these licenses can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <cstring>
+#include <list>
 #include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
 
 #include "backend.h"
 #include "file.h"
@@ -15,6 +21,223 @@ namespace wasmfs {
 
     class NodeBackend;
 
+// Broker descriptors currently held open; they do not survive a heap snapshot.
+    static size_t openDescriptors = 0;
+
+// Attributes of broker paths. PoB's loadfile and io.open probe the same paths again and again at startup,
+// and WasmFS's own dcache keeps neither missing children nor file sizes, so this cache answers repeated
+// lstat and stat requests without an RPC. The backend's own mutations bump `generation`, which drops
+// every entry; sizes are updated in place by writes. Paths under the read-only root.zip mount can't
+// change and are kept for good. Anything else can also change behind the backend's back, through cloud
+// builds or another tab sharing the same OPFS, so those entries are looked up again after
+// kMutableLifetimeMs; that still covers the bursts of probes PoB makes while loading.
+    struct CachedAttributes {
+        uint64_t generation;
+        // emscripten_get_now() time after which the entry is looked up again
+        double expires;
+        // 0 for a path that does not exist
+        mode_t mode;
+        bool hasSize;
+        uint32_t size;
+    };
+
+    struct NodeCacheStats {
+        uint32_t modeLookups;
+        uint32_t modeHits;
+        uint32_t sizeLookups;
+        uint32_t sizeHits;
+        // Bytes returned by NodeFile::read, and the read RPCs and bytes fetched to serve them
+        uint32_t readBytes;
+        uint32_t readRpcs;
+        uint32_t readRpcBytes;
+        // Bytes passed to NodeFile::write, and the write RPCs that stored them
+        uint32_t writeBytes;
+        uint32_t writeRpcs;
+    };
+
+    static constexpr uint64_t kPermanent = UINT64_MAX;
+    static constexpr double kMutableLifetimeMs = 1000;
+    static constexpr size_t kMaxCachedPaths = 16384;
+    static const std::string kReadOnlyMount = "/root";
+
+    static std::unordered_map<std::string, CachedAttributes> attributeCache;
+    static uint64_t generation = 0;
+    static NodeCacheStats cacheStats;
+
+    static bool isReadOnly(const std::string& path) {
+        return path.compare(0, kReadOnlyMount.size(), kReadOnlyMount) == 0 &&
+               (path.size() == kReadOnlyMount.size() || path[kReadOnlyMount.size()] == '/');
+    }
+
+    static void dropMutableBlocks();
+
+    static void invalidateAttributes() {
+        ++generation;
+        dropMutableBlocks();
+    }
+
+    static CachedAttributes* findAttributes(const std::string& path) {
+        auto it = attributeCache.find(path);
+        if (it == attributeCache.end()) {
+            return nullptr;
+        }
+        if (it->second.generation != kPermanent &&
+            (it->second.generation != generation || emscripten_get_now() >= it->second.expires)) {
+            attributeCache.erase(it);
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    static CachedAttributes& storeAttributes(const std::string& path) {
+        if (auto* entry = findAttributes(path)) {
+            return *entry;
+        }
+        if (attributeCache.size() >= kMaxCachedPaths) {
+            attributeCache.clear();
+        }
+        if (isReadOnly(path)) {
+            return attributeCache[path] = {kPermanent, 0, 0, false, 0};
+        }
+        return attributeCache[path] = {generation, emscripten_get_now() + kMutableLifetimeMs, 0, false, 0};
+    }
+
+    static int cachedMode(const std::string& path, mode_t* mode) {
+        ++cacheStats.modeLookups;
+        if (auto* entry = findAttributes(path)) {
+            ++cacheStats.modeHits;
+            if (entry->mode == 0) {
+                return ENOENT;
+            }
+            *mode = entry->mode;
+            return 0;
+        }
+        int err = _wasmfs_node_get_mode(path.c_str(), mode);
+        if (err == 0 || err == ENOENT) {
+            storeAttributes(path).mode = err ? 0 : *mode;
+        }
+        return err;
+    }
+
+    // `fd` is the open descriptor of the file, or -1.
+    static int cachedSize(const std::string& path, int fd, uint32_t* size) {
+        ++cacheStats.sizeLookups;
+        auto* entry = findAttributes(path);
+        if (entry && entry->hasSize) {
+            ++cacheStats.sizeHits;
+            *size = entry->size;
+            return 0;
+        }
+        int err = fd >= 0 ? _wasmfs_node_fstat_size(fd, size) : _wasmfs_node_stat_size(path.c_str(), size);
+        if (err == 0) {
+            auto& stored = storeAttributes(path);
+            stored.hasSize = true;
+            stored.size = *size;
+        }
+        return err;
+    }
+
+    static void forgetSize(const std::string& path) {
+        if (auto* entry = findAttributes(path)) {
+            entry->hasSize = false;
+        }
+    }
+
+    static void setCachedSize(const std::string& path, uint32_t size) {
+        if (auto* entry = findAttributes(path)) {
+            entry->hasSize = true;
+            entry->size = size;
+        }
+    }
+
+// File contents read through the broker, in blocks shared by all files under one byte budget and evicted
+// least recently used first. Lua's stdio reads a source file in small chunks, so a miss fetches a whole
+// small file, or a read-ahead window that grows while a file is read sequentially. The backend drops a
+// file's blocks when it writes to it, and every block that isn't under the read-only mount on the
+// mutations that bump the attribute generation. Files outside the read-only mount can be replaced by
+// cloud builds or another tab, so their blocks and size are also dropped each time they are opened.
+    static constexpr uint32_t kBlockSize = 64 * 1024;
+    static constexpr size_t kBlockBudget = 8 * 1024 * 1024;
+    static constexpr uint32_t kWholeFileLimit = 256 * 1024;
+    static constexpr uint32_t kMaxReadAhead = 1024 * 1024;
+
+// Writes are buffered per file and sent in one RPC when the file is closed, flushed, read or truncated, when
+// a write doesn't continue the buffered range, or once the buffer reaches this size.
+    static constexpr size_t kWriteBackLimit = 1024 * 1024;
+
+    struct Block {
+        std::string path;
+        uint32_t index;
+        // Shorter than kBlockSize, possibly empty, at the end of the file
+        std::vector<uint8_t> data;
+    };
+
+    // Most recently used first
+    static std::list<Block> blocks;
+    static std::unordered_map<std::string, std::unordered_map<uint32_t, std::list<Block>::iterator>> blockIndex;
+    static size_t blockBytes = 0;
+
+    static void eraseBlock(std::list<Block>::iterator it) {
+        auto file = blockIndex.find(it->path);
+        file->second.erase(it->index);
+        if (file->second.empty()) {
+            blockIndex.erase(file);
+        }
+        blockBytes -= it->data.size();
+        blocks.erase(it);
+    }
+
+    static const Block* findBlock(const std::string& path, uint32_t index) {
+        auto file = blockIndex.find(path);
+        if (file == blockIndex.end()) {
+            return nullptr;
+        }
+        auto it = file->second.find(index);
+        if (it == file->second.end()) {
+            return nullptr;
+        }
+        blocks.splice(blocks.begin(), blocks, it->second);
+        return &*it->second;
+    }
+
+    static void storeBlock(const std::string& path, uint32_t index, const uint8_t* data, size_t size) {
+        if (auto file = blockIndex.find(path); file != blockIndex.end()) {
+            if (auto it = file->second.find(index); it != file->second.end()) {
+                eraseBlock(it->second);
+            }
+        }
+        blocks.push_front({path, index, std::vector<uint8_t>(data, data + size)});
+        blockIndex[path][index] = blocks.begin();
+        blockBytes += size;
+        while (blockBytes > kBlockBudget && blocks.size() > 1) {
+            eraseBlock(std::prev(blocks.end()));
+        }
+    }
+
+    static void dropBlocks(const std::string& path) {
+        auto file = blockIndex.find(path);
+        if (file == blockIndex.end()) {
+            return;
+        }
+        std::vector<std::list<Block>::iterator> its;
+        for (auto& [index, it] : file->second) {
+            its.push_back(it);
+        }
+        for (auto it : its) {
+            eraseBlock(it);
+        }
+    }
+
+    static void dropMutableBlocks() {
+        for (auto it = blocks.begin(); it != blocks.end();) {
+            auto next = std::next(it);
+            if (!isReadOnly(it->path)) {
+                eraseBlock(it);
+            }
+            it = next;
+        }
+    }
+
 // The state of a file on the underlying Node file system.
     class NodeState {
         // Map all separate WasmFS opens of a file to a single underlying fd.
@@ -56,6 +279,7 @@ namespace wasmfs {
                 if (result < 0) {
                     return result;
                 }
+                ++openDescriptors;
                 // Fall through to update our state with the new result.
             } else if ((openFlags == O_RDONLY &&
                         (flags == O_WRONLY || flags == O_RDWR)) ||
@@ -86,6 +310,7 @@ namespace wasmfs {
             int ret = 0;
             if (--openCount == 0) {
                 ret = _wasmfs_node_close(fd);
+                --openDescriptors;
                 *this = NodeState(path);
             }
             return ret;
@@ -93,6 +318,13 @@ namespace wasmfs {
     };
 
     class NodeFile : public DataFile {
+        // Offset following the last read and the current read-ahead window, for sequential reads
+        off_t nextReadOffset = 0;
+        uint32_t readAhead = kBlockSize;
+        // Bytes written since the last flush, one contiguous range starting at dirtyOffset
+        off_t dirtyOffset = 0;
+        std::vector<uint8_t> dirty;
+
     public:
         NodeState state;
 
@@ -103,21 +335,20 @@ namespace wasmfs {
         off_t getSize() override {
             // TODO: This should really be using a 64-bit file size type.
             uint32_t size;
-            if (state.isOpen()) {
-                if (_wasmfs_node_fstat_size(state.getFD(), &size)) {
-                    // TODO: Make this fallible.
-                    return 0;
-                }
-            } else {
-                if (_wasmfs_node_stat_size(state.path.c_str(), &size)) {
-                    // TODO: Make this fallible.
-                    return 0;
-                }
+            if (cachedSize(state.path, state.isOpen() ? state.getFD() : -1, &size)) {
+                // TODO: Make this fallible.
+                size = 0;
+            }
+            if (!dirty.empty()) {
+                return std::max(off_t(size), dirtyOffset + off_t(dirty.size()));
             }
             return off_t(size);
         }
 
         int setSize(off_t size) override {
+            if (auto err = flushDirty()) {
+                return -err;
+            }
             if (state.isOpen()) {
                 if (_wasmfs_node_ftruncate(state.getFD(), size)) {
                     // TODO: Make this fallible.
@@ -129,33 +360,139 @@ namespace wasmfs {
                     return 0;
                 }
             }
+            setCachedSize(state.path, uint32_t(size));
+            dropBlocks(state.path);
             return 0;
         }
 
-        int open(oflags_t flags) override { return state.open(flags); }
+        int open(oflags_t flags) override {
+            if (!isReadOnly(state.path)) {
+                forgetSize(state.path);
+                dropBlocks(state.path);
+            }
+            return state.open(flags);
+        }
 
-        int close() override { return state.close(); }
+        // The descriptor is closed even when the buffered writes fail, and their error is reported instead.
+        int close() override {
+            int err = flushDirty();
+            if (auto closeErr = state.close(); closeErr && !err) {
+                err = closeErr;
+            }
+            return -err;
+        }
 
-        ssize_t read(uint8_t* buf, size_t len, off_t offset) override {
+        // Sends the buffered writes in one RPC. They are dropped even if it fails, like a failed write.
+        int flushDirty() {
+            if (dirty.empty()) {
+                return 0;
+            }
+            std::vector<uint8_t> data;
+            data.swap(dirty);
+            uint32_t nwritten;
+            ++cacheStats.writeRpcs;
+            if (auto err = _wasmfs_node_write(state.getFD(), data.data(), data.size(), dirtyOffset, &nwritten)) {
+                return err;
+            }
+            return nwritten < data.size() ? EIO : 0;
+        }
+
+        // Reads `length` bytes at block `first` in one RPC and caches them. The block at the end of the file
+        // is stored short, or empty, so later reads know where the file ends.
+        int fetchBlocks(uint32_t first, uint32_t length) {
+            std::vector<uint8_t> data(length);
             uint32_t nread;
-            if (auto err = _wasmfs_node_read(state.getFD(), buf, len, offset, &nread)) {
-                return -err;
+            if (auto err = _wasmfs_node_read(state.getFD(), data.data(), length, first * kBlockSize, &nread)) {
+                return err;
             }
-            return nread;
+            ++cacheStats.readRpcs;
+            cacheStats.readRpcBytes += nread;
+            for (uint32_t index = first, start = 0; start <= nread && start < length; ++index, start += kBlockSize) {
+                storeBlock(state.path, index, data.data() + start, std::min(kBlockSize, nread - start));
+            }
+            return 0;
         }
 
-        ssize_t write(const uint8_t* buf, size_t len, off_t offset) override {
-            uint32_t nwritten;
-            if (auto err =
-                    _wasmfs_node_write(state.getFD(), buf, len, offset, &nwritten)) {
+        ssize_t read(uint8_t* buf, size_t len, off_t offset) override {
+            if (auto err = flushDirty()) {
                 return -err;
             }
-            return nwritten;
+            if (len > kMaxReadAhead) {
+                // Large reads gain nothing from the cache; don't let them evict it
+                uint32_t nread;
+                if (auto err = _wasmfs_node_read(state.getFD(), buf, len, offset, &nread)) {
+                    return -err;
+                }
+                ++cacheStats.readRpcs;
+                cacheStats.readRpcBytes += nread;
+                cacheStats.readBytes += nread;
+                return nread;
+            }
+
+            readAhead = offset == nextReadOffset ? std::min(readAhead * 2, kMaxReadAhead) : kBlockSize;
+            size_t done = 0;
+            while (done < len) {
+                uint32_t position = uint32_t(offset + done);
+                uint32_t index = position / kBlockSize;
+                const Block* block = findBlock(state.path, index);
+                if (!block) {
+                    uint32_t size;
+                    bool whole = cachedSize(state.path, state.getFD(), &size) == 0 && size <= kWholeFileLimit;
+                    // One byte past the end of a whole file, so that its end is cached too
+                    uint32_t length = whole
+                                      ? size + 1
+                                      : std::max(readAhead, uint32_t(offset + len) - index * kBlockSize);
+                    if (whole) {
+                        index = 0;
+                    }
+                    length = (length + kBlockSize - 1) / kBlockSize * kBlockSize;
+                    if (auto err = fetchBlocks(index, length)) {
+                        return -err;
+                    }
+                    block = findBlock(state.path, position / kBlockSize);
+                    if (!block) {
+                        break;
+                    }
+                }
+                uint32_t start = position % kBlockSize;
+                if (start >= block->data.size()) {
+                    break;
+                }
+                size_t count = std::min(len - done, block->data.size() - start);
+                memcpy(buf + done, block->data.data() + start, count);
+                done += count;
+            }
+            nextReadOffset = offset + done;
+            cacheStats.readBytes += done;
+            return done;
         }
 
-        int flush() override {
-            WASMFS_UNREACHABLE("TODO: implement NodeFile::flush");
+        ssize_t write(const uint8_t* buf, size_t len, off_t offset) override {
+            if (!dirty.empty() && (offset < dirtyOffset || offset > dirtyOffset + off_t(dirty.size()))) {
+                if (auto err = flushDirty()) {
+                    return -err;
+                }
+            }
+            if (dirty.empty()) {
+                dirtyOffset = offset;
+            }
+            size_t start = size_t(offset - dirtyOffset);
+            dirty.resize(std::max(dirty.size(), start + len));
+            memcpy(dirty.data() + start, buf, len);
+            cacheStats.writeBytes += len;
+            if (auto* entry = findAttributes(state.path); entry && entry->hasSize) {
+                entry->size = std::max(entry->size, uint32_t(offset + len));
+            }
+            dropBlocks(state.path);
+            if (dirty.size() >= kWriteBackLimit) {
+                if (auto err = flushDirty()) {
+                    return -err;
+                }
+            }
+            return len;
         }
+
+        int flush() override { return -flushDirty(); }
     };
 
     class NodeDirectory : public Directory {
@@ -175,7 +512,7 @@ namespace wasmfs {
             // TODO: also retrieve and set ctime, atime, ino, etc.
             auto childPath = getChildPath(name);
             mode_t mode;
-            if (_wasmfs_node_get_mode(childPath.c_str(), &mode)) {
+            if (cachedMode(childPath, &mode)) {
                 return nullptr;
             }
             if (S_ISREG(mode)) {
@@ -193,6 +530,7 @@ namespace wasmfs {
 
         int removeChild(const std::string& name) override {
             auto childPath = getChildPath(name);
+            invalidateAttributes();
             // Try both `unlink` and `rmdir`.
             if (auto err = _wasmfs_node_unlink(childPath.c_str())) {
                 if (err == EISDIR) {
@@ -206,6 +544,7 @@ namespace wasmfs {
         std::shared_ptr<DataFile> insertDataFile(const std::string& name,
                                                  mode_t mode) override {
             auto childPath = getChildPath(name);
+            invalidateAttributes();
             if (_wasmfs_node_insert_file(childPath.c_str(), mode)) {
                 return nullptr;
             }
@@ -215,6 +554,7 @@ namespace wasmfs {
         std::shared_ptr<Directory> insertDirectory(const std::string& name,
                                                    mode_t mode) override {
             auto childPath = getChildPath(name);
+            invalidateAttributes();
             if (_wasmfs_node_insert_directory(childPath.c_str(), mode)) {
                 return nullptr;
             }
@@ -238,6 +578,7 @@ namespace wasmfs {
                 return -EINVAL;
             }
 
+            invalidateAttributes();
             auto r = _wasmfs_node_rename(state->path.c_str(), getChildPath(name).c_str());
             if (r == 0) {
                 state->path = getChildPath(name);
@@ -293,6 +634,63 @@ namespace wasmfs {
         return wasmFS.addBackend(std::make_unique<NodeBackend>(root));
     }
 
+    size_t wasmfs_nodefs_open_descriptors() {
+        return openDescriptors;
+    }
+
+    // Lookups and size requests, how many of each the attribute cache answered without an RPC, and the
+    // read and write traffic of NodeFile against the broker
+    EMSCRIPTEN_KEEPALIVE const NodeCacheStats* wasmfs_nodefs_cache_stats() {
+        return &cacheStats;
+    }
+
+    // Write the broker path of the Node-backed directory at the WasmFS `path` to `out` and return 0 or an
+    // error code, EXDEV if the directory belongs to another backend.
+    int wasmfs_nodefs_directory_path(const char* path, char* out, size_t size) {
+        std::shared_ptr<Directory> dir = path[0] == '/' ? wasmFS.getRootDirectory() : wasmFS.getCWD();
+        std::string rest(path);
+        size_t start = 0;
+        while (start < rest.size()) {
+            size_t end = rest.find('/', start);
+            if (end == std::string::npos) {
+                end = rest.size();
+            }
+            auto name = rest.substr(start, end - start);
+            start = end + 1;
+            if (name.empty() || name == ".") {
+                continue;
+            }
+            std::shared_ptr<File> child;
+            if (name == "..") {
+                child = dir->locked().getParent();
+                if (!child) {
+                    child = dir;
+                }
+            } else {
+                // Served from the dcache once the directory has been visited
+                child = dir->locked().getChild(name);
+            }
+            if (!child) {
+                return ENOENT;
+            }
+            dir = child->dynCast<Directory>();
+            if (!dir) {
+                return ENOTDIR;
+            }
+        }
+        auto node = std::dynamic_pointer_cast<NodeDirectory>(dir);
+        if (!node) {
+            return EXDEV;
+        }
+        // The backend root is mounted at "", which the broker calls "/"
+        const auto& nodePath = node->state.path.empty() ? std::string("/") : node->state.path;
+        if (nodePath.size() >= size) {
+            return ENAMETOOLONG;
+        }
+        memcpy(out, nodePath.c_str(), nodePath.size() + 1);
+        return 0;
+    }
+
     void EMSCRIPTEN_KEEPALIVE _wasmfs_node_record_dirent(
             std::vector<Directory::Entry>* entries, const char* name, int type) {
         entries->push_back({name, File::FileKind(type), 0});
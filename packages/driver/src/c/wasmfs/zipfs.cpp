@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+#include "backend.h"
+#include "file.h"
+#include "support.h"
+#include "wasmfs.h"
+
+namespace wasmfs {
+
+// Read-only backend over a zip archive held in linear memory, for the game root. The central directory is
+// indexed by path when the backend is created, so lookups never touch the archive again. Stored entries
+// are read straight out of the archive; deflated ones are inflated on their first read and kept until the
+// file is closed. Zip64 archives and encrypted entries aren't supported.
+
+    static constexpr uint32_t kEndOfCentralDirectory = 0x06054b50;
+    static constexpr uint32_t kCentralDirectoryHeader = 0x02014b50;
+    static constexpr uint32_t kLocalFileHeader = 0x04034b50;
+    static constexpr size_t kEndOfCentralDirectorySize = 22;
+    static constexpr size_t kCentralDirectoryHeaderSize = 46;
+    static constexpr size_t kLocalFileHeaderSize = 30;
+    static constexpr uint16_t kStored = 0;
+    static constexpr uint16_t kDeflated = 8;
+
+    static uint16_t read16(const uint8_t* p) { return uint16_t(p[0] | p[1] << 8); }
+
+    static uint32_t read32(const uint8_t* p) { return uint32_t(read16(p)) | uint32_t(read16(p + 2)) << 16; }
+
+    // MS-DOS date and time fields, taken as UTC, in milliseconds
+    static double dosTime(uint16_t time, uint16_t date) {
+        struct tm tm = {};
+        tm.tm_sec = (time & 0x1f) * 2;
+        tm.tm_min = (time >> 5) & 0x3f;
+        tm.tm_hour = time >> 11;
+        tm.tm_mday = date & 0x1f;
+        tm.tm_mon = ((date >> 5) & 0xf) - 1;
+        tm.tm_year = (date >> 9) + 80;
+        return double(timegm(&tm)) * 1000;
+    }
+
+    struct ZipEntry {
+        bool isDirectory;
+        uint16_t method;
+        // Where the entry's data starts in the archive, after its local header
+        uint32_t dataOffset;
+        uint32_t compressedSize;
+        uint32_t size;
+        double mtime;
+        // Names of the children of a directory
+        std::vector<std::string> children;
+    };
+
+    class ZipBackend : public Backend {
+    public:
+        const uint8_t* data;
+        size_t size;
+        // Keyed by the path inside the archive, without leading or trailing slashes; the root is ""
+        std::unordered_map<std::string, ZipEntry> entries;
+
+        ZipBackend(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+        // Index the central directory, or return false if this isn't an archive the backend can read.
+        bool index() {
+            if (size < kEndOfCentralDirectorySize) {
+                return false;
+            }
+            // The end of central directory record is followed by a comment of up to 64 KiB
+            size_t end = size - kEndOfCentralDirectorySize;
+            size_t last = end > 0xffff ? end - 0xffff : 0;
+            while (read32(data + end) != kEndOfCentralDirectory) {
+                if (end == last) {
+                    return false;
+                }
+                --end;
+            }
+            uint16_t count = read16(data + end + 10);
+            uint32_t directorySize = read32(data + end + 12);
+            uint32_t directoryOffset = read32(data + end + 16);
+            if (count == 0xffff || directoryOffset == 0xffffffff || size_t(directoryOffset) + directorySize > end) {
+                return false;
+            }
+
+            entries.reserve(count * 2);
+            entries[""] = {true, kStored, 0, 0, 0, 0, {}};
+            const uint8_t* header = data + directoryOffset;
+            const uint8_t* directoryEnd = header + directorySize;
+            for (uint16_t i = 0; i < count; ++i) {
+                if (directoryEnd - header < ptrdiff_t(kCentralDirectoryHeaderSize) ||
+                    read32(header) != kCentralDirectoryHeader) {
+                    return false;
+                }
+                uint16_t nameLength = read16(header + 28);
+                size_t headerSize =
+                        kCentralDirectoryHeaderSize + nameLength + read16(header + 30) + read16(header + 32);
+                if (directoryEnd - header < ptrdiff_t(headerSize)) {
+                    return false;
+                }
+                std::string name(reinterpret_cast<const char*>(header + kCentralDirectoryHeaderSize), nameLength);
+                std::replace(name.begin(), name.end(), '\\', '/');
+                bool isDirectory = !name.empty() && name.back() == '/';
+                name.erase(0, name.find_first_not_of('/'));
+                name.erase(name.find_last_not_of('/') + 1);
+                ZipEntry entry{isDirectory, read16(header + 10), 0, read32(header + 20), read32(header + 24),
+                               dosTime(read16(header + 12), read16(header + 14)), {}};
+                bool encrypted = read16(header + 8) & 1;
+                uint32_t localOffset = read32(header + 42);
+                header += headerSize;
+                if (name.empty()) {
+                    continue;
+                }
+                if (!isDirectory) {
+                    if (size_t(localOffset) + kLocalFileHeaderSize > size ||
+                        read32(data + localOffset) != kLocalFileHeader) {
+                        return false;
+                    }
+                    size_t dataOffset = size_t(localOffset) + kLocalFileHeaderSize +
+                                        read16(data + localOffset + 26) + read16(data + localOffset + 28);
+                    if (dataOffset > size || size - dataOffset < entry.compressedSize) {
+                        return false;
+                    }
+                    entry.dataOffset = uint32_t(dataOffset);
+                    // Encrypted entries are listed, but can't be read
+                    if (encrypted) {
+                        entry.method = 0xffff;
+                    }
+                }
+                insert(name, std::move(entry));
+            }
+            return true;
+        }
+
+        // Add `path` and any parent directories the archive doesn't list on their own.
+        void insert(const std::string& path, ZipEntry&& entry) {
+            if (auto it = entries.find(path); it != entries.end()) {
+                // A duplicate name, or an explicit entry for a directory one of its files implied
+                if (it->second.isDirectory && entry.isDirectory) {
+                    it->second.mtime = entry.mtime;
+                } else if (!it->second.isDirectory && !entry.isDirectory) {
+                    it->second = std::move(entry);
+                }
+                return;
+            }
+            size_t slash = path.rfind('/');
+            std::string parent = slash == std::string::npos ? "" : path.substr(0, slash);
+            if (entries.find(parent) == entries.end()) {
+                insert(parent, {true, kStored, 0, 0, 0, entry.mtime, {}});
+            }
+            auto& directory = entries[parent];
+            if (!directory.isDirectory) {
+                // A file and a directory of the same name; the file wins
+                return;
+            }
+            directory.children.push_back(slash == std::string::npos ? path : path.substr(slash + 1));
+            entries.emplace(path, std::move(entry));
+        }
+
+        std::shared_ptr<DataFile> createFile(mode_t mode) override {
+            WASMFS_UNREACHABLE("Zip archives are read-only");
+        }
+
+        std::shared_ptr<Directory> createDirectory(mode_t mode) override;
+
+        std::shared_ptr<Symlink> createSymlink(std::string target) override {
+            WASMFS_UNREACHABLE("Zip archives are read-only");
+        }
+    };
+
+    class ZipFile : public DataFile {
+        const ZipBackend& archive;
+        const ZipEntry& entry;
+        size_t openCount = 0;
+        // Contents of a deflated entry while the file is open
+        std::vector<uint8_t> inflated;
+
+    public:
+        ZipFile(ZipBackend* backend, const ZipEntry& entry)
+                : DataFile(0444, backend), archive(*backend), entry(entry) {
+            atime = mtime = ctime = entry.mtime;
+        }
+
+    private:
+        off_t getSize() override { return entry.size; }
+
+        int setSize(off_t size) override { return -EROFS; }
+
+        int open(oflags_t flags) override {
+            if (flags != O_RDONLY) {
+                return -EROFS;
+            }
+            ++openCount;
+            return 0;
+        }
+
+        int close() override {
+            if (--openCount == 0) {
+                inflated = {};
+            }
+            return 0;
+        }
+
+        // Inflate the whole entry in one call and return 0 or an error code.
+        int inflate() {
+            if (!inflated.empty() || entry.size == 0) {
+                return 0;
+            }
+            std::vector<uint8_t> contents(entry.size);
+            z_stream stream = {};
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+                return ENOMEM;
+            }
+            stream.next_in = const_cast<Bytef*>(archive.data + entry.dataOffset);
+            stream.avail_in = entry.compressedSize;
+            stream.next_out = contents.data();
+            stream.avail_out = entry.size;
+            int ret = ::inflate(&stream, Z_FINISH);
+            inflateEnd(&stream);
+            if (ret != Z_STREAM_END || stream.total_out != entry.size) {
+                return EIO;
+            }
+            inflated = std::move(contents);
+            return 0;
+        }
+
+        ssize_t read(uint8_t* buf, size_t len, off_t offset) override {
+            const uint8_t* contents;
+            if (entry.method == kStored && entry.compressedSize == entry.size) {
+                contents = archive.data + entry.dataOffset;
+            } else if (entry.method == kDeflated) {
+                if (auto err = inflate()) {
+                    return -err;
+                }
+                contents = inflated.data();
+            } else {
+                return -EIO;
+            }
+            if (offset >= off_t(entry.size)) {
+                return 0;
+            }
+            size_t count = std::min(len, size_t(entry.size - offset));
+            memcpy(buf, contents + offset, count);
+            return count;
+        }
+
+        ssize_t write(const uint8_t* buf, size_t len, off_t offset) override { return -EROFS; }
+
+        int flush() override { return 0; }
+    };
+
+    class ZipDirectory : public Directory {
+        ZipBackend& archive;
+        std::string path;
+        const ZipEntry& entry;
+
+    public:
+        ZipDirectory(ZipBackend* backend, std::string path, const ZipEntry& entry)
+                : Directory(0555, backend), archive(*backend), path(std::move(path)), entry(entry) {
+            atime = mtime = ctime = entry.mtime;
+        }
+
+    private:
+        std::string getChildPath(const std::string& name) {
+            return path.empty() ? name : path + '/' + name;
+        }
+
+        std::shared_ptr<File> getChild(const std::string& name) override {
+            auto childPath = getChildPath(name);
+            auto it = archive.entries.find(childPath);
+            if (it == archive.entries.end()) {
+                return nullptr;
+            }
+            if (it->second.isDirectory) {
+                return std::make_shared<ZipDirectory>(&archive, childPath, it->second);
+            }
+            return std::make_shared<ZipFile>(&archive, it->second);
+        }
+
+        int removeChild(const std::string& name) override { return -EROFS; }
+
+        std::shared_ptr<DataFile> insertDataFile(const std::string& name, mode_t mode) override {
+            return nullptr;
+        }
+
+        std::shared_ptr<Directory> insertDirectory(const std::string& name, mode_t mode) override {
+            return nullptr;
+        }
+
+        std::shared_ptr<Symlink> insertSymlink(const std::string& name, const std::string& target) override {
+            return nullptr;
+        }
+
+        int insertMove(const std::string& name, std::shared_ptr<File> file) override { return -EROFS; }
+
+        ssize_t getNumEntries() override { return entry.children.size(); }
+
+        Directory::MaybeEntries getEntries() override {
+            std::vector<Directory::Entry> entries;
+            entries.reserve(entry.children.size());
+            for (const auto& name : entry.children) {
+                bool isDirectory = archive.entries.at(getChildPath(name)).isDirectory;
+                entries.push_back({name, isDirectory ? File::DirectoryKind : File::DataFileKind, 0});
+            }
+            return {entries};
+        }
+    };
+
+    std::shared_ptr<Directory> ZipBackend::createDirectory(mode_t mode) {
+        return std::make_shared<ZipDirectory>(this, "", entries.at(""));
+    }
+
+    extern "C" {
+
+    // A backend serving the zip archive in `data`, which must stay valid as long as the backend is mounted,
+    // or null if the archive can't be read.
+    backend_t wasmfs_create_zipfs_backend(const uint8_t* data, size_t size) {
+        auto backend = std::make_unique<ZipBackend>(data, size);
+        if (!backend->index()) {
+            return nullptr;
+        }
+        return wasmFS.addBackend(std::move(backend));
+    }
+
+} // extern "C"
+
+} // namespace wasmfs
@@ -0,0 +1,507 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "byte_buffer.h"
+#include "lauxlib.h"
+#include "xml.h"
+
+// Native replacement for PoB's xml.lua. Nodes have the same shape:
+//
+//   { elem = "Name", attrib = { key = "value" }, [1] = child node or text, ... }
+//
+// ParseXML returns the list of top-level elements, ComposeXML serialises one node with a tab per
+// nesting level. Text is trimmed when read and written on its own line, like the Lua version.
+
+#define XML_MAX_DEPTH 200
+#define XML_NAME_SLOTS 256
+#define XML_MAX_NAMES 192
+
+typedef struct {
+    const char *name;
+    size_t len;
+    int index;
+} NameSlot;
+
+typedef struct {
+    lua_State *L;
+    const char *start;
+    const char *p;
+    const char *end;
+    int names;
+    int elem_key;
+    int attrib_key;
+    int name_count;
+    NameSlot slots[XML_NAME_SLOTS];
+    const char *open_names[XML_MAX_DEPTH];
+    size_t open_lens[XML_MAX_DEPTH];
+    int child_counts[XML_MAX_DEPTH + 1];
+    int depth;
+} Parser;
+
+// Parsing never calls back into Lua, so one parser state serves every call. Entity decoding and
+// composing write into the buffers below, which keep their capacity between calls.
+static Parser st_parser;
+static ByteBuffer st_scratch;
+static ByteBuffer st_output;
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int is_name_end(char c) {
+    return is_space(c) || c == '/' || c == '>' || c == '=';
+}
+
+// Element and attribute names repeat thousands of times in a build, so each distinct name is
+// pushed once and later occurrences reuse the same Lua string from the names table.
+static void push_name(Parser *P, const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    uint32_t index = hash & (XML_NAME_SLOTS - 1);
+    while (P->slots[index].name != NULL) {
+        NameSlot *slot = &P->slots[index];
+        if (slot->len == len && memcmp(slot->name, name, len) == 0) {
+            lua_rawgeti(P->L, P->names, slot->index);
+            return;
+        }
+        index = (index + 1) & (XML_NAME_SLOTS - 1);
+    }
+    lua_pushlstring(P->L, name, len);
+    if (P->name_count < XML_MAX_NAMES) {
+        P->name_count++;
+        lua_pushvalue(P->L, -1);
+        lua_rawseti(P->L, P->names, P->name_count);
+        P->slots[index] = (NameSlot){name, len, P->name_count};
+    }
+}
+
+static void append_utf8(ByteBuffer *out, unsigned long code) {
+    char bytes[4];
+    size_t n;
+    if (code < 0x80) {
+        bytes[0] = (char)code;
+        n = 1;
+    } else if (code < 0x800) {
+        bytes[0] = (char)(0xc0 | (code >> 6));
+        bytes[1] = (char)(0x80 | (code & 0x3f));
+        n = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = (char)(0xe0 | (code >> 12));
+        bytes[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+        bytes[2] = (char)(0x80 | (code & 0x3f));
+        n = 3;
+    } else {
+        bytes[0] = (char)(0xf0 | (code >> 18));
+        bytes[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+        bytes[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+        bytes[3] = (char)(0x80 | (code & 0x3f));
+        n = 4;
+    }
+    byte_buffer_append(out, bytes, n);
+}
+
+// Decodes one entity starting at '&'. Returns the number of bytes consumed, or 0 if it is not a
+// recognised entity, in which case the '&' is kept as is.
+static size_t decode_entity(const char *s, const char *end, ByteBuffer *out) {
+    static const struct {
+        const char *name;
+        size_t len;
+        char value;
+    } named[] = {
+        {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&amp;", 5, '&'}, {"&quot;", 6, '"'}, {"&apos;", 6, '\''},
+    };
+    size_t avail = end - s;
+    for (size_t i = 0; i < sizeof(named) / sizeof(named[0]); i++) {
+        if (avail >= named[i].len && memcmp(s, named[i].name, named[i].len) == 0) {
+            byte_buffer_append(out, &named[i].value, 1);
+            return named[i].len;
+        }
+    }
+    if (avail < 4 || s[1] != '#') {
+        return 0;
+    }
+    int hex = s[2] == 'x' || s[2] == 'X';
+    const char *q = s + (hex ? 3 : 2);
+    unsigned long code = 0;
+    const char *digits = q;
+    while (q < end && q - digits < 8) {
+        char c = *q;
+        int v = c >= '0' && c <= '9' ? c - '0'
+              : hex && c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : hex && c >= 'A' && c <= 'F' ? c - 'A' + 10
+              : -1;
+        if (v < 0) {
+            break;
+        }
+        code = code * (hex ? 16 : 10) + v;
+        q++;
+    }
+    if (q == digits || q >= end || *q != ';' || code > 0x10ffff) {
+        return 0;
+    }
+    append_utf8(out, code);
+    return q + 1 - s;
+}
+
+static void push_text(lua_State *L, const char *s, size_t len) {
+    const char *amp = memchr(s, '&', len);
+    if (amp == NULL) {
+        lua_pushlstring(L, s, len);
+        return;
+    }
+    const char *end = s + len;
+    st_scratch.size = 0;
+    byte_buffer_append(&st_scratch, s, amp - s);
+    const char *p = amp;
+    while (p < end) {
+        if (*p == '&') {
+            size_t used = decode_entity(p, end, &st_scratch);
+            if (used > 0) {
+                p += used;
+                continue;
+            }
+        }
+        const char *next = memchr(p + 1, '&', end - p - 1);
+        if (next == NULL) {
+            next = end;
+        }
+        byte_buffer_append(&st_scratch, p, next - p);
+        p = next;
+    }
+    lua_pushlstring(L, (const char *)st_scratch.data, st_scratch.size);
+}
+
+static int parse_error(Parser *P, const char *message) {
+    int line = 1;
+    for (const char *c = P->start; c < P->p && c < P->end; c++) {
+        line += *c == '\n';
+    }
+    lua_pushnil(P->L);
+    lua_pushfstring(P->L, "%s on line %d", message, line);
+    return 2;
+}
+
+static int skip_past(Parser *P, const char *terminator) {
+    size_t len = strlen(terminator);
+    for (const char *c = P->p; c + len <= P->end; c++) {
+        if (memcmp(c, terminator, len) == 0) {
+            P->p = c + len;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void skip_space(Parser *P) {
+    while (P->p < P->end && is_space(*P->p)) {
+        P->p++;
+    }
+}
+
+// Pops the value on top of the stack into the children of the element at `parent`.
+static void append_child(Parser *P, int parent) {
+    lua_rawseti(P->L, parent, ++P->child_counts[P->depth]);
+}
+
+static void add_text(Parser *P, const char *s, const char *e) {
+    while (s < e && is_space(*s)) {
+        s++;
+    }
+    while (e > s && is_space(e[-1])) {
+        e--;
+    }
+    if (s == e || P->depth == 0) {
+        return;
+    }
+    push_text(P->L, s, e - s);
+    append_child(P, -2);
+}
+
+// Parses one start tag after '<'. Leaves the element on the stack when it has content.
+static int parse_start_tag(Parser *P) {
+    lua_State *L = P->L;
+    const char *name = P->p;
+    while (P->p < P->end && !is_name_end(*P->p)) {
+        P->p++;
+    }
+    size_t name_len = P->p - name;
+    if (name_len == 0) {
+        return parse_error(P, "Expected element name");
+    }
+
+    lua_createtable(L, 0, 2);
+    lua_pushvalue(L, P->elem_key);
+    push_name(P, name, name_len);
+    lua_rawset(L, -3);
+    lua_createtable(L, 0, 4);
+
+    for (;;) {
+        skip_space(P);
+        if (P->p >= P->end) {
+            return parse_error(P, "Unterminated start tag");
+        }
+        char c = *P->p;
+        if (c == '>' || c == '/') {
+            int self_closing = c == '/';
+            P->p += self_closing ? 2 : 1;
+            if (self_closing && (P->p > P->end || P->p[-1] != '>')) {
+                return parse_error(P, "Expected '>'");
+            }
+            lua_pushvalue(L, P->attrib_key);
+            lua_insert(L, -2);
+            lua_rawset(L, -3);
+
+            lua_pushvalue(L, -1);
+            append_child(P, -3);
+            if (self_closing) {
+                lua_pop(L, 1);
+                return 0;
+            }
+            if (P->depth >= XML_MAX_DEPTH) {
+                return parse_error(P, "Elements nested too deeply");
+            }
+            P->open_names[P->depth] = name;
+            P->open_lens[P->depth] = name_len;
+            P->depth++;
+            P->child_counts[P->depth] = 0;
+            luaL_checkstack(L, 4, "XML nesting");
+            return 0;
+        }
+
+        const char *key = P->p;
+        while (P->p < P->end && !is_name_end(*P->p)) {
+            P->p++;
+        }
+        size_t key_len = P->p - key;
+        skip_space(P);
+        if (key_len == 0 || P->p >= P->end || *P->p != '=') {
+            return parse_error(P, "Expected attribute");
+        }
+        P->p++;
+        skip_space(P);
+        if (P->p >= P->end || (*P->p != '"' && *P->p != '\'')) {
+            return parse_error(P, "Expected quoted attribute value");
+        }
+        char quote = *P->p++;
+        const char *value = P->p;
+        const char *value_end = memchr(value, quote, P->end - value);
+        if (value_end == NULL) {
+            return parse_error(P, "Unterminated attribute value");
+        }
+        P->p = value_end + 1;
+        push_name(P, key, key_len);
+        push_text(L, value, value_end - value);
+        lua_rawset(L, -3);
+    }
+}
+
+static int parse_end_tag(Parser *P) {
+    const char *name = P->p;
+    while (P->p < P->end && !is_name_end(*P->p)) {
+        P->p++;
+    }
+    size_t name_len = P->p - name;
+    skip_space(P);
+    if (P->p >= P->end || *P->p != '>') {
+        return parse_error(P, "Expected '>'");
+    }
+    P->p++;
+    if (P->depth == 0) {
+        return parse_error(P, "Unexpected closing tag");
+    }
+    P->depth--;
+    if (P->open_lens[P->depth] != name_len || memcmp(P->open_names[P->depth], name, name_len) != 0) {
+        return parse_error(P, "Mismatched closing tag");
+    }
+    lua_pop(P->L, 1);
+    return 0;
+}
+
+// ParseXML(text) returns the list of top-level elements, or nil and an error message.
+static int ParseXML(lua_State *L) {
+    size_t len;
+    const char *text = luaL_checklstring(L, 1, &len);
+    lua_settop(L, 1);
+
+    Parser *P = &st_parser;
+    memset(P->slots, 0, sizeof(P->slots));
+    P->L = L;
+    P->start = text;
+    P->p = text;
+    P->end = text + len;
+    P->name_count = 0;
+    P->depth = 0;
+    P->child_counts[0] = 0;
+
+    lua_createtable(L, 64, 0);
+    P->names = lua_gettop(L);
+    lua_pushliteral(L, "elem");
+    P->elem_key = lua_gettop(L);
+    lua_pushliteral(L, "attrib");
+    P->attrib_key = lua_gettop(L);
+    lua_newtable(L);
+    int document = lua_gettop(L);
+
+    int result = 0;
+    while (P->p < P->end && result == 0) {
+        const char *lt = memchr(P->p, '<', P->end - P->p);
+        if (lt == NULL) {
+            add_text(P, P->p, P->end);
+            P->p = P->end;
+            break;
+        }
+        add_text(P, P->p, lt);
+        P->p = lt + 1;
+        size_t rest = P->end - P->p;
+        if (rest >= 1 && *P->p == '?') {
+            if (!skip_past(P, "?>")) {
+                result = parse_error(P, "Unterminated processing instruction");
+            }
+        } else if (rest >= 3 && memcmp(P->p, "!--", 3) == 0) {
+            if (!skip_past(P, "-->")) {
+                result = parse_error(P, "Unterminated comment");
+            }
+        } else if (rest >= 8 && memcmp(P->p, "![CDATA[", 8) == 0) {
+            const char *cdata = P->p + 8;
+            if (!skip_past(P, "]]>")) {
+                result = parse_error(P, "Unterminated CDATA section");
+            } else if (P->depth > 0) {
+                lua_pushlstring(L, cdata, P->p - 3 - cdata);
+                append_child(P, -2);
+            }
+        } else if (rest >= 1 && *P->p == '!') {
+            if (!skip_past(P, ">")) {
+                result = parse_error(P, "Unterminated declaration");
+            }
+        } else if (rest >= 1 && *P->p == '/') {
+            P->p++;
+            result = parse_end_tag(P);
+        } else {
+            result = parse_start_tag(P);
+        }
+    }
+    if (result == 0 && P->depth > 0) {
+        result = parse_error(P, "Unclosed element");
+    }
+    if (result != 0) {
+        return result;
+    }
+    lua_settop(L, document);
+    return 1;
+}
+
+static void append_escaped(ByteBuffer *out, const char *s, size_t len) {
+    const char *run = s;
+    for (const char *c = s; c < s + len; c++) {
+        const char *entity;
+        switch (*c) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&apos;"; break;
+            default: continue;
+        }
+        byte_buffer_append(out, run, c - run);
+        byte_buffer_append(out, entity, strlen(entity));
+        run = c + 1;
+    }
+    byte_buffer_append(out, run, s + len - run);
+}
+
+static void append_indent(ByteBuffer *out, int depth) {
+    static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+    while (depth > 0) {
+        int n = depth < 16 ? depth : 16;
+        byte_buffer_append(out, tabs, n);
+        depth -= n;
+    }
+}
+
+static void compose_node(lua_State *L, int index, int depth) {
+    ByteBuffer *out = &st_output;
+    if (depth > XML_MAX_DEPTH) {
+        luaL_error(L, "ComposeXML: nodes nested too deeply");
+    }
+    luaL_checkstack(L, 6, "XML nesting");
+    int type = lua_type(L, index);
+    if (type == LUA_TSTRING || type == LUA_TNUMBER) {
+        size_t len;
+        const char *text = lua_tolstring(L, index, &len);
+        append_indent(out, depth);
+        append_escaped(out, text, len);
+        byte_buffer_append(out, "\n", 1);
+        return;
+    }
+    if (type != LUA_TTABLE) {
+        luaL_error(L, "ComposeXML: unexpected %s node", lua_typename(L, type));
+    }
+
+    lua_getfield(L, index, "elem");
+    size_t elem_len;
+    const char *elem = lua_tolstring(L, -1, &elem_len);
+    if (elem == NULL) {
+        luaL_error(L, "ComposeXML: node without elem");
+    }
+    append_indent(out, depth);
+    byte_buffer_append(out, "<", 1);
+    byte_buffer_append(out, elem, elem_len);
+
+    lua_getfield(L, index, "attrib");
+    if (lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            size_t key_len, value_len;
+            lua_pushvalue(L, -2);
+            const char *key = luaL_tolstring(L, -1, &key_len);
+            const char *value = luaL_tolstring(L, -3, &value_len);
+            byte_buffer_append(out, " ", 1);
+            byte_buffer_append(out, key, key_len);
+            byte_buffer_append(out, "=\"", 2);
+            append_escaped(out, value, value_len);
+            byte_buffer_append(out, "\"", 1);
+            lua_pop(L, 4);
+        }
+    }
+    lua_pop(L, 1);
+
+    size_t count = lua_rawlen(L, index);
+    if (count == 0) {
+        byte_buffer_append(out, "/>\n", 3);
+    } else {
+        byte_buffer_append(out, ">\n", 2);
+        for (size_t i = 1; i <= count; i++) {
+            lua_rawgeti(L, index, (int)i);
+            compose_node(L, lua_gettop(L), depth + 1);
+            lua_pop(L, 1);
+        }
+        append_indent(out, depth);
+        byte_buffer_append(out, "</", 2);
+        byte_buffer_append(out, elem, elem_len);
+        byte_buffer_append(out, ">\n", 2);
+    }
+    lua_pop(L, 1);
+}
+
+// ComposeXML(node) returns the document text for the node and everything below it.
+static int ComposeXML(lua_State *L) {
+    static const char header[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+    st_output.size = 0;
+    byte_buffer_append(&st_output, header, sizeof(header) - 1);
+    compose_node(L, 1, 0);
+    lua_pushlstring(L, (const char *)st_output.data, st_output.size);
+    return 1;
+}
+
+void xml_init(lua_State *L) {
+    lua_pushcfunction(L, ParseXML);
+    lua_setglobal(L, "ParseXML");
+
+    lua_pushcfunction(L, ComposeXML);
+    lua_setglobal(L, "ComposeXML");
+}
@@ -0,0 +1,9 @@
+#ifndef DRIVER_XML_H
+#define DRIVER_XML_H
+
+#include "lua.h"
+
+// Registers ParseXML/ComposeXML, native versions of the functions in PoB's xml.lua.
+extern void xml_init(lua_State *L);
+
+#endif //DRIVER_XML_H
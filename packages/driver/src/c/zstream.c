@@ -0,0 +1,292 @@
+#include <string.h>
+
+#include "build_code_dictionary.h"
+#include "lauxlib.h"
+#include "zstream.h"
+
+#define ZSTREAM_TYPE "ZStream"
+#define ZSTREAM_MIN_CHUNK (16 * 1024)
+#define ZSTREAM_MAX_CHUNK (1024 * 1024)
+// One-shot Deflate/Inflate refuse inputs larger than this
+#define ZSTREAM_MAX_INPUT (128ull << 20)
+
+// One-shot Deflate/Inflate reuse these instead of allocating zlib state on every call.
+static ZStream st_deflate;
+static ZStream st_inflate;
+
+static const char *const strategy_names[] = {"default", "filtered", "huffman", "rle", "fixed", NULL};
+static const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+
+static int zstream_open(ZStream *stream, int inflating, int level, int strategy) {
+    memset(&stream->strm, 0, sizeof(stream->strm));
+    stream->inflating = inflating;
+    stream->finished = 0;
+    int ret = inflating ? inflateInit(&stream->strm)
+                        : deflateInit2(&stream->strm, level, Z_DEFLATED, MAX_WBITS, 8, strategy);
+    stream->failed = ret != Z_OK;
+    return ret;
+}
+
+static void zstream_close(ZStream *stream) {
+    if (stream->strm.state == NULL) {
+        return;
+    }
+    if (stream->inflating) {
+        inflateEnd(&stream->strm);
+    } else {
+        deflateEnd(&stream->strm);
+    }
+    stream->strm.state = NULL;
+}
+
+static int zstream_reset(ZStream *stream) {
+    int ret = stream->inflating ? inflateReset(&stream->strm) : deflateReset(&stream->strm);
+    stream->finished = 0;
+    stream->failed = ret != Z_OK;
+    return ret;
+}
+
+int zstream_reuse(ZStream *stream, int inflating, int level) {
+    if (stream->strm.state == NULL) {
+        return zstream_open(stream, inflating, level, Z_DEFAULT_STRATEGY);
+    }
+    int ret = zstream_reset(stream);
+    if (ret == Z_OK && !inflating) {
+        ret = deflateParams(&stream->strm, level, Z_DEFAULT_STRATEGY);
+    }
+    return ret;
+}
+
+// Runs zlib over the input and appends everything it produces to the buffer. Output goes straight
+// into the luaL_Buffer, in chunks that start at the size hint and double up to ZSTREAM_MAX_CHUNK, so
+// nothing is staged in a temporary allocation first.
+int zstream_run(ZStream *stream, const char *in, size_t in_len, int flush, luaL_Buffer *b) {
+    z_stream *strm = &stream->strm;
+    strm->next_in = (Bytef *)in;
+    strm->avail_in = in_len;
+
+    // inflate() treats Z_FINISH only as a hint, so it is driven the same way in both cases and
+    // finishing just requires reaching the end of the stream.
+    int zflush = stream->inflating ? Z_NO_FLUSH : flush;
+    size_t chunk = stream->size_hint;
+    if (chunk < ZSTREAM_MIN_CHUNK) {
+        chunk = ZSTREAM_MIN_CHUNK;
+    } else if (chunk > ZSTREAM_MAX_CHUNK) {
+        chunk = ZSTREAM_MAX_CHUNK;
+    }
+    for (;;) {
+        char *out = luaL_prepbuffsize(b, chunk);
+        strm->next_out = (Bytef *)out;
+        strm->avail_out = chunk;
+        int ret = stream->inflating ? inflate(strm, zflush) : deflate(strm, zflush);
+        luaL_addsize(b, chunk - strm->avail_out);
+
+        if (ret == Z_STREAM_END) {
+            stream->finished = 1;
+            return Z_OK;
+        }
+        if (ret == Z_NEED_DICT) {
+            // The header names a preset dictionary by its Adler-32. Build codes made with one of ours
+            // continue with it, so Inflate, inflate streams and DecodeBuildCode all accept them.
+            const BuildCodeDictionary *dictionary = build_code_dictionary_find(strm->adler);
+            if (dictionary == NULL) {
+                return Z_NEED_DICT;
+            }
+            ret = inflateSetDictionary(strm, dictionary->data, dictionary->size);
+            if (ret != Z_OK) {
+                return ret;
+            }
+            continue;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return ret;
+        }
+        if (strm->avail_out != 0 && strm->avail_in == 0) {
+            // All input consumed and zlib had room left, so it has nothing more to give right now.
+            if (flush == Z_FINISH) {
+                return Z_BUF_ERROR;
+            }
+            return Z_OK;
+        }
+        if (chunk < ZSTREAM_MAX_CHUNK) {
+            chunk *= 2;
+        }
+    }
+}
+
+static int push_error(lua_State *L, ZStream *stream, int ret) {
+    stream->failed = 1;
+    lua_pushnil(L);
+    lua_pushstring(L, ret == Z_DATA_ERROR && stream->strm.msg != NULL ? stream->strm.msg : zError(ret));
+    return 2;
+}
+
+static int process(lua_State *L, ZStream *stream, int index, int flush) {
+    size_t in_len = 0;
+    const char *in = luaL_optlstring(L, index, "", &in_len);
+    if (stream->failed) {
+        lua_pushnil(L);
+        lua_pushstring(L, "stream is in an error state");
+        return 2;
+    }
+    if (stream->finished) {
+        lua_pushnil(L);
+        lua_pushstring(L, "stream already finished");
+        return 2;
+    }
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    int ret = zstream_run(stream, in, in_len, flush, &b);
+    if (ret != Z_OK) {
+        return push_error(L, stream, ret);
+    }
+    luaL_pushresult(&b);
+    return 1;
+}
+
+static int Deflate(lua_State *L) {
+    size_t in_len;
+    luaL_checklstring(L, 1, &in_len);
+    int level = luaL_optint(L, 2, Z_BEST_COMPRESSION);
+
+    // Prevent deflation of input data larger than 128 MiB.
+    if (in_len > ZSTREAM_MAX_INPUT) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Input larger than 128 MiB");
+        return 2;
+    }
+
+    ZStream *stream = &st_deflate;
+    if (zstream_reuse(stream, 0, level) != Z_OK) {
+        zstream_close(stream);
+        lua_pushnil(L);
+        lua_pushstring(L, "deflateInit failed");
+        return 2;
+    }
+    stream->size_hint = deflateBound(&stream->strm, in_len);
+    return process(L, stream, 1, Z_FINISH);
+}
+
+static int Inflate(lua_State *L) {
+    size_t in_len;
+    luaL_checklstring(L, 1, &in_len);
+
+    // Prevent inflation of input data larger than 128 MiB.
+    if (in_len > ZSTREAM_MAX_INPUT) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Input larger than 128 MiB");
+        return 2;
+    }
+
+    ZStream *stream = &st_inflate;
+    if (zstream_reuse(stream, 1, 0) != Z_OK) {
+        zstream_close(stream);
+        lua_pushnil(L);
+        lua_pushstring(L, "inflateInit failed");
+        return 2;
+    }
+    stream->size_hint = in_len * 4;
+    return process(L, stream, 1, Z_FINISH);
+}
+
+static ZStream *new_stream(lua_State *L, int inflating, int level, int strategy, size_t size_hint) {
+    ZStream *stream = lua_newuserdata(L, sizeof(ZStream));
+    stream->strm.state = NULL;
+    luaL_setmetatable(L, ZSTREAM_TYPE);
+    if (zstream_open(stream, inflating, level, strategy) != Z_OK) {
+        luaL_error(L, "%s failed", inflating ? "inflateInit" : "deflateInit");
+    }
+    stream->size_hint = size_hint;
+    return stream;
+}
+
+// NewDeflateStream([level[, strategy[, sizeHint]]])
+static int NewDeflateStream(lua_State *L) {
+    int level = luaL_optint(L, 1, Z_BEST_COMPRESSION);
+    int strategy = strategies[luaL_checkoption(L, 2, "default", strategy_names)];
+    lua_Integer size_hint = luaL_optinteger(L, 3, 0);
+    luaL_argcheck(L, level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION, 1, "level out of range");
+    luaL_argcheck(L, size_hint >= 0, 3, "size hint must not be negative");
+    new_stream(L, 0, level, strategy, (size_t)size_hint);
+    return 1;
+}
+
+// NewInflateStream([sizeHint])
+static int NewInflateStream(lua_State *L) {
+    lua_Integer size_hint = luaL_optinteger(L, 1, 0);
+    luaL_argcheck(L, size_hint >= 0, 1, "size hint must not be negative");
+    new_stream(L, 1, 0, 0, (size_t)size_hint);
+    return 1;
+}
+
+// stream:Feed(data) returns whatever output is ready so far, possibly an empty string.
+static int ZStream_Feed(lua_State *L) {
+    ZStream *stream = luaL_checkudata(L, 1, ZSTREAM_TYPE);
+    luaL_checkstring(L, 2);
+    return process(L, stream, 2, Z_NO_FLUSH);
+}
+
+// stream:Finish([data]) returns the rest of the output. The stream can be used again after Reset().
+static int ZStream_Finish(lua_State *L) {
+    ZStream *stream = luaL_checkudata(L, 1, ZSTREAM_TYPE);
+    return process(L, stream, 2, Z_FINISH);
+}
+
+static int ZStream_Reset(lua_State *L) {
+    ZStream *stream = luaL_checkudata(L, 1, ZSTREAM_TYPE);
+    lua_Integer size_hint = luaL_optinteger(L, 2, (lua_Integer)stream->size_hint);
+    luaL_argcheck(L, size_hint >= 0, 2, "size hint must not be negative");
+    if (stream->strm.state == NULL || zstream_reset(stream) != Z_OK) {
+        return luaL_error(L, "stream cannot be reset");
+    }
+    stream->size_hint = (size_t)size_hint;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int ZStream_TotalIn(lua_State *L) {
+    ZStream *stream = luaL_checkudata(L, 1, ZSTREAM_TYPE);
+    lua_pushnumber(L, (lua_Number)stream->strm.total_in);
+    return 1;
+}
+
+static int ZStream_TotalOut(lua_State *L) {
+    ZStream *stream = luaL_checkudata(L, 1, ZSTREAM_TYPE);
+    lua_pushnumber(L, (lua_Number)stream->strm.total_out);
+    return 1;
+}
+
+static int ZStream_gc(lua_State *L) {
+    zstream_close(luaL_checkudata(L, 1, ZSTREAM_TYPE));
+    return 0;
+}
+
+void zstream_init(lua_State *L) {
+    static const luaL_Reg methods[] = {
+        {"Feed", ZStream_Feed},
+        {"Finish", ZStream_Finish},
+        {"Reset", ZStream_Reset},
+        {"TotalIn", ZStream_TotalIn},
+        {"TotalOut", ZStream_TotalOut},
+        {"__gc", ZStream_gc},
+        {NULL, NULL},
+    };
+    luaL_newmetatable(L, ZSTREAM_TYPE);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, methods, 0);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, Deflate);
+    lua_setglobal(L, "Deflate");
+
+    lua_pushcfunction(L, Inflate);
+    lua_setglobal(L, "Inflate");
+
+    lua_pushcfunction(L, NewDeflateStream);
+    lua_setglobal(L, "NewDeflateStream");
+
+    lua_pushcfunction(L, NewInflateStream);
+    lua_setglobal(L, "NewInflateStream");
+}
@@ -0,0 +1,26 @@
+#ifndef DRIVER_ZSTREAM_H
+#define DRIVER_ZSTREAM_H
+
+#include <zlib.h>
+#include "lua.h"
+#include "lauxlib.h"
+
+typedef struct {
+    z_stream strm;
+    int inflating;
+    int finished;
+    int failed;
+    size_t size_hint;
+} ZStream;
+
+// Opens the stream on first use and resets it afterwards, so one z_stream serves many calls.
+int zstream_reuse(ZStream *stream, int inflating, int level);
+
+// Runs the stream over the input, appending its output to the buffer. Returns a zlib status;
+// Z_NEED_DICT means the input asked for a preset dictionary the driver does not know.
+int zstream_run(ZStream *stream, const char *in, size_t in_len, int flush, luaL_Buffer *b);
+
+// Registers Deflate/Inflate and the NewDeflateStream/NewInflateStream constructors.
+extern void zstream_init(lua_State *L);
+
+#endif //DRIVER_ZSTREAM_H
@@ -5,14 +5,45 @@ import type { FilesystemConfig } from "./driver.ts";
 import { markEnvironmentError } from "./error.ts";
 import { FilesystemRpcHandler } from "./filesystem-handler.ts";
 import { CloudflareKV, rejectWrites } from "./fs.ts";
+import { log, tag } from "./logger.ts";
 import type { PoeOAuthAuthorization } from "./poe-oauth.ts";
 import { exposeRpcPort, prepareFetchHeaders, type RpcResult } from "./rpc.ts";
 import { removeStaleSettingsSuffix } from "./settings.ts";
+import { SubScriptCache } from "./sub-cache.ts";
+import {
+  serializeSubScriptDownload,
+  type SubScriptDownloadRequest,
+  type SubScriptDownloadResponse,
+  subScriptDownloadRequest,
+} from "./sub-download.ts";
+import { SubScriptJobs, splitSubScriptBatch } from "./sub-jobs.ts";
+import { SubScriptPool, subScriptPoolSize, subScriptPriority } from "./sub-pool.ts";
+import { SubScriptSharedData } from "./sub-shared-data.ts";
 import type { SubScriptWorker } from "./sub.ts";
 import { TruncatingWebAccess } from "./web-access.ts";
 // @ts-types="./vite-worker.d.ts"
 import SubWorkerObject from "./sub.ts?worker";
 
+// Outside the game's user directory, which the heap snapshot fingerprint covers. Entries are kept in a
+// directory per asset prefix, which names the game and version.
+const SUBSCRIPT_CACHE_DIRECTORY = "/user/.subscript-cache";
+// Time an aborted subscript gets to stop at its next cancellation check before its worker is terminated
+const SUBSCRIPT_ABORT_GRACE_MS = 1_000;
+
+type SubWorker = {
+  worker: Worker;
+  remote: Comlink.Remote<SubScriptWorker>;
+  // Version of each shared data image the worker holds
+  shared: Map<string, number>;
+  terminate(): void;
+};
+
+type SubscriptJob = {
+  port: MessagePort;
+  // Set to 1 on abort; polled by the Lua hook in the sub worker
+  cancel: Int32Array;
+};
+
 type BrokerCallbacks = {
   fetch: (url: string, headers: Record<string, string>, body?: string) => Promise<unknown>;
   oauthAuthorize: (url: string, timeoutMs: number) => Promise<PoeOAuthAuthorization>;
@@ -23,9 +54,29 @@ class AsyncBroker {
   private callbacks: BrokerCallbacks | undefined;
   private eventPort: MessagePort | undefined;
   private nextSubscriptId = 1;
-  private subscripts = new Map<number, { worker: Worker; port: MessagePort }>();
+  private nextSubscriptJobId = 1;
+  private sharedData = new SubScriptSharedData();
+  private subscripts = new SubScriptJobs<SubscriptJob>();
+  private subscriptPool = new SubScriptPool<SubWorker>(() => this.createSubWorker(), subScriptPoolSize());
+  private subscriptCache = new SubScriptCache({
+    read: async (path) => {
+      try {
+        return await zenfs.promises.readFile(`${SUBSCRIPT_CACHE_DIRECTORY}/${path}`);
+      } catch (error) {
+        if ((error as { code?: string }).code === "ENOENT") return undefined;
+        throw error;
+      }
+    },
+    write: async (path, data) => {
+      const file = `${SUBSCRIPT_CACHE_DIRECTORY}/${path}`;
+      await zenfs.promises.mkdir(file.slice(0, file.lastIndexOf("/")), { recursive: true });
+      await zenfs.promises.writeFile(file, data);
+    },
+    remove: (path) => zenfs.promises.rm(`${SUBSCRIPT_CACHE_DIRECTORY}/${path}`, { recursive: true, force: true }),
+  });
   private filesystem = new FilesystemRpcHandler();
   private cloudDirectory: string | undefined;
+  private userDirectory: string | undefined;
 
   async start(
     port: MessagePort,
@@ -35,11 +86,13 @@ class AsyncBroker {
     fetchCallback: BrokerCallbacks["fetch"],
     oauthAuthorizeCallback: BrokerCallbacks["oauthAuthorize"],
     pasteCallback: BrokerCallbacks["paste"],
-  ) {
+  ): Promise<ArrayBuffer> {
     this.callbacks = { fetch: fetchCallback, oauthAuthorize: oauthAuthorizeCallback, paste: pasteCallback };
     this.eventPort = eventPort;
     this.cloudDirectory = config.cloudflareKvAccessToken ? `/user/${config.userDirectory}/Builds/Cloud` : undefined;
+    this.userDirectory = `/user/${config.userDirectory}`;
     this.filesystem.reset(this.cloudDirectory);
+    this.subscriptCache.setVersion(assetPrefix);
     let rootZipData: ArrayBuffer;
     try {
       const rootZip = await fetch(`${assetPrefix}/root.zip`);
@@ -88,6 +141,10 @@ class AsyncBroker {
       if (!(await zenfs.promises.exists(`${directory}/Public`))) await zenfs.promises.mkdir(`${directory}/Public`);
     }
     exposeRpcPort(port, (operation, args, data) => this.handle(operation, args, data));
+    this.subscriptPool.warm(1);
+    // The driver mounts its own copy in memory; this mount keeps serving other readers of /root
+    const rootArchive = rootZipData.slice(0);
+    return Comlink.transfer(rootArchive, [rootArchive]);
   }
 
   private async handle(operation: string, args: unknown[], data?: Uint8Array): Promise<RpcResult> {
@@ -109,50 +166,169 @@ class AsyncBroker {
         return { value: await this.callbacks!.oauthAuthorize(args[0] as string, args[1] as number) };
       case "subscript_start": {
         const id = this.nextSubscriptId++;
-        const worker = new SubWorkerObject();
-        const remote = Comlink.wrap<SubScriptWorker>(worker);
-        const channel = new MessageChannel();
-        this.subscripts.set(id, { worker, port: channel.port1 });
-        exposeRpcPort(
-          channel.port1,
-          (nestedOperation, nestedArgs, nestedData) => this.handle(nestedOperation, nestedArgs, nestedData),
-        );
-        const finish = (result: Uint8Array) => {
-          if (!this.subscripts.has(id)) return;
-          this.eventPort?.postMessage({ type: "subscript_finished", id, data: result }, [result.buffer]);
-          this.finishSubscript(id);
-        };
-        const fail = (message: string) => {
-          if (!this.subscripts.has(id)) return;
-          this.eventPort?.postMessage({ type: "subscript_error", id, message });
-          this.finishSubscript(id);
-        };
-        void remote
-          .start(
-            args[0] as string,
-            data!,
-            Comlink.transfer(channel.port2, [channel.port2]),
-            Comlink.proxy(finish),
-            Comlink.proxy(fail),
-          )
-          .catch((error) => fail(error instanceof Error ? error.message : String(error)));
+        this.subscripts.open(id);
+        this.launchSubscript(id, 0, args[0] as string, data ?? new Uint8Array());
+        return { value: id };
+      }
+      case "subscript_start_batch": {
+        const shards = splitSubScriptBatch(data ?? new Uint8Array(), args[1] as number[]);
+        const id = this.nextSubscriptId++;
+        this.subscripts.open(id);
+        shards.forEach((shard, index) => this.launchSubscript(id, index + 1, args[0] as string, shard));
         return { value: id };
       }
       case "subscript_abort":
-        this.finishSubscript(args[0] as number);
+        // Running jobs stop cooperatively and keep their worker, unless they don't within the grace period
+        for (const [job, { port, cancel }] of this.subscripts.abort(args[0] as number)) {
+          Atomics.store(cancel, 0, 1);
+          this.subscriptPool.cancel(job, SUBSCRIPT_ABORT_GRACE_MS);
+          port.close();
+        }
         return { value: 0 };
       case "subscript_running":
-        return { value: this.subscripts.has(args[0] as number) };
+        return { value: this.subscripts.running(args[0] as number) };
+      case "subscript_count":
+        return { value: this.subscripts.size };
+      case "subscript_shared_data":
+        this.sharedData.set(args[0] as string, data);
+        // Cached results may have been computed from the previous image
+        await this.subscriptCache.invalidate();
+        return { value: 0 };
+      case "subscript_cache_configure":
+        this.subscriptCache.configure(args[0] as string, { ttl: args[1] as number, persist: args[2] as boolean });
+        return { value: 0 };
+      case "subscript_cache_invalidate":
+        await this.subscriptCache.invalidate((args[0] as string | null) ?? undefined);
+        return { value: 0 };
+      case "subscript_cache_stats":
+        return { value: this.subscriptCache.stats() };
+      case "heap_snapshot_fingerprint":
+        return { value: await this.heapSnapshotFingerprint() };
       default:
         throw new Error(`Unknown RPC operation: ${operation}`);
     }
   }
 
-  private finishSubscript(id: number) {
-    const subscript = this.subscripts.get(id);
-    subscript?.worker.terminate();
-    subscript?.port.close();
-    this.subscripts.delete(id);
+  // Digest of the user files PoB reads during OnInit. Cloud builds can change remotely, so they opt out.
+  private async heapSnapshotFingerprint(): Promise<string | null> {
+    if (this.cloudDirectory || !this.userDirectory) return null;
+    const encoder = new TextEncoder();
+    const chunks: Uint8Array[] = [];
+    const visit = async (path: string) => {
+      let entries: string[];
+      try {
+        entries = await zenfs.promises.readdir(path);
+      } catch (error) {
+        if ((error as { code?: string }).code === "ENOENT") return;
+        throw error;
+      }
+      for (const name of entries.sort()) {
+        const child = `${path}/${name}`;
+        const stat = await zenfs.promises.stat(child);
+        chunks.push(encoder.encode(`${child}\0${stat.size}\0${stat.mtimeMs}\0`));
+        if (stat.isDirectory()) await visit(child);
+      }
+    };
+    await visit(this.userDirectory);
+    try {
+      chunks.push(await zenfs.promises.readFile(`${this.userDirectory}/Settings.xml`));
+    } catch (error) {
+      if ((error as { code?: string }).code !== "ENOENT") throw error;
+    }
+
+    const bytes = new Uint8Array(chunks.reduce((sum, chunk) => sum + chunk.byteLength, 0));
+    let offset = 0;
+    for (const chunk of chunks) {
+      bytes.set(chunk, offset);
+      offset += chunk.byteLength;
+    }
+    const digest = new Uint8Array(await crypto.subtle.digest("SHA-256", bytes));
+    return Array.from(digest, (byte) => byte.toString(16).padStart(2, "0")).join("");
+  }
+
+  // Queues one run of a subscript. A batch launches one per shard under the same id, which stays running
+  // until every shard has finished or failed.
+  private launchSubscript(id: number, shard: number, script: string, data: Uint8Array) {
+    const job = this.nextSubscriptJobId++;
+    const queuedAt = performance.now();
+    const channel = new MessageChannel();
+    const cancel = new Int32Array(new SharedArrayBuffer(Int32Array.BYTES_PER_ELEMENT));
+    this.subscripts.add(id, job, { port: channel.port1, cancel });
+    exposeRpcPort(
+      channel.port1,
+      (nestedOperation, nestedArgs, nestedData) => this.handle(nestedOperation, nestedArgs, nestedData),
+    );
+    const settle = (message: object, transfer: Transferable[] = []) => {
+      const settled = this.subscripts.settle(id, job);
+      if (!settled) return;
+      settled.port.close();
+      this.eventPort?.postMessage(message, transfer);
+    };
+    const finish = (result: Uint8Array) =>
+      settle({ type: "subscript_finished", id, shard, data: result }, [result.buffer]);
+    const fail = (message: string) => settle({ type: "subscript_error", id, shard, message });
+    const progress = (data: Uint8Array) => {
+      if (!this.subscripts.has(id, job)) return;
+      this.eventPort?.postMessage({ type: "subscript_progress", id, shard, data }, [data.buffer]);
+    };
+    const download = subScriptDownloadRequest(script, data);
+    const run = (onFinished: (result: Uint8Array) => void) => {
+      if (download) {
+        log.debug(tag.subscript, "download", { id, shard, url: download.url });
+        return void this.download(download).then(onFinished);
+      }
+      return this.subscriptPool.run(job, subScriptPriority(script), async (worker) => {
+        const { remote } = worker;
+        log.debug(tag.subscript, "launch", { id, shard, waitMs: performance.now() - queuedAt });
+        try {
+          await this.sharedData.sync(worker.shared, (name, data) => worker.remote.setSharedData(name, data));
+          await remote.start(
+            script,
+            Comlink.transfer(data, [data.buffer]),
+            Comlink.transfer(channel.port2, [channel.port2]),
+            Comlink.proxy(onFinished),
+            Comlink.proxy(fail),
+            Comlink.proxy(progress),
+            cancel,
+          );
+        } catch (error) {
+          fail(error instanceof Error ? error.message : String(error));
+          throw error;
+        }
+      });
+    };
+    if (!this.subscriptCache.handles(script)) return run(finish);
+
+    // A cached result is delivered like a finished run, without taking a worker.
+    void (async () => {
+      const key = await this.subscriptCache.key(script, data);
+      const cached = await this.subscriptCache.get(script, key);
+      if (cached) return finish(cached);
+      if (!this.subscripts.has(id, job)) return;
+      run((result) => {
+        this.subscriptCache.set(script, key, result)
+          .catch((error) => log.warn(tag.subscript, "cache write failed", { error }));
+        finish(result);
+      });
+    })().catch((error) => fail(error instanceof Error ? error.message : String(error)));
+  }
+
+  // Runs a download-only subscript as a fetch. Failures become the errMsg result, as lcurl reports them.
+  private async download({ url, headers, body }: SubScriptDownloadRequest): Promise<Uint8Array> {
+    let response: SubScriptDownloadResponse;
+    try {
+      response = (await this.callbacks!.fetch(url, prepareFetchHeaders(headers), body)) as SubScriptDownloadResponse;
+    } catch (error) {
+      response = { error: error instanceof Error ? error.message : String(error) };
+    }
+    return serializeSubScriptDownload(response);
+  }
+
+  private createSubWorker(): SubWorker {
+    const worker = new SubWorkerObject();
+    const remote = Comlink.wrap<SubScriptWorker>(worker);
+    remote.prepare().catch((error) => log.warn(tag.subscript, "prepare failed", { error }));
+    return { worker, remote, shared: new Map(), terminate: () => worker.terminate() };
   }
 }
 
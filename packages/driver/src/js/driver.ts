@@ -10,11 +10,19 @@ import type { DriverDiagnostic } from "./diagnostic.ts";
 import { EventHandler } from "./event.ts";
 import { toggleFullscreen } from "./fullscreen.ts";
 import { DOMKeyboardState, KeyboardHandler, type PoBKey, PoBKeyboardState } from "./keyboard.ts";
+import type { InputFrameStats } from "./input-queue.ts";
 import { MouseHandler, type MouseState } from "./mouse-handler.ts";
 import { type FrameData, ReactOverlayManager, type RenderStats, type ToolbarCallbacks } from "./overlay/index.ts";
 import type { ToolbarPosition as ToolbarPos } from "./overlay/types.ts";
 import { BackgroundPromiseOwner, enqueueOwnedAction } from "./promise-owner.ts";
-import type { DriverWorker, HostCallbacks } from "./worker.ts";
+import type { StartupSpan } from "./startup-trace.ts";
+import type {
+  BuildCodeOptions,
+  BuildImportTimings,
+  DriverStartOptions,
+  DriverWorker,
+  HostCallbacks,
+} from "./worker.ts";
 // @ts-types="./vite-worker.d.ts"
 import WorkerObject from "./worker.ts?worker";
 
@@ -27,7 +35,7 @@ type AsyncBroker = {
     fetchCallback: HostCallbacks["onFetch"],
     oauthAuthorizeCallback: HostCallbacks["onOAuthAuthorize"],
     pasteCallback: () => Promise<string>,
-  ): Promise<void>;
+  ): Promise<ArrayBuffer>;
 };
 
 type AsyncDriverWorker = Comlink.Remote<DriverWorker> & {
@@ -42,6 +50,8 @@ export type FilesystemConfig = {
   cloudflareKvUserNamespace: string | undefined;
 };
 
+export type { BuildCodeOptions, BuildImportTimings, DriverStartOptions };
+
 export type DriverLifecycleCallbacks = {
   onWorkerCreated?: (worker: Worker) => void;
   onKeyboardStateChange?: (keys: readonly PoBKey[]) => void;
@@ -111,13 +121,13 @@ export class Driver {
     );
     this.diagnostic("driver", "construct", { build });
     const originalOnFrame = this.hostCallbacks.onFrame;
-    this.hostCallbacks.onFrame = (at: number, time: number, stats?: RenderStats) => {
+    this.hostCallbacks.onFrame = (at: number, time: number, stats?: RenderStats, input?: InputFrameStats) => {
       this.pushFrame(at, time, stats);
-      originalOnFrame(at, time, stats);
+      originalOnFrame(at, time, stats, input);
     };
   }
 
-  async start(fileSystemConfig: FilesystemConfig) {
+  async start(fileSystemConfig: FilesystemConfig, options: DriverStartOptions = {}) {
     if (this.isStarted) throw new Error("Already started");
     assertDriverCapabilities();
     this.isStarted = true;
@@ -130,7 +140,7 @@ export class Driver {
       this.broker = Comlink.wrap<AsyncBroker>(brokerWorker);
       const channel = new MessageChannel();
       const eventChannel = new MessageChannel();
-      await this.broker.start(
+      const rootArchive = await this.broker.start(
         Comlink.transfer(channel.port1, [channel.port1]),
         Comlink.transfer(eventChannel.port1, [eventChannel.port1]),
         this.assetPrefix,
@@ -160,6 +170,8 @@ export class Driver {
         Comlink.proxy((url) => {
           window.open(url, "_blank");
         }),
+        Comlink.transfer(rootArchive, [rootArchive]),
+        options,
       );
     } catch (error) {
       this.diagnostic("driver", "start-error", { error: String(error) }, "error");
@@ -422,18 +434,22 @@ export class Driver {
     });
   }
 
-  async loadBuildFromCode(code: string) {
+  async loadBuildFromCode(code: string): Promise<BuildImportTimings | undefined> {
     return this.driverWorker?.loadBuildFromCode(code);
   }
 
-  async getBuildCode(): Promise<string> {
-    const code = await this.driverWorker?.getBuildCode();
+  async getBuildCode(options?: BuildCodeOptions): Promise<string> {
+    const code = await this.driverWorker?.getBuildCode(options);
     if (!code) {
       throw new Error("getBuildCode failed");
     }
     return code;
   }
 
+  async getStartupTrace(): Promise<StartupSpan[]> {
+    return await this.driverWorker?.getStartupTrace() ?? [];
+  }
+
   async flushInput(): Promise<void> {
     await this.pendingClipboardAction;
     await this.driverWorker?.flushInput();
@@ -18,7 +18,17 @@ const environmentErrorPatterns: ReadonlyArray<readonly [EnvironmentErrorCategory
   ],
 ];
 
-const storagePathOperations = new Set(["readdir", "lstat", "stat", "open", "mkdir", "unlink", "rmdir", "truncate"]);
+const storagePathOperations = new Set([
+  "readdir",
+  "readdir_plus",
+  "lstat",
+  "stat",
+  "open",
+  "mkdir",
+  "unlink",
+  "rmdir",
+  "truncate",
+]);
 const storageDescriptorOperations = new Set(["fstat", "close", "read", "write", "ftruncate"]);
 
 export function isLocalUserStorageOperation(
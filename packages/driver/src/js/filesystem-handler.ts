@@ -4,6 +4,7 @@ import type { RpcResult } from "./rpc.ts";
 
 const FILESYSTEM_OPERATIONS = new Set([
   "readdir",
+  "readdir_plus",
   "lstat",
   "stat",
   "fstat",
@@ -50,6 +51,23 @@ export class FilesystemRpcHandler {
         const entries = await fs.promises.readdir(args[0] as string, { withFileTypes: true });
         return { value: entries.map((entry) => [entry.name, entry.isFile() ? 1 : entry.isDirectory() ? 2 : 3]) };
       }
+      case "readdir_plus": {
+        // NewFileSearch: the entries of one kind matching an fnmatch pattern, as [name, size, mtime in seconds]
+        const [path, pattern, directories] = args as [string, string, boolean];
+        const matcher = fileNamePattern(pattern);
+        const entries = (await fs.promises.readdir(path, { withFileTypes: true }))
+          .filter((entry) => entry.isDirectory() === directories && matcher.test(entry.name));
+        const parent = path.endsWith("/") ? path : `${path}/`;
+        const stats = await Promise.allSettled(entries.map((entry) => fs.promises.stat(`${parent}${entry.name}`)));
+        return {
+          value: entries.flatMap((entry, index) => {
+            const stat = stats[index];
+            return stat.status === "fulfilled"
+              ? [[entry.name, stat.value.size, Math.floor(stat.value.mtimeMs / 1000)]]
+              : [];
+          }),
+        };
+      }
       case "lstat":
         return { value: this.serializeStat(await fs.promises.lstat(args[0] as string), args[0] as string) };
       case "stat":
@@ -139,3 +157,38 @@ export class FilesystemRpcHandler {
 function serializeStat(stat: zenfs.Stats) {
   return { mode: stat.mode, size: stat.size };
 }
+
+// fnmatch(3) with FNM_PATHNAME for a single file name: `*`, `?`, bracket expressions and backslash escapes.
+export function fileNamePattern(pattern: string): RegExp {
+  const escape = (text: string) => text.replace(/[.*+?^${}()|[\]\\/]/g, "\\$&");
+  let source = "";
+  for (let i = 0; i < pattern.length; i += 1) {
+    const char = pattern[i];
+    if (char === "*") {
+      source += "[^/]*";
+    } else if (char === "?") {
+      source += "[^/]";
+    } else if (char === "[") {
+      const negated = pattern[i + 1] === "!" || pattern[i + 1] === "^";
+      // A "]" right after the opening bracket is part of the set, as is one escaped by a backslash
+      const start = i + (negated ? 2 : 1);
+      let end = pattern[start] === "]" ? start + 1 : start;
+      while (end < pattern.length && pattern[end] !== "]") end += pattern[end] === "\\" ? 2 : 1;
+      if (end >= pattern.length) {
+        source += "\\[";
+        continue;
+      }
+      const set = pattern.slice(start, end).replace(/\\(.)|[\\\]^]/g, (match, escaped?: string) =>
+        escaped === undefined ? `\\${match}` : /[\\\]^-]/.test(escaped) ? `\\${escaped}` : escaped
+      );
+      source += `[${negated ? "^" : ""}${set}]`;
+      i = end;
+    } else if (char === "\\" && i + 1 < pattern.length) {
+      i += 1;
+      source += escape(pattern[i]);
+    } else {
+      source += escape(char);
+    }
+  }
+  return new RegExp(`^${source}$`, "s");
+}
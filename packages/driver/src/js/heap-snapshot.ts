@@ -0,0 +1,47 @@
+// Post-init heap snapshots. A snapshot is the driver's linear memory captured right after start(),
+// stored in Cache Storage and copied into a fresh instance on the next load instead of running init.
+
+const CACHE_NAME = "pob-driver-heap-snapshot-v1";
+const TITLE_HEADER = "x-pob-title";
+
+export type HeapSnapshot = {
+  heap: Uint8Array;
+  title: string;
+};
+
+/**
+ * Cache key for a snapshot. It changes whenever the driver build, the game assets, or the user
+ * files read during OnInit change.
+ */
+export async function heapSnapshotKey(wasmBinary: ArrayBuffer, assetPrefix: string, fingerprint: string) {
+  const digest = new Uint8Array(await crypto.subtle.digest("SHA-256", wasmBinary));
+  const build = Array.from(digest, (byte) => byte.toString(16).padStart(2, "0")).join("");
+  const url = new URL(`/__pob_heap_snapshot__/${build}/${fingerprint}`, self.location.origin);
+  url.searchParams.set("assets", assetPrefix);
+  return url.href;
+}
+
+export async function loadHeapSnapshot(key: string): Promise<HeapSnapshot | undefined> {
+  const cache = await caches.open(CACHE_NAME);
+  const response = await cache.match(key);
+  if (!response) return undefined;
+  return {
+    heap: new Uint8Array(await response.arrayBuffer()),
+    title: decodeURIComponent(response.headers.get(TITLE_HEADER) ?? ""),
+  };
+}
+
+export async function storeHeapSnapshot(key: string, snapshot: HeapSnapshot): Promise<void> {
+  const cache = await caches.open(CACHE_NAME);
+  // Snapshots are hundreds of megabytes; keep only the newest one.
+  for (const request of await cache.keys()) await cache.delete(request);
+  await cache.put(
+    key,
+    new Response(snapshot.heap, {
+      headers: {
+        "Content-Type": "application/octet-stream",
+        [TITLE_HEADER]: encodeURIComponent(snapshot.title),
+      },
+    }),
+  );
+}
@@ -0,0 +1,80 @@
+// Producer side of the input ring declared in input.h. The driver drains it at the start of each frame.
+
+export const INPUT_EVENT = {
+  mouseMove: 0,
+  keyDown: 1,
+  keyUp: 2,
+  char: 3,
+} as const;
+
+export type InputEventType = (typeof INPUT_EVENT)[keyof typeof INPUT_EVENT];
+
+export type InputFrameStats = { events: number; dispatched: number; latency: number };
+
+const HEAD_OFFSET = 0;
+const TAIL_OFFSET = 4;
+const CAPACITY_OFFSET = 8;
+const EVENT_SIZE_OFFSET = 12;
+const EVENTS_OFFSET = 16;
+const EVENT_BYTES = 64;
+const NAME_OFFSET = 32;
+const NAME_BYTES = 32;
+const encoder = new TextEncoder();
+
+export class InputQueue {
+  private readonly capacity: number;
+
+  /**
+   * `heap` is read on every push because memory growth replaces the buffer. `drain` must empty the
+   * queue synchronously; it is called when the ring is full.
+   */
+  constructor(
+    private readonly heap: () => Uint8Array,
+    private readonly pointer: number,
+    private readonly drain: () => void,
+  ) {
+    const view = this.view();
+    this.capacity = view.getUint32(pointer + CAPACITY_OFFSET, true);
+    const eventSize = view.getUint32(pointer + EVENT_SIZE_OFFSET, true);
+    if (eventSize !== EVENT_BYTES) throw new Error(`Unexpected input event size: ${eventSize}`);
+  }
+
+  /** Returns false when the name does not fit in an event; the caller must dispatch it directly. */
+  push(type: InputEventType, name: string, doubleClick: number, x: number, y: number, time = performance.now()) {
+    let view = this.view();
+    let head = view.getUint32(this.pointer + HEAD_OFFSET, true);
+    if (head - view.getUint32(this.pointer + TAIL_OFFSET, true) >= this.capacity) {
+      this.drain();
+      view = this.view();
+      head = view.getUint32(this.pointer + HEAD_OFFSET, true);
+    }
+
+    const offset = this.pointer + EVENTS_OFFSET + (head % this.capacity) * EVENT_BYTES;
+    const heap = this.heap();
+    const nameSlot = heap.subarray(offset + NAME_OFFSET, offset + NAME_OFFSET + NAME_BYTES - 1);
+    const { read, written } = encoder.encodeInto(name, nameSlot);
+    if (read !== name.length) return false;
+    heap[offset + NAME_OFFSET + written] = 0;
+    view.setFloat64(offset, time, true);
+    view.setFloat64(offset + 8, x, true);
+    view.setFloat64(offset + 16, y, true);
+    view.setUint32(offset + 24, type, true);
+    view.setInt32(offset + 28, doubleClick, true);
+    view.setUint32(this.pointer + HEAD_OFFSET, (head + 1) >>> 0, true);
+    return true;
+  }
+
+  private view() {
+    const heap = this.heap();
+    return new DataView(heap.buffer, heap.byteOffset);
+  }
+}
+
+export function readInputFrameStats(heap: Uint8Array, pointer: number): InputFrameStats {
+  const view = new DataView(heap.buffer, heap.byteOffset);
+  return {
+    events: view.getUint32(pointer, true),
+    dispatched: view.getUint32(pointer + 4, true),
+    latency: view.getFloat64(pointer + 8, true),
+  };
+}
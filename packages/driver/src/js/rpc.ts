@@ -23,6 +23,8 @@ export function rpcErrorMetadata(cause: unknown): RpcErrorMetadata {
 
 const HEADER_BYTES = 16;
 const RPC_TIMEOUT_MS = 120_000;
+// Response room of the buffer a client keeps between calls; larger requests get a buffer of their own
+const REUSED_CAPACITY = 2 * 1024 * 1024;
 const encoder = new TextEncoder();
 const decoder = new TextDecoder();
 
@@ -34,16 +36,49 @@ export function prepareFetchHeaders(headers: Record<string, string>) {
   return { ...headers, "Content-Type": "application/x-www-form-urlencoded" };
 }
 
-export function createRpcClient(port: MessagePort) {
+// Request data is moved to the handler when the view spans its whole ArrayBuffer; see createRpcClient
+function transferable(data: Uint8Array | undefined): Transferable[] {
+  if (!data || !(data.buffer instanceof ArrayBuffer)) return [];
+  return data.byteOffset === 0 && data.byteLength === data.buffer.byteLength ? [data.buffer] : [];
+}
+
+/**
+ * Returns a call that posts a request to the handler behind `port` and blocks until it answers or
+ * `timeoutMs` passes.
+ *
+ * Ownership of the request `data`:
+ * - A view that spans its whole ArrayBuffer, such as HEAPU8.slice(), is transferred. The caller's buffer is
+ *   detached once the call is posted and must not be used again.
+ * - A view into part of an ArrayBuffer is copied and stays the caller's.
+ * - A view over a SharedArrayBuffer is neither copied nor transferred. The handler reads the caller's memory,
+ *   so the caller must not change it until the call returns.
+ *
+ * The result `data` is a fresh copy that belongs to the caller. Responses are written into a
+ * SharedArrayBuffer of REUSED_CAPACITY that the client keeps between calls; a call whose `capacity` is larger
+ * gets a buffer of its own, and a call that times out drops the kept one.
+ */
+export function createRpcClient(port: MessagePort, timeoutMs = RPC_TIMEOUT_MS) {
   let requestId = 0;
+  // Calls are synchronous, so one buffer serves them all unless a call asks for more room
+  let reusable: SharedArrayBuffer | undefined;
   return <T>(operation: string, args: unknown[] = [], data?: Uint8Array, capacity = 1024 * 1024): RpcResult<T> => {
-    const shared = new SharedArrayBuffer(HEADER_BYTES + capacity);
+    let shared: SharedArrayBuffer;
+    if (capacity > REUSED_CAPACITY) {
+      shared = new SharedArrayBuffer(HEADER_BYTES + capacity);
+    } else {
+      reusable ??= new SharedArrayBuffer(HEADER_BYTES + REUSED_CAPACITY);
+      shared = reusable;
+    }
     const control = new Int32Array(shared, 0, HEADER_BYTES / Int32Array.BYTES_PER_ELEMENT);
-    port.postMessage({ operation, args: [++requestId, ...args], data, shared } satisfies RpcRequest);
-    const deadline = performance.now() + RPC_TIMEOUT_MS;
+    Atomics.store(control, 0, 0);
+    const request = { operation, args: [++requestId, ...args], data, shared } satisfies RpcRequest;
+    port.postMessage(request, transferable(data));
+    const deadline = performance.now() + timeoutMs;
     while (Atomics.load(control, 0) === 0) {
       const remaining = deadline - performance.now();
       if (remaining <= 0 || Atomics.wait(control, 0, 0, remaining) === "timed-out") {
+        // The handler may still answer into this buffer later
+        if (shared === reusable) reusable = undefined;
         throw new Error(`RPC ${operation} timed out`);
       }
     }
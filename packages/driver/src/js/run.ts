@@ -7,6 +7,7 @@ async function main(): Promise<void> {
   const game = (testMode ? params.get("game") : null) ?? __RUN_GAME__;
   const version = (testMode ? params.get("version") : null) ?? __RUN_VERSION__;
   const poeOAuthExpiresIn = Number(params.get("poe-oauth-expires-in") ?? "2419200");
+  const heapSnapshot = testMode && params.get("heap-snapshot") === "1";
   const poeOAuthApiStatuses = (params.get("poe-oauth-api") ?? "200").split(",").map(Number);
   let poeOAuthRefreshCount = Number(params.get("poe-oauth-refresh-start") ?? "0");
   const poeOAuth: PoBTestState["poeOAuth"] = testMode && params.get("poe-oauth") === "mock"
@@ -21,6 +22,8 @@ async function main(): Promise<void> {
       errors: [] as string[],
       pressedKeys: [],
       frameSamples: [],
+      startup: null,
+      heapSnapshotStored: false,
       poeOAuth,
       resetFrameSamples() {
         this.frameSamples = [];
@@ -41,7 +44,7 @@ async function main(): Promise<void> {
         testState?.errors.push(String(error));
         console.error(error);
       },
-      onFrame: (_at, time, stats) => {
+      onFrame: (_at, time, stats, input) => {
         if (testState) {
           testState.frameCount += 1;
           testState.frameSamples.push({
@@ -52,6 +55,8 @@ async function main(): Promise<void> {
             instanceBytes: stats?.backend.instanceBytes ?? 0,
             instances: stats?.backend.instances ?? 0,
             dispatches: stats?.backend.dispatches ?? 0,
+            inputEvents: input?.events ?? 0,
+            inputLatency: input?.latency ?? 0,
           });
           if (stats) testState.renderStats = stats;
         }
@@ -116,6 +121,11 @@ async function main(): Promise<void> {
       onKeyboardStateChange: (keys) => {
         if (testState) testState.pressedKeys = [...keys];
       },
+      onDiagnostic: ({ event, data }) => {
+        if (!testState) return;
+        if (event === "startup") testState.startup = data as PoBTestState["startup"];
+        if (event === "heap-snapshot-stored") testState.heapSnapshotStored = true;
+      },
     },
   );
   await driver.start({
@@ -124,7 +134,7 @@ async function main(): Promise<void> {
     cloudflareKvPrefix: "/api/kv/",
     cloudflareKvAccessToken: undefined,
     cloudflareKvUserNamespace: undefined,
-  });
+  }, { heapSnapshot });
   const root = document.querySelector("#window") as HTMLElement;
   if (root) {
     await driver.attachToDOM(root);
@@ -132,7 +142,7 @@ async function main(): Promise<void> {
   if (testState) {
     testState.started = true;
     testState.loadBuildFromCode = (code) => driver.loadBuildFromCode(code);
-    testState.getBuildCode = () => driver.getBuildCode();
+    testState.getBuildCode = (options) => driver.getBuildCode(options);
     testState.flushInput = () => driver.flushInput();
   }
 }
@@ -0,0 +1,65 @@
+// Reader for the startup timeline recorded by trace.c.
+
+/** Order matches `TracePhase` in trace.h. */
+export const STARTUP_PHASES = [
+  "fs-backend",
+  "openlibs",
+  "boot",
+  "module-read",
+  "module-compile",
+  "module-execute",
+  "on-init",
+  "first-frame",
+] as const;
+
+export type StartupPhase = (typeof STARTUP_PHASES)[number];
+
+export type StartupSpan = {
+  phase: StartupPhase;
+  name: string;
+  bytes: number;
+  start: number;
+  duration: number;
+};
+
+export type StartupPhaseSummary = { count: number; duration: number; bytes: number };
+
+const EVENT_BYTES = 64;
+const NAME_OFFSET = 24;
+const NAME_BYTES = 40;
+const decoder = new TextDecoder();
+
+/** Decodes the ring buffer; `count` is the total number of spans ever recorded. */
+export function readStartupTrace(heap: Uint8Array, pointer: number, count: number, capacity: number): StartupSpan[] {
+  const view = new DataView(heap.buffer, heap.byteOffset);
+  const first = Math.max(0, count - capacity);
+  const spans: StartupSpan[] = [];
+  for (let index = first; index < count; index += 1) {
+    const offset = pointer + (index % capacity) * EVENT_BYTES;
+    const start = view.getFloat64(offset, true);
+    const name = heap.subarray(offset + NAME_OFFSET, offset + NAME_OFFSET + NAME_BYTES);
+    const nameEnd = name.indexOf(0);
+    spans.push({
+      phase: STARTUP_PHASES[view.getUint32(offset + 16, true)],
+      name: decoder.decode(nameEnd < 0 ? name : name.subarray(0, nameEnd)),
+      bytes: view.getUint32(offset + 20, true),
+      start,
+      duration: view.getFloat64(offset + 8, true) - start,
+    });
+  }
+  return spans;
+}
+
+/** Per-phase totals. Module execution spans nest, so their durations are inclusive. */
+export function summarizeStartupTrace(spans: StartupSpan[]): Record<StartupPhase, StartupPhaseSummary> {
+  const summary = Object.fromEntries(
+    STARTUP_PHASES.map((phase) => [phase, { count: 0, duration: 0, bytes: 0 }]),
+  ) as Record<StartupPhase, StartupPhaseSummary>;
+  for (const span of spans) {
+    const phase = summary[span.phase];
+    phase.count += 1;
+    phase.duration += span.duration;
+    phase.bytes += span.bytes;
+  }
+  return summary;
+}
@@ -0,0 +1,144 @@
+// Result cache for subscripts that PoB declares deterministic with ConfigureSubScriptCache. Entries are
+// keyed by the SHA-256 of the game version, of the script text and of its serialized arguments, kept in an
+// in-memory LRU and, when the script asks for it, in a disk tier of
+// `<version hash>/<script hash>/<arguments hash>` files. The version keeps a result computed by one PoB
+// release or game from being returned to another, whatever the script does about invalidation.
+
+export type SubScriptCacheOptions = {
+  /** Seconds an entry stays valid; 0 keeps it until it is invalidated. */
+  ttl: number;
+  /** Also keep results on disk, so they survive a reload. */
+  persist: boolean;
+};
+
+export type SubScriptCacheStore = {
+  read(path: string): Promise<Uint8Array | undefined>;
+  write(path: string, data: Uint8Array): Promise<void>;
+  remove(path: string): Promise<void>;
+};
+
+export type SubScriptCacheStats = { hits: number; misses: number; entries: number; bytes: number };
+
+type Entry = { result: Uint8Array; expiresAt: number };
+
+const MAX_ENTRIES = 256;
+const MAX_BYTES = 32 * 1024 * 1024;
+// Disk entries start with their expiry time as a little-endian float64, 0 for none.
+const EXPIRY_BYTES = 8;
+
+async function sha256(data: Uint8Array | string): Promise<string> {
+  const bytes = typeof data === "string" ? new TextEncoder().encode(data) : data;
+  const digest = new Uint8Array(await crypto.subtle.digest("SHA-256", bytes));
+  return Array.from(digest, (byte) => byte.toString(16).padStart(2, "0")).join("");
+}
+
+export class SubScriptCache {
+  private version = sha256("");
+  private scripts = new Map<string, SubScriptCacheOptions & { hash: Promise<string> }>();
+  private entries = new Map<string, Entry>();
+  private bytes = 0;
+  private hits = 0;
+  private misses = 0;
+
+  constructor(
+    private readonly store?: SubScriptCacheStore,
+    private readonly now: () => number = Date.now,
+  ) {}
+
+  /** Scopes the cache to a game version, such as the asset prefix root.zip is loaded from. */
+  setVersion(version: string) {
+    this.version = sha256(version);
+    this.entries.clear();
+    this.bytes = 0;
+  }
+
+  configure(script: string, options: SubScriptCacheOptions) {
+    this.scripts.set(script, { ...options, hash: sha256(script) });
+  }
+
+  handles(script: string) {
+    return this.scripts.has(script);
+  }
+
+  /** Cache key of a run of the configured `script`. Call it before `data` is transferred away. */
+  async key(script: string, data: Uint8Array): Promise<string> {
+    return `${await this.version}/${await this.scripts.get(script)!.hash}/${await sha256(data)}`;
+  }
+
+  async get(script: string, key: string): Promise<Uint8Array | undefined> {
+    const entry = this.entries.get(key) ?? await this.readDisk(script, key);
+    if (!entry || (entry.expiresAt > 0 && entry.expiresAt <= this.now())) {
+      this.misses += 1;
+      if (entry) {
+        this.delete(key);
+        if (this.scripts.get(script)?.persist) await this.store?.remove(key);
+      }
+      return undefined;
+    }
+    this.entries.delete(key);
+    this.entries.set(key, entry);
+    this.hits += 1;
+    return entry.result.slice();
+  }
+
+  async set(script: string, key: string, result: Uint8Array) {
+    const options = this.scripts.get(script);
+    if (!options || result.length > MAX_BYTES) return;
+    const entry = { result: result.slice(), expiresAt: options.ttl > 0 ? this.now() + options.ttl * 1000 : 0 };
+    this.insert(key, entry);
+    if (options.persist && this.store) {
+      const data = new Uint8Array(EXPIRY_BYTES + entry.result.length);
+      new DataView(data.buffer).setFloat64(0, entry.expiresAt, true);
+      data.set(entry.result, EXPIRY_BYTES);
+      await this.store.write(key, data);
+    }
+  }
+
+  /** Drops the cached results of `script`, or of every script, of the current version from memory and disk. */
+  async invalidate(script?: string) {
+    const version = await this.version;
+    const hashes = script === undefined
+      ? await Promise.all([...this.scripts.values()].map(({ hash }) => hash))
+      : this.scripts.has(script)
+      ? [await this.scripts.get(script)!.hash]
+      : [];
+    const prefixes = hashes.map((hash) => `${version}/${hash}`);
+    for (const key of [...this.entries.keys()]) {
+      if (prefixes.some((prefix) => key.startsWith(`${prefix}/`))) this.delete(key);
+    }
+    for (const prefix of prefixes) await this.store?.remove(prefix);
+  }
+
+  stats(): SubScriptCacheStats {
+    return { hits: this.hits, misses: this.misses, entries: this.entries.size, bytes: this.bytes };
+  }
+
+  private async readDisk(script: string, key: string): Promise<Entry | undefined> {
+    if (!this.scripts.get(script)?.persist || !this.store) return undefined;
+    const data = await this.store.read(key);
+    if (!data || data.length < EXPIRY_BYTES) return undefined;
+    const entry = {
+      result: data.slice(EXPIRY_BYTES),
+      expiresAt: new DataView(data.buffer, data.byteOffset).getFloat64(0, true),
+    };
+    this.insert(key, entry);
+    return entry;
+  }
+
+  private insert(key: string, entry: Entry) {
+    this.delete(key);
+    this.entries.set(key, entry);
+    this.bytes += entry.result.length;
+    for (const oldest of this.entries.keys()) {
+      if (this.entries.size <= MAX_ENTRIES && this.bytes <= MAX_BYTES) break;
+      this.delete(oldest);
+    }
+  }
+
+  private delete(key: string) {
+    const entry = this.entries.get(key);
+    if (!entry) return;
+    this.bytes -= entry.result.length;
+    this.entries.delete(key);
+  }
+}
@@ -0,0 +1,57 @@
+import { deserializeSubScriptValues, serializeSubScriptValues } from "./sub-serialization.ts";
+
+// Subscripts that only download a page. PoB's DownloadPage script builds an lcurl.safe easy handle,
+// performs it and returns the body; the broker answers those with a plain fetch instead of a sub worker.
+// Other scripts can opt in by starting with DOWNLOAD_MARKER and following the same convention:
+// `url, requestHeader, requestBody` in, `responseBody, errMsg, responseHeader` out.
+
+export const DOWNLOAD_MARKER = "-- subscript: download";
+
+export type SubScriptDownloadRequest = {
+  url: string;
+  headers: Record<string, string>;
+  body?: string;
+};
+
+export type SubScriptDownloadResponse = {
+  body?: string;
+  status?: number;
+  headers?: Record<string, string>;
+  error?: string;
+};
+
+function isDownloadPageScript(script: string) {
+  return script.includes('require("lcurl.safe")') &&
+    script.includes("local url, requestHeader, requestBody") &&
+    script.includes("easy:perform()") &&
+    script.includes("return responseBody, errMsg, responseHeader");
+}
+
+export function subScriptDownloadRequest(script: string, data: Uint8Array): SubScriptDownloadRequest | undefined {
+  if (!script.trimStart().startsWith(DOWNLOAD_MARKER) && !isDownloadPageScript(script)) return undefined;
+  const [url, header, body] = deserializeSubScriptValues(data);
+  if (typeof url !== "string") return undefined;
+  if (header !== undefined && typeof header !== "string") return undefined;
+  if (body !== undefined && typeof body !== "string") return undefined;
+  // Parsed like lcurl's OPT_HTTPHEADER lines, so both paths send the same request.
+  const headers = Object.fromEntries(
+    (header ?? "").split("\n").map((line) => line.split(":")).filter((parts) => parts.length === 2)
+      .map(([key, value]) => [key.trim(), value.trim()]),
+  );
+  return { url, headers, body };
+}
+
+/** The values the DownloadPage script would have returned for `response`. */
+export function serializeSubScriptDownload(response: SubScriptDownloadResponse): Uint8Array {
+  const body = response.error === undefined ? response.body ?? "" : "";
+  const header = Object.entries(response.headers ?? {}).map(([key, value]) => `${key}: ${value}`).join("\n");
+  const status = response.status ?? 0;
+  const errMsg = response.error !== undefined
+    ? response.error
+    : status !== 200
+    ? `Response code: ${status}`
+    : body.length === 0
+    ? "No data returned"
+    : undefined;
+  return serializeSubScriptValues([body, errMsg, response.error === undefined ? header : ""]);
+}
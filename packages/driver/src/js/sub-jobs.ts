@@ -0,0 +1,56 @@
+// The broker's running subscripts. One id covers every pool job it launched: a single one for
+// LaunchSubScript, one per shard for LaunchSubScriptBatch. The id counts as running until its last job has
+// finished or failed, or the whole id is aborted.
+
+/** Splits the arguments of a LaunchSubScriptBatch call into the value list of each shard. */
+export function splitSubScriptBatch(data: Uint8Array, sizes: number[]): Uint8Array[] {
+  const total = sizes.reduce((sum, size) => sum + size, 0);
+  if (sizes.length === 0 || sizes.some((size) => !Number.isInteger(size) || size < 0) || total !== data.length) {
+    throw new Error("Subscript batch sizes do not match its data");
+  }
+  let offset = 0;
+  return sizes.map((size) => data.slice(offset, (offset += size)));
+}
+
+export class SubScriptJobs<T> {
+  private subscripts = new Map<number, Map<number, T>>();
+
+  open(id: number) {
+    this.subscripts.set(id, new Map());
+  }
+
+  add(id: number, job: number, value: T) {
+    this.subscripts.get(id)?.set(job, value);
+  }
+
+  // Whether the job is still pending, so its results and progress should be delivered.
+  has(id: number, job: number) {
+    return this.subscripts.get(id)?.has(job) ?? false;
+  }
+
+  running(id: number) {
+    return this.subscripts.has(id);
+  }
+
+  get size() {
+    return this.subscripts.size;
+  }
+
+  // Removes a job that finished or failed and returns it, or undefined if it was already settled or
+  // aborted, in which case nothing must be reported for it.
+  settle(id: number, job: number): T | undefined {
+    const jobs = this.subscripts.get(id);
+    const value = jobs?.get(job);
+    if (!jobs || value === undefined) return undefined;
+    jobs.delete(job);
+    if (jobs.size === 0) this.subscripts.delete(id);
+    return value;
+  }
+
+  // Removes the id and returns the jobs that had not settled yet.
+  abort(id: number): [number, T][] {
+    const jobs = [...(this.subscripts.get(id) ?? [])];
+    this.subscripts.delete(id);
+    return jobs;
+  }
+}
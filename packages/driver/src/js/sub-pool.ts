@@ -0,0 +1,105 @@
+export enum SubScriptPriority {
+  High,
+  Normal,
+  Low,
+}
+
+export type PooledWorker = { terminate(): void };
+
+type Job<W> = {
+  id: number;
+  priority: SubScriptPriority;
+  run: (worker: W) => Promise<void>;
+};
+
+// Keeps sub workers with an instantiated driver alive between subscripts. A worker goes back to the idle
+// list when its job settles normally; a job that throws, or is cancelled while running and doesn't stop
+// in time, takes its worker down with it, since the Lua state or Wasm instance may be in an unknown state.
+export class SubScriptPool<W extends PooledWorker> {
+  private idle: W[] = [];
+  private queue: Job<W>[] = [];
+  private running = new Map<number, W>();
+
+  constructor(
+    private readonly create: () => W,
+    readonly size: number,
+  ) {}
+
+  // Starts workers ahead of the first subscript so that it does not pay for the driver instantiation.
+  warm(count: number) {
+    while (this.idle.length + this.running.size < Math.min(count, this.size)) this.idle.push(this.create());
+  }
+
+  run(id: number, priority: SubScriptPriority, run: (worker: W) => Promise<void>) {
+    const index = this.queue.findIndex((job) => job.priority > priority);
+    this.queue.splice(index < 0 ? this.queue.length : index, 0, { id, priority, run });
+    this.dispatch();
+  }
+
+  // Dequeues a waiting job. A running job gets `graceMs` to settle on its own, in which case its worker is
+  // released as usual, before the worker is terminated.
+  cancel(id: number, graceMs = 0) {
+    const index = this.queue.findIndex((job) => job.id === id);
+    if (index >= 0) this.queue.splice(index, 1);
+    const worker = this.running.get(id);
+    if (!worker) return;
+    if (graceMs > 0) {
+      setTimeout(() => this.cancel(id), graceMs);
+      return;
+    }
+    this.running.delete(id);
+    worker.terminate();
+    this.dispatch();
+  }
+
+  has(id: number) {
+    return this.running.has(id) || this.queue.some((job) => job.id === id);
+  }
+
+  get pending() {
+    return this.running.size + this.queue.length;
+  }
+
+  terminate() {
+    for (const worker of [...this.idle, ...this.running.values()]) worker.terminate();
+    this.idle = [];
+    this.queue = [];
+    this.running.clear();
+  }
+
+  private dispatch() {
+    while (this.queue.length > 0 && this.running.size < this.size) {
+      const job = this.queue.shift()!;
+      const worker = this.idle.pop() ?? this.create();
+      this.running.set(job.id, worker);
+      job.run(worker).then(
+        () => this.release(job.id, worker, true),
+        () => this.release(job.id, worker, false),
+      );
+    }
+  }
+
+  private release(id: number, worker: W, reusable: boolean) {
+    if (this.running.get(id) !== worker) return;
+    this.running.delete(id);
+    if (reusable && this.idle.length < this.size) {
+      this.idle.push(worker);
+    } else {
+      worker.terminate();
+    }
+    this.dispatch();
+  }
+}
+
+// One core stays with the main driver worker. Two slots at minimum, so a subscript that waits on the
+// network or an OAuth redirect does not hold up every other one.
+export function subScriptPoolSize(concurrency = globalThis.navigator?.hardwareConcurrency ?? 4) {
+  return Math.min(8, Math.max(2, concurrency - 1));
+}
+
+// PoB's background update check yields to downloads and OAuth, which the user is waiting for.
+export function subScriptPriority(script: string) {
+  if (script.includes("OAuth authorization code")) return SubScriptPriority.High;
+  if (script.includes("UpdateProgress(")) return SubScriptPriority.Low;
+  return SubScriptPriority.Normal;
+}
@@ -0,0 +1,179 @@
+// Values passed to and returned from subscripts, in the format of sub_serialization.h.
+
+const decoder = new TextDecoder();
+const encoder = new TextEncoder();
+
+const MAGIC = [0x4c, 0x53, 0x56]; // "LSV"
+const VERSION = 2;
+
+const NIL = 0;
+const FALSE = 1;
+const TRUE = 2;
+const INTEGER = 3;
+const FLOAT = 4;
+const STRING = 5;
+const TABLE = 6;
+
+/**
+ * A Lua value. Tables with only a 1..n sequence are arrays; other tables are Maps whose keys include
+ * the sequence indices. Plain objects serialize as tables with string keys.
+ */
+export type SubScriptValue =
+  | number
+  | boolean
+  | string
+  | undefined
+  | SubScriptValue[]
+  | Map<SubScriptValue, SubScriptValue>
+  | { [key: string]: SubScriptValue };
+
+export function serializeSubScriptValues(values: readonly SubScriptValue[]): Uint8Array {
+  const writer = new Writer();
+  writer.bytes(new Uint8Array([...MAGIC, VERSION]));
+  writer.uint32(values.length);
+  const seen = new Set<object>();
+  for (const value of values) writer.value(value, seen);
+  return writer.finish();
+}
+
+export function deserializeSubScriptValues(data: Uint8Array): SubScriptValue[] {
+  const reader = new Reader(data);
+  const header = reader.bytes(4);
+  if (MAGIC.some((byte, index) => header[index] !== byte)) throw new Error("Not subscript data");
+  if (header[3] !== VERSION) throw new Error(`Unsupported subscript data version ${header[3]}`);
+  const count = reader.uint32();
+  const values: SubScriptValue[] = [];
+  for (let index = 0; index < count; index += 1) values.push(reader.value());
+  if (!reader.done) throw new Error("Unexpected trailing subscript data");
+  return values;
+}
+
+class Writer {
+  private data = new Uint8Array(256);
+  private view = new DataView(this.data.buffer);
+  private offset = 0;
+
+  value(value: SubScriptValue, seen: Set<object>) {
+    if (value === undefined) {
+      this.uint8(NIL);
+    } else if (typeof value === "boolean") {
+      this.uint8(value ? TRUE : FALSE);
+    } else if (typeof value === "number") {
+      if (Number.isInteger(value) && value >= -0x80000000 && value <= 0x7fffffff && !Object.is(value, -0)) {
+        this.uint8(INTEGER);
+        this.reserve(4).setInt32(this.offset - 4, value, true);
+      } else {
+        this.uint8(FLOAT);
+        this.reserve(8).setFloat64(this.offset - 8, value, true);
+      }
+    } else if (typeof value === "string") {
+      const bytes = encoder.encode(value);
+      this.uint8(STRING);
+      this.uint32(bytes.length);
+      this.bytes(bytes);
+    } else {
+      if (seen.has(value)) throw new Error("Cannot pass a table that contains itself to a subscript");
+      seen.add(value);
+      const array = Array.isArray(value) ? value : [];
+      const entries = Array.isArray(value)
+        ? []
+        : value instanceof Map
+        ? [...value]
+        : Object.entries(value);
+      this.uint8(TABLE);
+      this.uint32(array.length);
+      this.uint32(entries.length);
+      for (const item of array) this.value(item, seen);
+      for (const [key, item] of entries) {
+        this.value(key, seen);
+        this.value(item, seen);
+      }
+      seen.delete(value);
+    }
+  }
+
+  uint8(value: number) {
+    this.reserve(1).setUint8(this.offset - 1, value);
+  }
+
+  uint32(value: number) {
+    this.reserve(4).setUint32(this.offset - 4, value, true);
+  }
+
+  bytes(bytes: Uint8Array) {
+    this.reserve(bytes.length);
+    this.data.set(bytes, this.offset - bytes.length);
+  }
+
+  finish(): Uint8Array {
+    return this.data.slice(0, this.offset);
+  }
+
+  private reserve(size: number): DataView {
+    if (this.offset + size > this.data.length) {
+      const data = new Uint8Array(Math.max(this.data.length * 2, this.offset + size));
+      data.set(this.data);
+      this.data = data;
+      this.view = new DataView(data.buffer);
+    }
+    this.offset += size;
+    return this.view;
+  }
+}
+
+class Reader {
+  private readonly view: DataView;
+  private offset = 0;
+
+  constructor(private readonly data: Uint8Array) {
+    this.view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  }
+
+  get done() {
+    return this.offset === this.data.length;
+  }
+
+  value(): SubScriptValue {
+    const tag = this.bytes(1)[0];
+    switch (tag) {
+      case NIL:
+        return undefined;
+      case FALSE:
+      case TRUE:
+        return tag === TRUE;
+      case INTEGER:
+        return this.view.getInt32(this.advance(4), true);
+      case FLOAT:
+        return this.view.getFloat64(this.advance(8), true);
+      case STRING:
+        return decoder.decode(this.bytes(this.uint32()));
+      case TABLE: {
+        const arrayLength = this.uint32();
+        const hashLength = this.uint32();
+        const array: SubScriptValue[] = [];
+        for (let index = 0; index < arrayLength; index += 1) array.push(this.value());
+        if (hashLength === 0) return array;
+        const table = new Map<SubScriptValue, SubScriptValue>(array.map((item, index) => [index + 1, item]));
+        for (let index = 0; index < hashLength; index += 1) table.set(this.value(), this.value());
+        return table;
+      }
+      default:
+        throw new Error(`Unsupported subscript value type ${tag}`);
+    }
+  }
+
+  uint32(): number {
+    return this.view.getUint32(this.advance(4), true);
+  }
+
+  bytes(length: number): Uint8Array {
+    return this.data.subarray(this.advance(length), this.offset);
+  }
+
+  private advance(size: number): number {
+    if (this.offset + size > this.data.length) throw new Error("Truncated subscript data");
+    const offset = this.offset;
+    this.offset += size;
+    return offset;
+  }
+}
@@ -0,0 +1,32 @@
+// Shared data images published with SetSubScriptSharedData. The broker keeps the latest version of each
+// image. A sub worker keeps the versions it has received in its heap, and is brought up to date before
+// each job, so an image is copied into a worker once per version rather than once per job.
+
+export class SubScriptSharedData {
+  private nextVersion = 1;
+  private images = new Map<string, { version: number; data: Uint8Array }>();
+
+  // Publishes a new version of an image, or withdraws it.
+  set(name: string, data: Uint8Array | undefined) {
+    if (data) {
+      this.images.set(name, { version: this.nextVersion++, data });
+    } else {
+      this.images.delete(name);
+    }
+  }
+
+  // Sends a worker the images it lacks or holds an old version of, and withdraws the ones that are gone.
+  // `held` is the version of each image the worker has, and is updated as they are sent.
+  async sync(held: Map<string, number>, send: (name: string, data: Uint8Array | null) => Promise<void>) {
+    for (const name of [...held.keys()]) {
+      if (this.images.has(name)) continue;
+      await send(name, null);
+      held.delete(name);
+    }
+    for (const [name, { version, data }] of this.images) {
+      if (held.get(name) === version) continue;
+      await send(name, data);
+      held.set(name, version);
+    }
+  }
+}
@@ -11,65 +11,115 @@ interface DriverModule extends EmscriptenModule {
   cwrap: typeof cwrap;
   bridge: unknown;
   rpcCall: ReturnType<typeof createRpcClient>;
+  cancelFlag: Int32Array | undefined;
 }
 
 type Imports = {
   subStart: (script: string, funcs: string, subs: string, size: number, data: number) => number;
+  subSetSharedData: (name: string, data: number, size: number) => void;
 };
 
+// Minimum time between two ReportProgress messages of a job
+const PROGRESS_INTERVAL_MS = 100;
+
+// Runs subscripts one at a time. The driver is instantiated once per worker and reused by later
+// subscripts; sub_start gives each of them a fresh Lua state and closes it afterwards.
 export class SubScriptWorker {
+  private driver: Promise<{ module: DriverModule; imports: Imports }> | undefined;
   private onFinished: (data: Uint8Array) => void = () => {};
   private onError: (message: string) => void = () => {};
+  private onProgress: (data: Uint8Array) => void = () => {};
+  private lastProgressAt = -Infinity;
+  private reported = false;
+
+  async prepare() {
+    await this.load();
+  }
+
+  // Keeps a shared data image in the driver's heap for the following jobs; null drops it.
+  async setSharedData(name: string, data: Uint8Array | null) {
+    const { module, imports } = await this.load();
+    if (!data) {
+      imports.subSetSharedData(name, 0, 0);
+      return;
+    }
+    const wasmData = module._malloc(data.length);
+    module.HEAPU8.set(data, wasmData);
+    imports.subSetSharedData(name, wasmData, data.length);
+  }
+
   async start(
     script: string,
     data: Uint8Array,
     rpcPort: MessagePort,
     onFinished: (data: Uint8Array) => void,
     onError: (message: string) => void,
+    onProgress: (data: Uint8Array) => void,
+    cancelFlag: Int32Array,
   ) {
-    const build = "release"; // TODO: configurable
     this.onFinished = onFinished;
     this.onError = onError;
+    this.onProgress = onProgress;
+    this.lastProgressAt = -Infinity;
+    this.reported = false;
     log.debug(tag.subscript, "start", { script });
 
     const rpcCall = createRpcClient(rpcPort);
-    const authorizationRequest = poeOAuthAuthorizationRequest(script, data);
-    if (authorizationRequest) {
-      const { value } = rpcCall<PoeOAuthAuthorization>("oauth_authorize", [
-        authorizationRequest.url,
-        authorizationRequest.timeoutMs,
-      ]);
-      this.onFinished(serializePoeOAuthAuthorization(value));
-      return;
+    try {
+      const authorizationRequest = poeOAuthAuthorizationRequest(script, data);
+      if (authorizationRequest) {
+        const { value } = rpcCall<PoeOAuthAuthorization>("oauth_authorize", [
+          authorizationRequest.url,
+          authorizationRequest.timeoutMs,
+        ]);
+        this.onFinished(serializePoeOAuthAuthorization(value));
+        return;
+      }
+
+      const { module, imports } = await this.load();
+      module.rpcCall = rpcCall;
+      module.cancelFlag = cancelFlag;
+      const wasmData = module._malloc(data.length);
+      module.HEAPU8.set(data, wasmData);
+      try {
+        const ret = imports.subStart(script, "", "", data.length, wasmData);
+        // Errors raised by the script are already reported, and the Lua state is closed either way.
+        if (ret !== 0 && !this.reported) throw new Error(`sub_start failed (status=${ret})`);
+        log.info(tag.subscript, `finished: ret=${ret}`);
+      } finally {
+        module._free(wasmData);
+        module.cancelFlag = undefined;
+      }
+    } finally {
+      rpcPort.close();
     }
+  }
+
+  private load() {
+    if (!this.driver) {
+      this.driver = this.instantiate();
+      this.driver.catch(() => (this.driver = undefined));
+    }
+    return this.driver;
+  }
 
-    const driver = (await import(`../../dist/${build}/driver.mjs`)) as {
+  private async instantiate() {
+    const build = "release"; // TODO: configurable
+    const driver = (await import(`../../dist/${build}/driver_sub.mjs`)) as {
       default: EmscriptenModuleFactory<DriverModule>;
     };
     const module = await driver.default({
       print: console.log, // TODO: log.info
       printErr: console.warn, // TODO: log.info
-      rpcCall,
     });
-
     module.bridge = this.resolveExports(module);
-    const imports = this.resolveImports(module);
-
-    const wasmData = module._malloc(data.length);
-    module.HEAPU8.set(data, wasmData);
-
-    try {
-      const ret = imports.subStart(script, "", "", data.length, wasmData);
-      if (ret !== 0) throw new Error(`sub_start failed (status=${ret})`);
-      log.info(tag.subscript, `finished: ret=${ret}`);
-    } finally {
-      module._free(wasmData);
-    }
+    return { module, imports: this.resolveImports(module) };
   }
 
   private resolveImports(module: DriverModule): Imports {
     return {
       subStart: module.cwrap("sub_start", "number", ["string", "string", "string", "number", "number"]),
+      subSetSharedData: module.cwrap("sub_set_shared_data", null, ["string", "number", "number"]),
     };
   }
 
@@ -77,12 +127,20 @@ export class SubScriptWorker {
     return {
       onSubScriptError: (message: string) => {
         log.error(tag.subscript, "onSubScriptError", { message });
+        this.reported = true;
         this.onError(message);
       },
       onSubScriptFinished: (data: number, size: number) => {
         const result = module.HEAPU8.slice(data, data + size);
-        log.debug(tag.subscript, "onSubScriptFinished", { result });
-        this.onFinished(result);
+        log.debug(tag.subscript, "onSubScriptFinished", { size });
+        this.reported = true;
+        this.onFinished(Comlink.transfer(result, [result.buffer]));
+      },
+      progressDue: () => performance.now() - this.lastProgressAt >= PROGRESS_INTERVAL_MS,
+      onSubScriptProgress: (data: number, size: number) => {
+        const progress = module.HEAPU8.slice(data, data + size);
+        this.lastProgressAt = performance.now();
+        this.onProgress(Comlink.transfer(progress, [progress.buffer]));
       },
     };
   }
@@ -20,15 +20,19 @@ type PoBTestState = {
     instanceBytes: number;
     instances: number;
     dispatches: number;
+    inputEvents: number;
+    inputLatency: number;
   }[];
+  startup: { mode: "cold" | "restored"; duration: number } | null;
+  heapSnapshotStored: boolean;
   poeOAuth?: {
     authorizationRequests: { url: string; timeoutMs: number }[];
     fetchRequests: { url: string; headers: Record<string, string>; body?: string }[];
     logoutCalls: number;
   };
   resetFrameSamples: () => void;
-  loadBuildFromCode?: (code: string) => Promise<void>;
-  getBuildCode?: () => Promise<string>;
+  loadBuildFromCode?: (code: string) => Promise<import("./worker.ts").BuildImportTimings | undefined>;
+  getBuildCode?: (options?: import("./worker.ts").BuildCodeOptions) => Promise<string>;
   flushInput?: () => Promise<void>;
 };
 
@@ -3,13 +3,22 @@ import { type ClipboardAction, PasteBuffer } from "./clipboard.ts";
 import { observeOwnedPromise } from "./promise-owner.ts";
 import type { DriverDiagnostic } from "./diagnostic.ts";
 import { cloneableError, markEnvironmentError, markKnownUpstreamError } from "./error.ts";
+import { heapSnapshotKey, loadHeapSnapshot, storeHeapSnapshot } from "./heap-snapshot.ts";
 import { ImageRepository } from "./image.ts";
+import {
+  INPUT_EVENT,
+  InputQueue,
+  type InputEventType,
+  type InputFrameStats,
+  readInputFrameStats,
+} from "./input-queue.ts";
 import type { PoBKey } from "./keyboard.ts";
 import { log, tag } from "./logger.ts";
 import type { MouseState } from "./mouse-handler.ts";
 import type { PoeOAuthAuthorization } from "./poe-oauth.ts";
 import { loadFonts, Renderer, type RenderStats, TextMetrics, WebGL2Backend } from "./renderer/index.ts";
 import { createRpcClient } from "./rpc.ts";
+import { readStartupTrace, type StartupSpan, summarizeStartupTrace } from "./startup-trace.ts";
 import { registerSentryWasm } from "./sentry-wasm.ts";
 
 const setSentryWasmCodeFile = registerSentryWasm(self);
@@ -18,9 +27,13 @@ const releaseWasmUrl = new URL("../../dist/release/driver.wasm", import.meta.url
 
 declare const __BPTC_SUPPORT_OVERRIDE__: boolean | undefined;
 
+const buildCodeDecoder = new TextDecoder();
+
 interface DriverModule extends EmscriptenModule {
   cwrap: typeof cwrap;
   rpcCall: ReturnType<typeof createRpcClient>;
+  /** root.zip for init() to mount at /app/root; init moves it into linear memory. */
+  rootArchive?: ArrayBuffer;
   takePasteText: () => string | undefined;
 }
 
@@ -37,13 +50,36 @@ type OnFetchFunction = (
 
 export type HostCallbacks = {
   onError: (error: unknown) => void;
-  onFrame: (at: number, time: number, stats?: RenderStats) => void;
+  onFrame: (at: number, time: number, stats?: RenderStats, input?: InputFrameStats) => void;
   onFetch: OnFetchFunction;
   onOAuthAuthorize: (url: string, timeoutMs: number) => Promise<PoeOAuthAuthorization>;
   onOAuthLogout: () => void;
   onTitleChange: (title: string) => void;
 };
 
+export type DriverStartOptions = {
+  /** Restore the post-init heap from a previous session and capture one when none matches. */
+  heapSnapshot?: boolean;
+};
+
+export type BuildCodeOptions = {
+  /** Deflate level, 0-9. Lower levels produce the code sooner; the default is 9. */
+  level?: number;
+  /**
+   * Prime deflate with the preset build dictionary. The code gets smaller, but only decoders that
+   * carry the same dictionary (pob-web itself) can read it.
+   */
+  dictionary?: boolean;
+};
+
+/** Milliseconds (with fractions) spent in each phase of a build import; `total` also covers mode switching. */
+export type BuildImportTimings = {
+  decode: number;
+  parse: number;
+  calc: number;
+  total: number;
+};
+
 type MainCallbacks = {
   copy: (text: string) => void;
   openUrl: (url: string) => void;
@@ -53,15 +89,28 @@ type Imports = {
   init: () => void;
   start: () => void;
   loadBuildFromCode: (code: string) => number;
-  getBuildCode: () => string;
+  buildImportStats: () => number;
+  getBuildCode: (level: number, dictionary: number) => number;
+  getBuildCodeLength: () => number;
   onFrame: () => void;
   sentryTestCrash: () => void;
   onKeyUp: (name: string, doubleClick: number) => void;
   onKeyDown: (name: string, doubleClick: number) => void;
   onChar: (char: string, doubleClick: number) => void;
+  flushInput: () => number;
+  inputQueue: () => number;
+  inputFrameStats: () => number;
   onDownloadPageResult: (result: string) => void;
-  onSubScriptFinished: (id: number, data: number) => number;
-  onSubScriptError: (id: number, message: string) => number;
+  onSubScriptFinished: (id: number, shard: number, data: number, size: number) => number;
+  onSubScriptError: (id: number, shard: number, message: string) => number;
+  onSubScriptProgress: (id: number, shard: number, data: number, size: number) => number;
+  heapSnapshotSize: () => number;
+  heapSnapshotReserve: (size: number) => number;
+  heapSnapshotRestored: () => number;
+  traceEvents: () => number;
+  traceCount: () => number;
+  traceCapacity: () => number;
+  filesystemCacheStats: () => number;
 };
 
 export class DriverWorker {
@@ -73,16 +122,18 @@ export class DriverWorker {
     height: 600,
     pixelRatio: 1,
   };
-  private mouseState: MouseState = { x: 0, y: 0 };
   private pressedKeys: Set<PoBKey> = new Set();
   private pasteBuffer = new PasteBuffer();
   private clipboardControlPending = false;
   private hostCallbacks: Omit<HostCallbacks, "onFetch" | "onOAuthAuthorize"> | undefined;
   private mainCallbacks: MainCallbacks | undefined;
   private imports: Imports | undefined;
+  private inputQueue: InputQueue | undefined;
   private dirtyCount = 0;
   private _frameScheduled = false;
   private visible = false;
+  private title = "";
+  private module: DriverModule | undefined;
   private onDiagnostic: ((diagnostic: DriverDiagnostic) => void) | undefined;
 
   async start(
@@ -97,7 +148,10 @@ export class DriverWorker {
     onDiagnostic: (diagnostic: DriverDiagnostic) => void,
     copy: MainCallbacks["copy"],
     openUrl: MainCallbacks["openUrl"],
+    rootArchive: ArrayBuffer,
+    options: DriverStartOptions = {},
   ) {
+    const startedAt = performance.now();
     this.onDiagnostic = onDiagnostic;
     this.diagnostic("worker", "start");
     this.imageRepo = new ImageRepository(`${assetPrefix}/root/`);
@@ -141,37 +195,135 @@ export class DriverWorker {
     });
 
     Object.assign(module, this.exports(module));
+    this.module = module;
     this.imports = this.resolveImports(module);
+    const imports = this.imports;
+    this.inputQueue = new InputQueue(() => module.HEAPU8, imports.inputQueue(), () => imports.flushInput());
     eventPort.onmessage = ({
       data,
     }: MessageEvent<{
-      type: "subscript_finished" | "subscript_error";
+      type: "subscript_finished" | "subscript_error" | "subscript_progress";
       id: number;
+      shard: number;
       data?: Uint8Array;
       message?: string;
     }>) => {
-      if (data.type === "subscript_finished") {
+      if (data.type === "subscript_finished" || data.type === "subscript_progress") {
         const result = data.data ?? new Uint8Array();
         const wasmData = module._malloc(result.length);
         module.HEAPU8.set(result, wasmData);
-        this.imports?.onSubScriptFinished(data.id, wasmData);
+        const callback = data.type === "subscript_finished"
+          ? this.imports?.onSubScriptFinished
+          : this.imports?.onSubScriptProgress;
+        callback?.(data.id, data.shard, wasmData, result.length);
         module._free(wasmData);
       } else {
         const message = data.message ?? "Subscript failed";
-        this.imports?.onSubScriptError(data.id, message);
+        this.imports?.onSubScriptError(data.id, data.shard, message);
         this.hostCallbacks?.onError(new Error(`Subscript failed: ${message}`));
       }
       this.invalidate();
     };
     eventPort.start();
 
-    this.imports?.init();
-    this.imports?.start();
+    const snapshotKey = options.heapSnapshot
+      ? await this.heapSnapshotKey(wasmBinary, assetPrefix, rpcCall)
+      : undefined;
+    if (snapshotKey && await this.restoreHeapSnapshot(module, snapshotKey)) {
+      this.diagnostic("worker", "startup", { mode: "restored", duration: performance.now() - startedAt });
+    } else {
+      // A restored heap already holds the archive and the mounted tree
+      module.rootArchive = rootArchive;
+      this.imports?.init();
+      this.imports?.start();
+      this.diagnostic("worker", "startup", { mode: "cold", duration: performance.now() - startedAt });
+      this.diagnostic("worker", "startup-trace", summarizeStartupTrace(this.getStartupTrace()));
+      this.diagnostic("worker", "filesystem-cache", this.filesystemCacheStats());
+      if (snapshotKey) this.captureHeapSnapshot(module, snapshotKey, rpcCall);
+    }
     this.invalidate();
   }
 
+  private async heapSnapshotKey(
+    wasmBinary: ArrayBuffer,
+    assetPrefix: string,
+    rpcCall: DriverModule["rpcCall"],
+  ): Promise<string | undefined> {
+    try {
+      const fingerprint = rpcCall<string | null>("heap_snapshot_fingerprint").value;
+      return fingerprint ? await heapSnapshotKey(wasmBinary, assetPrefix, fingerprint) : undefined;
+    } catch (error) {
+      this.diagnostic("worker", "heap-snapshot-error", { stage: "key", error: String(error) }, "error");
+      return undefined;
+    }
+  }
+
+  private async restoreHeapSnapshot(module: DriverModule, key: string): Promise<boolean> {
+    let snapshot: Awaited<ReturnType<typeof loadHeapSnapshot>>;
+    try {
+      snapshot = await loadHeapSnapshot(key);
+    } catch (error) {
+      this.diagnostic("worker", "heap-snapshot-error", { stage: "load", error: String(error) }, "error");
+      return false;
+    }
+    if (!snapshot) return false;
+    if (this.imports?.heapSnapshotReserve(snapshot.heap.byteLength) !== 0) {
+      this.diagnostic("worker", "heap-snapshot-error", { stage: "reserve", bytes: snapshot.heap.byteLength }, "error");
+      return false;
+    }
+    // Nothing has run on this instance yet, so overwriting its whole heap is safe.
+    module.HEAPU8.set(snapshot.heap, 0);
+    this.imports?.heapSnapshotRestored();
+    this.title = snapshot.title;
+    if (snapshot.title) this.hostCallbacks?.onTitleChange(snapshot.title);
+    this.diagnostic("worker", "heap-snapshot-restored", { bytes: snapshot.heap.byteLength });
+    return true;
+  }
+
+  private captureHeapSnapshot(module: DriverModule, key: string, rpcCall: DriverModule["rpcCall"]) {
+    const size = this.imports?.heapSnapshotSize() ?? 0;
+    const running = rpcCall<number>("subscript_count").value;
+    if (size === 0 || running > 0) {
+      this.diagnostic("worker", "heap-snapshot-skipped", { openFiles: size === 0, subscripts: running });
+      return;
+    }
+    const heap = module.HEAPU8.slice(0, size);
+    storeHeapSnapshot(key, { heap, title: this.title }).then(
+      () => this.diagnostic("worker", "heap-snapshot-stored", { bytes: size }),
+      (error) => this.diagnostic("worker", "heap-snapshot-error", { stage: "store", error: String(error) }, "error"),
+    );
+  }
+
+  // Path lookups and size requests during startup, the RPCs the WasmFS attribute cache saved, and the
+  // bytes read against the read RPCs behind them
+  private filesystemCacheStats() {
+    if (!this.module || !this.imports) return undefined;
+    const stats = new Uint32Array(this.module.HEAPU8.buffer, this.imports.filesystemCacheStats(), 9);
+    return {
+      lookups: stats[0],
+      sizes: stats[2],
+      savedRpcs: stats[1] + stats[3],
+      readBytes: stats[4],
+      readRpcs: stats[5],
+      readRpcBytes: stats[6],
+      writeBytes: stats[7],
+      writeRpcs: stats[8],
+    };
+  }
+
   destroy() {}
 
+  /** Startup timeline recorded by the driver up to the first frame. */
+  getStartupTrace(): StartupSpan[] {
+    if (!this.module || !this.imports) return [];
+    return readStartupTrace(
+      this.module.HEAPU8,
+      this.imports.traceEvents(),
+      this.imports.traceCount(),
+      this.imports.traceCapacity(),
+    );
+  }
+
   setCanvas(canvas: OffscreenCanvas) {
     this.diagnostic("canvas", "transferred", { width: canvas.width, height: canvas.height });
     const backend = new WebGL2Backend(canvas, (event, data) => this.diagnostic("webgl", event, data));
@@ -208,7 +360,7 @@ export class DriverWorker {
   }
 
   updateMouseState(mouseState: MouseState) {
-    this.mouseState = mouseState;
+    this.queueInput(INPUT_EVENT.mouseMove, "", 0, mouseState.x, mouseState.y);
   }
 
   updateKeyboardState(keys: Set<PoBKey>) {
@@ -216,26 +368,37 @@ export class DriverWorker {
   }
 
   handleMouseMove(mouseState: MouseState) {
-    this.mouseState = mouseState;
-    this.invalidate();
+    this.updateMouseState(mouseState);
+    // The cursor is only read from OnFrame, so one frame is enough; Lua asks for more when it animates.
+    this.requestFrames(0);
   }
 
   handleKeyDown(name: string, doubleClick: number) {
-    this.imports?.onKeyDown(name, doubleClick);
+    if (!this.queueInput(INPUT_EVENT.keyDown, name, doubleClick)) this.imports?.onKeyDown(name, doubleClick);
     this.invalidate();
   }
 
   handleKeyUp(name: string, doubleClick: number) {
-    this.imports?.onKeyUp(name, doubleClick);
+    if (!this.queueInput(INPUT_EVENT.keyUp, name, doubleClick)) this.imports?.onKeyUp(name, doubleClick);
     this.invalidate();
   }
 
   handleChar(char: string, doubleClick: number) {
-    this.imports?.onChar(char, doubleClick);
+    if (!this.queueInput(INPUT_EVENT.char, char, doubleClick)) this.imports?.onChar(char, doubleClick);
     this.invalidate();
   }
 
-  flushInput() {}
+  flushInput() {
+    this.imports?.flushInput();
+    this.invalidate();
+  }
+
+  /** Returns false when the event has to be dispatched directly; anything queued before it is flushed first. */
+  private queueInput(type: InputEventType, name: string, doubleClick: number, x = 0, y = 0) {
+    if (this.inputQueue?.push(type, name, doubleClick, x, y)) return true;
+    this.imports?.flushInput();
+    return false;
+  }
 
   handleVisibilityChange(visible: boolean) {
     this.visible = visible;
@@ -244,20 +407,33 @@ export class DriverWorker {
     }
   }
 
-  async loadBuildFromCode(code: string) {
+  async loadBuildFromCode(code: string): Promise<BuildImportTimings | undefined> {
     const status = this.imports?.loadBuildFromCode(code);
     if (status !== undefined && status !== 0) {
       throw new Error(`loadBuildFromCode failed (status=${status})`);
     }
     this.invalidate();
+    if (!this.module || !this.imports) return undefined;
+    const view = new DataView(this.module.HEAPU8.buffer);
+    const pointer = this.imports.buildImportStats();
+    const timings = {
+      decode: view.getFloat64(pointer, true),
+      parse: view.getFloat64(pointer + 8, true),
+      calc: view.getFloat64(pointer + 16, true),
+      total: view.getFloat64(pointer + 24, true),
+    };
+    this.diagnostic("worker", "build-import", timings);
+    return timings;
   }
 
-  async getBuildCode(): Promise<string> {
-    const code = this.imports?.getBuildCode();
-    if (!code) {
+  async getBuildCode(options: BuildCodeOptions = {}): Promise<string> {
+    const pointer = this.imports?.getBuildCode(options.level ?? -1, options.dictionary ? 1 : 0);
+    if (!pointer || !this.module || !this.imports) {
       throw new Error("getBuildCode failed");
     }
-    return code;
+    // The code is still owned by the Lua state; decode it in place.
+    const length = this.imports.getBuildCodeLength();
+    return buildCodeDecoder.decode(this.module.HEAPU8.subarray(pointer, pointer + length));
   }
 
   setLayerVisible(layer: number, sublayer: number, visible: boolean) {
@@ -282,7 +458,10 @@ export class DriverWorker {
 
         const time = performance.now() - start;
         const stats = this.renderer?.getStats();
-        this.hostCallbacks?.onFrame(start, time, stats);
+        const input = this.module && this.imports
+          ? readInputFrameStats(this.module.HEAPU8, this.imports.inputFrameStats())
+          : undefined;
+        this.hostCallbacks?.onFrame(start, time, stats, input);
         if ((stats?.frameCount ?? 0) <= 3 || (stats?.frameCount ?? 0) % 60 === 0 || time > 100) {
           this.diagnostic("frame", "complete", {
             duration: time,
@@ -290,6 +469,8 @@ export class DriverWorker {
             instances: stats?.backend.instances,
             instanceBytes: stats?.backend.instanceBytes,
             dispatches: stats?.backend.dispatches,
+            inputEvents: input?.events,
+            inputLatency: input?.latency,
           });
         }
         this.dirtyCount -= 1;
@@ -322,15 +503,28 @@ export class DriverWorker {
       init: module.cwrap("init", "number", []),
       start: module.cwrap("start", "number", []),
       loadBuildFromCode: module.cwrap("load_build_from_code", "number", ["string"]),
-      getBuildCode: module.cwrap("get_build_code", "string", []),
+      buildImportStats: module.cwrap("build_import_stats", "number", []),
+      getBuildCode: module.cwrap("get_build_code", "number", ["number", "number"]),
+      getBuildCodeLength: module.cwrap("get_build_code_length", "number", []),
       onFrame: module.cwrap("on_frame", "number", []),
       sentryTestCrash: module.cwrap("sentry_test_crash", null, []),
       onKeyUp: module.cwrap("on_key_up", "number", ["string", "number"]),
       onKeyDown: module.cwrap("on_key_down", "number", ["string", "number"]),
       onChar: module.cwrap("on_char", "number", ["string", "number"]),
+      flushInput: module.cwrap("flush_input", "number", []),
+      inputQueue: module.cwrap("input_queue", "number", []),
+      inputFrameStats: module.cwrap("input_frame_stats", "number", []),
       onDownloadPageResult: module.cwrap("on_download_page_result", "number", ["string"]),
-      onSubScriptFinished: module.cwrap("on_subscript_finished", "number", ["number", "number"]),
-      onSubScriptError: module.cwrap("on_subscript_error", "number", ["number", "string"]),
+      onSubScriptFinished: module.cwrap("on_subscript_finished", "number", ["number", "number", "number", "number"]),
+      onSubScriptError: module.cwrap("on_subscript_error", "number", ["number", "number", "string"]),
+      onSubScriptProgress: module.cwrap("on_subscript_progress", "number", ["number", "number", "number", "number"]),
+      heapSnapshotSize: module.cwrap("heap_snapshot_size", "number", []),
+      heapSnapshotReserve: module.cwrap("heap_snapshot_reserve", "number", ["number"]),
+      heapSnapshotRestored: module.cwrap("heap_snapshot_restored", "number", []),
+      traceEvents: module.cwrap("trace_events", "number", []),
+      traceCount: module.cwrap("trace_count", "number", []),
+      traceCapacity: module.cwrap("trace_capacity", "number", []),
+      filesystemCacheStats: module.cwrap("wasmfs_nodefs_cache_stats", "number", []),
     };
   }
 
@@ -340,12 +534,13 @@ export class DriverWorker {
         this.hostCallbacks?.onError(markKnownUpstreamError(new Error(`Error in lua: ${message}`))),
       onOAuthLogout: () => this.hostCallbacks?.onOAuthLogout(),
       requestFrames: (count: number) => this.requestFrames(count),
-      setWindowTitle: (title: string) => this.hostCallbacks?.onTitleChange(title),
+      setWindowTitle: (title: string) => {
+        this.title = title;
+        this.hostCallbacks?.onTitleChange(title);
+      },
       getScreenWidth: () => this.screenSize.width,
       getScreenHeight: () => this.screenSize.height,
       getScreenScale: () => this.screenSize.pixelRatio,
-      getCursorPosX: () => this.mouseState.x,
-      getCursorPosY: () => this.mouseState.y,
       isKeyDown: (name: string) =>
         this.pressedKeys.has(name as PoBKey) || (name === "CTRL" && this.clipboardControlPending),
       takePasteText: () => this.pasteBuffer.take(),
@@ -382,9 +577,8 @@ export class DriverWorker {
     if (action.type === "paste") this.pasteBuffer.push(action.text);
 
     this.clipboardControlPending = true;
-    this.imports?.onKeyDown(key, 0);
-    this.imports?.onKeyUp(key, 0);
-    this.invalidate();
+    this.handleKeyDown(key, 0);
+    this.handleKeyUp(key, 0);
   }
 }
 
@@ -0,0 +1,76 @@
+// Compares the native bit module with the bit32-based shim boot.lua used to install.
+//
+//   node build/driver_bit_bench.mjs
+//
+// Each case runs a million calls per implementation; the hash case is a string hash of the kind
+// PoB computes over tree and item data. Times are per million calls.
+
+#include <emscripten.h>
+#include <stdio.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "bit.h"
+
+static int Now(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now());
+    return 1;
+}
+
+static const char *bench_lua =
+    "local shim = {\n"
+    "  lshift = bit32.lshift, rshift = bit32.rshift, band = bit32.band, bor = bit32.bor,\n"
+    "  bxor = bit32.bxor, bnot = bit32.bnot,\n"
+    "  tobit = function(value)\n"
+    "    local normalized = value % 0x100000000\n"
+    "    return normalized >= 0x80000000 and normalized - 0x100000000 or normalized\n"
+    "  end,\n"
+    "}\n"
+    "local iterations = 1000000\n"
+    "local cases = {\n"
+    "  {'tobit', function(b) local f, x = b.tobit, 0 for i = 1, iterations do x = f(i * 65599) end return x end},\n"
+    "  {'band', function(b) local f, x = b.band, 0 for i = 1, iterations do x = f(i, 0xff00ff) end return x end},\n"
+    "  {'bor', function(b) local f, x = b.bor, 0 for i = 1, iterations do x = f(i, 0x10) end return x end},\n"
+    "  {'bxor', function(b) local f, x = b.bxor, 0 for i = 1, iterations do x = f(x, i) end return x end},\n"
+    "  {'lshift', function(b) local f, x = b.lshift, 0 for i = 1, iterations do x = f(i, 5) end return x end},\n"
+    "  {'rshift', function(b) local f, x = b.rshift, 0 for i = 1, iterations do x = f(i, 3) end return x end},\n"
+    "  {'hash', function(b)\n"
+    "    local band, bxor, lshift, rshift, tobit = b.band, b.bxor, b.lshift, b.rshift, b.tobit\n"
+    "    local text = string.rep('Passive Skill Tree Node ', 4)\n"
+    "    local hash = 0\n"
+    "    for _ = 1, iterations / (#text * 4) do\n"
+    "      for i = 1, #text do\n"
+    "        hash = tobit(bxor(lshift(hash, 5), rshift(hash, 27), text:byte(i)))\n"
+    "        hash = band(hash, 0x7fffffff)\n"
+    "      end\n"
+    "    end\n"
+    "    return hash\n"
+    "  end},\n"
+    "}\n"
+    "for _, case in ipairs(cases) do\n"
+    "  local label, fn = case[1], case[2]\n"
+    "  local times = {}\n"
+    "  for _, impl in ipairs({shim, bit}) do\n"
+    "    collectgarbage('collect')\n"
+    "    local start = Now()\n"
+    "    fn(impl)\n"
+    "    times[#times + 1] = Now() - start\n"
+    "  end\n"
+    "  print(string.format('%-8s shim %8.2f ms  native %8.2f ms  %5.2fx', label, times[1], times[2],\n"
+    "    times[1] / times[2]))\n"
+    "end\n";
+
+int main(void) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    bit_init(L);
+    lua_register(L, "Now", Now);
+
+    if (luaL_dostring(L, bench_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Conformance test for the native bit module. Expected values are LuaJIT 2.1 outputs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "bit.h"
+
+static const char *const cases[][2] = {
+    {"bit.tobit(0xffffffff)", "-1"},
+    {"bit.tobit(0xffffffff + 1)", "0"},
+    {"bit.tobit(2^40 + 1234)", "1234"},
+    {"bit.tobit(-1)", "-1"},
+    {"bit.tobit(0x80000000)", "-2147483648"},
+    {"bit.tobit(-0x80000001)", "2147483647"},
+    {"bit.tobit(1.5)", "2"},
+    {"bit.tobit(2.5)", "2"},
+    {"bit.tobit(-1.5)", "-2"},
+    {"bit.tobit('0x10')", "16"},
+    {"bit.bnot(0)", "-1"},
+    {"bit.bnot(0x12345678)", "-305419897"},
+    {"bit.band(0x12345678, 0xff)", "120"},
+    {"bit.band(-1)", "-1"},
+    {"bit.band(0xff, 0xf0f, 0xf3)", "3"},
+    {"bit.bor(1, 2, 4, 8)", "15"},
+    {"bit.bor(0x80000000, 0)", "-2147483648"},
+    {"bit.bxor(0xa5a5f0f0, 0xaa55ff00)", "267390960"},
+    {"bit.bxor(1, 2, 3)", "0"},
+    {"bit.lshift(1, 0)", "1"},
+    {"bit.lshift(1, 8)", "256"},
+    {"bit.lshift(1, 31)", "-2147483648"},
+    {"bit.lshift(1, 40)", "256"},
+    {"bit.lshift(1, -1)", "-2147483648"},
+    {"bit.lshift(0x87654321, 12)", "1412567040"},
+    {"bit.rshift(256, 8)", "1"},
+    {"bit.rshift(-256, 8)", "16777215"},
+    {"bit.rshift(0x87654321, 12)", "554580"},
+    {"bit.arshift(-256, 8)", "-1"},
+    {"bit.arshift(0x87654321, 12)", "-493996"},
+    {"bit.arshift(256, 8)", "1"},
+    {"bit.rol(0x12345678, 12)", "1164411171"},
+    {"bit.rol(0x12345678, 0)", "305419896"},
+    {"bit.ror(0x12345678, 12)", "1736516421"},
+    {"bit.ror(0x12345678, 32)", "305419896"},
+    {"bit.bswap(0x12345678)", "2018915346"},
+    {"bit.bswap(0x78563412)", "305419896"},
+    {"bit.tohex(1)", "00000001"},
+    {"bit.tohex(-1)", "ffffffff"},
+    {"bit.tohex(0xffffffff)", "ffffffff"},
+    {"bit.tohex(-1, -8)", "FFFFFFFF"},
+    {"bit.tohex(0x21, 4)", "0021"},
+    {"bit.tohex(0x87654321, 4)", "4321"},
+    {"bit.tohex(0x87654321, -4)", "4321"},
+    {"bit.tohex(0xabcdef, -16)", "00ABCDEF"},
+    {"bit.tohex(255, 0)", ""},
+    {"select('#', bit.band(1, 2))", "1"},
+    {"require('bit') == bit", "true"},
+    {"pcall(bit.band)", "false"},
+    {"pcall(bit.bor, 1, {})", "false"},
+};
+
+int main(void) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    bit_init(L);
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char chunk[256];
+        snprintf(chunk, sizeof(chunk), "return tostring((%s))", cases[i][0]);
+        if (luaL_dostring(L, chunk) != LUA_OK) {
+            fprintf(stderr, "%s: %s\n", cases[i][0], lua_tostring(L, -1));
+            failures++;
+        } else if (strcmp(lua_tostring(L, -1), cases[i][1]) != 0) {
+            fprintf(stderr, "%s: expected %s, got %s\n", cases[i][0], cases[i][1], lua_tostring(L, -1));
+            failures++;
+        }
+        lua_settop(L, 0);
+    }
+    lua_close(L);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
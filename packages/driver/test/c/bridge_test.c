@@ -1,7 +1,16 @@
+#include "base64.h"
+#include "build_code.h"
+#include "build_code_dictionary.h"
 #include "byte_buffer.h"
 #include "draw_color.h"
 #include "dpi.h"
+#include "lua_bundle_format.h"
+#include "sub_lua.h"
+#include "sub_shared_data.h"
 #include "sub_serialization.h"
+#include "zstream.h"
+#include "lauxlib.h"
+#include "lualib.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,26 +25,198 @@
     } while (0)
 
 static void test_subscript_values_round_trip(void) {
-    DataItem input[] = {
-        {.type = TYPE_DOUBLE, .value.doubleValue = 123.5},
-        {.type = TYPE_BOOLEAN, .value.intValue = 1},
-        {.type = TYPE_STRING, .value.stringValue = "result"},
-    };
-    unsigned char *serialized;
-    serialize(input, 3, &serialized);
-
-    int count;
-    DataItem *output = deserialize(serialized, &count);
-    CHECK(count == 3);
-    CHECK(output[0].type == TYPE_DOUBLE);
-    CHECK(output[0].value.doubleValue == 123.5);
-    CHECK(output[1].type == TYPE_BOOLEAN);
-    CHECK(output[1].value.intValue == 1);
-    CHECK(output[2].type == TYPE_STRING);
-    CHECK(strcmp(output[2].value.stringValue, "result") == 0);
-
-    free_deserialized_data(output, count);
-    free(serialized);
+    ByteBuffer buffer = {0};
+    sub_write_header(&buffer, 6);
+    sub_write_number(&buffer, 123.5);
+    sub_write_number(&buffer, -42);
+    sub_write_boolean(&buffer, 1);
+    sub_write_string(&buffer, "nul\0byte", 8);
+    sub_write_table(&buffer, 1, 0);
+    sub_write_nil(&buffer);
+    sub_write_nil(&buffer);
+
+    SubReader reader = {buffer.data, buffer.size, 0};
+    uint32_t count;
+    SubValue value;
+    CHECK(sub_read_header(&reader, &count) == 0);
+    CHECK(count == 6);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_FLOAT);
+    CHECK(value.value.number == 123.5);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_INTEGER);
+    CHECK(value.value.integer == -42);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_TRUE);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_STRING);
+    CHECK(value.value.string.length == 8);
+    CHECK(memcmp(value.value.string.data, "nul\0byte", 8) == 0);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_TABLE);
+    CHECK(value.value.table.array == 1);
+    CHECK(value.value.table.hash == 0);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_NIL);
+    CHECK(sub_read_value(&reader, &value) == 0);
+    CHECK(value.type == SUB_NIL);
+    CHECK(reader.offset == buffer.size);
+    CHECK(sub_read_value(&reader, &value) == -1);
+
+    byte_buffer_free(&buffer);
+}
+
+static void test_subscript_values_reject_malformed_data(void) {
+    ByteBuffer buffer = {0};
+    sub_write_header(&buffer, 1);
+    sub_write_string(&buffer, "result", 6);
+    uint32_t count;
+    SubValue value;
+
+    SubReader truncated = {buffer.data, buffer.size - 1, 0};
+    CHECK(sub_read_header(&truncated, &count) == 0);
+    CHECK(sub_read_value(&truncated, &value) == -1);
+
+    buffer.data[3] = 1;
+    SubReader old_version = {buffer.data, buffer.size, 0};
+    CHECK(sub_read_header(&old_version, &count) == -1);
+
+    // A table cannot claim more values than there are bytes left.
+    buffer.size = 0;
+    sub_write_header(&buffer, 1);
+    sub_write_table(&buffer, 0x7fffffff, 0);
+    SubReader oversized = {buffer.data, buffer.size, 0};
+    CHECK(sub_read_header(&oversized, &count) == 0);
+    CHECK(sub_read_value(&oversized, &value) == -1);
+
+    byte_buffer_free(&buffer);
+}
+
+static void test_subscript_batch_layout(void) {
+    lua_State *L = luaL_newstate();
+    CHECK(luaL_dostring(L, "return {1, 'two'}, {}, {{x = true}}") == LUA_OK);
+    CHECK(lua_gettop(L) == 3);
+
+    // The shards lie back to back, each a complete value list the broker can hand to a sub worker as is.
+    ByteBuffer buffer = {0};
+    uint32_t sizes[3];
+    CHECK(sub_lua_serialize_shards(L, &buffer, 1, 3, sizes) == 0);
+    CHECK(lua_gettop(L) == 3);
+    CHECK(sizes[0] + sizes[1] + sizes[2] == buffer.size);
+
+    const uint32_t counts[] = {2, 0, 1};
+    size_t offset = 0;
+    for (int i = 0; i < 3; i++) {
+        SubReader reader = {buffer.data + offset, sizes[i], 0};
+        uint32_t count;
+        CHECK(sub_read_header(&reader, &count) == 0);
+        CHECK(count == counts[i]);
+        CHECK(sub_lua_deserialize(L, buffer.data + offset, sizes[i]) == (int)counts[i]);
+        offset += sizes[i];
+    }
+    CHECK(lua_gettop(L) == 6);
+    CHECK(lua_tointeger(L, 4) == 1);
+    CHECK(strcmp(lua_tostring(L, 5), "two") == 0);
+    lua_getfield(L, 6, "x");
+    CHECK(lua_toboolean(L, -1));
+    lua_settop(L, 0);
+
+    // A shard holding a function fails the whole batch.
+    CHECK(luaL_dostring(L, "return {1}, {function() end}") == LUA_OK);
+    buffer.size = 0;
+    CHECK(sub_lua_serialize_shards(L, &buffer, 1, 2, sizes) == -1);
+    CHECK(lua_isstring(L, -1));
+
+    byte_buffer_free(&buffer);
+    lua_close(L);
+}
+
+static void test_subscript_callback_arguments(void) {
+    lua_State *L = luaL_newstate();
+    ByteBuffer buffer = {0};
+    lua_pushstring(L, "result");
+    CHECK(sub_lua_serialize(L, &buffer, 1, 0) == 0);
+
+    // LaunchSubScript: OnSubFinished(id, ...) and OnSubError(id, message)
+    CHECK(sub_lua_push_result(L, 7, 0, buffer.data, buffer.size) == 2);
+    CHECK(lua_touserdata(L, 1) == (void *)7);
+    CHECK(strcmp(lua_tostring(L, 2), "result") == 0);
+    lua_settop(L, 0);
+    CHECK(sub_lua_push_error(L, 7, 0, "failed") == 2);
+    CHECK(lua_touserdata(L, 1) == (void *)7);
+    CHECK(strcmp(lua_tostring(L, 2), "failed") == 0);
+    lua_settop(L, 0);
+
+    // LaunchSubScriptBatch: OnSubFinished(id, shard, ...) but OnSubError(id, message, shard)
+    CHECK(sub_lua_push_result(L, 7, 3, buffer.data, buffer.size) == 3);
+    CHECK(lua_touserdata(L, 1) == (void *)7);
+    CHECK(lua_tointeger(L, 2) == 3);
+    CHECK(strcmp(lua_tostring(L, 3), "result") == 0);
+    lua_settop(L, 0);
+    CHECK(sub_lua_push_error(L, 7, 3, "failed") == 3);
+    CHECK(lua_touserdata(L, 1) == (void *)7);
+    CHECK(strcmp(lua_tostring(L, 2), "failed") == 0);
+    CHECK(lua_tointeger(L, 3) == 3);
+    lua_settop(L, 0);
+
+    // A malformed result pushes nothing.
+    CHECK(sub_lua_push_result(L, 7, 3, buffer.data, buffer.size - 1) == -1);
+    CHECK(lua_gettop(L) == 0);
+
+    byte_buffer_free(&buffer);
+    lua_close(L);
+}
+
+// Publishes `source`'s result as SetSubScriptSharedData does, then hands the image to the sub worker side.
+static void publish_shared_data(const char *name, const char *source) {
+    lua_State *L = luaL_newstate();
+    CHECK(luaL_dostring(L, source) == LUA_OK);
+    ByteBuffer image = {0};
+    CHECK(sub_lua_serialize(L, &image, 1, SUB_LUA_SKIP_UNSUPPORTED) == 0);
+    sub_shared_data_set(name, image.data, image.size);
+    lua_close(L);
+}
+
+// Runs `source` in a fresh state, like a subscript run, and checks that it returns true.
+static void check_shared_data_run(const char *source) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    sub_shared_data_open(L);
+    if (luaL_dostring(L, source) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        CHECK(0);
+    }
+    CHECK(lua_toboolean(L, -1));
+    lua_close(L);
+}
+
+static void test_subscript_shared_data(void) {
+    publish_shared_data("Data", "return {skills = {Fireball = {level = 20, tags = {'spell', 'fire'}}}, "
+                                "count = 1.5, calc = function() end, [1] = 'first'}");
+    // Decoded once per run; the function is left out and writes stay in the run.
+    check_shared_data_run("local data = GetSubScriptSharedData('Data')\n"
+                          "assert(data == GetSubScriptSharedData('Data'))\n"
+                          "assert(data.skills.Fireball.level == 20 and data.skills.Fireball.tags[2] == 'fire')\n"
+                          "assert(data.count == 1.5 and data[1] == 'first' and data.calc == nil)\n"
+                          "data.count = 2\n"
+                          "return GetSubScriptSharedData('Missing') == nil");
+    check_shared_data_run("return GetSubScriptSharedData('Data').count == 1.5");
+
+    // A new version replaces the image for the following runs, and NULL withdraws it.
+    publish_shared_data("Data", "return {count = 3}");
+    publish_shared_data("Other", "return {name = 'other'}");
+    check_shared_data_run("local data, other = GetSubScriptSharedData('Data'), GetSubScriptSharedData('Other')\n"
+                          "return data.count == 3 and data.skills == nil and other.name == 'other'");
+    sub_shared_data_set("Data", NULL, 0);
+    check_shared_data_run("return GetSubScriptSharedData('Data') == nil and GetSubScriptSharedData('Other') ~= nil");
+
+    uint8_t *malformed = malloc(4);
+    memcpy(malformed, "bad!", 4);
+    sub_shared_data_set("Data", malformed, 4);
+    check_shared_data_run("local ok, err = pcall(GetSubScriptSharedData, 'Data')\n"
+                          "return not ok and err:find('malformed shared data') ~= nil");
+    sub_shared_data_set("Data", NULL, 0);
+    sub_shared_data_set("Other", NULL, 0);
 }
 
 static void test_large_buffer_append(void) {
@@ -120,10 +301,144 @@ static void test_dpi_scaling(void) {
     CHECK(dpi_get_scale(3.0) == 3.0);
 }
 
+static uint8_t *write_bundle(uint32_t flags, const char *stamp, size_t *size) {
+    LuaBundleWriter writer;
+    lua_bundle_writer_init(&writer, flags);
+    CHECK(lua_bundle_writer_add(&writer, "Modules/Main.lua", "main chunk", 10) == LUA_BUNDLE_OK);
+    CHECK(lua_bundle_writer_add(&writer, "Launch.lua", "launch chunk", 12) == LUA_BUNDLE_OK);
+    CHECK(lua_bundle_writer_add(&writer, "lua/xml.lua", "", 0) == LUA_BUNDLE_OK);
+
+    ByteBuffer out = {0};
+    CHECK(lua_bundle_writer_finish(&writer, stamp, strlen(stamp), &out) == LUA_BUNDLE_OK);
+    lua_bundle_writer_free(&writer);
+    *size = out.size;
+    return out.data;
+}
+
+static void check_bundle_entry(const LuaBundle *bundle, const char *name, const char *expected) {
+    const LuaBundleEntry *entry = lua_bundle_find(bundle, name, strlen(name));
+    CHECK(entry != NULL);
+    ByteBuffer chunk = {0};
+    CHECK(lua_bundle_read(bundle, entry, &chunk) == LUA_BUNDLE_OK);
+    CHECK(chunk.size == strlen(expected));
+    CHECK(chunk.size == 0 || memcmp(chunk.data, expected, chunk.size) == 0);
+    byte_buffer_free(&chunk);
+}
+
+static void test_lua_bundle_round_trip(void) {
+    const uint32_t flag_sets[] = {0, LUA_BUNDLE_FLAG_DEFLATE};
+    for (size_t i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]); i++) {
+        size_t size;
+        uint8_t *data = write_bundle(flag_sets[i], "stamp", &size);
+        LuaBundle bundle;
+        CHECK(lua_bundle_parse(&bundle, data, size, "stamp", 5) == LUA_BUNDLE_OK);
+        CHECK(bundle.count == 3);
+        check_bundle_entry(&bundle, "Launch.lua", "launch chunk");
+        check_bundle_entry(&bundle, "Modules/Main.lua", "main chunk");
+        check_bundle_entry(&bundle, "lua/xml.lua", "");
+        CHECK(lua_bundle_find(&bundle, "Modules/Main", 12) == NULL);
+        CHECK(lua_bundle_find(&bundle, "Missing.lua", 11) == NULL);
+        lua_bundle_free(&bundle);
+    }
+}
+
+static void test_lua_bundle_rejects_mismatches(void) {
+    size_t size;
+    uint8_t *data = write_bundle(0, "stamp", &size);
+    LuaBundle bundle;
+    CHECK(lua_bundle_parse(&bundle, data, size, "other", 5) == LUA_BUNDLE_ERROR_STAMP);
+    lua_bundle_free(&bundle);
+
+    data = write_bundle(0, "stamp", &size);
+    data[4] = LUA_BUNDLE_VERSION + 1;
+    CHECK(lua_bundle_parse(&bundle, data, size, "stamp", 5) == LUA_BUNDLE_ERROR_VERSION);
+    lua_bundle_free(&bundle);
+
+    data = write_bundle(0, "stamp", &size);
+    CHECK(lua_bundle_parse(&bundle, data, size - 20, "stamp", 5) == LUA_BUNDLE_ERROR_FORMAT);
+    lua_bundle_free(&bundle);
+
+    LuaBundleWriter writer;
+    lua_bundle_writer_init(&writer, 0);
+    CHECK(lua_bundle_writer_add(&writer, "Launch.lua", "a", 1) == LUA_BUNDLE_OK);
+    CHECK(lua_bundle_writer_add(&writer, "Launch.lua", "b", 1) == LUA_BUNDLE_OK);
+    ByteBuffer out = {0};
+    CHECK(lua_bundle_writer_finish(&writer, "stamp", 5, &out) == LUA_BUNDLE_ERROR_DUPLICATE);
+    lua_bundle_writer_free(&writer);
+    byte_buffer_free(&out);
+}
+
+static void test_build_code_dictionary(void) {
+    const BuildCodeDictionary *latest = build_code_dictionary_latest();
+    CHECK(latest->size > 0 && latest->size <= 32 * 1024);
+    CHECK(latest->id == adler32(adler32(0L, Z_NULL, 0), latest->data, latest->size));
+    CHECK(build_code_dictionary_find(latest->id) == latest);
+    CHECK(build_code_dictionary_find(0) == NULL);
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    zstream_init(L);
+    build_code_init(L);
+    CHECK(luaL_dostring(
+              L,
+              "local xml = string.rep('<PlayerStat stat=\"Life\" value=\"4000\"/>', 50)\n"
+              "local plain, primed = EncodeBuildCode(xml), EncodeBuildCode(xml, 9, true)\n"
+              "assert(#primed < #plain)\n"
+              "assert(DecodeBuildCode(plain) == xml and DecodeBuildCode(primed) == xml)\n"
+              "assert(Inflate(Base64Decode(primed)) == xml)\n"
+              // Made with v1 when it was registered; it must keep decoding for as long as the driver ships.
+              "assert(DecodeBuildCode('ePmn2hMRQx8JgozowBrNlgZKyEM54ZklyRlKdkg1OXIxCavUTQwMDJT07WADLxhDSwDXsiZx') ==\n"
+              "  '<PathOfBuilding><Build level=\"90\" className=\"Witch\">' ..\n"
+              "  '<PlayerStat stat=\"Life\" value=\"4000\"/></Build></PathOfBuilding>')\n"
+              // The same build deflated with a dictionary the driver doesn't have
+              "local xml, err = DecodeBuildCode('ePkMVwKsXc0xCoAwDEDRq5RcoB1chLSDs6jg4Bw02kJ0sLHg7YWObn96HyfSOO7dk2RL1xGwlhEuLB5aB2YVynmgkz0sSdcIASehl-9ZSU1WUg992hlMIXnYQ-OcAxvQViqg_S0-17ImcQ==')\n"
+              "assert(xml == nil and err:find('preset dictionary'), err)\n") == LUA_OK);
+
+    // The header's FDICT flag and dictionary id name the version the code was made with.
+    CHECK(luaL_dostring(L, "return Base64Decode(EncodeBuildCode('<Build/>', 9, true))") == LUA_OK);
+    const unsigned char *header = (const unsigned char *)lua_tostring(L, -1);
+    CHECK(header[1] & 0x20);
+    CHECK(((uLong)header[2] << 24 | (uLong)header[3] << 16 | (uLong)header[4] << 8 | header[5]) == latest->id);
+    lua_close(L);
+}
+
+static void test_base64_codec(void) {
+    char text[16];
+    CHECK(base64_encode((const uint8_t *)"foobar", 6, text, 0) == 8);
+    CHECK(memcmp(text, "Zm9vYmFy", 8) == 0);
+    CHECK(base64_encode((const uint8_t *)"fo", 2, text, 0) == 4);
+    CHECK(memcmp(text, "Zm8=", 4) == 0);
+    CHECK(base64_encode((const uint8_t *)"f", 1, text, 0) == 4);
+    CHECK(memcmp(text, "Zg==", 4) == 0);
+
+    const uint8_t binary[] = {0xfb, 0xff, 0xbf, 0x00};
+    CHECK(base64_encode(binary, 4, text, 0) == base64_encoded_size(4));
+    CHECK(memcmp(text, "+/+/AA==", 8) == 0);
+    CHECK(base64_encode(binary, 4, text, 1) == 8);
+    CHECK(memcmp(text, "-_-_AA==", 8) == 0);
+
+    uint8_t decoded[16];
+    CHECK(base64_decode("-_-_AA==", 8, decoded) == 4);
+    CHECK(memcmp(decoded, binary, 4) == 0);
+    CHECK(base64_decode("+/+/\nAA", 7, decoded) == 4);
+    CHECK(memcmp(decoded, binary, 4) == 0);
+    CHECK(base64_decode("Zm8=ignored", 11, decoded) == 2);
+    CHECK(memcmp(decoded, "fo", 2) == 0);
+    CHECK(base64_decoded_size(8) >= 6);
+}
+
 int main(void) {
     test_subscript_values_round_trip();
+    test_subscript_values_reject_malformed_data();
+    test_subscript_batch_layout();
+    test_subscript_callback_arguments();
+    test_subscript_shared_data();
     test_large_buffer_append();
     test_draw_color_escapes();
     test_dpi_scaling();
+    test_lua_bundle_round_trip();
+    test_lua_bundle_rejects_mismatches();
+    test_base64_codec();
+    test_build_code_dictionary();
     return 0;
 }
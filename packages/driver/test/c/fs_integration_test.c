@@ -1,15 +1,14 @@
 #include "fs.h"
 
-#include <emscripten/wasmfs.h>
 #include <lauxlib.h>
 #include <lualib.h>
 #include <stdio.h>
 
-extern backend_t wasmfs_create_nodefs_backend(const char *root);
-
 int main(void) {
-    backend_t backend = wasmfs_create_nodefs_backend("");
-    wasmfs_create_directory("/app", 0777, backend);
+    if (fs_mount() == 0) {
+        fprintf(stderr, "Lua filesystem integration failed: root archive was not mounted\n");
+        return 1;
+    }
 
     lua_State *L = luaL_newstate();
     luaL_openlibs(L);
@@ -26,16 +25,23 @@ int main(void) {
             "end\n"
             "save('alpha.xml', '<PathOfBuilding name=\"alpha\"/>')\n"
             "save('beta.xml', '<PathOfBuilding name=\"beta\"/>')\n"
+            "local chunked = assert(io.open('/app/user/Persisted/chunked.txt', 'wb'))\n"
+            "chunked:setvbuf('no')\n"
+            "for _ = 1, 100 do assert(chunked:write('<Line/>')) end\n"
+            "assert(chunked:close())\n"
+            "local written = assert(io.open('/app/user/Persisted/chunked.txt', 'rb'))\n"
+            "assert(written:read('*a') == string.rep('<Line/>', 100))\n"
+            "assert(written:close())\n"
             "local folder = assert(NewFileSearch('/app/user/Path of Building/Builds/*', true))\n"
             "assert(folder:GetFileName() == 'Saved Builds')\n"
             "assert(folder:NextFile() == nil)\n"
             "assert(NewFileSearch('/app/user/Path of Building/Builds/Saved Builds', false) == nil)\n"
             "local search = assert(NewFileSearch('/app/user/Path of Building/Builds/Saved Builds/*.xml', false))\n"
-            "local names = {[search:GetFileName()] = true}\n"
+            "local names = {[search:GetFileName()] = search:GetFileSize()}\n"
             "assert(search:NextFile())\n"
-            "names[search:GetFileName()] = true\n"
+            "names[search:GetFileName()] = search:GetFileSize()\n"
             "assert(search:NextFile() == nil)\n"
-            "assert(names['alpha.xml'] and names['beta.xml'])\n"
+            "assert(names['alpha.xml'] == 30 and names['beta.xml'] == 29)\n"
             "assert(NewFileSearch('/app/user/Path of Building/Builds/Saved Builds/*.xml', true) == nil)\n"
             "assert(NewFileSearch('/app/user/Path of Building/Builds/Saved Builds/missing-*.xml', false) == nil)\n"
             "local input = assert(io.open('/app/user/Path of Building/Builds/Saved Builds/beta.xml', 'rb'))\n"
@@ -48,7 +54,55 @@ int main(void) {
             "assert(existing:seek('end') > 0)\n"
             "assert(existing:seek('set', 0) == 0)\n"
             "assert(existing:read('*a') == '<PathOfBuilding name=\"existing\"/>')\n"
-            "assert(existing:close())\n";
+            "assert(existing:close())\n"
+            "for _ = 1, 3 do assert(io.open('/app/user/Persisted/missing.lua', 'rb') == nil) end\n"
+            "local function store(name, value)\n"
+            "  local file = assert(io.open('/app/user/Persisted/' .. name, 'wb'))\n"
+            "  assert(file:write(value))\n"
+            "  assert(file:close())\n"
+            "end\n"
+            "local function load(name)\n"
+            "  local file = assert(io.open('/app/user/Persisted/' .. name, 'rb'))\n"
+            "  local value = file:read('*a')\n"
+            "  assert(file:close())\n"
+            "  return value\n"
+            "end\n"
+            "local small = string.rep('0123456789', 10000)\n"
+            "store('small.bin', small)\n"
+            "assert(load('small.bin') == small)\n"
+            "local large = string.rep('abcdefgh', 262144)\n"
+            "store('large.bin', large)\n"
+            "assert(load('large.bin') == large)\n"
+            "local edited = assert(io.open('/app/user/Persisted/small.bin', 'r+b'))\n"
+            "assert(edited:read(10) == '0123456789')\n"
+            "assert(edited:seek('set', 10) == 10)\n"
+            "assert(edited:write('XY'))\n"
+            "assert(edited:seek('set', 0) == 0)\n"
+            "assert(edited:read(12) == '0123456789XY')\n"
+            "assert(edited:close())\n"
+            "assert(load('shared.txt') == '<PathOfBuilding name=\"shared\"/>')\n"
+            "assert(load('shared.txt') == '<PathOfBuilding name=\"changed in another tab\"/>')\n"
+            "local manifest = assert(io.open('/app/root/manifest.xml', 'rb'))\n"
+            "assert(manifest:read('*a') == '<PoBVersion/>')\n"
+            "assert(manifest:close())\n"
+            "assert(loadfile('/app/root/lua/module.lua')() == 3500)\n"
+            "local stored = assert(io.open('/app/root/Data/stored.bin', 'rb'))\n"
+            "assert(stored:seek('end') == 4096)\n"
+            "assert(stored:seek('set', 4000) == 4000)\n"
+            "assert(stored:read('*a') == string.rep('s', 96))\n"
+            "assert(stored:close())\n"
+            "assert(io.open('/app/root/missing.lua', 'rb') == nil)\n"
+            "assert(io.open('/app/root/manifest.xml', 'wb') == nil)\n"
+            "assert(not MakeDir('/app/root/Data/New'))\n"
+            "local folders = assert(NewFileSearch('/app/root/*', true))\n"
+            "local names = {[folders:GetFileName()] = true}\n"
+            "assert(folders:NextFile())\n"
+            "names[folders:GetFileName()] = true\n"
+            "assert(folders:NextFile() == nil and names.Data and names.lua)\n"
+            "local modules = assert(NewFileSearch('/app/root/lua/*.lua', false))\n"
+            "assert(modules:GetFileName() == 'module.lua' and modules:GetFileSize() == 3524)\n"
+            "assert(modules:GetFileModifiedTime() > 0)\n"
+            "assert(modules:NextFile() == nil)\n";
 
     int status = luaL_dostring(L, script);
     if (status != LUA_OK) {
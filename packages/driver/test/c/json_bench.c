@@ -0,0 +1,223 @@
+// Checks the native JsonDecode/JsonEncode against PoB's dkjson.lua and compares their throughput.
+//
+//   node build/driver_json_bench.mjs <dkjson.lua> <payload.json>...
+//
+// Payloads are recorded API responses. Each is decoded by both implementations (and lazily) and the
+// results must be identical, including dkjson's error positions and messages for a set of malformed
+// and unusual documents; both encoders must then produce the same text from the same table. Every
+// payload is also repeated into a multi-megabyte array, the size of a large stash tab response.
+// Times are per call, allocated is the total Lua heap allocation per call. Exits with status 1 on
+// the first difference.
+
+#include <emscripten.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "json.h"
+
+static double st_allocated = 0;
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    (void)ud;
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+    size_t old = ptr != NULL ? osize : 0;
+    void *next = realloc(ptr, nsize);
+    if (next != NULL && nsize > old) {
+        st_allocated += (double)(nsize - old);
+    }
+    return next;
+}
+
+static int Now(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now());
+    return 1;
+}
+
+static int Allocated(lua_State *L) {
+    lua_pushnumber(L, st_allocated);
+    return 1;
+}
+
+static const char *compare_lua =
+    "function Compare(a, b, path)\n"
+    "  if type(a) ~= type(b) then\n"
+    "    error(string.format('%s: %s (lua) ~= %s (native)', path, type(a), type(b)), 0)\n"
+    "  end\n"
+    "  if type(a) ~= 'table' then\n"
+    "    if a ~= b and (a == a or b == b) then\n"
+    "      error(string.format('%s: %q (lua) ~= %q (native)', path, tostring(a), tostring(b)), 0)\n"
+    "    end\n"
+    "    return\n"
+    "  end\n"
+    "  local ma, mb = getmetatable(a), getmetatable(b)\n"
+    "  if (ma and ma.__jsontype) ~= (mb and mb.__jsontype) then\n"
+    "    error(string.format('%s: __jsontype differs', path), 0)\n"
+    "  end\n"
+    "  for k, v in pairs(a) do Compare(v, b[k], path .. '.' .. tostring(k)) end\n"
+    "  for k in pairs(b) do\n"
+    "    if a[k] == nil then error(string.format('%s.%s: only in native', path, tostring(k)), 0) end\n"
+    "  end\n"
+    "end\n"
+    "function CompareResults(label, a, b)\n"
+    "  if a.n ~= b.n then error(string.format('%s: %d results (lua) ~= %d (native)', label, a.n, b.n), 0) end\n"
+    "  for i = 1, a.n do Compare(a[i], b[i], label .. '#' .. i) end\n"
+    "end\n";
+
+static const char *checks_lua =
+    "local dkjson = ...\n"
+    "local documents = {\n"
+    "  '', '   ', '{}', '[]', '[1,2,3]', '[1 2 3]', '[1,,2]', '[1,2,]', '{\"a\":1,}', '{\"a\" 1}', '{\"a\"}',\n"
+    "  '[1:2, 3]', '{null:1}', '{1:2}', '{\"a\":{\"b\":[]}}', '[null,null,3]', '[null]', 'null', 'true',\n"
+    "  'truex', 'nul', 'True', '01', '-', '-.5', '.5', '5.', '1.2.3', '1e', '1e5', '1E+5', '-1e-5', '1-2',\n"
+    "  '123abc', '\"abc', '\"ab\\\\', '\"\\\\u00e9\\\\u20ac\"', '\"\\\\ud83d\\\\ude00\"', '\"\\\\ud83d\"', '\"\\\\ud83dx\"',\n"
+    "  '\"\\\\ud83d\\\\u0041\"', '\"\\\\u12\"', '\"\\\\u-001\"', '\"\\\\u 1 \"', '\"\\\\uzzzz\"', '\"\\\\q\\\\/\\\\b\\\\f\\\\n\\\\r\\\\t\"',\n"
+    "  '\\239\\187\\191[1]', '// c\\n[1]', '/* c */ [1]', '/* c', '// c', '[1, // c\\n 2]', '[\\n1,\\n2\\n',\n"
+    "  '{\"a\":\\n[1,\\n', '[1}', '{\"a\":1]', '@', '[\"x\" : 1]', '\\t\\v\\f\\r\\n 7 trailing',\n"
+    "}\n"
+    "for _, text in ipairs(documents) do\n"
+    "  CompareResults(string.format('%q', text), table.pack(dkjson.decode(text)), table.pack(JsonDecode(text)))\n"
+    "  if text ~= '' then\n"
+    "    CompareResults(string.format('lazy %q', text), table.pack(dkjson.decode(text)), table.pack(JsonDecodeLazy(text, 1)))\n"
+    "  end\n"
+    "end\n"
+    "local text = '  [1, null, {\"a\": null}]  '\n"
+    "CompareResults('pos', table.pack(dkjson.decode(text, 4)), table.pack(JsonDecode(text, 4)))\n"
+    "CompareResults('past end', table.pack(dkjson.decode(text, 100)), table.pack(JsonDecode(text, 100)))\n"
+    "CompareResults('nullval', table.pack(dkjson.decode(text, 1, false)), table.pack(JsonDecode(text, 1, false)))\n"
+    "CompareResults('no metatables', table.pack(dkjson.decode(text, 1, nil, nil)), table.pack(JsonDecode(text, 1, nil, nil)))\n"
+    "local values = {\n"
+    "  {}, setmetatable({}, {__jsontype = 'object'}), {1, nil, 3}, {n = 3}, {n = 2, 1, 2, 3}, {[20] = 1},\n"
+    "  {[1.5] = 1}, {a = {b = {}}}, {[3] = 'x', [-1] = 'y'}, 'plain', '\"q\" \\\\ \\1\\31\\127 / \\n\\t',\n"
+    "  '\\226\\128\\168 \\239\\187\\191 \\194\\173 \\216\\128 \\220\\143 \\225\\158\\180 \\226\\129\\160 \\239\\191\\176 é',\n"
+    "  1, -0.5, 1 / 0, -1 / 0, 0 / 0, 1e300, 0.1, 123456789012345678, true, false, {[1] = true, [2] = false},\n"
+    "}\n"
+    "for i, value in ipairs(values) do\n"
+    "  local expected, actual = dkjson.encode(value), JsonEncode(value)\n"
+    "  if expected ~= actual then\n"
+    "    error(string.format('encode #%d: %q (lua) ~= %q (native)', i, expected, tostring(actual)), 0)\n"
+    "  end\n"
+    "end\n"
+    "local cycle = {}\n"
+    "cycle.self = cycle\n"
+    "for i, value in ipairs({dkjson.null, {print}, {[{}] = 1}, cycle, setmetatable({}, {__jsonorder = {}})}) do\n"
+    "  if JsonEncode(value) ~= false then error(string.format('hook #%d was not left to dkjson', i), 0) end\n"
+    "end\n"
+    "local lazy = JsonDecodeLazy('[[1,2],[3,[4,5,6]],7]', 1)\n"
+    "if #lazy ~= 3 or rawget(lazy, 3) ~= nil or lazy[2][2][3] ~= 6 or rawget(lazy, 2) == nil then\n"
+    "  error('lazy array does not decode on access', 0)\n"
+    "end\n"
+    "local count = 0\n"
+    "for i, v in ipairs(lazy) do count = count + i end\n"
+    "for k, v in pairs(JsonDecodeLazy('[1,2,3]', 1)) do count = count + v end\n"
+    "if count ~= 12 then error('lazy array iteration is incomplete', 0) end\n";
+
+static const char *bench_lua =
+    "local dkjson, name, text = ...\n"
+    "local luaDoc, luaPos = dkjson.decode(text)\n"
+    "assert(luaDoc, luaPos)\n"
+    "CompareResults(name, table.pack(luaDoc, luaPos), table.pack(JsonDecode(text)))\n"
+    "Compare(luaDoc, JsonDecodeLazy(text, 4), name .. ' (lazy)')\n"
+    "local luaText, nativeText = dkjson.encode(luaDoc), JsonEncode(luaDoc)\n"
+    "if luaText ~= nativeText then\n"
+    "  local at = 1\n"
+    "  while luaText:byte(at) == nativeText:byte(at) do at = at + 1 end\n"
+    "  error(string.format('%s: encoded text differs at byte %d: %q (lua) ~= %q (native)', name, at,\n"
+    "    luaText:sub(at, at + 40), nativeText:sub(at, at + 40)), 0)\n"
+    "end\n"
+    "local stash, size = {}, 0\n"
+    "repeat stash[#stash + 1] = luaDoc; size = size + #luaText until size > 4 * 1048576\n"
+    "local stashText = dkjson.encode(stash)\n"
+    "for _, payload in ipairs({{name, text, luaDoc, 50}, {name .. ' x' .. #stash, stashText, stash, 3}}) do\n"
+    "  local label, input, doc, iterations = payload[1], payload[2], payload[3], payload[4]\n"
+    "  print(string.format('%s: %d bytes', label, #input))\n"
+    "  local cases = {\n"
+    "    {'decode lua', dkjson.decode, input},\n"
+    "    {'decode native', JsonDecode, input},\n"
+    "    {'decode lazy', JsonDecodeLazy, input},\n"
+    "    {'encode lua', dkjson.encode, doc},\n"
+    "    {'encode native', JsonEncode, doc},\n"
+    "  }\n"
+    "  for _, case in ipairs(cases) do\n"
+    "    local caseLabel, fn, arg = case[1], case[2], case[3]\n"
+    "    collectgarbage('collect')\n"
+    "    local allocated, start = Allocated(), Now()\n"
+    "    for _ = 1, iterations do fn(arg) end\n"
+    "    local elapsed = (Now() - start) / iterations\n"
+    "    print(string.format('  %-14s %9.3f ms %8.1f MB/s %10d bytes allocated', caseLabel, elapsed,\n"
+    "      #input / elapsed / 1000, (Allocated() - allocated) / iterations))\n"
+    "  end\n"
+    "end\n";
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(len + 1);
+    *size = fread(data, 1, len, f);
+    fclose(f);
+    return data;
+}
+
+static int run_chunk(lua_State *L, const char *chunk, int dkjson, int nargs) {
+    if (luaL_loadstring(L, chunk) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 0;
+    }
+    lua_insert(L, -nargs - 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dkjson);
+    lua_insert(L, -nargs - 1);
+    if (lua_pcall(L, nargs + 1, 0, 0) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <dkjson.lua> <payload.json>...\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = lua_newstate(counting_alloc, NULL);
+    luaL_openlibs(L);
+    json_init(L);
+    lua_register(L, "Now", Now);
+    lua_register(L, "Allocated", Allocated);
+
+    if (luaL_dofile(L, argv[1]) != LUA_OK || luaL_dostring(L, compare_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    int dkjson = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (!run_chunk(L, checks_lua, dkjson, 0)) {
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        size_t len;
+        char *text = read_file(argv[i], &len);
+        if (text == NULL) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        lua_pushstring(L, argv[i]);
+        lua_pushlstring(L, text, len);
+        free(text);
+        if (!run_chunk(L, bench_lua, dkjson, 2)) {
+            return 1;
+        }
+    }
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Build save time through the broker-backed filesystem, and how many write RPCs a save costs.
+//
+//   deno task test:performance:save [--runs <count>] [build code file...]
+//
+// The XML of each build code is written to /app the way PoB's SaveDB does, with one file:write of the
+// whole text, and line by line through buffered and unbuffered stdio, as the smaller settings writers
+// do. Times are the median per save, including open and close.
+
+#include <emscripten.h>
+#include <emscripten/wasmfs.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "build_code.h"
+
+extern backend_t wasmfs_create_nodefs_backend(const char *root);
+extern const uint32_t *wasmfs_nodefs_cache_stats(void);
+
+static int Now(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now());
+    return 1;
+}
+
+// Write RPCs sent by the Node backend so far
+static int WriteRpcs(lua_State *L) {
+    lua_pushnumber(L, wasmfs_nodefs_cache_stats()[8]);
+    return 1;
+}
+
+static const char *bench_lua =
+    "local name, code, runs = ...\n"
+    "local xml = assert(DecodeBuildCode(code))\n"
+    "local path = '/app/save-bench.xml'\n"
+    "local cases = {\n"
+    "  {'SaveDB', function(file) assert(file:write(xml)) end},\n"
+    "  {'lines buffered', function(file)\n"
+    "    for line in xml:gmatch('[^\\n]*\\n?') do assert(file:write(line)) end\n"
+    "  end},\n"
+    "  {'lines unbuffered', function(file)\n"
+    "    file:setvbuf('no')\n"
+    "    for line in xml:gmatch('[^\\n]*\\n?') do assert(file:write(line)) end\n"
+    "  end},\n"
+    "}\n"
+    "print(string.format('%s: %d bytes of XML', name, #xml))\n"
+    "for _, case in ipairs(cases) do\n"
+    "  local label, save = case[1], case[2]\n"
+    "  local samples, rpcs = {}, WriteRpcs()\n"
+    "  for run = 1, runs do\n"
+    "    local start = Now()\n"
+    "    local file = assert(io.open(path, 'wb'))\n"
+    "    save(file)\n"
+    "    assert(file:close())\n"
+    "    samples[run] = Now() - start\n"
+    "  end\n"
+    "  rpcs = (WriteRpcs() - rpcs) / runs\n"
+    "  local file = assert(io.open(path, 'rb'))\n"
+    "  assert(file:read('*a') == xml, label .. ': saved text differs')\n"
+    "  assert(file:close())\n"
+    "  table.sort(samples)\n"
+    "  print(string.format('%-17s %9.3f ms %8d write RPCs', label, samples[math.ceil(runs / 2)], rpcs))\n"
+    "end\n";
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <runs> <build code>...\n", argv[0]);
+        return 1;
+    }
+
+    backend_t backend = wasmfs_create_nodefs_backend("");
+    wasmfs_create_directory("/app", 0777, backend);
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    build_code_init(L);
+    lua_register(L, "Now", Now);
+    lua_register(L, "WriteRpcs", WriteRpcs);
+
+    if (luaL_loadstring(L, bench_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    int bench = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    for (int i = 2; i < argc; i++) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, bench);
+        lua_pushfstring(L, "build %d", i - 1);
+        lua_pushstring(L, argv[i]);
+        lua_pushinteger(L, atoi(argv[1]));
+        if (lua_pcall(L, 3, 0, 0) != LUA_OK) {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            return 1;
+        }
+    }
+    lua_close(L);
+    return 0;
+}
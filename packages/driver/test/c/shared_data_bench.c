@@ -0,0 +1,147 @@
+// What GetSubScriptSharedData costs a subscript run, against loading the same data from Lua source.
+//
+//   node build/driver_shared_data_bench.mjs [--runs <count>] [skills...]
+//
+// The data is a synthetic table shaped like PoB's skill data: one entry per skill with stats, tags and
+// per-level values. "reload" compiles and runs its Lua constructor in a fresh state, which is the least a
+// subscript pays to build the data itself; PoB's Data modules do more work than a plain constructor.
+// "decode" reads the shared data image into a fresh state, as the first GetSubScriptSharedData call of a
+// run does. Times are the median per run.
+
+#include <emscripten.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "sub_lua.h"
+
+static const char *generate_lua =
+    "local count = ...\n"
+    "local skills = {}\n"
+    "for i = 1, count do\n"
+    "  local levels = {}\n"
+    "  for level = 1, 20 do\n"
+    "    levels[level] = {level * 3 + i % 7, level * 5, levelRequirement = level * 4, manaCost = 10 + level}\n"
+    "  end\n"
+    "  skills['Skill' .. i] = {\n"
+    "    name = 'Skill ' .. i, baseEffectiveness = 1 + i / count, incrementalEffectiveness = 0.03,\n"
+    "    skillTypes = {[1] = true, [4] = true, [i % 30 + 5] = true},\n"
+    "    stats = {'spell_minimum_base_fire_damage', 'spell_maximum_base_fire_damage', 'base_cast_speed_+%'},\n"
+    "    tags = {'spell', 'fire', 'projectile', 'area'},\n"
+    "    levels = levels,\n"
+    "  }\n"
+    "end\n"
+    "local function write(value, out)\n"
+    "  if type(value) == 'table' then\n"
+    "    out[#out + 1] = '{'\n"
+    "    for key, item in pairs(value) do\n"
+    "      out[#out + 1] = '['\n"
+    "      write(key, out)\n"
+    "      out[#out + 1] = ']='\n"
+    "      write(item, out)\n"
+    "      out[#out + 1] = ','\n"
+    "    end\n"
+    "    out[#out + 1] = '}'\n"
+    "  elseif type(value) == 'string' then\n"
+    "    out[#out + 1] = string.format('%q', value)\n"
+    "  elseif type(value) == 'number' then\n"
+    "    out[#out + 1] = string.format('%.17g', value)\n"
+    "  else\n"
+    "    out[#out + 1] = tostring(value)\n"
+    "  end\n"
+    "end\n"
+    "local out = {'return '}\n"
+    "write(skills, out)\n"
+    "return skills, table.concat(out)\n";
+
+static int compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *samples, int count) {
+    qsort(samples, count, sizeof(double), compare);
+    return samples[count / 2];
+}
+
+static int bench(int skills, int runs) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    if (luaL_loadstring(L, generate_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua_pushinteger(L, skills);
+    if (lua_pcall(L, 1, 2, 0) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    size_t source_size;
+    const char *source = lua_tolstring(L, -1, &source_size);
+    ByteBuffer image = {0};
+    lua_pushvalue(L, -2);
+    if (sub_lua_serialize(L, &image, lua_gettop(L), SUB_LUA_SKIP_UNSUPPORTED) != 0) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+
+    double *reload = malloc(sizeof(double) * runs);
+    double *decode = malloc(sizeof(double) * runs);
+    for (int run = 0; run < runs; run++) {
+        double start = emscripten_get_now();
+        lua_State *R = luaL_newstate();
+        if (luaL_loadbuffer(R, source, source_size, "=data") != LUA_OK || lua_pcall(R, 0, 1, 0) != LUA_OK) {
+            fprintf(stderr, "%s\n", lua_tostring(R, -1));
+            return 1;
+        }
+        lua_close(R);
+        reload[run] = emscripten_get_now() - start;
+
+        start = emscripten_get_now();
+        R = luaL_newstate();
+        if (sub_lua_deserialize(R, image.data, image.size) != 1) {
+            fprintf(stderr, "malformed image\n");
+            return 1;
+        }
+        lua_close(R);
+        decode[run] = emscripten_get_now() - start;
+    }
+
+    double reload_ms = median(reload, runs);
+    double decode_ms = median(decode, runs);
+    printf("%6d skills  source %7.0f KiB  image %7.0f KiB  reload %8.2f ms  decode %8.2f ms  %5.2fx\n", skills,
+           source_size / 1024.0, image.size / 1024.0, reload_ms, decode_ms, reload_ms / decode_ms);
+
+    free(reload);
+    free(decode);
+    byte_buffer_free(&image);
+    lua_close(L);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int runs = 10;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+        runs = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        static const int defaults[] = {250, 1000, 4000};
+        for (int i = 0; i < 3; i++) {
+            if (bench(defaults[i], runs) != 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    for (int i = first; i < argc; i++) {
+        if (bench(atoi(argv[i]), runs) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
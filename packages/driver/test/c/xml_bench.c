@@ -0,0 +1,154 @@
+// Checks the native ParseXML/ComposeXML against PoB's xml.lua and compares their throughput.
+//
+//   node build/driver_xml_bench.mjs <xml.lua> <build code file>...
+//
+// Each file holds a build code. Its XML is parsed by both implementations and the trees must be
+// identical; both composers must then produce the same text from the same tree. Times are per call,
+// allocated is the total Lua heap allocation per call, which is mostly short-lived tables and strings.
+// Exits with status 1 on the first difference.
+
+#include <emscripten.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "build_code.h"
+#include "xml.h"
+#include "zstream.h"
+
+static double st_allocated = 0;
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    (void)ud;
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+    size_t old = ptr != NULL ? osize : 0;
+    void *next = realloc(ptr, nsize);
+    if (next != NULL && nsize > old) {
+        st_allocated += (double)(nsize - old);
+    }
+    return next;
+}
+
+static int Now(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now());
+    return 1;
+}
+
+static int Allocated(lua_State *L) {
+    lua_pushnumber(L, st_allocated);
+    return 1;
+}
+
+static const char *bench_lua =
+    "local LuaXml, name, code = ...\n"
+    "local xml = assert(DecodeBuildCode(code))\n"
+    "local function compare(a, b, path)\n"
+    "  if type(a) ~= type(b) then\n"
+    "    error(string.format('%s: %s (lua) ~= %s (native)', path, type(a), type(b)), 0)\n"
+    "  end\n"
+    "  if type(a) ~= 'table' then\n"
+    "    if a ~= b then error(string.format('%s: %q (lua) ~= %q (native)', path, a, b), 0) end\n"
+    "    return\n"
+    "  end\n"
+    "  for k, v in pairs(a) do compare(v, b[k], path .. '.' .. tostring(k)) end\n"
+    "  for k in pairs(b) do\n"
+    "    if a[k] == nil then error(string.format('%s.%s: only in native', path, tostring(k)), 0) end\n"
+    "  end\n"
+    "end\n"
+    "local luaDoc = assert(LuaXml.ParseXML(xml))\n"
+    "compare(luaDoc, assert(ParseXML(xml)), name)\n"
+    "local luaText, nativeText = LuaXml.ComposeXML(luaDoc[1]), ComposeXML(luaDoc[1])\n"
+    "if luaText ~= nativeText then\n"
+    "  local at = 1\n"
+    "  while luaText:byte(at) == nativeText:byte(at) do at = at + 1 end\n"
+    "  error(string.format('%s: composed text differs at byte %d: %q (lua) ~= %q (native)', name, at,\n"
+    "    luaText:sub(at, at + 40), nativeText:sub(at, at + 40)), 0)\n"
+    "end\n"
+    "for _, broken in ipairs({ '<a><b></a>', '<a', '<a x=1/>', '<a>' }) do\n"
+    "  if (LuaXml.ParseXML(broken) == nil) ~= (ParseXML(broken) == nil) then\n"
+    "    error(string.format('%q: only one implementation rejected it', broken), 0)\n"
+    "  end\n"
+    "end\n"
+    "local iterations = #xml > 1048576 and 5 or 50\n"
+    "local cases = {\n"
+    "  {'parse lua', LuaXml.ParseXML, xml, #xml},\n"
+    "  {'parse native', ParseXML, xml, #xml},\n"
+    "  {'compose lua', LuaXml.ComposeXML, luaDoc[1], #luaText},\n"
+    "  {'compose native', ComposeXML, luaDoc[1], #luaText},\n"
+    "}\n"
+    "for _, case in ipairs(cases) do\n"
+    "  local label, fn, input, bytes = case[1], case[2], case[3], case[4]\n"
+    "  collectgarbage('collect')\n"
+    "  local allocated, start = Allocated(), Now()\n"
+    "  for _ = 1, iterations do fn(input) end\n"
+    "  local elapsed = (Now() - start) / iterations\n"
+    "  print(string.format('%-15s %9.3f ms %8.1f MB/s %10d bytes allocated', label, elapsed,\n"
+    "    bytes / elapsed / 1000, (Allocated() - allocated) / iterations))\n"
+    "end\n";
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(len + 1);
+    *size = fread(data, 1, len, f);
+    fclose(f);
+    return data;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <xml.lua> <build code file>...\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = lua_newstate(counting_alloc, NULL);
+    luaL_openlibs(L);
+    zstream_init(L);
+    build_code_init(L);
+    xml_init(L);
+    lua_register(L, "Now", Now);
+    lua_register(L, "Allocated", Allocated);
+
+    if (luaL_dofile(L, argv[1]) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    int lua_xml = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (luaL_loadstring(L, bench_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    int bench = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    for (int i = 2; i < argc; i++) {
+        size_t code_len;
+        char *code = read_file(argv[i], &code_len);
+        if (code == NULL) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        printf("%s: %zu bytes of code\n", argv[i], code_len);
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, bench);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, lua_xml);
+        lua_pushstring(L, argv[i]);
+        lua_pushlstring(L, code, code_len);
+        free(code);
+        if (lua_pcall(L, 3, 0, 0) != LUA_OK) {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            return 1;
+        }
+    }
+    lua_close(L);
+    return 0;
+}
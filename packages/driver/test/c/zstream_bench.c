@@ -0,0 +1,241 @@
+// Compares the former one-shot Deflate/Inflate with the zstream versions on real build codes.
+//
+//   node build/driver_zstream_bench.mjs <build code file>...
+//
+// Each file holds a build code (base64url of the deflated build XML). The XML is compressed and
+// decompressed with the old implementation, the new one-shot globals, and a stream fed in 16 KiB
+// chunks. Times are per call; peak is the largest amount of Lua heap plus scratch buffers seen.
+
+#include <emscripten.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "zstream.h"
+
+static size_t st_heap = 0;
+static size_t st_peak = 0;
+
+static void track(size_t grow, size_t shrink) {
+    st_heap = st_heap + grow - shrink;
+    if (st_heap > st_peak) {
+        st_peak = st_heap;
+    }
+}
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    (void)ud;
+    size_t old = ptr != NULL ? osize : 0;
+    if (nsize == 0) {
+        free(ptr);
+        track(0, old);
+        return NULL;
+    }
+    void *next = realloc(ptr, nsize);
+    if (next != NULL) {
+        track(nsize, old);
+    }
+    return next;
+}
+
+// The implementations that lived in driver.c before zstream.c, kept here as the baseline.
+static int LegacyDeflate(lua_State *L) {
+    size_t in_len;
+    const char *in = luaL_checklstring(L, 1, &in_len);
+    z_stream strm = {0};
+    if (deflateInit(&strm, Z_BEST_COMPRESSION) != Z_OK) {
+        return 0;
+    }
+    uLong out_sz = deflateBound(&strm, in_len);
+    void *out = malloc(out_sz);
+    track(out_sz, 0);
+    strm.next_in = (Bytef *)in;
+    strm.avail_in = in_len;
+    strm.next_out = out;
+    strm.avail_out = out_sz;
+    int ret = deflate(&strm, Z_FINISH);
+    deflateEnd(&strm);
+    if (ret == Z_STREAM_END) {
+        lua_pushlstring(L, out, strm.total_out);
+    }
+    free(out);
+    track(0, out_sz);
+    return ret == Z_STREAM_END;
+}
+
+static int LegacyInflate(lua_State *L) {
+    size_t in_len;
+    const char *in = luaL_checklstring(L, 1, &in_len);
+    z_stream strm = {0};
+    if (inflateInit(&strm) != Z_OK) {
+        return 0;
+    }
+    uLong out_sz = in_len * 4;
+    void *out = malloc(out_sz);
+    track(out_sz, 0);
+    strm.next_in = (Bytef *)in;
+    strm.avail_in = in_len;
+    strm.next_out = out;
+    strm.avail_out = out_sz;
+    int ret;
+    while ((ret = inflate(&strm, Z_NO_FLUSH)) == Z_OK) {
+        if (strm.avail_out == 0) {
+            out = realloc(out, out_sz * 2);
+            track(out_sz * 2, out_sz);
+            out_sz *= 2;
+            strm.next_out = (Bytef *)out + strm.total_out;
+            strm.avail_out = out_sz - strm.total_out;
+        }
+    }
+    inflateEnd(&strm);
+    if (ret == Z_STREAM_END) {
+        lua_pushlstring(L, out, strm.total_out);
+    }
+    free(out);
+    track(0, out_sz);
+    return ret == Z_STREAM_END;
+}
+
+static int Now(lua_State *L) {
+    lua_pushnumber(L, emscripten_get_now());
+    return 1;
+}
+
+static int ResetPeak(lua_State *L) {
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    st_peak = st_heap;
+    lua_pushnumber(L, (lua_Number)st_heap);
+    return 1;
+}
+
+static int Peak(lua_State *L) {
+    lua_pushnumber(L, (lua_Number)st_peak);
+    return 1;
+}
+
+static const char *bench_lua =
+    "local xml, iterations = ...\n"
+    "local function stream(new, data)\n"
+    "  local s, parts = new(), {}\n"
+    "  for i = 1, #data, 16384 do parts[#parts + 1] = s:Feed(data:sub(i, i + 16383)) end\n"
+    "  parts[#parts + 1] = s:Finish()\n"
+    "  return table.concat(parts)\n"
+    "end\n"
+    "local deflated = Deflate(xml)\n"
+    "local cases = {\n"
+    "  {'deflate legacy', LegacyDeflate, xml},\n"
+    "  {'deflate one-shot', Deflate, xml},\n"
+    "  {'deflate stream', function(d) return stream(NewDeflateStream, d) end, xml},\n"
+    "  {'inflate legacy', LegacyInflate, deflated},\n"
+    "  {'inflate one-shot', Inflate, deflated},\n"
+    "  {'inflate stream', function(d) return stream(NewInflateStream, d) end, deflated},\n"
+    "}\n"
+    "for _, case in ipairs(cases) do\n"
+    "  local name, fn, input = case[1], case[2], case[3]\n"
+    "  local result = fn(input)\n"
+    "  assert(Inflate(name:find('deflate') and result or deflated) == xml, name .. ' produced wrong output')\n"
+    "  result = nil\n"
+    "  local base = ResetPeak()\n"
+    "  local start = Now()\n"
+    "  for _ = 1, iterations do fn(input) end\n"
+    "  local elapsed = (Now() - start) / iterations\n"
+    "  print(string.format('%-18s %9.3f ms %10d bytes peak', name, elapsed, Peak() - base))\n"
+    "end\n";
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(len + 1);
+    *size = fread(data, 1, len, f);
+    fclose(f);
+    return data;
+}
+
+static size_t base64url_decode(const char *in, size_t len, unsigned char *out) {
+    size_t n = 0;
+    unsigned int acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = in[i];
+        int v = c >= 'A' && c <= 'Z' ? c - 'A'
+              : c >= 'a' && c <= 'z' ? c - 'a' + 26
+              : c >= '0' && c <= '9' ? c - '0' + 52
+              : c == '-' || c == '+' ? 62
+              : c == '_' || c == '/' ? 63
+              : -1;
+        if (v < 0) {
+            continue;
+        }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (acc >> bits) & 0xff;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <build code file>...\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = lua_newstate(counting_alloc, NULL);
+    luaL_openlibs(L);
+    zstream_init(L);
+    lua_register(L, "LegacyDeflate", LegacyDeflate);
+    lua_register(L, "LegacyInflate", LegacyInflate);
+    lua_register(L, "Now", Now);
+    lua_register(L, "ResetPeak", ResetPeak);
+    lua_register(L, "Peak", Peak);
+    if (luaL_loadstring(L, bench_lua) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    int bench = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    for (int i = 1; i < argc; i++) {
+        size_t code_len;
+        char *code = read_file(argv[i], &code_len);
+        if (code == NULL) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        unsigned char *deflated = malloc(code_len);
+        size_t deflated_len = base64url_decode(code, code_len, deflated);
+        free(code);
+
+        lua_getglobal(L, "Inflate");
+        lua_pushlstring(L, (const char *)deflated, deflated_len);
+        free(deflated);
+        lua_call(L, 1, 2);
+        if (lua_isnil(L, -2)) {
+            fprintf(stderr, "%s: %s\n", argv[i], lua_tostring(L, -1));
+            return 1;
+        }
+        lua_pop(L, 1);
+        size_t xml_len = lua_rawlen(L, -1);
+        printf("%s: %zu bytes of code, %zu bytes of XML\n", argv[i], code_len, xml_len);
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, bench);
+        lua_insert(L, -2);
+        lua_pushinteger(L, xml_len > (1 << 20) ? 5 : 50);
+        if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+            fprintf(stderr, "%s\n", lua_tostring(L, -1));
+            return 1;
+        }
+    }
+    lua_close(L);
+    return 0;
+}
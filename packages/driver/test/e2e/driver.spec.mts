@@ -175,17 +175,49 @@ test("the current build exports and reloads through the Lua runtime", async ({ p
     return getBuildCode();
   });
   if (!initialCode) throw new Error("getBuildCode returned no code");
-  await page.evaluate((code) => {
+  const timings = await page.evaluate((code) => {
     const loadBuildFromCode = window.__POB_TEST__?.loadBuildFromCode;
     if (!loadBuildFromCode) throw new Error("loadBuildFromCode test hook is unavailable");
     return loadBuildFromCode(code);
   }, initialCode);
+  if (!timings) throw new Error("loadBuildFromCode returned no timings");
+  expect(timings.parse).toBeGreaterThan(0);
+  expect(timings.total).toBeGreaterThanOrEqual(timings.decode + timings.parse);
   const roundTrippedCode = await page.evaluate(() => window.__POB_TEST__?.getBuildCode?.());
   expect(roundTrippedCode).toMatch(/^[A-Za-z0-9_=-]+$/);
   expect(roundTrippedCode).not.toBe(initialCode);
   expect((await page.evaluate(() => window.__POB_TEST__?.errors)) ?? []).toEqual([]);
 });
 
+test("fast and preset-dictionary build codes reload", async ({ page }) => {
+  test.skip(targeted, "Targeted compatibility checks only run the startup scenario");
+  const release = releases.find((candidate) => candidate.game === "poe1");
+  if (!release) throw new Error("The default E2E releases do not include Path of Exile 1");
+  await page.goto(`/?game=${release.game}&version=${release.version}`);
+  await page.waitForFunction(() => window.__POB_TEST__?.started === true);
+
+  const codes = await page.evaluate(async () => {
+    const getBuildCode = window.__POB_TEST__?.getBuildCode;
+    if (!getBuildCode) throw new Error("getBuildCode test hook is unavailable");
+    return {
+      plain: await getBuildCode(),
+      fast: await getBuildCode({ level: 1 }),
+      dictionary: await getBuildCode({ dictionary: true }),
+    };
+  });
+
+  // Each encoding loads back into the same build as the plain code
+  const reload = async (code: string) => {
+    await page.evaluate((code) => window.__POB_TEST__?.loadBuildFromCode?.(code), code);
+    return await page.evaluate(() => window.__POB_TEST__?.getBuildCode?.());
+  };
+  const reloaded = await reload(codes.plain);
+  expect(reloaded).toMatch(/^[A-Za-z0-9_=-]+$/);
+  expect(await reload(codes.fast)).toBe(reloaded);
+  expect(await reload(codes.dictionary)).toBe(reloaded);
+  expect((await page.evaluate(() => window.__POB_TEST__?.errors)) ?? []).toEqual([]);
+});
+
 test("hidden pages release physical keys but preserve virtual modifiers", async ({ page }) => {
   const release = releases[0];
   if (!release) throw new Error("No E2E release is configured");
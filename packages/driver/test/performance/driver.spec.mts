@@ -35,6 +35,8 @@ test("steady-state PoE 1 frame time", async ({ page }, testInfo) => {
   const instanceBytes = samples.reduce((total, sample) => total + sample.instanceBytes, 0);
   const instances = samples.reduce((total, sample) => total + sample.instances, 0);
   const dispatches = samples.reduce((total, sample) => total + sample.dispatches, 0);
+  const inputLatency = median(samples.map((sample) => sample.inputLatency));
+  const inputEvents = samples.reduce((total, sample) => total + sample.inputEvents, 0);
   expect(glyphMisses).toBe(0);
   expect(glyphUploadBytes).toBe(0);
   expect(instanceBytes).toBe(instances * 100);
@@ -50,6 +52,8 @@ test("steady-state PoE 1 frame time", async ({ page }, testInfo) => {
       instanceBytes,
       instances,
       dispatches,
+      inputLatency,
+      inputEvents,
     }),
   );
 });
@@ -0,0 +1,19 @@
+// Differential test and throughput benchmark for the native JSON binding. Extracts PoB's dkjson.lua
+// from a local root.zip and runs build/driver_json_bench.mjs with it against recorded API payloads.
+//
+//   deno task test:performance:json [--root-zip <path>] [payload.json...]
+import { Command } from "@cliffy/command";
+import { defaultRootZip, runBench, withRootLua } from "./root-lua.ts";
+
+const { options, args } = await new Command()
+  .name("json-bench")
+  .option("--root-zip <path:string>", "root.zip that contains lua/dkjson.lua", { default: defaultRootZip })
+  .arguments("[payloads...:string]")
+  .parse(Deno.args);
+
+const fixtures = new URL("fixtures/", import.meta.url);
+const payloads = args.length > 0 ? args : [
+  new URL("poe-api-character-items.json", fixtures).pathname,
+  new URL("poe-trade-fetch.json", fixtures).pathname,
+];
+await withRootLua(options.rootZip, "lua/dkjson.lua", (dkjson) => runBench("driver_json_bench", [dkjson, ...payloads]));
@@ -0,0 +1,25 @@
+import AdmZip from "adm-zip";
+
+export const defaultRootZip =
+  new URL("../../../packer/r2/games/poe1/versions/v2.66.2/root.zip", import.meta.url).pathname;
+
+/** Extracts one of PoB's Lua files from root.zip to a temporary file for the duration of `fn`. */
+export async function withRootLua<T>(rootZip: string, name: string, fn: (path: string) => Promise<T>): Promise<T> {
+  const entry = new AdmZip(rootZip).getEntry(name);
+  if (!entry) throw new Error(`${rootZip} does not contain ${name}`);
+
+  const path = await Deno.makeTempFile({ suffix: ".lua" });
+  try {
+    await Deno.writeFile(path, entry.getData());
+    return await fn(path);
+  } finally {
+    await Deno.remove(path);
+  }
+}
+
+/** Runs one of the node benchmarks built next to the driver and propagates its exit status. */
+export async function runBench(name: string, args: string[]): Promise<void> {
+  const bench = new URL(`../../build/${name}.mjs`, import.meta.url).pathname;
+  const { code } = await new Deno.Command("node", { args: [bench, ...args] }).spawn().status;
+  if (code !== 0) Deno.exitCode = code;
+}
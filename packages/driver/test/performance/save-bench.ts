@@ -0,0 +1,40 @@
+// Build save time through the production RPC and a ZenFS broker. Runs build/driver_save_bench.mjs, which
+// saves the XML of each build code the way PoB does and reports the median time and write RPCs per save.
+//
+//   deno task test:performance:save [--runs <count>] [build code file...]
+import { Command } from "@cliffy/command";
+import { createRpcClient } from "../../src/js/rpc.ts";
+
+const { options, args } = await new Command()
+  .name("save-bench")
+  .option("--runs <count:integer>", "Number of saves per build and mode", { default: 20 })
+  .arguments("[codes...:string]")
+  .parse(Deno.args);
+
+const paths = args.length > 0
+  ? args
+  : [new URL("../../../web/test/e2e/fixtures/pobb-poe2-v0.5.txt", import.meta.url).pathname];
+const codes = await Promise.all(paths.map(async (path) => (await Deno.readTextFile(path)).trim()));
+
+const worker = new Worker(new URL("./save-bench.worker.ts", import.meta.url).href, { type: "module" });
+const channel = new MessageChannel();
+try {
+  const ready = new Promise<void>((resolve, reject) => {
+    worker.onmessage = () => resolve();
+    worker.onerror = (event) => reject(event.error ?? new Error(event.message));
+  });
+  worker.postMessage({ type: "start", port: channel.port1 }, [channel.port1]);
+  await ready;
+
+  const { default: createModule } = await import("../../build/driver_save_bench.mjs");
+  await createModule({
+    arguments: [String(options.runs), ...codes],
+    rpcCall: createRpcClient(channel.port2),
+    onExit: (code: number) => {
+      if (code !== 0) Deno.exitCode = code;
+    },
+  });
+} finally {
+  channel.port2.close();
+  worker.terminate();
+}
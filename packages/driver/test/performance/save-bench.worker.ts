@@ -0,0 +1,15 @@
+import { configure, InMemory } from "@zenfs/core";
+import { FilesystemRpcHandler } from "../../src/js/filesystem-handler.ts";
+import { exposeRpcPort } from "../../src/js/rpc.ts";
+
+const handler = new FilesystemRpcHandler();
+
+self.onmessage = async ({ data }: MessageEvent<{ type: "start"; port: MessagePort }>) => {
+  await configure({ mounts: { "/": InMemory } });
+  handler.reset();
+  exposeRpcPort(data.port, async (operation, args, payload) => {
+    if (!handler.handles(operation)) throw new Error(`Unsupported operation in save benchmark: ${operation}`);
+    return await handler.handle(operation, args, payload);
+  });
+  self.postMessage({ type: "ready" });
+};
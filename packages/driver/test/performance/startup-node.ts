@@ -0,0 +1,129 @@
+// Headless time-to-first-frame benchmark. Runs the Node build of the driver against a local root.zip, with
+// a fresh Wasm instance and filesystem per run, and reports the median of each startup phase.
+//
+//   deno task test:performance:startup --runs 10 --budget total=6000 --budget on-init=3000
+import { Command } from "@cliffy/command";
+import { createRpcClient } from "../../src/js/rpc.ts";
+import { readStartupTrace, STARTUP_PHASES, type StartupPhase, summarizeStartupTrace } from "../../src/js/startup-trace.ts";
+
+type Metric = StartupPhase | "total";
+type DriverNodeModule = {
+  cwrap: (name: string, returnType: string, argTypes: string[]) => () => number;
+  HEAPU8: Uint8Array;
+};
+
+const { options } = await new Command()
+  .name("startup-node")
+  .option("--root-zip <path:string>", "root.zip to mount at /root", {
+    default: new URL("../../../packer/r2/games/poe1/versions/v2.66.2/root.zip", import.meta.url).pathname,
+  })
+  .option("--runs <count:integer>", "Number of cold starts", { default: 5 })
+  .option("--budget <metric=ms:string>", "Fail when the median of a phase, or total, exceeds the budget", {
+    collect: true,
+  })
+  .option("--json", "Print the medians as JSON")
+  .parse(Deno.args);
+
+const budgets = new Map<Metric, number>();
+for (const budget of options.budget ?? []) {
+  const [metric, value] = budget.split("=");
+  if (metric !== "total" && !STARTUP_PHASES.includes(metric as StartupPhase)) {
+    throw new Error(`Unknown budget metric: ${metric}`);
+  }
+  budgets.set(metric as Metric, Number(value));
+}
+
+const rootZip = await Deno.readFile(options.rootZip);
+const { default: createModule } = await import("../../build/driver_node.mjs");
+
+const samples = new Map<Metric, number[]>();
+for (let run = 0; run < options.runs; run += 1) {
+  const result = await startOnce();
+  for (const [metric, duration] of Object.entries(result) as [Metric, number][]) {
+    samples.set(metric, [...(samples.get(metric) ?? []), duration]);
+  }
+}
+
+const medians = Object.fromEntries([...samples].map(([metric, values]) => [metric, median(values)])) as Record<
+  Metric,
+  number
+>;
+if (options.json) {
+  console.log(JSON.stringify({ runs: options.runs, medians }));
+} else {
+  for (const [metric, duration] of Object.entries(medians)) {
+    console.log(`${metric.padEnd(16)} ${duration.toFixed(1).padStart(10)} ms`);
+  }
+}
+
+let failed = false;
+for (const [metric, budget] of budgets) {
+  if (medians[metric] > budget) {
+    console.error(`${metric} median ${medians[metric].toFixed(1)} ms exceeds budget ${budget} ms`);
+    failed = true;
+  }
+}
+if (failed) Deno.exit(1);
+
+async function startOnce(): Promise<Record<Metric, number>> {
+  const worker = new Worker(new URL("./startup-node.worker.ts", import.meta.url).href, { type: "module" });
+  const channel = new MessageChannel();
+  try {
+    const ready = new Promise<void>((resolve, reject) => {
+      worker.onmessage = () => resolve();
+      worker.onerror = (event) => reject(event.error ?? new Error(event.message));
+    });
+    const data = rootZip.slice().buffer;
+    worker.postMessage({ type: "start", port: channel.port1, rootZip: data }, [channel.port1, data]);
+    await ready;
+
+    const errors: string[] = [];
+    const startedAt = performance.now();
+    const module: DriverNodeModule = await createModule({
+      print: () => {},
+      printErr: () => {},
+      rpcCall: createRpcClient(channel.port2),
+      rootArchive: rootZip.slice().buffer,
+      onError: (message: string) => errors.push(message),
+      onOAuthLogout: () => {},
+      requestFrames: () => {},
+      setWindowTitle: () => {},
+      getScreenWidth: () => 1920,
+      getScreenHeight: () => 1080,
+      getScreenScale: () => 1,
+      isKeyDown: () => false,
+      takePasteText: () => "",
+      imageLoad: () => {},
+      drawCommit: () => {},
+      getStringWidth: (_size: number, _font: number, text: string) => text.length * 8,
+      getStringCursorIndex: () => 0,
+      copy: () => {},
+      openUrl: () => {},
+    });
+    module.cwrap("init", "number", [])();
+    module.cwrap("start", "number", [])();
+    const total = performance.now() - startedAt;
+    if (errors.length > 0) throw new Error(`Driver reported errors during startup: ${errors.join("\n")}`);
+
+    const spans = readStartupTrace(
+      module.HEAPU8,
+      module.cwrap("trace_events", "number", [])(),
+      module.cwrap("trace_count", "number", [])(),
+      module.cwrap("trace_capacity", "number", [])(),
+    );
+    const summary = summarizeStartupTrace(spans);
+    return {
+      ...Object.fromEntries(STARTUP_PHASES.map((phase) => [phase, summary[phase].duration])),
+      total,
+    } as Record<Metric, number>;
+  } finally {
+    channel.port2.close();
+    worker.terminate();
+  }
+}
+
+function median(values: number[]) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const middle = Math.floor(sorted.length / 2);
+  return sorted.length % 2 === 0 ? (sorted[middle - 1] + sorted[middle]) / 2 : sorted[middle];
+}
@@ -0,0 +1,17 @@
+import { Zip } from "@zenfs/archives";
+import { configure, InMemory, resolveMountConfig } from "@zenfs/core";
+import { FilesystemRpcHandler } from "../../src/js/filesystem-handler.ts";
+import { exposeRpcPort } from "../../src/js/rpc.ts";
+
+const handler = new FilesystemRpcHandler();
+
+self.onmessage = async ({ data }: MessageEvent<{ type: "start"; port: MessagePort; rootZip: ArrayBuffer }>) => {
+  const root = await resolveMountConfig({ backend: Zip, data: data.rootZip, name: "root.zip" });
+  await configure({ mounts: { "/root": root, "/user": InMemory } });
+  handler.reset();
+  exposeRpcPort(data.port, async (operation, args, payload) => {
+    if (!handler.handles(operation)) throw new Error(`Unsupported operation in startup benchmark: ${operation}`);
+    return await handler.handle(operation, args, payload);
+  });
+  self.postMessage({ type: "ready" });
+};
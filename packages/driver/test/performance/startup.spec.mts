@@ -0,0 +1,34 @@
+import { expect, test } from "../../../../tools/playwright.mts";
+
+const STARTUP_URL = "/?game=poe1&version=v2.66.2&heap-snapshot=1";
+
+test("PoE 1 startup from cold init and from a heap snapshot", async ({ page }, testInfo) => {
+  const waitForFirstFrame = async () => {
+    await page.waitForFunction(() =>
+      window.__POB_TEST__?.started === true && window.__POB_TEST__.startup !== null &&
+      window.__POB_TEST__.frameCount > 0
+    );
+    return page.evaluate(() => ({ ...window.__POB_TEST__!.startup!, errors: window.__POB_TEST__!.errors }));
+  };
+
+  await page.goto(STARTUP_URL);
+  const cold = await waitForFirstFrame();
+  await page.waitForFunction(() => window.__POB_TEST__?.heapSnapshotStored === true);
+
+  await page.reload();
+  const restored = await waitForFirstFrame();
+
+  expect(cold.mode).toBe("cold");
+  expect(restored.mode).toBe("restored");
+  expect(cold.errors).toEqual([]);
+  expect(restored.errors).toEqual([]);
+  console.log(
+    JSON.stringify({
+      browser: testInfo.project.name,
+      repetition: testInfo.repeatEachIndex,
+      cold: cold.duration,
+      restored: restored.duration,
+      speedup: cold.duration / restored.duration,
+    }),
+  );
+});
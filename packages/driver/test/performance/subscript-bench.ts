@@ -0,0 +1,90 @@
+// Subscript launch latency and the cost of the sub worker build. Reports the Wasm size and instantiate time of
+// the full driver and of driver_sub, then the subscript launch latency with and without a warm instance: a
+// cold launch instantiates driver_sub the way a fresh sub worker does before its first job, a warm launch
+// reuses one instance, as the broker's pool does. Both run a small script through sub_start, which creates
+// and closes the Lua state.
+//
+//   deno task test:performance:subscript --runs 20
+import { Command } from "@cliffy/command";
+import { serializeSubScriptValues } from "../../src/js/sub-serialization.ts";
+
+type DriverModule = {
+  cwrap: (name: string, returnType: string, argTypes: string[]) => (...args: unknown[]) => number;
+  HEAPU8: Uint8Array;
+  _malloc: (size: number) => number;
+  _free: (pointer: number) => void;
+  bridge: unknown;
+};
+type DriverFactory = (options: Record<string, unknown>) => Promise<DriverModule>;
+
+const { options } = await new Command()
+  .name("subscript-bench")
+  .option("--runs <count:integer>", "Number of instantiations and launches per mode", { default: 10 })
+  .parse(Deno.args);
+
+const build = new URL("../../build/", import.meta.url);
+const { default: createDriver } = (await import("../../build/driver_node.mjs")) as { default: DriverFactory };
+const { default: createSub } = (await import("../../build/driver_sub_node.mjs")) as { default: DriverFactory };
+const script = "local url, header = ... local curl = require('lcurl.safe') return url, header, curl ~= nil";
+const data = serializeSubScriptValues(["https://www.pathofexile.com/", "Accept: application/json"]);
+
+function instantiate(factory: DriverFactory): Promise<DriverModule> {
+  return factory({ print: () => {}, printErr: () => {} });
+}
+
+function launch(module: DriverModule) {
+  let finished = false;
+  module.bridge = {
+    onSubScriptFinished: () => (finished = true),
+    onSubScriptError: (message: string) => {
+      throw new Error(message);
+    },
+  };
+  const pointer = module._malloc(data.length);
+  module.HEAPU8.set(data, pointer);
+  try {
+    const ret = module.cwrap("sub_start", "number", ["string", "string", "string", "number", "number"])(
+      script,
+      "",
+      "",
+      data.length,
+      pointer,
+    );
+    if (ret !== 0 || !finished) throw new Error(`sub_start failed (status=${ret})`);
+  } finally {
+    module._free(pointer);
+  }
+}
+
+async function measure(fn: () => unknown | Promise<unknown>) {
+  const samples: number[] = [];
+  for (let run = 0; run < options.runs; run += 1) {
+    const startedAt = performance.now();
+    await fn();
+    samples.push(performance.now() - startedAt);
+  }
+  return median(samples);
+}
+
+const warmModule = await instantiate(createSub);
+launch(warmModule);
+const results: [string, number][] = [
+  ["instantiate driver", await measure(() => instantiate(createDriver))],
+  ["instantiate driver_sub", await measure(() => instantiate(createSub))],
+  ["launch cold", await measure(async () => launch(await instantiate(createSub)))],
+  ["launch warm", await measure(() => launch(warmModule))],
+];
+
+for (const name of ["driver_node", "driver_sub_node"]) {
+  const { size } = await Deno.stat(new URL(`${name}.wasm`, build));
+  console.log(`${`${name}.wasm`.padEnd(24)} ${(size / 1024).toFixed(0).padStart(10)} KiB`);
+}
+for (const [name, duration] of results) {
+  console.log(`${name.padEnd(24)} ${duration.toFixed(2).padStart(10)} ms`);
+}
+
+function median(values: number[]) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const middle = Math.floor(sorted.length / 2);
+  return sorted.length % 2 === 0 ? (sorted[middle - 1] + sorted[middle]) / 2 : sorted[middle];
+}
@@ -0,0 +1,17 @@
+// Differential test and throughput benchmark for the native XML binding. Extracts PoB's xml.lua from a
+// local root.zip and runs build/driver_xml_bench.mjs with it against the build code fixtures.
+//
+//   deno task test:performance:xml [--root-zip <path>] [build code file...]
+import { Command } from "@cliffy/command";
+import { defaultRootZip, runBench, withRootLua } from "./root-lua.ts";
+
+const { options, args } = await new Command()
+  .name("xml-bench")
+  .option("--root-zip <path:string>", "root.zip that contains lua/xml.lua", { default: defaultRootZip })
+  .arguments("[codes...:string]")
+  .parse(Deno.args);
+
+const codes = args.length > 0
+  ? args
+  : [new URL("../../../web/test/e2e/fixtures/pobb-poe2-v0.5.txt", import.meta.url).pathname];
+await withRootLua(options.rootZip, "lua/xml.lua", (xmlLua) => runBench("driver_xml_bench", [xmlLua, ...codes]));
@@ -1,6 +1,6 @@
 import { assertEquals } from "@std/assert";
 import { configure, fs, InMemory } from "@zenfs/core";
-import { FilesystemRpcHandler } from "../../src/js/filesystem-handler.ts";
+import { fileNamePattern, FilesystemRpcHandler } from "../../src/js/filesystem-handler.ts";
 
 Deno.test("cloud mount stats are always writable for WasmFS", async () => {
   await configure({ mounts: { "/": InMemory } });
@@ -16,3 +16,38 @@ Deno.test("cloud mount stats are always writable for WasmFS", async () => {
   assertEquals((directory.value as { mode: number }).mode & 0o777, 0o777);
   assertEquals((file.value as { mode: number }).mode & 0o777, 0o777);
 });
+
+Deno.test("readdir_plus lists the matching entries with their size and modification time", async () => {
+  await configure({ mounts: { "/": InMemory } });
+  const directory = "/user/Path of Building/Builds";
+  await fs.promises.mkdir(`${directory}/Folder`, { recursive: true });
+  await fs.promises.writeFile(`${directory}/alpha.xml`, "alpha");
+  await fs.promises.writeFile(`${directory}/beta.xml`, "beta!!");
+  await fs.promises.writeFile(`${directory}/notes.txt`, "notes");
+
+  const handler = new FilesystemRpcHandler();
+  handler.reset();
+  const files = (await handler.handle("readdir_plus", [directory, "*.xml", false])).value as [string, number, number][];
+  assertEquals(files.map(([name, size]) => [name, size]).sort(), [["alpha.xml", 5], ["beta.xml", 6]]);
+  assertEquals(files.every(([, , mtime]) => Number.isInteger(mtime) && mtime > 0), true);
+  const folders = (await handler.handle("readdir_plus", [directory, "*", true])).value as [string, number, number][];
+  assertEquals(folders.map(([name]) => name), ["Folder"]);
+});
+
+Deno.test("file search patterns follow fnmatch", () => {
+  const cases: [string, string, boolean][] = [
+    ["*.xml", "build.xml", true],
+    ["*.xml", "build.xml.bak", false],
+    ["?.lua", "a.lua", true],
+    ["[!ab]*", "beta", false],
+    ["[a-c]1", "b1", true],
+    ["[]a]x", "]x", true],
+    ["[a", "[a", true],
+    ["a\\*", "a*", true],
+    ["a.b", "axb", false],
+    ["(x)+", "(x)+", true],
+  ];
+  for (const [pattern, name, expected] of cases) {
+    assertEquals(fileNamePattern(pattern).test(name), expected, `${pattern} ${name}`);
+  }
+});
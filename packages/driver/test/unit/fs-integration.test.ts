@@ -1,4 +1,6 @@
 import { assert, assertEquals } from "@std/assert";
+import AdmZip from "adm-zip";
+import { Buffer } from "node:buffer";
 import { createRpcClient } from "../../src/js/rpc.ts";
 
 type TraceEntry = {
@@ -24,7 +26,7 @@ Deno.test("Lua filesystem operations round trip through production RPC and ZenFS
     await ready;
 
     const { default: createModule } = await import("../../build/driver_fs_integration_test.mjs");
-    await createModule({ rpcCall: createRpcClient(channel.port2) });
+    await createModule({ rpcCall: createRpcClient(channel.port2), rootArchive: rootArchive() });
 
     const snapshotPromise = waitForMessage<{ type: "snapshot"; snapshot: Snapshot }>(worker, "snapshot");
     worker.postMessage({ type: "snapshot" });
@@ -36,7 +38,7 @@ Deno.test("Lua filesystem operations round trip through production RPC and ZenFS
     });
 
     const operations = snapshot.trace.map((entry) => entry.operation);
-    for (const operation of ["mkdir", "open", "write", "readdir", "lstat", "stat", "fstat", "read", "close"]) {
+    for (const operation of ["mkdir", "open", "write", "readdir_plus", "lstat", "stat", "fstat", "read", "close"]) {
       assert(operations.includes(operation), `Missing production RPC operation: ${operation}`);
     }
     assert(
@@ -47,11 +49,24 @@ Deno.test("Lua filesystem operations round trip through production RPC and ZenFS
       ),
       "mkdir must preserve the production path and mode arguments",
     );
-    assert(
-      snapshot.trace.some((entry) =>
-        entry.operation === "readdir" && entry.args[0] === "/user/Path of Building/Builds/Saved Builds"
-      ),
-      "readdir must preserve the production directory path",
+    const searches = snapshot.trace.filter((entry) => entry.operation === "readdir_plus");
+    assertEquals(
+      searches.map((entry) => entry.args),
+      [
+        ["/user/Path of Building/Builds", "*", true],
+        ["/user/Path of Building/Builds", "Saved Builds", false],
+        ["/user/Path of Building/Builds/Saved Builds", "*.xml", false],
+        ["/user/Path of Building/Builds/Saved Builds", "*.xml", true],
+        ["/user/Path of Building/Builds/Saved Builds", "missing-*.xml", false],
+        ["/user/Persisted", "*.xml", false],
+      ],
+      "NewFileSearch must list each directory with one RPC and pass its pattern to the broker",
+    );
+    const builds = searches[2].value as [string, number, number][];
+    assertEquals(
+      builds.map(([name, size]) => [name, size]).sort(),
+      [["alpha.xml", 30], ["beta.xml", 29]],
+      "Search entries must carry the file sizes",
     );
     assert(
       snapshot.trace.some((entry) =>
@@ -67,13 +82,41 @@ Deno.test("Lua filesystem operations round trip through production RPC and ZenFS
       ),
       "read must preserve the fd, length, position, and binary response",
     );
-    assert(
-      snapshot.trace.some((entry) =>
-        entry.operation === "readdir" &&
-        Array.isArray(entry.value) &&
-        entry.value.some((item) => Array.isArray(item) && item[0] === "Saved Builds" && item[1] === 2)
+    const writes = (path: string) =>
+      descriptorTraces(snapshot.trace, path).flat().filter((entry) => entry.operation === "write");
+    assertEquals(
+      [
+        "/user/Path of Building/Builds/Saved Builds/alpha.xml",
+        "/user/Path of Building/Builds/Saved Builds/beta.xml",
+        "/user/Persisted/chunked.txt",
+      ].map((path) => writes(path).map((entry) => entry.requestBytes)),
+      [[30], [29], [700]],
+      "Unbuffered Lua writes must reach the broker as one write per file",
+    );
+    const small = descriptorTraces(snapshot.trace, "/user/Persisted/small.bin").map(readsAndWrites);
+    assertEquals(
+      small.map((entries) => entries.map((entry) => entry.operation)),
+      [["write"], ["read"], ["read", "write", "read"]],
+      "Reads after a write must flush it and fetch the file again",
+    );
+    assertEquals(small[1][0].responseBytes, 100000, "A small file must be fetched whole in one read");
+    const large = readsAndWrites(descriptorTraces(snapshot.trace, "/user/Persisted/large.bin")[1]);
+    assertEquals(
+      large.map((entry) => entry.responseBytes),
+      [128 * 1024, 1024 * 1024, 2 * 1024 * 1024 - 1152 * 1024],
+      "Sequential reads of a large file must grow their read-ahead and fetch each byte once",
+    );
+    assertEquals(
+      descriptorTraces(snapshot.trace, "/user/Persisted/shared.txt").map((entries) =>
+        readsAndWrites(entries).map((entry) => entry.responseBytes)
       ),
-      "Directory entries must preserve the production directory type",
+      [['<PathOfBuilding name="shared"/>'.length], ['<PathOfBuilding name="changed in another tab"/>'.length]],
+      "A file changed by another tab must be fetched again when it is reopened",
+    );
+    assertEquals(
+      (searches[0].value as [string, number, number][]).map(([name]) => name),
+      ["Saved Builds"],
+      "Directory searches must only return directories",
     );
     assert(
       snapshot.trace.some((entry) =>
@@ -83,12 +126,59 @@ Deno.test("Lua filesystem operations round trip through production RPC and ZenFS
       ),
       "Stat responses must preserve the production mode",
     );
+    assertEquals(
+      snapshot.trace.filter((entry) => entry.args[0] === "/user/Persisted/missing.lua").length,
+      1,
+      "Repeated lookups of a missing file must be answered by the attribute cache",
+    );
+    assertEquals(
+      snapshot.trace.filter((entry) => typeof entry.args[0] === "string" && entry.args[0].startsWith("/root")),
+      [],
+      "The game root must be served from the in-memory archive",
+    );
   } finally {
     channel.port2.close();
     worker.terminate();
   }
 });
 
+// The RPCs made through each descriptor opened on `path`, one list per open
+function descriptorTraces(trace: TraceEntry[], path: string): TraceEntry[][] {
+  const open = new Map<number, TraceEntry[]>();
+  const descriptors: TraceEntry[][] = [];
+  for (const entry of trace) {
+    const target = entry.args[0];
+    if (entry.operation === "open") {
+      if (target === path) {
+        const entries: TraceEntry[] = [];
+        descriptors.push(entries);
+        open.set(entry.value as number, entries);
+      }
+      continue;
+    }
+    const entries = typeof target === "number" ? open.get(target) : undefined;
+    if (!entries) continue;
+    entries.push(entry);
+    if (entry.operation === "close") open.delete(target as number);
+  }
+  return descriptors;
+}
+
+function readsAndWrites(entries: TraceEntry[]): TraceEntry[] {
+  return entries.filter((entry) => entry.operation === "read" || entry.operation === "write");
+}
+
+// A root.zip with deflated and stored entries, and directories that only exist as parents of files
+function rootArchive(): ArrayBuffer {
+  const zip = new AdmZip();
+  zip.addFile("manifest.xml", Buffer.from("<PoBVersion/>"));
+  zip.addFile("lua/module.lua", Buffer.from(`local s = [[${"module\n".repeat(500)}]] return #s`));
+  zip.addFile("Data/stored.bin", Buffer.from("s".repeat(4096)));
+  zip.getEntry("Data/stored.bin")!.header.method = 0;
+  const data = zip.toBuffer();
+  return data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength) as ArrayBuffer;
+}
+
 function waitForMessage<T extends { type: string }>(worker: Worker, type: T["type"]): Promise<T> {
   return new Promise((resolve, reject) => {
     const onMessage = (event: MessageEvent<T>) => {
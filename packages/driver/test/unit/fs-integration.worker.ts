@@ -13,12 +13,18 @@ type TraceEntry = {
 const trace: TraceEntry[] = [];
 const handler = new FilesystemRpcHandler();
 
+// Stands in for another tab sharing the storage: shared.txt is rewritten once the driver has read it
+const sharedPath = "/user/Persisted/shared.txt";
+let sharedFd: number | undefined;
+let sharedChanged = false;
+
 self.onmessage = async ({ data }: MessageEvent<{ type: "start"; port: MessagePort } | { type: "snapshot" }>) => {
   if (data.type === "start") {
     await configure({ mounts: { "/": InMemory } });
     fs.mkdirSync("/user", { recursive: true });
     fs.mkdirSync("/user/Persisted");
     fs.writeFileSync("/user/Persisted/existing.xml", '<PathOfBuilding name="existing"/>');
+    fs.writeFileSync(sharedPath, '<PathOfBuilding name="shared"/>');
     handler.reset();
     exposeRpcPort(data.port, recordFilesystemOperation);
     self.postMessage({ type: "ready" });
@@ -49,6 +55,12 @@ async function recordFilesystemOperation(
   data?: Uint8Array,
 ): Promise<RpcResult> {
   const result = await handler.handle(operation, args, data);
+  if (operation === "open" && args[0] === sharedPath) {
+    sharedFd = result.value as number;
+  } else if (operation === "close" && args[0] === sharedFd && !sharedChanged) {
+    sharedChanged = true;
+    fs.writeFileSync(sharedPath, '<PathOfBuilding name="changed in another tab"/>');
+  }
   trace.push({
     operation,
     args,
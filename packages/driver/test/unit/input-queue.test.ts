@@ -0,0 +1,72 @@
+import { assert, assertEquals } from "@std/assert";
+import { INPUT_EVENT, InputQueue, readInputFrameStats } from "../../src/js/input-queue.ts";
+
+function createQueue(capacity: number) {
+  const pointer = 8;
+  const heap = new Uint8Array(pointer + 16 + capacity * 64);
+  const view = new DataView(heap.buffer);
+  view.setUint32(pointer + 8, capacity, true);
+  view.setUint32(pointer + 12, 64, true);
+  const drained: number[] = [];
+  const queue = new InputQueue(() => heap, pointer, () => {
+    // Stand-in for flush_input: consume everything up to head.
+    const head = view.getUint32(pointer, true);
+    drained.push(head - view.getUint32(pointer + 4, true));
+    view.setUint32(pointer + 4, head, true);
+  });
+  const event = (index: number) => {
+    const offset = pointer + 16 + (index % capacity) * 64;
+    const name = heap.subarray(offset + 32, offset + 64);
+    return {
+      time: view.getFloat64(offset, true),
+      x: view.getFloat64(offset + 8, true),
+      type: view.getUint32(offset + 24, true),
+      doubleClick: view.getInt32(offset + 28, true),
+      name: new TextDecoder().decode(name.subarray(0, name.indexOf(0))),
+    };
+  };
+  return { queue, view, pointer, drained, event };
+}
+
+Deno.test("input queue writes events in the layout read by input.c", () => {
+  const { queue, view, pointer, event } = createQueue(4);
+
+  assert(queue.push(INPUT_EVENT.mouseMove, "", 0, 12.5, 40, 100));
+  assert(queue.push(INPUT_EVENT.keyDown, "LEFTBUTTON", 1, 0, 0, 101));
+  assert(queue.push(INPUT_EVENT.char, "é", 0, 0, 0, 102));
+
+  assertEquals(view.getUint32(pointer, true), 3);
+  assertEquals(event(0), { time: 100, x: 12.5, type: INPUT_EVENT.mouseMove, doubleClick: 0, name: "" });
+  assertEquals(event(1), { time: 101, x: 0, type: INPUT_EVENT.keyDown, doubleClick: 1, name: "LEFTBUTTON" });
+  assertEquals(event(2).name, "é");
+});
+
+Deno.test("input queue drains when the ring is full", () => {
+  const { queue, view, pointer, drained, event } = createQueue(2);
+
+  queue.push(INPUT_EVENT.keyDown, "a", 0, 0, 0);
+  queue.push(INPUT_EVENT.keyUp, "a", 0, 0, 0);
+  assertEquals(drained, []);
+  queue.push(INPUT_EVENT.keyDown, "b", 0, 0, 0);
+
+  assertEquals(drained, [2]);
+  assertEquals(view.getUint32(pointer, true), 3);
+  assertEquals(event(2).name, "b");
+});
+
+Deno.test("input queue rejects names that do not fit in an event", () => {
+  const { queue, view, pointer } = createQueue(4);
+
+  assertEquals(queue.push(INPUT_EVENT.char, "x".repeat(32), 0, 0, 0), false);
+  assertEquals(view.getUint32(pointer, true), 0);
+});
+
+Deno.test("input frame stats are read from the exported struct", () => {
+  const heap = new Uint8Array(32);
+  const view = new DataView(heap.buffer);
+  view.setUint32(8, 5, true);
+  view.setUint32(12, 2, true);
+  view.setFloat64(16, 7.25, true);
+
+  assertEquals(readInputFrameStats(heap, 8), { events: 5, dispatched: 2, latency: 7.25 });
+});
@@ -1,15 +1,6 @@
 import { assertEquals } from "@std/assert";
-import {
-  deserializeSubScriptValues,
-  poeOAuthAuthorizationRequest,
-  serializePoeOAuthAuthorization,
-  serializeSubScriptValues,
-} from "../../src/js/poe-oauth.ts";
-
-Deno.test("subscript values round trip through the browser serializer", () => {
-  const values = [123.5, true, false, "result", "", undefined] as const;
-  assertEquals(deserializeSubScriptValues(serializeSubScriptValues(values)), [...values]);
-});
+import { poeOAuthAuthorizationRequest, serializePoeOAuthAuthorization } from "../../src/js/poe-oauth.ts";
+import { deserializeSubScriptValues, serializeSubScriptValues } from "../../src/js/sub-serialization.ts";
 
 Deno.test("PoE OAuth denial is returned as an ordinary subscript result", () => {
   assertEquals(
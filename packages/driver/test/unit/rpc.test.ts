@@ -1,6 +1,12 @@
-import { assertEquals, assertThrows } from "@std/assert";
+import { assertEquals, assertNotStrictEquals, assertStrictEquals, assertThrows } from "@std/assert";
 import { environmentErrorCategory, markEnvironmentError } from "../../src/js/error.ts";
-import { prepareFetchHeaders, restoreRpcError, rpcErrorMetadata } from "../../src/js/rpc.ts";
+import {
+  createRpcClient,
+  prepareFetchHeaders,
+  restoreRpcError,
+  rpcErrorMetadata,
+  type RpcRequest,
+} from "../../src/js/rpc.ts";
 
 Deno.test("fetch headers reject POESESSID without forwarding it", () => {
   assertThrows(() => prepareFetchHeaders({ cookie: "poesessid=secret" }), Error, "POESESSID");
@@ -29,3 +35,95 @@ Deno.test("environment error categories survive RPC error serialization", () =>
   assertEquals(restored.message, original.message);
   assertEquals(environmentErrorCategory(restored), "storage");
 });
+
+type Posted = { shared: SharedArrayBuffer; transfer: Transferable[] };
+type RpcCall = ReturnType<typeof createRpcClient>;
+
+// Runs `body` with a client whose requests are answered by rpc.worker.ts, recording what each call posts
+async function withRpcWorker(timeoutMs: number | undefined, body: (call: RpcCall, posted: Posted[]) => void) {
+  const worker = new Worker(new URL("./rpc.worker.ts", import.meta.url).href, { type: "module" });
+  const channel = new MessageChannel();
+  try {
+    const ready = new Promise((resolve) => worker.addEventListener("message", resolve, { once: true }));
+    worker.postMessage({ type: "start", port: channel.port1 }, [channel.port1]);
+    await ready;
+
+    const posted: Posted[] = [];
+    const port = {
+      postMessage(request: RpcRequest, transfer: Transferable[]) {
+        posted.push({ shared: request.shared, transfer });
+        channel.port2.postMessage(request, transfer);
+      },
+    } as unknown as MessagePort;
+    body(createRpcClient(port, timeoutMs), posted);
+  } finally {
+    channel.port2.close();
+    worker.terminate();
+  }
+}
+
+Deno.test("RPC calls reuse one response buffer and each reads its own reply", async () => {
+  await withRpcWorker(undefined, (call, posted) => {
+    const first = call("echo", ["first"], new Uint8Array([1, 2, 3, 4]));
+    const second = call("echo", ["second"], new Uint8Array([5]));
+
+    assertStrictEquals(posted[1].shared, posted[0].shared);
+    assertEquals(first.value, ["first"]);
+    assertEquals(first.data, new Uint8Array([1, 2, 3, 4]));
+    assertEquals(second.value, ["second"]);
+    assertEquals(second.data, new Uint8Array([5]));
+  });
+});
+
+Deno.test("RPC calls above the reused capacity get a buffer of their own", async () => {
+  await withRpcWorker(undefined, (call, posted) => {
+    call("echo", ["small"]);
+    const large = new Uint8Array(3 * 1024 * 1024).fill(7);
+    const result = call("echo", ["large"], large, 4 * 1024 * 1024);
+    call("echo", ["small again"]);
+
+    assertNotStrictEquals(posted[1].shared, posted[0].shared);
+    assertEquals(result.data?.length, 3 * 1024 * 1024);
+    assertEquals(result.data?.[3 * 1024 * 1024 - 1], 7);
+    assertStrictEquals(posted[2].shared, posted[0].shared);
+  });
+});
+
+Deno.test("RPC timeouts drop the reused buffer so a late reply cannot answer the next call", async () => {
+  await withRpcWorker(1000, (call, posted) => {
+    // Answered 500 ms after the client gave up, while the next call is still waiting
+    assertThrows(() => call("sleep", ["late", 1500]), Error, "RPC sleep timed out");
+    const next = call("sleep", ["next", 800]);
+    call("echo", ["after"]);
+
+    assertEquals(next.value, ["next", 800]);
+    assertNotStrictEquals(posted[1].shared, posted[0].shared);
+    assertStrictEquals(posted[2].shared, posted[1].shared);
+  });
+});
+
+Deno.test("RPC request data is transferred only when the view spans its whole ArrayBuffer", async () => {
+  await withRpcWorker(undefined, (call, posted) => {
+    const whole = new Uint8Array([1, 2, 3]);
+    const wholeBuffer = whole.buffer;
+    assertEquals(call("echo", [], whole).data, new Uint8Array([1, 2, 3]));
+    assertEquals(posted[0].transfer, [wholeBuffer]);
+    assertEquals(whole.byteLength, 0);
+
+    const backing = new Uint8Array([0, 1, 2, 3, 4]);
+    const part = backing.subarray(1, 4);
+    assertEquals(call("echo", [], part).data, new Uint8Array([1, 2, 3]));
+    assertEquals(posted[1].transfer, []);
+    assertEquals(backing, new Uint8Array([0, 1, 2, 3, 4]));
+
+    const shared = new Uint8Array(new SharedArrayBuffer(3));
+    shared.set([1, 2, 3]);
+    assertEquals(call("echo", [], shared).data, new Uint8Array([1, 2, 3]));
+    assertEquals(posted[2].transfer, []);
+    assertEquals([...shared], [1, 2, 3]);
+
+    const sharedPart = shared.subarray(1);
+    assertEquals(call("echo", [], sharedPart).data, new Uint8Array([2, 3]));
+    assertEquals(posted[3].transfer, []);
+  });
+});
@@ -0,0 +1,10 @@
+import { exposeRpcPort } from "../../src/js/rpc.ts";
+
+// Answers with the arguments and data it was sent. "sleep" answers only after args[1] ms.
+self.onmessage = ({ data }: MessageEvent<{ type: "start"; port: MessagePort }>) => {
+  exposeRpcPort(data.port, async (operation, args, payload) => {
+    if (operation === "sleep") await new Promise((resolve) => setTimeout(resolve, args[1] as number));
+    return { value: args, data: payload };
+  });
+  self.postMessage({ type: "ready" });
+};
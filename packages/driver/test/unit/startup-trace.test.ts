@@ -0,0 +1,46 @@
+import { assertEquals } from "@std/assert";
+import { readStartupTrace, summarizeStartupTrace } from "../../src/js/startup-trace.ts";
+
+function writeEvent(
+  heap: Uint8Array,
+  offset: number,
+  phase: number,
+  name: string,
+  bytes: number,
+  start: number,
+  end: number,
+) {
+  const view = new DataView(heap.buffer);
+  view.setFloat64(offset, start, true);
+  view.setFloat64(offset + 8, end, true);
+  view.setUint32(offset + 16, phase, true);
+  view.setUint32(offset + 20, bytes, true);
+  heap.set(new TextEncoder().encode(name), offset + 24);
+}
+
+Deno.test("startup trace reads the ring buffer oldest first after wrapping", () => {
+  const pointer = 16;
+  const heap = new Uint8Array(pointer + 2 * 64);
+  // Three spans were recorded into two slots, so the first one was overwritten by the third.
+  writeEvent(heap, pointer, 5, "Launch.lua", 0, 30, 45);
+  writeEvent(heap, pointer + 64, 3, "Modules/Main.lua", 1024, 10, 12);
+
+  const spans = readStartupTrace(heap, pointer, 3, 2);
+
+  assertEquals(spans, [
+    { phase: "module-read", name: "Modules/Main.lua", bytes: 1024, start: 10, duration: 2 },
+    { phase: "module-execute", name: "Launch.lua", bytes: 0, start: 30, duration: 15 },
+  ]);
+});
+
+Deno.test("startup trace summary totals spans per phase", () => {
+  const summary = summarizeStartupTrace([
+    { phase: "module-read", name: "a.lua", bytes: 10, start: 0, duration: 1 },
+    { phase: "module-read", name: "b.lua", bytes: 20, start: 1, duration: 2 },
+    { phase: "on-init", name: "OnInit", bytes: 0, start: 3, duration: 50 },
+  ]);
+
+  assertEquals(summary["module-read"], { count: 2, duration: 3, bytes: 30 });
+  assertEquals(summary["on-init"], { count: 1, duration: 50, bytes: 0 });
+  assertEquals(summary["first-frame"], { count: 0, duration: 0, bytes: 0 });
+});
@@ -0,0 +1,103 @@
+import { assertEquals } from "@std/assert";
+import { SubScriptCache, type SubScriptCacheStore } from "../../src/js/sub-cache.ts";
+
+function memoryStore() {
+  const files = new Map<string, Uint8Array>();
+  const store: SubScriptCacheStore = {
+    read: (path) => Promise.resolve(files.get(path)?.slice()),
+    write: (path, data) => {
+      files.set(path, data.slice());
+      return Promise.resolve();
+    },
+    remove: (path) => {
+      for (const file of [...files.keys()]) {
+        if (file === path || file.startsWith(`${path}/`)) files.delete(file);
+      }
+      return Promise.resolve();
+    },
+  };
+  return { files, store };
+}
+
+Deno.test("subscript results are cached by script and arguments", async () => {
+  const cache = new SubScriptCache();
+  cache.configure("return ...", { ttl: 0, persist: false });
+  assertEquals(cache.handles("return ..."), true);
+  assertEquals(cache.handles("return 1"), false);
+
+  const first = await cache.key("return ...", new Uint8Array([1]));
+  const second = await cache.key("return ...", new Uint8Array([2]));
+  assertEquals(await cache.get("return ...", first), undefined);
+  await cache.set("return ...", first, new Uint8Array([10]));
+  await cache.set("return ...", second, new Uint8Array([20, 21]));
+
+  assertEquals(await cache.get("return ...", first), new Uint8Array([10]));
+  const again = await cache.key("return ...", new Uint8Array([2]));
+  assertEquals(await cache.get("return ...", again), new Uint8Array([20, 21]));
+  assertEquals(cache.stats(), { hits: 2, misses: 1, entries: 2, bytes: 3 });
+
+  await cache.invalidate("return ...");
+  assertEquals(await cache.get("return ...", first), undefined);
+  assertEquals(cache.stats().entries, 0);
+});
+
+Deno.test("cached subscript results expire after their TTL", async () => {
+  let now = 1_000;
+  const { files, store } = memoryStore();
+  const cache = new SubScriptCache(store, () => now);
+  cache.configure("fetch", { ttl: 60, persist: true });
+  const key = await cache.key("fetch", new Uint8Array([1]));
+  await cache.set("fetch", key, new Uint8Array([7]));
+
+  now += 59_000;
+  assertEquals(await cache.get("fetch", key), new Uint8Array([7]));
+  now += 1_000;
+  assertEquals(await cache.get("fetch", key), undefined);
+  assertEquals(files.size, 0);
+});
+
+Deno.test("persisted subscript results are read back from disk", async () => {
+  const { files, store } = memoryStore();
+  const writer = new SubScriptCache(store);
+  writer.configure("calc", { ttl: 0, persist: true });
+  writer.configure("other", { ttl: 0, persist: true });
+  const key = await writer.key("calc", new Uint8Array([1, 2, 3]));
+  await writer.set("calc", key, new Uint8Array([4, 5]));
+  await writer.set("other", await writer.key("other", new Uint8Array()), new Uint8Array([6]));
+  assertEquals(files.size, 2);
+
+  const reader = new SubScriptCache(store);
+  reader.configure("calc", { ttl: 0, persist: true });
+  assertEquals(await reader.get("calc", key), new Uint8Array([4, 5]));
+  assertEquals(reader.stats().hits, 1);
+
+  await reader.invalidate();
+  assertEquals(files.size, 1);
+  assertEquals(await reader.get("calc", key), undefined);
+});
+
+Deno.test("subscript results are kept apart per game version", async () => {
+  const { files, store } = memoryStore();
+  const poe1 = new SubScriptCache(store);
+  poe1.setVersion("/games/poe1/versions/2.50.0");
+  poe1.configure("calc", { ttl: 0, persist: true });
+  const key = await poe1.key("calc", new Uint8Array([1]));
+  await poe1.set("calc", key, new Uint8Array([1]));
+
+  const poe2 = new SubScriptCache(store);
+  poe2.setVersion("/games/poe2/versions/0.1.0");
+  poe2.configure("calc", { ttl: 0, persist: true });
+  const otherKey = await poe2.key("calc", new Uint8Array([1]));
+  assertEquals(otherKey === key, false);
+  assertEquals(otherKey.split("/")[0] === key.split("/")[0], false);
+  assertEquals(await poe2.get("calc", otherKey), undefined);
+  await poe2.set("calc", otherKey, new Uint8Array([2]));
+  assertEquals(files.size, 2);
+
+  // Invalidation stays within the version, and switching versions drops the in-memory entries.
+  await poe2.invalidate();
+  assertEquals([...files.keys()], [key]);
+  poe1.setVersion("/games/poe1/versions/2.51.0");
+  assertEquals(poe1.stats().entries, 0);
+  assertEquals(await poe1.get("calc", await poe1.key("calc", new Uint8Array([1]))), undefined);
+});
@@ -0,0 +1,40 @@
+import { assertEquals } from "@std/assert";
+import { serializeSubScriptDownload, subScriptDownloadRequest } from "../../src/js/sub-download.ts";
+import { deserializeSubScriptValues, serializeSubScriptValues } from "../../src/js/sub-serialization.ts";
+
+const downloadPageScript = `
+  local url, requestHeader, requestBody, connectionProtocol, proxyURL = ...
+  local curl = require("lcurl.safe")
+  local easy = curl.easy()
+  local _, error = easy:perform()
+  return responseBody, errMsg, responseHeader
+`;
+
+Deno.test("download subscripts are recognized by their script or an explicit marker", () => {
+  const data = serializeSubScriptValues(["https://example.com/", "Accept: text/plain\nbroken\nX-A: 1", "a=1"]);
+  const request = {
+    url: "https://example.com/",
+    headers: { Accept: "text/plain", "X-A": "1" },
+    body: "a=1",
+  };
+  assertEquals(subScriptDownloadRequest(downloadPageScript, data), request);
+  assertEquals(subScriptDownloadRequest("-- subscript: download\nreturn ...", data), request);
+  assertEquals(subScriptDownloadRequest('local curl = require("lcurl.safe") return ...', data), undefined);
+  assertEquals(subScriptDownloadRequest(downloadPageScript, serializeSubScriptValues([1])), undefined);
+  assertEquals(
+    subScriptDownloadRequest(downloadPageScript, serializeSubScriptValues(["https://example.com/"])),
+    { url: "https://example.com/", headers: {}, body: undefined },
+  );
+});
+
+Deno.test("download results have the shape DownloadPage returns", () => {
+  const result = (response: Parameters<typeof serializeSubScriptDownload>[0]) =>
+    deserializeSubScriptValues(serializeSubScriptDownload(response));
+  assertEquals(
+    result({ body: "ok", status: 200, headers: { "content-type": "text/plain", etag: "1" } }),
+    ["ok", undefined, "content-type: text/plain\netag: 1"],
+  );
+  assertEquals(result({ body: "missing", status: 404, headers: {} }), ["missing", "Response code: 404", ""]);
+  assertEquals(result({ body: "", status: 200 }), ["", "No data returned", ""]);
+  assertEquals(result({ error: "Network error" }), ["", "Network error", ""]);
+});
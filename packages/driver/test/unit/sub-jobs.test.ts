@@ -0,0 +1,55 @@
+import { assertEquals, assertThrows } from "@std/assert";
+import { SubScriptJobs, splitSubScriptBatch } from "../../src/js/sub-jobs.ts";
+
+Deno.test("batch arguments are split into one value list per shard", () => {
+  const data = Uint8Array.of(1, 2, 3, 4, 5, 6);
+  assertEquals(
+    splitSubScriptBatch(data, [2, 0, 4]),
+    [Uint8Array.of(1, 2), new Uint8Array(), Uint8Array.of(3, 4, 5, 6)],
+  );
+  // Each shard is its own buffer, so it can be transferred to a sub worker on its own.
+  const [first, second] = splitSubScriptBatch(data, [3, 3]);
+  assertEquals(first.byteOffset, 0);
+  assertEquals(first.buffer === second.buffer, false);
+  assertThrows(() => splitSubScriptBatch(data, [2, 2]), Error, "do not match");
+  assertThrows(() => splitSubScriptBatch(data, [7, -1]), Error, "do not match");
+  assertThrows(() => splitSubScriptBatch(new Uint8Array(), []), Error, "do not match");
+});
+
+Deno.test("a batch keeps running until its last shard settles", () => {
+  const jobs = new SubScriptJobs<{ shard: number }>();
+  jobs.open(1);
+  jobs.add(1, 10, { shard: 1 });
+  jobs.add(1, 11, { shard: 2 });
+  jobs.add(1, 12, { shard: 3 });
+  assertEquals(jobs.running(1), true);
+
+  // Every shard is reported once, whether it finishes or fails.
+  assertEquals(jobs.settle(1, 11), { shard: 2 });
+  assertEquals(jobs.settle(1, 11), undefined);
+  assertEquals(jobs.settle(1, 10), { shard: 1 });
+  assertEquals(jobs.running(1), true);
+  assertEquals(jobs.has(1, 12), true);
+  assertEquals(jobs.settle(1, 12), { shard: 3 });
+  assertEquals(jobs.running(1), false);
+  assertEquals(jobs.size, 0);
+});
+
+Deno.test("aborting a batch cancels its pending shards and silences them", () => {
+  const jobs = new SubScriptJobs<string>();
+  jobs.open(1);
+  jobs.add(1, 10, "shard 1");
+  jobs.add(1, 11, "shard 2");
+  jobs.open(2);
+  jobs.add(2, 20, "single");
+  assertEquals(jobs.settle(1, 10), "shard 1");
+
+  assertEquals(jobs.abort(1), [[11, "shard 2"]]);
+  assertEquals(jobs.running(1), false);
+  // A shard that settles after the abort is not reported.
+  assertEquals(jobs.has(1, 11), false);
+  assertEquals(jobs.settle(1, 11), undefined);
+  assertEquals(jobs.abort(1), []);
+  assertEquals(jobs.running(2), true);
+  assertEquals(jobs.size, 1);
+});
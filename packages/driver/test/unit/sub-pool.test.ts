@@ -0,0 +1,146 @@
+import { assertEquals } from "@std/assert";
+import { SubScriptPool, subScriptPoolSize, SubScriptPriority, subScriptPriority } from "../../src/js/sub-pool.ts";
+
+class FakeWorker {
+  static created = 0;
+  readonly name = `worker-${++FakeWorker.created}`;
+  terminated = false;
+  terminate() {
+    this.terminated = true;
+  }
+}
+
+function deferred() {
+  let resolve!: () => void;
+  let reject!: (error: Error) => void;
+  const promise = new Promise<void>((res, rej) => {
+    resolve = res;
+    reject = rej;
+  });
+  return { promise, resolve, reject };
+}
+
+async function flush() {
+  for (let i = 0; i < 5; i += 1) await Promise.resolve();
+}
+
+Deno.test("subscript workers are reused between jobs and replaced after failures", async () => {
+  const workers: FakeWorker[] = [];
+  const pool = new SubScriptPool(() => {
+    const worker = new FakeWorker();
+    workers.push(worker);
+    return worker;
+  }, 2);
+  pool.warm(1);
+  assertEquals(workers.length, 1);
+
+  const used: FakeWorker[] = [];
+  pool.run(1, SubScriptPriority.Normal, (worker) => {
+    used.push(worker);
+    return Promise.resolve();
+  });
+  await flush();
+  pool.run(2, SubScriptPriority.Normal, (worker) => {
+    used.push(worker);
+    return Promise.reject(new Error("trap"));
+  });
+  await flush();
+  pool.run(3, SubScriptPriority.Normal, (worker) => {
+    used.push(worker);
+    return Promise.resolve();
+  });
+  await flush();
+
+  assertEquals(used.map((worker) => worker.name), [workers[0].name, workers[0].name, workers[1].name]);
+  assertEquals(workers.map((worker) => worker.terminated), [true, false]);
+  assertEquals(pool.pending, 0);
+});
+
+Deno.test("subscript jobs wait for a free worker in priority order", async () => {
+  const pool = new SubScriptPool(() => new FakeWorker(), 1);
+  const order: number[] = [];
+  const first = deferred();
+  pool.run(1, SubScriptPriority.Normal, () => {
+    order.push(1);
+    return first.promise;
+  });
+  const queued = [[2, SubScriptPriority.Low], [3, SubScriptPriority.Normal], [4, SubScriptPriority.High]];
+  for (const [id, priority] of queued) {
+    pool.run(id, priority, () => {
+      order.push(id);
+      return Promise.resolve();
+    });
+  }
+  assertEquals(pool.pending, 4);
+  assertEquals(pool.has(2), true);
+
+  first.resolve();
+  await flush();
+  assertEquals(order, [1, 4, 3, 2]);
+  assertEquals(pool.has(2), false);
+});
+
+Deno.test("cancelling a subscript dequeues it or terminates its worker", async () => {
+  const workers: FakeWorker[] = [];
+  const pool = new SubScriptPool(() => {
+    const worker = new FakeWorker();
+    workers.push(worker);
+    return worker;
+  }, 1);
+  const running = deferred();
+  const started: number[] = [];
+  pool.run(1, SubScriptPriority.Normal, () => {
+    started.push(1);
+    return running.promise;
+  });
+  pool.run(2, SubScriptPriority.Normal, () => {
+    started.push(2);
+    return new Promise(() => {});
+  });
+  pool.run(3, SubScriptPriority.Normal, () => {
+    started.push(3);
+    return Promise.resolve();
+  });
+
+  pool.cancel(2);
+  pool.cancel(1);
+  await flush();
+  assertEquals(started, [1, 3]);
+  assertEquals(workers[0].terminated, true);
+
+  // The cancelled job settling later must not return its terminated worker to the pool.
+  running.resolve();
+  await flush();
+  pool.run(4, SubScriptPriority.Normal, () => Promise.resolve());
+  await flush();
+  assertEquals(workers.length, 2);
+  assertEquals(workers[1].terminated, false);
+});
+
+Deno.test("a cancelled subscript that stops within the grace period keeps its worker", async () => {
+  const workers: FakeWorker[] = [];
+  const pool = new SubScriptPool(() => {
+    const worker = new FakeWorker();
+    workers.push(worker);
+    return worker;
+  }, 2);
+  const stopping = deferred();
+  pool.run(1, SubScriptPriority.Normal, () => stopping.promise);
+  pool.run(2, SubScriptPriority.Normal, () => new Promise(() => {}));
+
+  pool.cancel(1, 10);
+  pool.cancel(2, 10);
+  stopping.resolve();
+  await flush();
+  assertEquals(workers.map((worker) => worker.terminated), [false, false]);
+  await new Promise((resolve) => setTimeout(resolve, 20));
+  assertEquals(workers.map((worker) => worker.terminated), [false, true]);
+  assertEquals(pool.pending, 0);
+});
+
+Deno.test("subscript pool size and priority follow the machine and the script", () => {
+  assertEquals([1, 2, 4, 8, 32].map((concurrency) => subScriptPoolSize(concurrency)), [2, 2, 3, 7, 8]);
+  assertEquals(subScriptPriority('UpdateProgress("Checking for update...")'), SubScriptPriority.Low);
+  assertEquals(subScriptPriority("-- OAuth authorization code"), SubScriptPriority.High);
+  assertEquals(subScriptPriority("return curl.easy()"), SubScriptPriority.Normal);
+});
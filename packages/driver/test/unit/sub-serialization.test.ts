@@ -0,0 +1,30 @@
+import { assertEquals, assertThrows } from "@std/assert";
+import { deserializeSubScriptValues, serializeSubScriptValues } from "../../src/js/sub-serialization.ts";
+
+Deno.test("subscript values round trip through the browser serializer", () => {
+  const values = [123.5, 42, -7, 2 ** 40, true, false, "result", "", "nul\0byte", undefined] as const;
+  assertEquals(deserializeSubScriptValues(serializeSubScriptValues(values)), [...values]);
+});
+
+Deno.test("subscript tables keep their sequence and their other keys", () => {
+  const nested = { name: "Frost Witch", items: ["Ring", "Amulet"], level: 92 };
+  const [sequence, object, map] = deserializeSubScriptValues(
+    serializeSubScriptValues([[1, "two", [3]], nested, new Map([[1.5, true]])]),
+  );
+  assertEquals(sequence, [1, "two", [3]]);
+  assertEquals(object, new Map(Object.entries(nested)));
+  assertEquals(map, new Map([[1.5, true]]));
+});
+
+Deno.test("subscript data is checked for its version, truncation and cycles", () => {
+  const data = serializeSubScriptValues(["result"]);
+  assertThrows(() => deserializeSubScriptValues(data.subarray(0, data.length - 1)), Error, "Truncated");
+  assertThrows(() => deserializeSubScriptValues(Uint8Array.of(...data.subarray(0, 3), 1, ...data.subarray(4))));
+  assertThrows(() => deserializeSubScriptValues(Uint8Array.of(...data, 0)), Error, "trailing");
+
+  const cycle: { self?: unknown } = {};
+  cycle.self = cycle;
+  assertThrows(() => serializeSubScriptValues([cycle as never]), Error, "contains itself");
+  const shared = ["shared"];
+  assertEquals(deserializeSubScriptValues(serializeSubScriptValues([[shared, shared]])), [[shared, shared]]);
+});
@@ -0,0 +1,46 @@
+import { assertEquals } from "@std/assert";
+import { SubScriptSharedData } from "../../src/js/sub-shared-data.ts";
+
+function fakeWorker() {
+  const held = new Map<string, number>();
+  const sent: [string, number[] | null][] = [];
+  const send = (name: string, data: Uint8Array | null) => {
+    sent.push([name, data && [...data]]);
+    return Promise.resolve();
+  };
+  return { held, sent, send };
+}
+
+Deno.test("shared data images are copied into a worker once per version", async () => {
+  const images = new SubScriptSharedData();
+  const worker = fakeWorker();
+  images.set("Data", Uint8Array.of(1));
+  images.set("Tree", Uint8Array.of(2));
+
+  await images.sync(worker.held, worker.send);
+  await images.sync(worker.held, worker.send);
+  assertEquals(worker.sent, [["Data", [1]], ["Tree", [2]]]);
+
+  // A new version replaces the old one; the unchanged image is not sent again.
+  images.set("Data", Uint8Array.of(3));
+  await images.sync(worker.held, worker.send);
+  assertEquals(worker.sent.slice(2), [["Data", [3]]]);
+});
+
+Deno.test("withdrawn shared data images are removed from workers", async () => {
+  const images = new SubScriptSharedData();
+  const first = fakeWorker();
+  images.set("Data", Uint8Array.of(1));
+  images.set("Tree", Uint8Array.of(2));
+  await images.sync(first.held, first.send);
+
+  images.set("Data", undefined);
+  await images.sync(first.held, first.send);
+  assertEquals(first.sent.slice(2), [["Data", null]]);
+  assertEquals([...first.held.keys()], ["Tree"]);
+
+  // A worker created later only receives what is still published.
+  const second = fakeWorker();
+  await images.sync(second.held, second.send);
+  assertEquals(second.sent, [["Tree", [2]]]);
+});
@@ -0,0 +1,59 @@
+import { fromFileUrl } from "@std/path";
+
+/** Build output of the driver's node-targeted bytecode compiler (`driver_luac`). */
+export const luacModuleUrl = new URL("../../driver/build/driver_luac.mjs", import.meta.url);
+export const luacWasmPath = fromFileUrl(new URL("../../driver/build/driver_luac.wasm", import.meta.url));
+
+export type LuaBundleSource = { name: string; source: Uint8Array };
+
+export type LuaBundleOptions = {
+  /** Deflate each chunk so the mounted bundle stays small in driver memory. */
+  compress: boolean;
+  /** Drop line info and local names. Runtime errors then lose their file and line. */
+  strip: boolean;
+};
+
+export type LuaBundleResult = {
+  bundle: Uint8Array;
+  count: number;
+  /** Sources the compiler rejected; the driver keeps loading these from root.zip. */
+  skipped: { name: string; error: string }[];
+};
+
+type LuacModule = {
+  HEAPU8: Uint8Array;
+  _malloc(size: number): number;
+  _free(ptr: number): void;
+  UTF8ToString(ptr: number): string;
+  cwrap(name: string, returnType: string | null, argTypes: string[]): (...args: unknown[]) => number;
+};
+
+/** Compiles the given sources with the driver's Lua build and returns the `.lua.bundle` image. */
+export async function buildLuaBundle(sources: LuaBundleSource[], options: LuaBundleOptions): Promise<LuaBundleResult> {
+  const { default: createModule } = await import(luacModuleUrl.href);
+  const module: LuacModule = await createModule();
+  const begin = module.cwrap("luac_begin", null, ["number", "number"]);
+  const add = module.cwrap("luac_add", "number", ["string", "number", "number"]);
+  const finish = module.cwrap("luac_finish", "number", []);
+  const error = module.cwrap("luac_error", "number", []);
+  const data = module.cwrap("luac_data", "number", []);
+  const size = module.cwrap("luac_size", "number", []);
+
+  begin(options.compress ? 1 : 0, options.strip ? 1 : 0);
+  const skipped: LuaBundleResult["skipped"] = [];
+  for (const { name, source } of sources) {
+    const ptr = module._malloc(source.byteLength);
+    module.HEAPU8.set(source, ptr);
+    const failed = add(name, ptr, source.byteLength);
+    module._free(ptr);
+    if (failed) skipped.push({ name, error: module.UTF8ToString(error()) });
+  }
+  if (finish()) throw new Error(`Failed to build Lua bundle: ${module.UTF8ToString(error())}`);
+
+  const ptr = data();
+  return {
+    bundle: module.HEAPU8.slice(ptr, ptr + size()),
+    count: sources.length - skipped.length,
+    skipped,
+  };
+}
@@ -8,11 +8,16 @@ import { parseDDSDX10 } from "dds";
 import { imageDimensionsFromData } from "image-dimensions";
 import { gameData, isGame } from "pob-game";
 import { Buffer } from "node:buffer";
+import { buildLuaBundle, type LuaBundleSource, luacWasmPath } from "./lua-bundle.ts";
 
-const { args: [tag, game, mode] } = await new Command()
+const { args: [tag, game, mode], options } = await new Command()
   .name("pack")
   .description("Pack an upstream Path of Building release")
   .arguments("<tag:string> <game:string> [mode:string]")
+  .option("--lua-bundle", "Add a precompiled bytecode bundle of all Lua modules (requires a driver build)")
+  .option("--lua-bundle-strip", "Drop line info from the bytecode bundle; Lua errors then lose their file and line", {
+    depends: ["lua-bundle"],
+  })
   .parse(Deno.args);
 
 if (!isGame(game)) throw new Error(`Unsupported game: ${game}`);
@@ -51,6 +56,7 @@ if (clone) {
 }
 
 const imageIndex: string[] = [];
+const luaSources: LuaBundleSource[] = [];
 const zip = new AdmZip();
 const basePath = `${repoDir}/src`;
 for await (const entry of walk(basePath, { includeDirs: true, followSymlinks: false })) {
@@ -86,13 +92,28 @@ for await (const entry of walk(basePath, { includeDirs: true, followSymlinks: fa
       )
       : content;
     zip.addFile(newRelPath, Buffer.from(newContent));
+    if (extension === ".zip") storeUncompressed(newRelPath);
+    if (extension === ".lua") luaSources.push({ name: newRelPath, source: newContent });
   }
 }
 
 const luaPath = `${repoDir}/runtime/lua`;
 for await (const entry of walk(luaPath, { includeDirs: false, exts: [".lua"] })) {
   const relPath = relative(luaPath, entry.path).replaceAll("\\", "/");
-  zip.addFile(`lua/${relPath}`, Buffer.from(await Deno.readFile(entry.path)));
+  const content = await Deno.readFile(entry.path);
+  zip.addFile(`lua/${relPath}`, Buffer.from(content));
+  luaSources.push({ name: `lua/${relPath}`, source: content });
+}
+
+if (options.luaBundle) {
+  const { bundle, count, skipped } = await buildLuaBundle(luaSources, {
+    compress: true,
+    strip: options.luaBundleStrip ?? false,
+  });
+  for (const { name, error } of skipped) console.warn(`Leaving ${name} out of the Lua bundle: ${error}`);
+  console.log(`Bundled ${count} Lua modules (${bundle.byteLength} bytes)`);
+  zip.addFile(".lua.bundle", Buffer.from(bundle));
+  storeUncompressed(".lua.bundle");
 }
 
 zip.addFile(".image.tsv", Buffer.from(imageIndex.join("\n")));
@@ -116,6 +137,11 @@ await ensureDir(rootDir);
 zip.extractAllTo(rootDir, true);
 await Deno.writeTextFile(cacheMarker, inputHash);
 
+// Entries that are compressed already. Stored entries are read in place from the driver's in-memory root.zip.
+function storeUncompressed(name: string) {
+  zip.getEntry(name)!.header.method = 0;
+}
+
 async function packInputHash(): Promise<string> {
   const workspaceRoot = resolve(dirname(fromFileUrl(import.meta.url)), "../../..");
   const inputs = [
@@ -126,6 +152,7 @@ async function packInputHash(): Promise<string> {
     "packages/packer/deno.json",
     "packages/packer/src",
   ];
+  if (options.luaBundle) inputs.push(relative(workspaceRoot, luacWasmPath));
   const files: string[] = [];
   for (const input of inputs) {
     const target = join(workspaceRoot, input);
@@ -136,7 +163,8 @@ async function packInputHash(): Promise<string> {
   files.sort();
 
   const encoder = new TextEncoder();
-  const chunks: Uint8Array[] = [];
+  const luaBundleMode = options.luaBundle ? (options.luaBundleStrip ? "stripped" : "debug") : "none";
+  const chunks: Uint8Array[] = [encoder.encode(`lua-bundle=${luaBundleMode}\0`)];
   for (const file of files) {
     chunks.push(encoder.encode(`${relative(workspaceRoot, file)}\0`));
     chunks.push(await Deno.readFile(file));
@@ -0,0 +1,126 @@
+import { deflateSync, inflateSync } from "node:zlib";
+
+/** zlib only looks back 32 KiB, so anything longer would never be referenced. */
+export const MAX_DICTIONARY_SIZE = 32 * 1024;
+
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+export function decodeBuildCode(code: string): string {
+  const base64 = code.trim().replaceAll("-", "+").replaceAll("_", "/");
+  const binary = Uint8Array.from(atob(base64), (value) => value.charCodeAt(0));
+  return decoder.decode(inflateSync(binary));
+}
+
+/** Pieces of build XML that are likely to repeat across builds: whole lines, tags and attributes. */
+export function fragments(xml: string): string[] {
+  const result: string[] = [];
+  for (const rawLine of xml.split("\n")) {
+    const line = rawLine.trim();
+    if (line.length === 0) continue;
+    result.push(line);
+    for (const match of line.matchAll(/<\/?[A-Za-z][\w:]*|\s[\w:]+="[^"]*"|\s[\w:]+="/g)) {
+      result.push(match[0]);
+    }
+  }
+  return result;
+}
+
+/**
+ * Picks the fragments that save the most bytes over the corpus and packs them into a dictionary.
+ * The most valuable fragments go last, where deflate reaches them with the shortest distances.
+ */
+export function trainDictionary(corpus: string[], size = MAX_DICTIONARY_SIZE): Uint8Array {
+  const counts = new Map<string, number>();
+  for (const xml of corpus) {
+    for (const fragment of fragments(xml)) counts.set(fragment, (counts.get(fragment) ?? 0) + 1);
+  }
+
+  const candidates = [...counts]
+    .filter(([fragment, count]) => count > 1 && fragment.length > 3)
+    .map(([fragment, count]) => ({ fragment, score: count * (fragment.length - 3) }))
+    .sort((a, b) => b.score - a.score || (a.fragment < b.fragment ? -1 : a.fragment > b.fragment ? 1 : 0));
+
+  return packDictionary(candidates.map(({ fragment }) => fragment).reverse(), size);
+}
+
+/**
+ * Packs fragments into a dictionary, one per line and in the given order, so the last ones are those deflate
+ * reaches with the shortest distances. A fragment contained in a later one is left out, and once the size limit
+ * is reached the earliest fragments are the ones dropped.
+ */
+export function packDictionary(fragments: string[], size = MAX_DICTIONARY_SIZE): Uint8Array {
+  const chosen: string[] = [];
+  let text = "";
+  let bytes = 0;
+  for (const fragment of [...fragments].reverse()) {
+    if (text.includes(fragment)) continue;
+    const length = encoder.encode(fragment).length + 1;
+    if (bytes + length > size) continue;
+    chosen.push(fragment);
+    text += `${fragment}\n`;
+    bytes += length;
+  }
+  return encoder.encode(chosen.reverse().map((fragment) => `${fragment}\n`).join(""));
+}
+
+/**
+ * Sets every `holdout`-th build aside, so a dictionary can be judged on builds it was not trained on.
+ * A dictionary measured on its own training builds looks better than it will on anyone else's.
+ */
+export function splitCorpus<T>(corpus: T[], holdout: number): { training: T[]; heldOut: T[] } {
+  if (holdout < 2) throw new Error("holdout must be at least 2");
+  const training = corpus.filter((_, index) => index % holdout !== holdout - 1);
+  const heldOut = corpus.filter((_, index) => index % holdout === holdout - 1);
+  if (heldOut.length === 0) throw new Error(`Need at least ${holdout} builds to hold out one of them`);
+  return { training, heldOut };
+}
+
+export type CompressionResult = {
+  level: number;
+  dictionary: boolean;
+  xmlBytes: number;
+  compressedBytes: number;
+  codeLength: number;
+  ratio: number;
+  deflateMs: number;
+  inflateMs: number;
+};
+
+/** Compresses every build at the given level and reports totals; times are per build. */
+export function measure(
+  corpus: string[],
+  level: number,
+  dictionary: Uint8Array | undefined,
+  repeat = 20,
+): CompressionResult {
+  const inputs = corpus.map((xml) => encoder.encode(xml));
+  const options = dictionary ? { level, dictionary } : { level };
+  const outputs = inputs.map((input) => deflateSync(input, options));
+
+  const deflateStart = performance.now();
+  for (let index = 0; index < repeat; index += 1) {
+    for (const input of inputs) deflateSync(input, options);
+  }
+  const deflateMs = (performance.now() - deflateStart) / repeat / inputs.length;
+
+  const inflateOptions = dictionary ? { dictionary } : {};
+  const inflateStart = performance.now();
+  for (let index = 0; index < repeat; index += 1) {
+    for (const output of outputs) inflateSync(output, inflateOptions);
+  }
+  const inflateMs = (performance.now() - inflateStart) / repeat / outputs.length;
+
+  const xmlBytes = inputs.reduce((total, input) => total + input.length, 0);
+  const compressedBytes = outputs.reduce((total, output) => total + output.length, 0);
+  return {
+    level,
+    dictionary: dictionary !== undefined,
+    xmlBytes,
+    compressedBytes,
+    codeLength: outputs.reduce((total, output) => total + Math.ceil(output.length / 3) * 4, 0),
+    ratio: xmlBytes / compressedBytes,
+    deflateMs,
+    inflateMs,
+  };
+}
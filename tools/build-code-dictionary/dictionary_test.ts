@@ -0,0 +1,72 @@
+import { assert, assertEquals, assertThrows } from "@std/assert";
+import { deflateSync, inflateSync } from "node:zlib";
+import { decodeBuildCode, fragments, measure, packDictionary, splitCorpus, trainDictionary } from "./dictionary.ts";
+import { BUILD_FORMAT_VOCABULARY } from "./vocabulary.ts";
+
+const BUILD = [
+  '<?xml version="1.0" encoding="UTF-8"?>',
+  "<PathOfBuilding>",
+  '\t<Build level="90" className="Witch" ascendClassName="Elementalist">',
+  '\t\t<PlayerStat stat="Life" value="4000"/>',
+  '\t\t<PlayerStat stat="Mana" value="1200"/>',
+  '\t\t<PlayerStat stat="Life" value="4000"/>',
+  "\t</Build>",
+  "</PathOfBuilding>",
+].join("\n");
+
+Deno.test("fragments splits lines into tags and attributes", () => {
+  assertEquals(fragments('  <PlayerStat stat="Life" value="4000"/>\n'), [
+    '<PlayerStat stat="Life" value="4000"/>',
+    "<PlayerStat",
+    ' stat="Life"',
+    ' value="4000"',
+  ]);
+});
+
+Deno.test("trainDictionary keeps repeated fragments within the size limit", () => {
+  const dictionary = new TextDecoder().decode(trainDictionary([BUILD, BUILD], 256));
+  assert(dictionary.length <= 256);
+  assert(dictionary.includes('<PlayerStat stat="Life" value="4000"/>'));
+  // The line repeated most often scores highest and is placed last, closest to the data.
+  assert(dictionary.endsWith('<PlayerStat stat="Life" value="4000"/>\n'));
+});
+
+Deno.test("a trained dictionary round trips and shrinks similar builds", () => {
+  const dictionary = trainDictionary([BUILD, BUILD.replace("Witch", "Ranger")]);
+  const input = new TextEncoder().encode(BUILD.replace("90", "95"));
+  const compressed = deflateSync(input, { level: 9, dictionary });
+  assertEquals(new Uint8Array(inflateSync(compressed, { dictionary })), input);
+  assert(compressed.length < deflateSync(input, { level: 9 }).length);
+});
+
+Deno.test("decodeBuildCode reads base64url build codes", () => {
+  const deflated = deflateSync(new TextEncoder().encode(BUILD), { level: 9 });
+  const code = btoa(String.fromCharCode(...deflated)).replaceAll("+", "-").replaceAll("/", "_");
+  assertEquals(decodeBuildCode(`${code}\n`), BUILD);
+});
+
+Deno.test("measure reports totals for the corpus", () => {
+  const result = measure([BUILD], 9, undefined, 1);
+  assertEquals(result.xmlBytes, new TextEncoder().encode(BUILD).length);
+  assert(result.compressedBytes > 0 && result.ratio > 1);
+  assertEquals(result.dictionary, false);
+});
+
+Deno.test("splitCorpus holds out every nth build", () => {
+  assertEquals(splitCorpus([1, 2, 3, 4, 5, 6, 7], 3), { training: [1, 2, 4, 5, 7], heldOut: [3, 6] });
+  assertThrows(() => splitCorpus([1, 2], 3));
+  assertThrows(() => splitCorpus([1, 2, 3], 1));
+});
+
+Deno.test("packDictionary keeps the order, skips contained fragments and drops the earliest at the limit", () => {
+  const decode = (dictionary: Uint8Array) => new TextDecoder().decode(dictionary);
+  assertEquals(decode(packDictionary(["<Item", ' id="', "<Item>", ' id="1"'])), '<Item>\n id="1"\n');
+  assertEquals(decode(packDictionary(["first", "second", "third"], 13)), "second\nthird\n");
+});
+
+Deno.test("the shipped dictionary is the build format vocabulary", async () => {
+  const shipped = await Deno.readFile(
+    new URL("../../packages/driver/dictionaries/build-code-v1.txt", import.meta.url),
+  );
+  assertEquals(shipped, packDictionary(BUILD_FORMAT_VOCABULARY));
+});
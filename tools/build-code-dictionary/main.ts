@@ -0,0 +1,88 @@
+import { Command } from "@cliffy/command";
+import {
+  decodeBuildCode,
+  MAX_DICTIONARY_SIZE,
+  measure,
+  packDictionary,
+  splitCorpus,
+  trainDictionary,
+} from "./dictionary.ts";
+import { BUILD_FORMAT_VOCABULARY } from "./vocabulary.ts";
+
+async function readCorpus(files: string[]): Promise<string[]> {
+  return await Promise.all(files.map(async (file) => decodeBuildCode(await Deno.readTextFile(file))));
+}
+
+const train = new Command()
+  .description("Train a preset dictionary from build code files")
+  .option("--output <path:string>", "Dictionary file to write", { required: true })
+  .option("--size <bytes:integer>", "Dictionary size limit", { default: MAX_DICTIONARY_SIZE })
+  .arguments("<files...:string>")
+  .action(async (options, ...files) => {
+    const dictionary = trainDictionary(await readCorpus(files), options.size);
+    await Deno.writeFile(options.output, dictionary);
+    console.log(`Wrote ${dictionary.length} bytes to ${options.output}`);
+  });
+
+const vocabulary = new Command()
+  .description("Write the dictionary made from PoB's build format vocabulary, which no build was used for")
+  .option("--output <path:string>", "Dictionary file to write", { required: true })
+  .option("--size <bytes:integer>", "Dictionary size limit", { default: MAX_DICTIONARY_SIZE })
+  .action(async (options) => {
+    const dictionary = packDictionary(BUILD_FORMAT_VOCABULARY, options.size);
+    await Deno.writeFile(options.output, dictionary);
+    console.log(`Wrote ${dictionary.length} bytes to ${options.output}`);
+  });
+
+const report = new Command()
+  .description("Compare compression ratio and speed with and without a dictionary")
+  .option("--dictionary <path:string>", "Dictionary file", { required: true })
+  .option("--levels <levels:integer[]>", "Deflate levels to measure", { default: [1, 6, 9] })
+  .arguments("<files...:string>")
+  .action(async (options, ...files) => {
+    const corpus = await readCorpus(files);
+    const dictionary = await Deno.readFile(options.dictionary);
+    printComparison(corpus, options.levels, dictionary);
+  });
+
+const evaluate = new Command()
+  .description("Train on part of a corpus and report the gain on the builds held out from training")
+  .option("--holdout <n:integer>", "Hold out every nth build", { default: 5 })
+  .option("--size <bytes:integer>", "Dictionary size limit", { default: MAX_DICTIONARY_SIZE })
+  .option("--levels <levels:integer[]>", "Deflate levels to measure", { default: [1, 6, 9] })
+  .option("--output <path:string>", "Also write the trained dictionary here")
+  .arguments("<files...:string>")
+  .action(async (options, ...files) => {
+    const { training, heldOut } = splitCorpus(await readCorpus(files), options.holdout);
+    const dictionary = trainDictionary(training, options.size);
+    if (options.output) await Deno.writeFile(options.output, dictionary);
+    console.log(`Trained ${dictionary.length} bytes on ${training.length} builds, measured on ${heldOut.length}`);
+    printComparison(heldOut, options.levels, dictionary);
+  });
+
+function printComparison(corpus: string[], levels: number[], dictionary: Uint8Array) {
+  const rows = levels.flatMap((level) => [
+    measure(corpus, level, undefined),
+    measure(corpus, level, dictionary),
+  ]);
+  console.table(
+    rows.map((row) => ({
+      level: row.level,
+      dictionary: row.dictionary,
+      compressed: row.compressedBytes,
+      code: row.codeLength,
+      ratio: row.ratio.toFixed(2),
+      "deflate ms": row.deflateMs.toFixed(3),
+      "inflate ms": row.inflateMs.toFixed(3),
+    })),
+  );
+}
+
+await new Command()
+  .name("build-code-dictionary")
+  .description("Train and evaluate the preset dictionary used for build codes")
+  .command("train", train)
+  .command("vocabulary", vocabulary)
+  .command("report", report)
+  .command("evaluate", evaluate)
+  .parse(Deno.args);
@@ -0,0 +1,298 @@
+/**
+ * What PoB writes into every build, taken from its save code rather than from any build: element and attribute
+ * names, the fixed sets of slot, section and stat names, and the keywords of item text. Values that depend on
+ * the build (levels, ids, item mods, tree nodes) are left out, so no build is part of what the dictionary is
+ * made from and every build can be used to measure it.
+ *
+ * Listed in the order PoB writes them, with the entries every element shares at the end; packDictionary keeps
+ * this order, so those end up last, where deflate reaches them with the shortest distances.
+ */
+export const BUILD_FORMAT_VOCABULARY: string[] = [
+  // Build.lua
+  '<?xml version="1.0" encoding="UTF-8"?>',
+  "<PathOfBuilding>",
+  "</PathOfBuilding>",
+  "<PathOfBuilding2>",
+  "</PathOfBuilding2>",
+  "<Build",
+  ' level="',
+  ' targetVersion="',
+  ' className="',
+  ' ascendClassName="',
+  ' characterLevelAutoMode="',
+  ' mainSocketGroup="',
+  ' viewMode="',
+  ' bandit="',
+  ' pantheonMajorGod="',
+  ' pantheonMinorGod="',
+  "</Build>",
+  "<Import",
+  ' lastAccountHash="',
+  ' lastCharacterHash="',
+  ' lastRealm="',
+  ' lastLeague="',
+  ' exportParty="',
+  "<TimelessData",
+  ' searchListFallback="',
+  ' searchList="',
+  ' devotionVariant1="',
+  ' devotionVariant2="',
+  "<FullDPSSkill",
+  ' source="',
+  ' skillPart="',
+  "<MinionStat",
+  // NotesTab.lua, TreeTab.lua
+  "<Notes>",
+  "</Notes>",
+  "<NotesHTML>",
+  "</NotesHTML>",
+  "<TreeView",
+  ' searchStr="',
+  ' zoomLevel="',
+  ' zoomX="',
+  ' zoomY="',
+  ' showHeatMap="',
+  ' showStatDifferences="',
+  "<Tree",
+  ' activeSpec="',
+  "</Tree>",
+  "<Spec",
+  ' title="',
+  ' treeVersion="',
+  ' classId="',
+  ' ascendClassId="',
+  ' secondaryAscendClassId="',
+  ' masteryEffects="',
+  ' nodes="',
+  "</Spec>",
+  "<URL>",
+  "</URL>",
+  "https://www.pathofexile.com/passive-skill-tree/",
+  "https://www.pathofexile.com/fullscreen-passive-skill-tree/",
+  "<Sockets>",
+  "</Sockets>",
+  "<Socket",
+  ' nodeId="',
+  "<Overrides>",
+  "</Overrides>",
+  "<Overrides/>",
+  "<WeaponSet1>",
+  "<WeaponSet2>",
+  // CalcsTab.lua, ConfigTab.lua
+  "<Calcs>",
+  "</Calcs>",
+  "<Section",
+  ' collapsed="false"',
+  ' collapsed="true"',
+  ' subsection="',
+  ' id="Offence"',
+  ' id="Defence"',
+  ' id="MiscDefences"',
+  ' id="DamageTaken"',
+  ' id="DamageAvoidance"',
+  ' id="Charges"',
+  ' id="Attributes"',
+  ' id="SkillTypeStats"',
+  "<Config",
+  ' activeConfigSet="',
+  "</Config>",
+  "<ConfigSet",
+  "</ConfigSet>",
+  "<Placeholder",
+  "<Input",
+  ' name="',
+  ' boolean="true"',
+  ' number="',
+  ' string="',
+  // SkillsTab.lua
+  "<Skills",
+  ' activeSkillSet="',
+  ' sortGemsByDPS="true"',
+  ' sortGemsByDPSField="CombinedDPS"',
+  ' defaultGemLevel="normalMaximum"',
+  ' defaultGemQuality="',
+  ' showSupportGemTypes="ALL"',
+  ' showAltQualityGems="false"',
+  "</Skills>",
+  "<SkillSet",
+  "</SkillSet>",
+  "<Skill",
+  ' mainActiveSkill="',
+  ' mainActiveSkillCalcs="',
+  ' includeInFullDPS="',
+  ' label="',
+  ' slot="',
+  ' source="',
+  ' enabled="true"',
+  ' enabled="false"',
+  "</Skill>",
+  "<Gem",
+  ' nameSpec="',
+  ' gemId="Metadata/Items/Gems/SkillGem',
+  ' gemId="Metadata/Items/Gems/SupportGem',
+  ' variantId="',
+  ' skillId="',
+  ' level="20"',
+  ' quality="',
+  ' qualityId="Default"',
+  ' count="1"',
+  ' corrupted="',
+  ' corruptLevel="',
+  ' enableGlobal1="true"',
+  ' enableGlobal2="true"',
+  // ItemsTab.lua
+  "<Items",
+  ' activeItemSet="',
+  ' useSecondWeaponSet="nil"',
+  "</Items>",
+  "<ItemSet",
+  "</ItemSet>",
+  "<Slot",
+  ' itemId="',
+  ' itemPbURL=""',
+  ' active="true"',
+  ' name="Weapon 1"',
+  ' name="Weapon 2"',
+  ' name="Weapon 1 Swap"',
+  ' name="Weapon 2 Swap"',
+  ' name="Helmet"',
+  ' name="Body Armour"',
+  ' name="Gloves"',
+  ' name="Boots"',
+  ' name="Amulet"',
+  ' name="Ring 1"',
+  ' name="Ring 2"',
+  ' name="Belt"',
+  ' name="Flask 1"',
+  ' name="Flask 2"',
+  ' name="Flask 3"',
+  ' name="Flask 4"',
+  ' name="Flask 5"',
+  ' name="Charm 1"',
+  ' name="Charm 2"',
+  ' name="Charm 3"',
+  "<Item",
+  ' variant="',
+  ' variantAlt="',
+  "</Item>",
+  "<ModRange",
+  ' range="',
+  // Item text, as Item:BuildRaw writes it
+  "Rarity: NORMAL",
+  "Rarity: MAGIC",
+  "Rarity: RARE",
+  "Rarity: UNIQUE",
+  "Rarity: RELIC",
+  "Unique ID: ",
+  "Item Level: ",
+  "Quality: ",
+  "Sockets: ",
+  "LevelReq: ",
+  "Implicits: ",
+  "Limited to: ",
+  "Radius: ",
+  "Rune: ",
+  "Corrupted",
+  "Mirrored",
+  "Requires Level ",
+  "{crafted}",
+  "{fractured}",
+  "{enchant}",
+  "{rune}",
+  "{range:",
+  "{tags:",
+  "{variant:",
+  // The stats Build.lua saves for every build
+  "<PlayerStat",
+  ' stat="',
+  ' value="',
+  ' stat="AverageHit"',
+  ' stat="AverageDamage"',
+  ' stat="Speed"',
+  ' stat="HitSpeed"',
+  ' stat="PreEffectiveCritChance"',
+  ' stat="CritChance"',
+  ' stat="CritMultiplier"',
+  ' stat="HitChance"',
+  ' stat="TotalDPS"',
+  ' stat="TotalDot"',
+  ' stat="WithBleedDPS"',
+  ' stat="WithIgniteDPS"',
+  ' stat="WithPoisonDPS"',
+  ' stat="CombinedDPS"',
+  ' stat="CullingDPS"',
+  ' stat="ReservationDPS"',
+  ' stat="AreaOfEffectRadiusMetres"',
+  ' stat="ManaCost"',
+  ' stat="ManaPerSecondCost"',
+  ' stat="Str"',
+  ' stat="ReqStr"',
+  ' stat="Dex"',
+  ' stat="ReqDex"',
+  ' stat="Int"',
+  ' stat="ReqInt"',
+  ' stat="Devotion"',
+  ' stat="TotalEHP"',
+  ' stat="PhysicalMaximumHitTaken"',
+  ' stat="FireMaximumHitTaken"',
+  ' stat="ColdMaximumHitTaken"',
+  ' stat="LightningMaximumHitTaken"',
+  ' stat="ChaosMaximumHitTaken"',
+  ' stat="Life"',
+  ' stat="Spec:LifeInc"',
+  ' stat="LifeUnreserved"',
+  ' stat="LifeRecoverable"',
+  ' stat="LifeUnreservedPercent"',
+  ' stat="LifeRegenRecovery"',
+  ' stat="LifeLeechGainRate"',
+  ' stat="Mana"',
+  ' stat="Spec:ManaInc"',
+  ' stat="ManaUnreserved"',
+  ' stat="ManaUnreservedPercent"',
+  ' stat="ManaRegenRecovery"',
+  ' stat="ManaLeechGainRate"',
+  ' stat="Spirit"',
+  ' stat="SpiritUnreserved"',
+  ' stat="EnergyShield"',
+  ' stat="Spec:EnergyShieldInc"',
+  ' stat="EnergyShieldRecoveryCap"',
+  ' stat="EnergyShieldRegenRecovery"',
+  ' stat="EnergyShieldLeechGainRate"',
+  ' stat="Ward"',
+  ' stat="Evasion"',
+  ' stat="Spec:EvasionInc"',
+  ' stat="MeleeEvadeChance"',
+  ' stat="ProjectileEvadeChance"',
+  ' stat="Armour"',
+  ' stat="Spec:ArmourInc"',
+  ' stat="PhysicalDamageReduction"',
+  ' stat="EffectiveBlockChance"',
+  ' stat="EffectiveSpellBlockChance"',
+  ' stat="AttackDodgeChance"',
+  ' stat="SpellDodgeChance"',
+  ' stat="EffectiveSpellSuppressionChance"',
+  ' stat="FireResist"',
+  ' stat="FireResistOverCap"',
+  ' stat="ColdResist"',
+  ' stat="ColdResistOverCap"',
+  ' stat="LightningResist"',
+  ' stat="LightningResistOverCap"',
+  ' stat="ChaosResist"',
+  ' stat="ChaosResistOverCap"',
+  ' stat="EffectiveMovementSpeedMod"',
+  ' stat="FullDPS"',
+  ' stat="PowerCharges"',
+  ' stat="PowerChargesMax"',
+  ' stat="FrenzyCharges"',
+  ' stat="FrenzyChargesMax"',
+  ' stat="EnduranceCharges"',
+  ' stat="EnduranceChargesMax"',
+  ' stat="SkillDPS"',
+  // Common to every element
+  ' id="',
+  '"/>',
+  '">',
+  "true",
+  "false",
+  "nil",
+];
@@ -47,7 +47,7 @@ const test = new Command().description("Run the complete reproducible validation
 
 const testTool = new Command()
   .description("Run static and unit checks for a repository tool")
-  .type("tool", new EnumType(["sentry-upload", "upstream-sync"] as const))
+  .type("tool", new EnumType(["build-code-dictionary", "sentry-upload", "upstream-sync"] as const))
   .arguments("<tool:tool>")
   .action(async (_options, tool) => {
     const directory = `tools/${tool}`;
@@ -113,8 +113,10 @@ const pack = new Command()
   .type("game", gameType)
   .option("--game <game:game>", "Game to pack", { required: true })
   .option("--tag <tag:string>", "Upstream tag", { required: true })
+  .option("--lua-bundle", "Add a precompiled Lua bytecode bundle; requires driver:build")
   .action(async (options) => {
-    await $`deno task --filter pob-packer pack ${options.tag} ${options.game} clone`;
+    const extra = options.luaBundle ? ["--lua-bundle"] : [];
+    await $`deno task --filter pob-packer pack ${options.tag} ${options.game} clone ${extra}`;
   });
 
 const driverDev = new Command()